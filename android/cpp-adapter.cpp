@@ -1,15 +1,70 @@
 #include "context.h"
+#include "context_pool.h"
+#include "embedding.h"
+#include "executor.h"
+#include "token_ring.h"
 #include "unpack.h"
 #include "log.h"
+#include "trace.h"
 #include <jni.h>
+#include <pthread.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <nlohmann/json.hpp>
 
 // package com.qnnllm
 
-// Context::create(config: String): Context*
-extern "C" JNIEXPORT jlong JNICALL Java_com_qnnllm_Context_create(JNIEnv *env, jclass jthiz,
-                                                                        jstring lib_path,
-                                                                        jstring jconfig) {
+static JavaVM *g_vm = nullptr;
+static pthread_key_t g_detach_key;
+static jmethodID g_on_doorbell = nullptr;
+static jmethodID g_runnable_run = nullptr;
+
+static void detachCurrentThread(void *) {
+  g_vm->DetachCurrentThread();
+}
+
+// JNIEnv of the calling thread, native worker threads are attached on first use
+// and detached when they exit.
+static JNIEnv *currentEnv() {
+  JNIEnv *env = nullptr;
+  if (g_vm->GetEnv((void **)&env, JNI_VERSION_1_6) == JNI_OK) {
+    return env;
+  }
+  if (g_vm->AttachCurrentThreadAsDaemon(&env, nullptr) != JNI_OK) {
+    LOGE("Failed to attach native thread");
+    return nullptr;
+  }
+  pthread_setspecific(g_detach_key, env);
+  return env;
+}
+
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+  JNIEnv *env = nullptr;
+  if (vm->GetEnv((void **)&env, JNI_VERSION_1_6) != JNI_OK) {
+    return JNI_ERR;
+  }
+  g_vm = vm;
+  pthread_key_create(&g_detach_key, detachCurrentThread);
+  jclass stream_class = env->FindClass("com/qnnllm/TokenStream");
+  g_on_doorbell = env->GetMethodID(stream_class, "onDoorbell", "()V");
+  env->DeleteLocalRef(stream_class);
+  jclass runnable_class = env->FindClass("java/lang/Runnable");
+  g_runnable_run = env->GetMethodID(runnable_class, "run", "()V");
+  env->DeleteLocalRef(runnable_class);
+  return JNI_VERSION_1_6;
+}
+
+struct TokenStream {
+  explicit TokenStream(size_t capacity) : ring(capacity) {}
+
+  qnnllm::TokenRing ring;
+  jobject listener = nullptr;
+};
+
+// Point the loader at the app's native libs and the DSP skeletons
+static void setLibraryPaths(JNIEnv *env, jstring lib_path) {
   const char *lib_path_str = env->GetStringUTFChars(lib_path, nullptr);
   char ld_library_path[1024];
   snprintf(ld_library_path, sizeof(ld_library_path), "%s:/vendor/dsp/cdsp:/vendor/lib64",
@@ -20,11 +75,21 @@ extern "C" JNIEXPORT jlong JNICALL Java_com_qnnllm_Context_create(JNIEnv *env, j
            "%s;/system/lib/rfsa/adsp;/system/vendor/lib/rfsa/adsp;/dsp", lib_path_str);
   setenv("ADSP_LIBRARY_PATH", adsp_library_path, 1);
   env->ReleaseStringUTFChars(lib_path, lib_path_str);
+}
+
+// Context::create(config: String, share: Boolean): Context*
+// Leases the context from the shared pool, idle contexts loaded with the same config are reused
+extern "C" JNIEXPORT jlong JNICALL Java_com_qnnllm_Context_create(JNIEnv *env, jclass jthiz,
+                                                                        jstring lib_path,
+                                                                        jstring jconfig,
+                                                                        jboolean jshare) {
+  QNN_TRACE_SCOPE("JNI create");
+  setLibraryPaths(env, lib_path);
   LOGI("QNN libGenie version: %s", qnnllm::Context::version().c_str());
   const char *config_str = env->GetStringUTFChars(jconfig, nullptr);
   qnnllm::Context *ctx = NULL;
   try {
-    ctx = new qnnllm::Context(config_str);
+    ctx = qnnllm::ContextPool::shared().acquire(config_str, jshare);
     env->ReleaseStringUTFChars(jconfig, config_str);
     return (jlong)ctx;
   } catch (const std::runtime_error &e) {
@@ -34,20 +99,92 @@ extern "C" JNIEXPORT jlong JNICALL Java_com_qnnllm_Context_create(JNIEnv *env, j
   }
 }
 
-// Context::nativeUnpack(bundlePath: String, unpackDir: String): String
+static nlohmann::json progressToJson(const UnpackProgress &progress) {
+  nlohmann::json sections = nlohmann::json::array();
+  for (auto &section : progress.sections) {
+    sections.push_back({
+      {"name", section.name},
+      {"bytes_in", section.bytes_in},
+      {"bytes_out", section.bytes_out},
+      {"total_in", section.total_in},
+      {"total_out", section.total_out},
+      {"elapsed_ms", section.elapsed_ms},
+      {"crc_ms", section.crc_ms},
+      {"skipped", section.skipped},
+      {"done", section.done},
+    });
+  }
+  return {
+    {"bytes_in", progress.bytes_in},
+    {"bytes_out", progress.bytes_out},
+    {"total_in", progress.total_in},
+    {"total_out", progress.total_out},
+    {"elapsed_ms", progress.elapsed_ms},
+    {"crc_ms", progress.crc_ms},
+    {"in_mb_per_s", progress.in_mb_per_s},
+    {"out_mb_per_s", progress.out_mb_per_s},
+    {"finished", progress.finished},
+    {"sections", sections},
+  };
+}
+
+// Context::nativeUnpack(bundlePath: String, unpackDir: String, verify: Int, deepVerify: Boolean,
+//                       writer: Int, bufferSize: Int, progressIntervalMs: Int,
+//                       listener: UnpackListener?): String
 extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_nativeUnpack(JNIEnv *env, jclass cls,
                                                                      jstring jbundle_path,
-                                                                     jstring junpack_dir) {
+                                                                     jstring junpack_dir,
+                                                                     jint jverify,
+                                                                     jboolean jdeep_verify,
+                                                                     jint jwriter,
+                                                                     jint jbuffer_size,
+                                                                     jint jprogress_interval_ms,
+                                                                     jobject jlistener) {
+  QNN_TRACE_SCOPE("JNI unpack");
   const char *bundle_path_str = env->GetStringUTFChars(jbundle_path, nullptr);
   const char *unpack_dir_str = env->GetStringUTFChars(junpack_dir, nullptr);
   try {
-    unpackModel(bundle_path_str, unpack_dir_str);
+    UnpackOptions options;
+    options.verify = static_cast<VerifyMode>(jverify);
+    options.deep_verify = jdeep_verify == JNI_TRUE;
+    options.writer = static_cast<WriterBackend>(jwriter);
+    // Leave the performance cores to any model already running
+    options.cores = qnnllm::CoreHint::Efficiency;
+    if (jbuffer_size > 0) {
+      options.buffer_size = jbuffer_size;
+    }
+    if (jprogress_interval_ms > 0) {
+      options.progress_interval_ms = jprogress_interval_ms;
+    }
+    if (jlistener != nullptr) {
+      jclass listener_class = env->GetObjectClass(jlistener);
+      jmethodID on_progress = env->GetMethodID(listener_class, "onProgress", "(Ljava/lang/String;)V");
+      env->DeleteLocalRef(listener_class);
+      // Reports are made on this thread, so env stays valid
+      options.on_progress = [env, jlistener, on_progress](const UnpackProgress &progress) {
+        QNN_TRACE_SCOPE("JNI onProgress");
+        jstring jprogress = env->NewStringUTF(progressToJson(progress).dump().c_str());
+        env->CallVoidMethod(jlistener, on_progress, jprogress);
+        env->DeleteLocalRef(jprogress);
+        if (env->ExceptionCheck()) {
+          env->ExceptionClear();
+          throw std::runtime_error("Unpack progress listener failed");
+        }
+      };
+    }
+    UnpackProgress summary = unpackModel(bundle_path_str, unpack_dir_str, options);
     std::ifstream config_file(std::string(unpack_dir_str) + "/config.json");
-    std::string config_str((std::istreambuf_iterator<char>(config_file)),
-                           std::istreambuf_iterator<char>());
+    nlohmann::json config = nlohmann::json::parse(config_file, nullptr, false);
+    if (config.is_discarded()) {
+      throw std::runtime_error("Invalid config.json in bundle");
+    }
+    nlohmann::json result = {
+      {"config", config},
+      {"summary", progressToJson(summary)},
+    };
     env->ReleaseStringUTFChars(jbundle_path, bundle_path_str);
     env->ReleaseStringUTFChars(junpack_dir, unpack_dir_str);
-    return env->NewStringUTF(config_str.c_str());
+    return env->NewStringUTF(result.dump().c_str());
   } catch (const std::runtime_error &e) {
     env->ReleaseStringUTFChars(jbundle_path, bundle_path_str);
     env->ReleaseStringUTFChars(junpack_dir, unpack_dir_str);
@@ -57,54 +194,320 @@ extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_nativeUnpack(JNIEnv
 }
 
 // Context::free(ctx: Context*): void
+// Returns the lease, the pool keeps the context loaded for its idle period
 extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_free(JNIEnv *env, jclass jthiz,
                                                                      jlong jcontext) {
   try {
-    delete (qnnllm::Context *)jcontext;
+    qnnllm::ContextPool::shared().release((qnnllm::Context *)jcontext);
   } catch (const std::runtime_error &e) {
     env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
   }
 }
 
-// Context::process(ctx: Context*, input: String): void
-extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_process(JNIEnv *env, jclass jthiz,
+// Context::nativeSetPoolOptions(maxContexts: Int, idleMs: Int): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_nativeSetPoolOptions(JNIEnv *env, jclass jthiz,
+                                                                               jint jmax_contexts,
+                                                                               jint jidle_ms) {
+  qnnllm::ContextPoolOptions options;
+  options.max_contexts = (size_t)std::max(jmax_contexts, 1);
+  options.idle_ms = (uint32_t)std::max(jidle_ms, 0);
+  qnnllm::ContextPool::shared().setOptions(options);
+}
+
+// Context::nativeTrimPool(): Int
+extern "C" JNIEXPORT jint JNICALL Java_com_qnnllm_Context_nativeTrimPool(JNIEnv *env, jclass jthiz) {
+  return (jint)qnnllm::ContextPool::shared().trim();
+}
+
+// Context::nativeGetPoolStats(): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_nativeGetPoolStats(JNIEnv *env, jclass jthiz) {
+  auto stats = qnnllm::ContextPool::shared().stats();
+  nlohmann::json entries = nlohmann::json::array();
+  for (auto &entry : stats.entries) {
+    entries.push_back({
+      {"key", entry.key},
+      {"leases", entry.leases},
+      {"shared", entry.shared},
+      {"loading", entry.loading},
+      {"idle_ms", entry.idle_ms},
+      {"load_ms", entry.load_ms},
+      {"hits", entry.hits},
+    });
+  }
+  nlohmann::json json = {
+    {"loaded", stats.loaded},
+    {"leased", stats.leased},
+    {"max_contexts", stats.max_contexts},
+    {"idle_ms", stats.idle_ms},
+    {"hits", stats.hits},
+    {"misses", stats.misses},
+    {"evictions", stats.evictions},
+    {"expirations", stats.expirations},
+    {"load_failures", stats.load_failures},
+    {"last_load_ms", stats.last_load_ms},
+    {"avg_load_ms", stats.avg_load_ms},
+    {"max_load_ms", stats.max_load_ms},
+    {"entries", entries},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+// Context::nativeGetLogHistory(limit: Int): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_nativeGetLogHistory(JNIEnv *env, jclass jthiz,
+                                                                                 jint jlimit) {
+  nlohmann::json records = nlohmann::json::array();
+  for (auto &record : qnnllm::log::history(jlimit > 0 ? (size_t)jlimit : 0)) {
+    records.push_back({
+      {"time", record.time_us / 1000.0},
+      {"level", qnnllm::log::levelName(record.level)},
+      {"thread", record.thread},
+      {"message", record.message},
+    });
+  }
+  // Messages may hold bytes Genie did not encode as UTF-8
+  return env->NewStringUTF(records.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace).c_str());
+}
+
+// Context::nativeGetLogStats(): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_nativeGetLogStats(JNIEnv *env, jclass jthiz) {
+  auto stats = qnnllm::log::stats();
+  nlohmann::json json = {
+    {"written", stats.written},
+    {"dropped", stats.dropped},
+    {"emitted", stats.emitted},
+    {"threads", stats.threads},
+    {"history", stats.history},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+// Context::nativeStartTrace(): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_nativeStartTrace(JNIEnv *env, jclass jthiz) {
+  qnnllm::trace::start();
+}
+
+// Context::nativeStopTrace(): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_nativeStopTrace(JNIEnv *env, jclass jthiz) {
+  qnnllm::trace::stop();
+}
+
+// Context::nativeGetTrace(): String
+// Chrome trace event JSON of the spans recorded since the last start
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_nativeGetTrace(JNIEnv *env, jclass jthiz) {
+  return env->NewStringUTF(qnnllm::trace::exportJson().c_str());
+}
+
+// Context::nativeGetTraceStats(): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_nativeGetTraceStats(JNIEnv *env, jclass jthiz) {
+  auto stats = qnnllm::trace::stats();
+  nlohmann::json json = {
+    {"enabled", stats.enabled},
+    {"events", stats.events},
+    {"dropped", stats.dropped},
+    {"threads", stats.threads},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+static nlohmann::json prefillProgressToJson(const qnnllm::PrefillProgress &progress) {
+  return {
+    {"total_tokens", progress.total_tokens},
+    {"reused_tokens", progress.reused_tokens},
+    {"prefilled_tokens", progress.prefilled_tokens},
+    {"chunks", progress.chunks},
+    {"discarded_steps", progress.discarded_steps},
+    {"elapsed_ms", progress.elapsed_ms},
+    {"cancelled", progress.cancelled},
+    {"finished", progress.finished},
+  };
+}
+
+// Context::process(ctx: Context*, input: String, priority: Int, chunkTokens: Int,
+//                  listener: PrefillListener?): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_process(JNIEnv *env, jclass jthiz,
                                                                      jlong jcontext,
-                                                                     jstring jinput) {
+                                                                     jstring jinput,
+                                                                     jint jpriority,
+                                                                     jint jchunk_tokens,
+                                                                     jobject jlistener) {
+  QNN_TRACE_SCOPE("JNI process");
   const char *input_str = env->GetStringUTFChars(jinput, nullptr);
+  qnnllm::PrefillOptions options;
+  if (jchunk_tokens > 0) {
+    options.chunk_tokens = jchunk_tokens;
+  }
+  qnnllm::Context::PrefillCallback callback;
+  jobject listener = nullptr;
+  if (jlistener != nullptr) {
+    // Reports are made on the context worker thread
+    listener = env->NewGlobalRef(jlistener);
+    jclass listener_class = env->GetObjectClass(jlistener);
+    jmethodID on_progress = env->GetMethodID(listener_class, "onProgress", "(Ljava/lang/String;)V");
+    env->DeleteLocalRef(listener_class);
+    callback = [listener, on_progress](const qnnllm::PrefillProgress &progress) {
+      QNN_TRACE_SCOPE("JNI onProgress");
+      JNIEnv *worker_env = currentEnv();
+      if (worker_env == nullptr) return;
+      jstring jprogress = worker_env->NewStringUTF(prefillProgressToJson(progress).dump().c_str());
+      worker_env->CallVoidMethod(listener, on_progress, jprogress);
+      worker_env->DeleteLocalRef(jprogress);
+      if (worker_env->ExceptionCheck()) {
+        worker_env->ExceptionClear();
+      }
+    };
+  }
+  jstring result = NULL;
   try {
-    ((qnnllm::Context *)jcontext)->process(input_str);
+    qnnllm::PrefillProgress progress =
+      ((qnnllm::Context *)jcontext)->process(input_str, (qnnllm::Priority)jpriority, options, callback);
+    result = env->NewStringUTF(prefillProgressToJson(progress).dump().c_str());
   } catch (const std::runtime_error &e) {
-    env->ReleaseStringUTFChars(jinput, input_str);
     env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
   }
+  if (listener != nullptr) {
+    env->DeleteGlobalRef(listener);
+  }
   env->ReleaseStringUTFChars(jinput, input_str);
+  return result;
+}
+
+static nlohmann::json queryMetricsToJson(const qnnllm::QueryMetrics &metrics) {
+  nlohmann::json profile = nlohmann::json::parse(metrics.profile, nullptr, false);
+  return {
+    {"queue_ms", metrics.queue_ms},
+    {"ttft_ms", metrics.ttft_ms},
+    {"prefill_ms", metrics.prefill_ms},
+    {"decode_ms", metrics.decode_ms},
+    {"total_ms", metrics.total_ms},
+    {"tokens", metrics.tokens},
+    {"tokens_per_s", metrics.tokens_per_s},
+    {"prompt_tokens", metrics.prompt_tokens},
+    {"reused_tokens", metrics.reused_tokens},
+    {"decode_steps", metrics.decode_steps},
+    {"tokens_per_step", metrics.tokens_per_step},
+    {"accepted_tokens", metrics.accepted_tokens},
+    {"acceptance_rate", metrics.acceptance_rate},
+    {"itl_p50_ms", metrics.itl_p50_ms},
+    {"itl_p90_ms", metrics.itl_p90_ms},
+    {"itl_p99_ms", metrics.itl_p99_ms},
+    {"itl_max_ms", metrics.itl_max_ms},
+    {"aborted", metrics.aborted},
+    {"stop_reason", qnnllm::stopReasonName(metrics.stop_reason)},
+    {"genie", {
+      {"valid", metrics.genie.valid},
+      {"prompt_tokens", metrics.genie.prompt_tokens},
+      {"generated_tokens", metrics.genie.generated_tokens},
+      {"prompt_rate", metrics.genie.prompt_rate},
+      {"ttft_ms", metrics.genie.ttft_ms},
+      {"token_rate", metrics.genie.token_rate},
+    }},
+    {"profile", profile.is_discarded() ? nlohmann::json() : profile},
+  };
 }
 
-// Context::query(ctx: Context*, input_str: String, java_callback: Object): String
+// Context::query(ctx: Context*, input_str: String, priority: Int, maxNewTokens: Int, deadlineMs: Int,
+//                maxTtftMs: Int, stream: TokenStream*): String
 extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_query(JNIEnv *env, jclass jthiz,
                                                                          jlong jcontext,
                                                                          jstring jinput,
-                                                                         jobject jcallback) {
+                                                                         jint jpriority,
+                                                                         jint jmax_new_tokens,
+                                                                         jint jdeadline_ms,
+                                                                         jint jmax_ttft_ms,
+                                                                         jlong jstream) {
+  QNN_TRACE_SCOPE("JNI query");
   const char *input = env->GetStringUTFChars(jinput, nullptr);
   std::string input_str = input;
   env->ReleaseStringUTFChars(jinput, input);
-  jweak weak_callback = env->NewWeakGlobalRef(jcallback);
+  auto stream = (TokenStream *)jstream;
+  qnnllm::QueryOptions options;
+  options.max_new_tokens = (uint32_t)std::max(jmax_new_tokens, 0);
+  options.deadline_ms = (uint32_t)std::max(jdeadline_ms, 0);
+  options.max_ttft_ms = (uint32_t)std::max(jmax_ttft_ms, 0);
   try {
-    auto profile = ((qnnllm::Context *)jcontext)->query(input_str, [env, weak_callback](
-      const char *response, const GenieDialog_SentenceCode_t sentenceCode) {
-      jclass callback_class = env->GetObjectClass(weak_callback);
-      jmethodID on_response_method = env->GetMethodID(callback_class, "onResponse", "(Ljava/lang/String;I)V");
-      env->CallVoidMethod(weak_callback, on_response_method, env->NewStringUTF(response), (jint)sentenceCode);
-    });
-    env->DeleteWeakGlobalRef(weak_callback);
-    return env->NewStringUTF(profile.c_str());
+    auto metrics = ((qnnllm::Context *)jcontext)->query(input_str, [stream](
+      const char *response, const GenieDialog_SentenceCode_t sentenceCode,
+      const qnnllm::ResponseBatch &batch) {
+      stream->ring.write(response, strlen(response), sentenceCode, batch.fragments,
+                         (uint32_t)((batch.flush_ns - batch.first_ns) / 1000));
+    }, (qnnllm::Priority)jpriority, options);
+    nlohmann::json result = queryMetricsToJson(metrics);
+    // The stream is created per query, its counters cover this one
+    auto ring = stream->ring.stats();
+    result["stream"] = {
+      {"stalls", ring.stalls},
+      {"stall_ms", ring.stall_us / 1000.0},
+      {"max_stall_ms", ring.max_stall_us / 1000.0},
+      {"dropped", ring.dropped},
+      {"dropped_bytes", ring.dropped_bytes},
+      {"truncated", ring.dropped > 0},
+    };
+    return env->NewStringUTF(result.dump().c_str());
   } catch (const std::runtime_error &e) {
-    env->DeleteWeakGlobalRef(weak_callback);
     env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
     return NULL;
   }
 }
 
+// TokenStream::nativeCreate(capacity: Int): TokenStream*
+extern "C" JNIEXPORT jlong JNICALL Java_com_qnnllm_TokenStream_nativeCreate(JNIEnv *env,
+                                                                            jobject jthiz,
+                                                                            jint jcapacity) {
+  auto stream = new TokenStream((size_t)jcapacity);
+  stream->listener = env->NewGlobalRef(jthiz);
+  jobject listener = stream->listener;
+  stream->ring.setDoorbell([listener]() {
+    QNN_TRACE_SCOPE("JNI onDoorbell");
+    JNIEnv *env = currentEnv();
+    if (env == nullptr) return;
+    env->CallVoidMethod(listener, g_on_doorbell);
+    if (env->ExceptionCheck()) {
+      env->ExceptionDescribe();
+      env->ExceptionClear();
+    }
+  });
+  return (jlong)stream;
+}
+
+// TokenStream::nativeBuffer(stream: TokenStream*): ByteBuffer
+extern "C" JNIEXPORT jobject JNICALL Java_com_qnnllm_TokenStream_nativeBuffer(JNIEnv *env,
+                                                                              jobject jthiz,
+                                                                              jlong jstream) {
+  auto stream = (TokenStream *)jstream;
+  return env->NewDirectByteBuffer(stream->ring.data(), (jlong)stream->ring.capacity());
+}
+
+// TokenStream::nativeWritePosition(stream: TokenStream*): Long
+extern "C" JNIEXPORT jlong JNICALL Java_com_qnnllm_TokenStream_nativeWritePosition(JNIEnv *env,
+                                                                                   jobject jthiz,
+                                                                                   jlong jstream) {
+  return (jlong)((TokenStream *)jstream)->ring.writePosition();
+}
+
+// TokenStream::nativeConsume(stream: TokenStream*, position: Long): Long
+extern "C" JNIEXPORT jlong JNICALL Java_com_qnnllm_TokenStream_nativeConsume(JNIEnv *env,
+                                                                             jobject jthiz,
+                                                                             jlong jstream,
+                                                                             jlong jposition) {
+  return (jlong)((TokenStream *)jstream)->ring.consume((uint64_t)jposition);
+}
+
+// TokenStream::nativeClose(stream: TokenStream*): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_TokenStream_nativeClose(JNIEnv *env,
+                                                                          jobject jthiz,
+                                                                          jlong jstream) {
+  ((TokenStream *)jstream)->ring.close();
+}
+
+// TokenStream::nativeFree(stream: TokenStream*): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_TokenStream_nativeFree(JNIEnv *env,
+                                                                         jobject jthiz,
+                                                                         jlong jstream) {
+  auto stream = (TokenStream *)jstream;
+  env->DeleteGlobalRef(stream->listener);
+  delete stream;
+}
+
 // Context::setStopWords(ctx: Context*, stop_words: String): void
 extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_setStopWords(JNIEnv *env,
                                                                              jclass jthiz,
@@ -133,14 +536,20 @@ extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_applySamplerConfig(
   }
 }
 
-// Context::saveSession(ctx: Context*, filename: String): void
+// Context::saveSession(ctx: Context*, filename: String, priority: Int, level: Int, background: Boolean): void
 extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_saveSession(JNIEnv *env,
                                                                             jclass jthiz,
                                                                             jlong jcontext,
-                                                                            jstring jfilename) {
+                                                                            jstring jfilename,
+                                                                            jint jpriority,
+                                                                            jint jlevel,
+                                                                            jboolean jbackground) {
   const char *filename_str = env->GetStringUTFChars(jfilename, nullptr);
   try {
-    ((qnnllm::Context *)jcontext)->saveSession(filename_str);
+    qnnllm::SnapshotOptions options;
+    options.level = jlevel;
+    options.background = jbackground;
+    ((qnnllm::Context *)jcontext)->saveSession(filename_str, (qnnllm::Priority)jpriority, options);
     env->ReleaseStringUTFChars(jfilename, filename_str);
   } catch (const std::runtime_error &e) {
     env->ReleaseStringUTFChars(jfilename, filename_str);
@@ -148,14 +557,15 @@ extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_saveSession(JNIEnv *en
   }
 }
 
-// Context::restoreSession(ctx: Context*, filename: String): void
+// Context::restoreSession(ctx: Context*, filename: String, priority: Int): void
 extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_restoreSession(JNIEnv *env,
                                                                                jclass jthiz,
                                                                                jlong jcontext,
-                                                                               jstring jfilename) {
+                                                                               jstring jfilename,
+                                                                               jint jpriority) {
   const char *filename_str = env->GetStringUTFChars(jfilename, nullptr);
   try {
-    ((qnnllm::Context *)jcontext)->restoreSession(filename_str);
+    ((qnnllm::Context *)jcontext)->restoreSession(filename_str, (qnnllm::Priority)jpriority);
     env->ReleaseStringUTFChars(jfilename, filename_str);
   } catch (const std::runtime_error &e) {
     env->ReleaseStringUTFChars(jfilename, filename_str);
@@ -172,3 +582,356 @@ extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_abort(JNIEnv *env, jcl
     env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
   }
 }
+
+// Context::cancelPending(ctx: Context*): Int
+extern "C" JNIEXPORT jint JNICALL Java_com_qnnllm_Context_cancelPending(JNIEnv *env, jclass jthiz,
+                                                                        jlong jcontext) {
+  return (jint)((qnnllm::Context *)jcontext)->cancelPending();
+}
+
+// Context::getQueueStats(ctx: Context*): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_getQueueStats(JNIEnv *env, jclass jthiz,
+                                                                           jlong jcontext) {
+  auto stats = ((qnnllm::Context *)jcontext)->queueStats();
+  nlohmann::json json = {
+    {"depth", stats.depth},
+    {"max_depth", stats.max_depth},
+    {"capacity", stats.capacity},
+    {"running", stats.running},
+    {"submitted", stats.submitted},
+    {"completed", stats.completed},
+    {"cancelled", stats.cancelled},
+    {"avg_wait_ms", stats.avg_wait_ms},
+    {"max_wait_ms", stats.max_wait_ms},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+// Context::getMetricsStats(ctx: Context*): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_getMetricsStats(JNIEnv *env, jclass jthiz,
+                                                                             jlong jcontext) {
+  auto stats = ((qnnllm::Context *)jcontext)->metricsStats();
+  nlohmann::json histogram = nlohmann::json::array();
+  for (auto &bucket : stats.itl_histogram) {
+    // The last bucket is unbounded, reported as null
+    histogram.push_back({std::isinf(bucket.first) ? nlohmann::json() : nlohmann::json(bucket.first),
+                         bucket.second});
+  }
+  nlohmann::json json = {
+    {"queries", stats.queries},
+    {"tokens", stats.tokens},
+    {"aborted", stats.aborted},
+    {"window", stats.window},
+    {"ttft_p50_ms", stats.ttft_p50_ms},
+    {"ttft_p90_ms", stats.ttft_p90_ms},
+    {"ttft_p99_ms", stats.ttft_p99_ms},
+    {"prefill_p50_ms", stats.prefill_p50_ms},
+    {"tokens_per_s_mean", stats.tokens_per_s_mean},
+    {"tokens_per_s_p50", stats.tokens_per_s_p50},
+    {"tokens_per_s_min", stats.tokens_per_s_min},
+    {"tokens_per_step_mean", stats.tokens_per_step_mean},
+    {"acceptance_rate_mean", stats.acceptance_rate_mean},
+    {"itl_p50_ms", stats.itl_p50_ms},
+    {"itl_p90_ms", stats.itl_p90_ms},
+    {"itl_p99_ms", stats.itl_p99_ms},
+    {"itl_histogram", histogram},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+// Context::resetMetrics(ctx: Context*): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_resetMetrics(JNIEnv *env, jclass jthiz,
+                                                                       jlong jcontext) {
+  ((qnnllm::Context *)jcontext)->resetMetrics();
+}
+
+// Context::setSessionCache(ctx: Context*, dir: String, budget: Long, maxEntries: Int): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_setSessionCache(JNIEnv *env, jclass jthiz,
+                                                                          jlong jcontext,
+                                                                          jstring jdir,
+                                                                          jlong jbudget,
+                                                                          jint jmax_entries) {
+  const char *dir_str = env->GetStringUTFChars(jdir, nullptr);
+  try {
+    ((qnnllm::Context *)jcontext)->setSessionCache(dir_str, (uint64_t)jbudget, (size_t)jmax_entries);
+    env->ReleaseStringUTFChars(jdir, dir_str);
+  } catch (const std::runtime_error &e) {
+    env->ReleaseStringUTFChars(jdir, dir_str);
+    env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
+  }
+}
+
+// Context::getSessionCacheStats(ctx: Context*): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_getSessionCacheStats(JNIEnv *env,
+                                                                                  jclass jthiz,
+                                                                                  jlong jcontext) {
+  auto stats = ((qnnllm::Context *)jcontext)->sessionCacheStats();
+  nlohmann::json json = {
+    {"entries", stats.entries},
+    {"bytes", stats.bytes},
+    {"budget", stats.budget},
+    {"hits", stats.hits},
+    {"misses", stats.misses},
+    {"saves", stats.saves},
+    {"evictions", stats.evictions},
+    {"evicted_bytes", stats.evicted_bytes},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+// Context::setResponseCoalescing(ctx: Context*, intervalMs: Int, maxFragments: Int): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_setResponseCoalescing(JNIEnv *env,
+                                                                                jclass jthiz,
+                                                                                jlong jcontext,
+                                                                                jint jinterval_ms,
+                                                                                jint jmax_fragments) {
+  try {
+    qnnllm::CoalesceOptions options;
+    options.interval_ms = (uint32_t)jinterval_ms;
+    options.max_fragments = (uint32_t)jmax_fragments;
+    ((qnnllm::Context *)jcontext)->setResponseCoalescing(options);
+  } catch (const std::runtime_error &e) {
+    env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
+  }
+}
+
+// Context::applyLora(ctx: Context*, adapter: String, engine: String, priority: Int): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_applyLora(JNIEnv *env, jclass jthiz,
+                                                                    jlong jcontext,
+                                                                    jstring jadapter,
+                                                                    jstring jengine,
+                                                                    jint jpriority) {
+  const char *adapter_str = env->GetStringUTFChars(jadapter, nullptr);
+  const char *engine_str = env->GetStringUTFChars(jengine, nullptr);
+  std::string adapter = adapter_str, engine = engine_str;
+  env->ReleaseStringUTFChars(jadapter, adapter_str);
+  env->ReleaseStringUTFChars(jengine, engine_str);
+  try {
+    ((qnnllm::Context *)jcontext)->applyLora(adapter, engine, (qnnllm::Priority)jpriority);
+  } catch (const std::runtime_error &e) {
+    env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
+  }
+}
+
+// Context::setLoraStrength(ctx: Context*, tensor: String, alpha: Float, engine: String, priority: Int): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_setLoraStrength(JNIEnv *env, jclass jthiz,
+                                                                          jlong jcontext,
+                                                                          jstring jtensor,
+                                                                          jfloat jalpha,
+                                                                          jstring jengine,
+                                                                          jint jpriority) {
+  const char *tensor_str = env->GetStringUTFChars(jtensor, nullptr);
+  const char *engine_str = env->GetStringUTFChars(jengine, nullptr);
+  std::string tensor = tensor_str, engine = engine_str;
+  env->ReleaseStringUTFChars(jtensor, tensor_str);
+  env->ReleaseStringUTFChars(jengine, engine_str);
+  try {
+    ((qnnllm::Context *)jcontext)->setLoraStrength(tensor, jalpha, engine, (qnnllm::Priority)jpriority);
+  } catch (const std::runtime_error &e) {
+    env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
+  }
+}
+
+// Context::setLoraResidency(ctx: Context*, maxAdapters: Int): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_setLoraResidency(JNIEnv *env, jclass jthiz,
+                                                                           jlong jcontext,
+                                                                           jint jmax_adapters) {
+  ((qnnllm::Context *)jcontext)->setLoraResidency(jmax_adapters > 0 ? (size_t)jmax_adapters : 1);
+}
+
+// Context::getLoraStats(ctx: Context*): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_getLoraStats(JNIEnv *env, jclass jthiz,
+                                                                          jlong jcontext) {
+  auto stats = ((qnnllm::Context *)jcontext)->loraStats();
+  nlohmann::json json = {
+    {"engine", stats.engine},
+    {"adapter", stats.adapter},
+    {"swaps", stats.swaps},
+    {"skipped", stats.skipped},
+    {"resident_hits", stats.resident_hits},
+    {"last_swap_ms", stats.last_swap_ms},
+    {"avg_swap_ms", stats.avg_swap_ms},
+    {"max_swap_ms", stats.max_swap_ms},
+    {"capacity", stats.capacity},
+    {"resident", stats.resident},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+// Context::getSnapshotStats(ctx: Context*): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_getSnapshotStats(JNIEnv *env, jclass jthiz,
+                                                                              jlong jcontext) {
+  auto stats = ((qnnllm::Context *)jcontext)->snapshotStats();
+  nlohmann::json json = {
+    {"saves", stats.saves},
+    {"restores", stats.restores},
+    {"rejected", stats.rejected},
+    {"failures", stats.failures},
+    {"pending", stats.pending},
+    {"last_raw_bytes", stats.last_raw_bytes},
+    {"last_bytes", stats.last_bytes},
+    {"last_handoff_ms", stats.last_handoff_ms},
+    {"last_write_ms", stats.last_write_ms},
+    {"last_restore_ms", stats.last_restore_ms},
+    {"last_error", stats.last_error},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+// Context::setGrammar(ctx: Context*, grammar: String, priority: Int): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_Context_setGrammar(JNIEnv *env, jclass jthiz,
+                                                                     jlong jcontext,
+                                                                     jstring jgrammar,
+                                                                     jint jpriority) {
+  const char *grammar_str = env->GetStringUTFChars(jgrammar, nullptr);
+  std::string grammar = grammar_str;
+  env->ReleaseStringUTFChars(jgrammar, grammar_str);
+  try {
+    ((qnnllm::Context *)jcontext)->setGrammar(grammar, (qnnllm::Priority)jpriority);
+  } catch (const std::runtime_error &e) {
+    env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
+  }
+}
+
+// Context::getSamplerStats(ctx: Context*): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_Context_getSamplerStats(JNIEnv *env, jclass jthiz,
+                                                                             jlong jcontext) {
+  auto stats = ((qnnllm::Context *)jcontext)->samplerStats();
+  nlohmann::json json = {
+    {"steps", stats.steps},
+    {"mask_cache_hits", stats.mask_cache_hits},
+    {"dead_ends", stats.dead_ends},
+    {"avg_mask_us", stats.avg_mask_us},
+    {"avg_sample_us", stats.avg_sample_us},
+    {"max_step_us", stats.max_step_us},
+    {"avg_candidates", stats.avg_candidates},
+    {"kernel", stats.kernel},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
+
+// EmbeddingContext::create(libPath: String, config: String): EmbeddingContext*
+extern "C" JNIEXPORT jlong JNICALL Java_com_qnnllm_EmbeddingContext_create(JNIEnv *env, jclass jthiz,
+                                                                           jstring lib_path,
+                                                                           jstring jconfig) {
+  setLibraryPaths(env, lib_path);
+  const char *config_str = env->GetStringUTFChars(jconfig, nullptr);
+  try {
+    auto ctx = new qnnllm::EmbeddingContext(config_str);
+    env->ReleaseStringUTFChars(jconfig, config_str);
+    return (jlong)ctx;
+  } catch (const std::runtime_error &e) {
+    env->ReleaseStringUTFChars(jconfig, config_str);
+    env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
+    return 0;
+  }
+}
+
+// EmbeddingContext::free(ctx: EmbeddingContext*): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_EmbeddingContext_free(JNIEnv *env, jclass jthiz,
+                                                                        jlong jcontext) {
+  delete (qnnllm::EmbeddingContext *)jcontext;
+}
+
+static std::string base64Encode(const uint8_t *data, size_t length) {
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((length + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 2 < length; i += 3) {
+    uint32_t n = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    out += table[n >> 18];
+    out += table[(n >> 12) & 63];
+    out += table[(n >> 6) & 63];
+    out += table[n & 63];
+  }
+  if (i < length) {
+    uint32_t n = data[i] << 16;
+    if (i + 1 < length) n |= data[i + 1] << 8;
+    out += table[n >> 18];
+    out += table[(n >> 12) & 63];
+    out += i + 1 < length ? table[(n >> 6) & 63] : '=';
+    out += '=';
+  }
+  return out;
+}
+
+// EmbeddingContext::embed(ctx: EmbeddingContext*, inputs: Array<String>, normalize: Boolean,
+//                         priority: Int): String
+// The vectors go out as one base64 little-endian float32 buffer, JS views it as a Float32Array
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_EmbeddingContext_embed(JNIEnv *env, jclass jthiz,
+                                                                            jlong jcontext,
+                                                                            jobjectArray jinputs,
+                                                                            jboolean jnormalize,
+                                                                            jint jpriority) {
+  std::vector<std::string> inputs(env->GetArrayLength(jinputs));
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    auto jinput = (jstring)env->GetObjectArrayElement(jinputs, (jsize)i);
+    const char *input_str = env->GetStringUTFChars(jinput, nullptr);
+    inputs[i] = input_str;
+    env->ReleaseStringUTFChars(jinput, input_str);
+    env->DeleteLocalRef(jinput);
+  }
+  try {
+    auto result = ((qnnllm::EmbeddingContext *)jcontext)
+                    ->embed(inputs, jnormalize == JNI_TRUE, static_cast<qnnllm::Priority>(jpriority));
+    nlohmann::json json = {
+      {"count", result.count},
+      {"dimensions", result.dimensions},
+      {"elapsed_ms", result.elapsed_ms},
+      {"data", base64Encode(reinterpret_cast<const uint8_t *>(result.data.data()),
+                            result.data.size() * sizeof(float))},
+    };
+    return env->NewStringUTF(json.dump().c_str());
+  } catch (const std::runtime_error &e) {
+    env->ThrowNew(env->FindClass("java/lang/Exception"), e.what());
+    return nullptr;
+  }
+}
+
+// EmbeddingContext::cancelPending(ctx: EmbeddingContext*): Int
+extern "C" JNIEXPORT jint JNICALL Java_com_qnnllm_EmbeddingContext_cancelPending(JNIEnv *env, jclass jthiz,
+                                                                                 jlong jcontext) {
+  return (jint)((qnnllm::EmbeddingContext *)jcontext)->cancelPending();
+}
+
+// NativeExecutor::nativeExecute(priority: Int, cores: Int, task: Runnable): void
+extern "C" JNIEXPORT void JNICALL Java_com_qnnllm_NativeExecutor_nativeExecute(JNIEnv *env,
+                                                                               jclass jthiz,
+                                                                               jint jpriority,
+                                                                               jint jcores,
+                                                                               jobject jtask) {
+  jobject task = env->NewGlobalRef(jtask);
+  // Not blocking as a whole: the scheduler and the context pool mark the worker
+  // blocked only while a call waits on them, most calls return right away
+  qnnllm::TaskHints hints{(qnnllm::Priority)jpriority, (qnnllm::CoreHint)jcores, false};
+  qnnllm::Executor::shared().submit([task]() {
+    JNIEnv *env = currentEnv();
+    if (!env) return;
+    env->CallVoidMethod(task, g_runnable_run);
+    if (env->ExceptionCheck()) {
+      env->ExceptionDescribe();
+      env->ExceptionClear();
+    }
+    env->DeleteGlobalRef(task);
+  }, hints);
+}
+
+// NativeExecutor::nativeGetStats(): String
+extern "C" JNIEXPORT jstring JNICALL Java_com_qnnllm_NativeExecutor_nativeGetStats(JNIEnv *env,
+                                                                                jclass jthiz) {
+  auto stats = qnnllm::Executor::shared().stats();
+  nlohmann::json json = {
+    {"workers", stats.workers},
+    {"parallelism", stats.parallelism},
+    {"blocked", stats.blocked},
+    {"depth", {stats.depth[0], stats.depth[1], stats.depth[2]}},
+    {"max_depth", stats.max_depth},
+    {"submitted", stats.submitted},
+    {"executed", stats.executed},
+    {"steals", stats.steals},
+    {"efficiency_cores", stats.efficiency_cores},
+    {"performance_cores", stats.performance_cores},
+  };
+  return env->NewStringUTF(json.dump().c_str());
+}
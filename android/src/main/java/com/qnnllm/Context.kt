@@ -4,31 +4,90 @@ import android.os.Build
 import android.util.Log
 import android.content.Context as AndroidContext
 
-class Context constructor(context: AndroidContext, config: String) {
+class Context constructor(context: AndroidContext, config: String, share: Boolean = false) {
   private val mLibPath: String = context.applicationInfo.nativeLibraryDir
   private val mContextPtr: Long
 
   abstract class Callback {
-    abstract fun onResponse(response: String, sentenceCode: Int)
+    abstract fun onResponse(response: String, sentenceCode: Int, fragments: Int, batchUs: Long, dropped: Int)
   }
 
-  external fun create(libPath: String, config: String): Long
+  abstract class UnpackListener {
+    abstract fun onProgress(progress: String)
+  }
+
+  abstract class PrefillListener {
+    abstract fun onProgress(progress: String)
+  }
+
+  external fun create(libPath: String, config: String, share: Boolean): Long
   external fun free(contextPtr: Long)
-  external fun process(contextPtr: Long, input: String)
-  external fun query(contextPtr: Long, input: String, callback: Callback): String
+  external fun process(
+    contextPtr: Long,
+    input: String,
+    priority: Int,
+    chunkTokens: Int,
+    listener: PrefillListener?
+  ): String
+  external fun query(
+    contextPtr: Long,
+    input: String,
+    priority: Int,
+    maxNewTokens: Int,
+    deadlineMs: Int,
+    maxTtftMs: Int,
+    streamPtr: Long
+  ): String
   external fun setStopWords(contextPtr: Long, stopWords: String)
   external fun applySamplerConfig(contextPtr: Long, config: String)
-  external fun saveSession(contextPtr: Long, filename: String)
-  external fun restoreSession(contextPtr: Long, filename: String)
+  external fun saveSession(contextPtr: Long, filename: String, priority: Int, level: Int, background: Boolean)
+  external fun restoreSession(contextPtr: Long, filename: String, priority: Int)
   external fun abort(contextPtr: Long)
+  external fun cancelPending(contextPtr: Long): Int
+  external fun getQueueStats(contextPtr: Long): String
+  external fun getMetricsStats(contextPtr: Long): String
+  external fun resetMetrics(contextPtr: Long)
+  external fun setSessionCache(contextPtr: Long, dir: String, budget: Long, maxEntries: Int)
+  external fun getSessionCacheStats(contextPtr: Long): String
+  external fun setResponseCoalescing(contextPtr: Long, intervalMs: Int, maxFragments: Int)
+  external fun applyLora(contextPtr: Long, adapter: String, engine: String, priority: Int)
+  external fun setLoraStrength(contextPtr: Long, tensor: String, alpha: Float, engine: String, priority: Int)
+  external fun setLoraResidency(contextPtr: Long, maxAdapters: Int)
+  external fun getLoraStats(contextPtr: Long): String
+  external fun setGrammar(contextPtr: Long, grammar: String, priority: Int)
+  external fun getSamplerStats(contextPtr: Long): String
+  external fun getSnapshotStats(contextPtr: Long): String
 
   init {
-    this.mContextPtr = create(mLibPath, config)
+    this.mContextPtr = create(mLibPath, config, share)
   }
 
   companion object {
+    const val PRIORITY_HIGH = 0
+    const val PRIORITY_NORMAL = 1
+    const val PRIORITY_LOW = 2
+
+    const val VERIFY_FULL = 0
+    const val VERIFY_SECTIONS = 1
+    const val VERIFY_NONE = 2
+
+    const val WRITER_PWRITE = 0
+    const val WRITER_URING = 1
+    const val WRITER_STREAM = 2
+
+    const val LORA_ENGINE = "primary"
+
     @JvmStatic
-    external fun nativeUnpack(bundlePath: String, unpackDir: String): String
+    external fun nativeUnpack(
+      bundlePath: String,
+      unpackDir: String,
+      verify: Int,
+      deepVerify: Boolean,
+      writer: Int,
+      bufferSize: Int,
+      progressIntervalMs: Int,
+      listener: UnpackListener?
+    ): String
 
     @JvmStatic
     fun load() {
@@ -41,20 +100,124 @@ class Context constructor(context: AndroidContext, config: String) {
     }
 
     @JvmStatic
-    fun create(context: AndroidContext, config: String): Context {
+    external fun nativeSetPoolOptions(maxContexts: Int, idleMs: Int)
+
+    @JvmStatic
+    external fun nativeTrimPool(): Int
+
+    @JvmStatic
+    external fun nativeGetPoolStats(): String
+
+    @JvmStatic
+    external fun nativeGetLogHistory(limit: Int): String
+
+    @JvmStatic
+    external fun nativeGetLogStats(): String
+
+    @JvmStatic
+    external fun nativeStartTrace()
+
+    @JvmStatic
+    external fun nativeStopTrace()
+
+    @JvmStatic
+    external fun nativeGetTrace(): String
+
+    @JvmStatic
+    external fun nativeGetTraceStats(): String
+
+    @JvmStatic
+    fun setPoolOptions(maxContexts: Int, idleMs: Int) {
+      load()
+      nativeSetPoolOptions(maxContexts, idleMs)
+    }
+
+    @JvmStatic
+    fun trimPool(): Int {
+      load()
+      return nativeTrimPool()
+    }
+
+    @JvmStatic
+    fun getPoolStats(): String {
+      load()
+      return nativeGetPoolStats()
+    }
+
+    @JvmStatic
+    fun getLogHistory(limit: Int = 0): String {
+      load()
+      return nativeGetLogHistory(limit)
+    }
+
+    @JvmStatic
+    fun getLogStats(): String {
+      load()
+      return nativeGetLogStats()
+    }
+
+    @JvmStatic
+    fun startTrace() {
       load()
-      return Context(context, config)
+      nativeStartTrace()
     }
 
     @JvmStatic
-    fun unpack(bundlePath: String, unpackDir: String): String {
+    fun stopTrace() {
       load()
-      return nativeUnpack(bundlePath, unpackDir)
+      nativeStopTrace()
+    }
+
+    @JvmStatic
+    fun getTrace(): String {
+      load()
+      return nativeGetTrace()
+    }
+
+    @JvmStatic
+    fun getTraceStats(): String {
+      load()
+      return nativeGetTraceStats()
+    }
+
+    @JvmStatic
+    fun create(context: AndroidContext, config: String, share: Boolean = false): Context {
+      load()
+      return Context(context, config, share)
+    }
+
+    @JvmStatic
+    fun unpack(
+      bundlePath: String,
+      unpackDir: String,
+      verify: Int = VERIFY_FULL,
+      deepVerify: Boolean = false,
+      writer: Int = WRITER_PWRITE,
+      bufferSize: Int = 0,
+      progressIntervalMs: Int = 0,
+      listener: UnpackListener? = null
+    ): String {
+      load()
+      return nativeUnpack(
+        bundlePath,
+        unpackDir,
+        verify,
+        deepVerify,
+        writer,
+        bufferSize,
+        progressIntervalMs,
+        listener
+      )
     }
   }
 
-  fun process(input: String) {
-    process(mContextPtr, input)
+  fun process(
+    input: String,
+    priority: Int = PRIORITY_NORMAL,
+    chunkTokens: Int = 0,
+    listener: PrefillListener? = null
+  ): String {
+    return process(mContextPtr, input, priority, chunkTokens, listener)
   }
 
   fun setStopWords(stopWords: String) {
@@ -65,22 +228,92 @@ class Context constructor(context: AndroidContext, config: String) {
     applySamplerConfig(mContextPtr, config)
   }
 
-  fun saveSession(filename: String) {
-    saveSession(mContextPtr, filename)
+  fun saveSession(filename: String, priority: Int = PRIORITY_NORMAL, level: Int = 3, background: Boolean = true) {
+    saveSession(mContextPtr, filename, priority, level, background)
   }
 
-  fun restoreSession(filename: String) {
-    restoreSession(mContextPtr, filename)
+  fun restoreSession(filename: String, priority: Int = PRIORITY_NORMAL) {
+    restoreSession(mContextPtr, filename, priority)
   }
 
-  fun query(input: String, callback: Callback): String {
-    return query(mContextPtr, input, callback)
+  fun query(
+    input: String,
+    callback: Callback,
+    priority: Int = PRIORITY_NORMAL,
+    maxNewTokens: Int = 0,
+    deadlineMs: Int = 0,
+    maxTtftMs: Int = 0
+  ): String {
+    val stream = TokenStream(TokenStream.DEFAULT_CAPACITY, callback)
+    try {
+      val metrics = query(mContextPtr, input, priority, maxNewTokens, deadlineMs, maxTtftMs, stream.ptr)
+      stream.finish()
+      return metrics
+    } finally {
+      stream.release()
+    }
   }
 
   fun abort() {
     abort(mContextPtr)
   }
 
+  fun cancelPending(): Int {
+    return cancelPending(mContextPtr)
+  }
+
+  fun getQueueStats(): String {
+    return getQueueStats(mContextPtr)
+  }
+
+  fun getMetricsStats(): String {
+    return getMetricsStats(mContextPtr)
+  }
+
+  fun resetMetrics() {
+    resetMetrics(mContextPtr)
+  }
+
+  fun setSessionCache(dir: String, budget: Long, maxEntries: Int) {
+    setSessionCache(mContextPtr, dir, budget, maxEntries)
+  }
+
+  fun getSessionCacheStats(): String {
+    return getSessionCacheStats(mContextPtr)
+  }
+
+  fun setResponseCoalescing(intervalMs: Int, maxFragments: Int) {
+    setResponseCoalescing(mContextPtr, intervalMs, maxFragments)
+  }
+
+  fun applyLora(adapter: String, engine: String = LORA_ENGINE, priority: Int = PRIORITY_NORMAL) {
+    applyLora(mContextPtr, adapter, engine, priority)
+  }
+
+  fun setLoraStrength(tensor: String, alpha: Float, engine: String = LORA_ENGINE, priority: Int = PRIORITY_NORMAL) {
+    setLoraStrength(mContextPtr, tensor, alpha, engine, priority)
+  }
+
+  fun setLoraResidency(maxAdapters: Int) {
+    setLoraResidency(mContextPtr, maxAdapters)
+  }
+
+  fun getLoraStats(): String {
+    return getLoraStats(mContextPtr)
+  }
+
+  fun setGrammar(grammar: String, priority: Int = PRIORITY_NORMAL) {
+    setGrammar(mContextPtr, grammar, priority)
+  }
+
+  fun getSamplerStats(): String {
+    return getSamplerStats(mContextPtr)
+  }
+
+  fun getSnapshotStats(): String {
+    return getSnapshotStats(mContextPtr)
+  }
+
   fun release() {
     free(mContextPtr)
   }
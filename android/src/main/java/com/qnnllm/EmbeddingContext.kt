@@ -0,0 +1,29 @@
+package com.qnnllm
+
+import android.content.Context as AndroidContext
+
+class EmbeddingContext constructor(context: AndroidContext, config: String) {
+  private val mLibPath: String = context.applicationInfo.nativeLibraryDir
+  private val mContextPtr: Long
+
+  external fun create(libPath: String, config: String): Long
+  external fun free(contextPtr: Long)
+  external fun embed(contextPtr: Long, inputs: Array<String>, normalize: Boolean, priority: Int): String
+  external fun cancelPending(contextPtr: Long): Int
+
+  init {
+    this.mContextPtr = create(mLibPath, config)
+  }
+
+  fun embed(inputs: Array<String>, normalize: Boolean = false, priority: Int = Context.PRIORITY_NORMAL): String {
+    return embed(mContextPtr, inputs, normalize, priority)
+  }
+
+  fun cancelPending(): Int {
+    return cancelPending(mContextPtr)
+  }
+
+  fun release() {
+    free(mContextPtr)
+  }
+}
@@ -0,0 +1,27 @@
+package com.qnnllm
+
+/**
+ * Runs module calls on the shared native executor (see cpp/executor.h), so that
+ * Java work is prioritized together with native background work such as unpacking.
+ */
+object NativeExecutor {
+  const val CORES_ANY = 0
+  const val CORES_EFFICIENCY = 1
+  const val CORES_PERFORMANCE = 2
+
+  init {
+    Context.load()
+  }
+
+  @JvmStatic
+  external fun nativeExecute(priority: Int, cores: Int, task: Runnable)
+
+  @JvmStatic
+  external fun nativeGetStats(): String
+
+  fun execute(priority: Int, cores: Int = CORES_ANY, task: () -> Unit) {
+    nativeExecute(priority, cores, Runnable { task() })
+  }
+
+  fun getStats(): String = nativeGetStats()
+}
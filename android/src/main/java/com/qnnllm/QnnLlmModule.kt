@@ -1,12 +1,16 @@
 package com.qnnllm
 
+import android.content.ComponentCallbacks2
+import android.content.res.Configuration
 import com.facebook.react.bridge.ReactApplicationContext
 import com.facebook.react.module.annotations.ReactModule
 import com.facebook.react.bridge.Promise
+import com.facebook.react.bridge.ReadableArray
 import com.facebook.react.bridge.Arguments
 import com.facebook.react.bridge.WritableMap
 import com.facebook.react.modules.core.DeviceEventManagerModule
 
+import java.util.concurrent.ConcurrentHashMap
 import java.util.concurrent.atomic.AtomicLong
 import java.io.File
 
@@ -18,7 +22,8 @@ class QnnLlmModule(reactContext: ReactApplicationContext) :
     return NAME
   }
 
-  private val mContexts = mutableMapOf<Long, Context>()
+  private val mContexts = ConcurrentHashMap<Long, Context>()
+  private val mEmbeddingContexts = ConcurrentHashMap<Long, EmbeddingContext>()
   private val mContextId = AtomicLong(0)
 
   val mHtpConfigFilePath: String
@@ -30,129 +35,518 @@ class QnnLlmModule(reactContext: ReactApplicationContext) :
     }
     mHtpConfigFilePath = configFile.path
     configFile.deleteOnExit()
+
+    // Free the contexts the pool keeps warm once the app is hidden or memory runs low
+    reactContext.registerComponentCallbacks(object : ComponentCallbacks2 {
+      override fun onTrimMemory(level: Int) {
+        if (level >= ComponentCallbacks2.TRIM_MEMORY_RUNNING_LOW) {
+          NativeExecutor.execute(Context.PRIORITY_LOW) {
+            try {
+              Context.trimPool()
+            } catch (e: Exception) {
+              // Not loaded on this device
+            }
+          }
+        }
+      }
+
+      override fun onConfigurationChanged(newConfig: Configuration) {}
+
+      override fun onLowMemory() {}
+    })
   }
 
-  override fun createContext(config: String, promise: Promise) {
-    Thread {
+  override fun createContext(config: String, share: Boolean, promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_LOW) {
       try {
-        val context = Context(reactApplicationContext, config)
+        val context = Context(reactApplicationContext, config, share)
         val id = mContextId.incrementAndGet()
         mContexts[id] = context
         promise.resolve(id)
       } catch (e: Exception) {
         promise.reject("E_CREATE_CONTEXT", e.message, e)
       }
-    }.start()
+    }
   }
 
-  override fun unpack(bundlePath: String, unpackDir: String, promise: Promise) {
-    Thread {
+  override fun createEmbeddingContext(config: String, promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_LOW) {
       try {
-        promise.resolve(Context.unpack(bundlePath, unpackDir))
+        val context = EmbeddingContext(reactApplicationContext, config)
+        val id = mContextId.incrementAndGet()
+        mEmbeddingContexts[id] = context
+        promise.resolve(id)
+      } catch (e: Exception) {
+        promise.reject("E_CREATE_EMBEDDING_CONTEXT", e.message, e)
+      }
+    }
+  }
+
+  override fun freeEmbeddingContext(id: Double, promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_NORMAL) {
+      try {
+        mEmbeddingContexts.remove(id.toLong())?.release()
+        promise.resolve(null)
+      } catch (e: Exception) {
+        promise.reject("E_FREE", e.message, e)
+      }
+    }
+  }
+
+  override fun embed(id: Double, inputs: ReadableArray, normalize: Boolean, priority: Double, promise: Promise) {
+    NativeExecutor.execute(priority.toInt()) {
+      try {
+        val context = mEmbeddingContexts[id.toLong()]
+        if (context == null) {
+          promise.reject(Exception("Context not found"))
+          return@execute
+        }
+        val strings = Array(inputs.size()) { inputs.getString(it) ?: "" }
+        promise.resolve(context.embed(strings, normalize, priority.toInt()))
+      } catch (e: Exception) {
+        promise.reject("E_EMBED", e.message, e)
+      }
+    }
+  }
+
+  override fun cancelPendingEmbeddings(id: Double, promise: Promise) {
+    try {
+      promise.resolve(mEmbeddingContexts[id.toLong()]?.cancelPending() ?: 0)
+    } catch (e: Exception) {
+      promise.reject("E_CANCEL_PENDING", e.message, e)
+    }
+  }
+
+  override fun unpack(
+    bundlePath: String,
+    unpackDir: String,
+    verify: Double,
+    deepVerify: Boolean,
+    writer: Double,
+    bufferSize: Double,
+    unpackId: Double,
+    progressIntervalMs: Double,
+    promise: Promise
+  ) {
+    NativeExecutor.execute(Context.PRIORITY_LOW, NativeExecutor.CORES_EFFICIENCY) {
+      try {
+        val listener = if (progressIntervalMs <= 0) null else object : Context.UnpackListener() {
+          override fun onProgress(progress: String) {
+            val data = Arguments.createMap()
+            data.putInt("unpackId", unpackId.toInt())
+            data.putString("progress", progress)
+            fireEvent("unpackProgress", data)
+          }
+        }
+        promise.resolve(
+          Context.unpack(
+            bundlePath,
+            unpackDir,
+            verify.toInt(),
+            deepVerify,
+            writer.toInt(),
+            bufferSize.toInt(),
+            progressIntervalMs.toInt(),
+            listener
+          )
+        )
       } catch (e: Exception) {
         promise.reject("E_UNPACK", e.message, e)
       }
-    }.start()
+    }
   }
 
   override fun freeContext(id: Double, promise: Promise) {
-    Thread {
+    NativeExecutor.execute(Context.PRIORITY_NORMAL) {
       try {
         mContexts.remove(id.toLong())?.release()
         promise.resolve(null)
       } catch (e: Exception) {
         promise.reject("E_FREE", e.message, e)
       }
-    }.start()
+    }
   }
 
-  override fun process(id: Double, input: String, promise: Promise) {
-    Thread {
+  override fun process(
+    id: Double,
+    requestId: Double,
+    input: String,
+    priority: Double,
+    chunkTokens: Double,
+    reportProgress: Boolean,
+    promise: Promise
+  ) {
+    NativeExecutor.execute(priority.toInt()) {
       try {
-        mContexts[id.toLong()]?.process(input)
-        promise.resolve(null)
+        val listener = if (!reportProgress) null else object : Context.PrefillListener() {
+          override fun onProgress(progress: String) {
+            val data = Arguments.createMap()
+            data.putInt("contextId", id.toInt())
+            data.putInt("requestId", requestId.toInt())
+            data.putString("progress", progress)
+            fireEvent("prefillProgress", data)
+          }
+        }
+        promise.resolve(mContexts[id.toLong()]?.process(input, priority.toInt(), chunkTokens.toInt(), listener))
       } catch (e: Exception) {
         promise.reject("E_PROCESS", e.message, e)
       }
-    }.start()
+    }
   }
 
-  override fun query(id: Double, input: String, promise: Promise) {
-    Thread {
+  override fun query(
+    id: Double,
+    requestId: Double,
+    input: String,
+    priority: Double,
+    maxNewTokens: Double,
+    deadlineMs: Double,
+    maxTtftMs: Double,
+    promise: Promise
+  ) {
+    NativeExecutor.execute(priority.toInt()) {
       try {
         val context = mContexts[id.toLong()]
         if (context == null) {
           promise.reject(Exception("Context not found"))
         }
-        val profile = context?.query(input, object : Context.Callback() {
-          override fun onResponse(response: String, sentenceCode: Int) {
+        val metrics = context?.query(input, object : Context.Callback() {
+          override fun onResponse(response: String, sentenceCode: Int, fragments: Int, batchUs: Long, dropped: Int) {
             val data = Arguments.createMap()
             data.putString("response", response)
-            data.putInt("code", sentenceCode)
+            data.putInt("sentenceCode", sentenceCode)
             data.putInt("contextId", id.toInt())
-            fireEvent("onResponse", data)
+            data.putInt("requestId", requestId.toInt())
+            data.putInt("fragments", fragments)
+            data.putDouble("batchMs", batchUs / 1000.0)
+            data.putInt("dropped", dropped)
+            fireEvent("response", data)
           }
-        })
-        promise.resolve(profile)
+        }, priority.toInt(), maxNewTokens.toInt(), deadlineMs.toInt(), maxTtftMs.toInt())
+        promise.resolve(metrics)
       } catch (e: Exception) {
         promise.reject("E_QUERY", e.message, e)
       }
-    }.start()
+    }
   }
 
   override fun setStopWords(id: Double, stopWords: String, promise: Promise) {
-    Thread {
+    NativeExecutor.execute(Context.PRIORITY_NORMAL) {
       try {
         mContexts[id.toLong()]?.setStopWords(stopWords)
         promise.resolve(null)
       } catch (e: Exception) {
         promise.reject("E_SET_STOP_WORDS", e.message, e)
       }
-    }.start()
+    }
   }
 
   override fun applySamplerConfig(id: Double, config: String, promise: Promise) {
-    Thread {
+    NativeExecutor.execute(Context.PRIORITY_NORMAL) {
       try {
         mContexts[id.toLong()]?.applySamplerConfig(config)
         promise.resolve(null)
       } catch (e: Exception) {
         promise.reject("E_APPLY_SAMPLER_CONFIG", e.message, e)
       }
-    }.start()
+    }
   }
 
-  override fun saveSession(id: Double, filename: String, promise: Promise) {
-    Thread {
+  override fun saveSession(
+    id: Double,
+    filename: String,
+    priority: Double,
+    level: Double,
+    background: Boolean,
+    promise: Promise
+  ) {
+    NativeExecutor.execute(priority.toInt()) {
       try {
-        mContexts[id.toLong()]?.saveSession(filename)
+        mContexts[id.toLong()]?.saveSession(filename, priority.toInt(), level.toInt(), background)
         promise.resolve(null)
       } catch (e: Exception) {
         promise.reject("E_SAVE_SESSION", e.message, e)
       }
-    }.start()
+    }
   }
 
-  override fun restoreSession(id: Double, filename: String, promise: Promise) {
-    Thread {
+  override fun restoreSession(id: Double, filename: String, priority: Double, promise: Promise) {
+    NativeExecutor.execute(priority.toInt()) {
       try {
-        mContexts[id.toLong()]?.restoreSession(filename)
+        mContexts[id.toLong()]?.restoreSession(filename, priority.toInt())
         promise.resolve(null)
       } catch (e: Exception) {
         promise.reject("E_RESTORE_SESSION", e.message, e)
       }
-    }.start()
+    }
   }
 
   override fun abort(id: Double, promise: Promise) {
-    Thread {
+    NativeExecutor.execute(Context.PRIORITY_HIGH) {
       try {
         mContexts[id.toLong()]?.abort()
         promise.resolve(null)
       } catch (e: Exception) {
         promise.reject("E_ABORT", e.message, e)
       }
-    }.start()
+    }
+  }
+
+  override fun cancelPending(id: Double, promise: Promise) {
+    try {
+      promise.resolve(mContexts[id.toLong()]?.cancelPending() ?: 0)
+    } catch (e: Exception) {
+      promise.reject("E_CANCEL_PENDING", e.message, e)
+    }
+  }
+
+  override fun getQueueStats(id: Double, promise: Promise) {
+    try {
+      val context = mContexts[id.toLong()]
+      if (context == null) {
+        promise.reject(Exception("Context not found"))
+        return
+      }
+      promise.resolve(context.getQueueStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_QUEUE_STATS", e.message, e)
+    }
+  }
+
+  override fun getMetricsStats(id: Double, promise: Promise) {
+    try {
+      val context = mContexts[id.toLong()]
+      if (context == null) {
+        promise.reject(Exception("Context not found"))
+        return
+      }
+      promise.resolve(context.getMetricsStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_METRICS_STATS", e.message, e)
+    }
+  }
+
+  override fun resetMetrics(id: Double, promise: Promise) {
+    try {
+      mContexts[id.toLong()]?.resetMetrics()
+      promise.resolve(null)
+    } catch (e: Exception) {
+      promise.reject("E_RESET_METRICS", e.message, e)
+    }
+  }
+
+  override fun setSessionCache(id: Double, dir: String, budget: Double, maxEntries: Double, promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_NORMAL) {
+      try {
+        mContexts[id.toLong()]?.setSessionCache(dir, budget.toLong(), maxEntries.toInt())
+        promise.resolve(null)
+      } catch (e: Exception) {
+        promise.reject("E_SET_SESSION_CACHE", e.message, e)
+      }
+    }
+  }
+
+  override fun setResponseCoalescing(id: Double, intervalMs: Double, maxFragments: Double, promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_NORMAL) {
+      try {
+        mContexts[id.toLong()]?.setResponseCoalescing(intervalMs.toInt(), maxFragments.toInt())
+        promise.resolve(null)
+      } catch (e: Exception) {
+        promise.reject("E_SET_RESPONSE_COALESCING", e.message, e)
+      }
+    }
+  }
+
+  override fun applyLora(id: Double, adapter: String, engine: String, priority: Double, promise: Promise) {
+    NativeExecutor.execute(priority.toInt()) {
+      try {
+        mContexts[id.toLong()]?.applyLora(adapter, engine, priority.toInt())
+        promise.resolve(null)
+      } catch (e: Exception) {
+        promise.reject("E_APPLY_LORA", e.message, e)
+      }
+    }
+  }
+
+  override fun setLoraStrength(
+    id: Double,
+    tensor: String,
+    alpha: Double,
+    engine: String,
+    priority: Double,
+    promise: Promise
+  ) {
+    NativeExecutor.execute(priority.toInt()) {
+      try {
+        mContexts[id.toLong()]?.setLoraStrength(tensor, alpha.toFloat(), engine, priority.toInt())
+        promise.resolve(null)
+      } catch (e: Exception) {
+        promise.reject("E_SET_LORA_STRENGTH", e.message, e)
+      }
+    }
+  }
+
+  override fun setLoraResidency(id: Double, maxAdapters: Double, promise: Promise) {
+    try {
+      mContexts[id.toLong()]?.setLoraResidency(maxAdapters.toInt())
+      promise.resolve(null)
+    } catch (e: Exception) {
+      promise.reject("E_SET_LORA_RESIDENCY", e.message, e)
+    }
+  }
+
+  override fun getLoraStats(id: Double, promise: Promise) {
+    try {
+      val context = mContexts[id.toLong()]
+      if (context == null) {
+        promise.reject(Exception("Context not found"))
+        return
+      }
+      promise.resolve(context.getLoraStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_LORA_STATS", e.message, e)
+    }
+  }
+
+  override fun setGrammar(id: Double, grammar: String, priority: Double, promise: Promise) {
+    NativeExecutor.execute(priority.toInt()) {
+      try {
+        mContexts[id.toLong()]?.setGrammar(grammar, priority.toInt())
+        promise.resolve(null)
+      } catch (e: Exception) {
+        promise.reject("E_SET_GRAMMAR", e.message, e)
+      }
+    }
+  }
+
+  override fun getSnapshotStats(id: Double, promise: Promise) {
+    try {
+      val context = mContexts[id.toLong()]
+      if (context == null) {
+        promise.reject(Exception("Context not found"))
+        return
+      }
+      promise.resolve(context.getSnapshotStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_SNAPSHOT_STATS", e.message, e)
+    }
+  }
+
+  override fun getSamplerStats(id: Double, promise: Promise) {
+    try {
+      val context = mContexts[id.toLong()]
+      if (context == null) {
+        promise.reject(Exception("Context not found"))
+        return
+      }
+      promise.resolve(context.getSamplerStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_SAMPLER_STATS", e.message, e)
+    }
+  }
+
+  override fun getSessionCacheStats(id: Double, promise: Promise) {
+    try {
+      val context = mContexts[id.toLong()]
+      if (context == null) {
+        promise.reject(Exception("Context not found"))
+        return
+      }
+      promise.resolve(context.getSessionCacheStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_SESSION_CACHE_STATS", e.message, e)
+    }
+  }
+
+  override fun setContextPoolOptions(maxContexts: Double, idleMs: Double, promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_LOW) {
+      try {
+        Context.setPoolOptions(maxContexts.toInt(), idleMs.toInt())
+        promise.resolve(null)
+      } catch (e: Exception) {
+        promise.reject("E_SET_CONTEXT_POOL_OPTIONS", e.message, e)
+      }
+    }
+  }
+
+  override fun trimContextPool(promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_LOW) {
+      try {
+        promise.resolve(Context.trimPool())
+      } catch (e: Exception) {
+        promise.reject("E_TRIM_CONTEXT_POOL", e.message, e)
+      }
+    }
+  }
+
+  override fun getContextPoolStats(promise: Promise) {
+    try {
+      promise.resolve(Context.getPoolStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_CONTEXT_POOL_STATS", e.message, e)
+    }
+  }
+
+  override fun getLogHistory(limit: Double, promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_LOW) {
+      try {
+        promise.resolve(Context.getLogHistory(limit.toInt()))
+      } catch (e: Exception) {
+        promise.reject("E_GET_LOG_HISTORY", e.message, e)
+      }
+    }
+  }
+
+  override fun getLogStats(promise: Promise) {
+    try {
+      promise.resolve(Context.getLogStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_LOG_STATS", e.message, e)
+    }
+  }
+
+  override fun startTrace(promise: Promise) {
+    try {
+      Context.startTrace()
+      promise.resolve(null)
+    } catch (e: Exception) {
+      promise.reject("E_START_TRACE", e.message, e)
+    }
+  }
+
+  override fun stopTrace(promise: Promise) {
+    try {
+      Context.stopTrace()
+      promise.resolve(null)
+    } catch (e: Exception) {
+      promise.reject("E_STOP_TRACE", e.message, e)
+    }
+  }
+
+  override fun getTrace(promise: Promise) {
+    NativeExecutor.execute(Context.PRIORITY_LOW) {
+      try {
+        promise.resolve(Context.getTrace())
+      } catch (e: Exception) {
+        promise.reject("E_GET_TRACE", e.message, e)
+      }
+    }
+  }
+
+  override fun getTraceStats(promise: Promise) {
+    try {
+      promise.resolve(Context.getTraceStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_TRACE_STATS", e.message, e)
+    }
+  }
+
+  override fun getExecutorStats(promise: Promise) {
+    try {
+      promise.resolve(NativeExecutor.getStats())
+    } catch (e: Exception) {
+      promise.reject("E_GET_EXECUTOR_STATS", e.message, e)
+    }
   }
 
   fun addListener(type: String) {}
@@ -0,0 +1,104 @@
+package com.qnnllm
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.concurrent.ExecutorService
+import java.util.concurrent.Executors
+
+/**
+ * Consumer side of the native token ring (see cpp/token_ring.h for the record layout).
+ * Native code rings the doorbell only when records land after the consumer drained,
+ * the records are then decoded on a shared drain thread and passed to the callback.
+ */
+class TokenStream(capacity: Int, private val callback: Context.Callback) {
+  private val mPtr: Long
+  private val mBuffer: ByteBuffer
+  private val mCapacity: Int
+  private var mReadPos = 0L
+  private var mScratch = ByteArray(256)
+  private var mReleased = false
+
+  external fun nativeCreate(capacity: Int): Long
+  external fun nativeBuffer(streamPtr: Long): ByteBuffer
+  external fun nativeWritePosition(streamPtr: Long): Long
+  external fun nativeConsume(streamPtr: Long, position: Long): Long
+  external fun nativeClose(streamPtr: Long)
+  external fun nativeFree(streamPtr: Long)
+
+  init {
+    mPtr = nativeCreate(capacity)
+    mBuffer = nativeBuffer(mPtr).order(ByteOrder.LITTLE_ENDIAN)
+    mCapacity = mBuffer.capacity()
+  }
+
+  val ptr: Long
+    get() = mPtr
+
+  // Called from native code on the producer thread
+  fun onDoorbell() {
+    sDrainExecutor.execute { drain() }
+  }
+
+  /**
+   * Deliver every published record, call once the producer is done.
+   */
+  fun finish() {
+    sDrainExecutor.submit { drain() }.get()
+  }
+
+  fun release() {
+    nativeClose(mPtr)
+    sDrainExecutor.submit {
+      mReleased = true
+      nativeFree(mPtr)
+    }.get()
+  }
+
+  private fun drain() {
+    if (mReleased) return
+    var writePos = nativeWritePosition(mPtr)
+    // Re-arm even if nothing is new, the doorbell may be for records drained already
+    do {
+      while (mReadPos < writePos) {
+        readRecord()
+      }
+      writePos = nativeConsume(mPtr, mReadPos)
+    } while (mReadPos < writePos)
+  }
+
+  private fun readRecord() {
+    val offset = (mReadPos % mCapacity).toInt()
+    val remaining = mCapacity - offset
+    if (remaining < HEADER_SIZE) {
+      mReadPos += remaining
+      return
+    }
+    val length = mBuffer.getInt(offset)
+    if (length == WRAP) {
+      mReadPos += remaining
+      return
+    }
+    val code = mBuffer.getInt(offset + 4)
+    val fragments = mBuffer.getInt(offset + 8)
+    val batchUs = mBuffer.getInt(offset + 12).toLong() and 0xffffffffL
+    val dropped = mBuffer.getInt(offset + 16)
+    if (mScratch.size < length) {
+      mScratch = ByteArray(length)
+    }
+    mBuffer.position(offset + HEADER_SIZE)
+    mBuffer.get(mScratch, 0, length)
+    mReadPos += HEADER_SIZE + ((length + 3) and 3.inv())
+    callback.onResponse(String(mScratch, 0, length, Charsets.UTF_8), code, fragments, batchUs, dropped)
+  }
+
+  companion object {
+    const val DEFAULT_CAPACITY = 64 * 1024
+
+    private const val HEADER_SIZE = 20
+    private const val WRAP = -1
+
+    private val sDrainExecutor: ExecutorService = Executors.newSingleThreadExecutor { runnable ->
+      Thread(runnable, "QnnLlmTokenStream").apply { isDaemon = true }
+    }
+  }
+}
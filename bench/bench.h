@@ -0,0 +1,60 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace qnnllm {
+namespace bench {
+
+struct BenchOptions {
+  double      scale = 1.0;     // Multiplies data sizes and token counts
+  int         iterations = 5;  // Timed runs per case, the median is reported
+  std::string work_dir;        // Scratch space for bundles and unpacked files
+};
+
+// -----------------------------------------------------------------------------
+// Collects results as {"suite", "case", "params", "metrics"} objects
+// -----------------------------------------------------------------------------
+class Report {
+public:
+  void add(const std::string &suite, const std::string &name, nlohmann::json params,
+           nlohmann::json metrics);
+
+  nlohmann::json results() const;
+
+private:
+  nlohmann::json results_ = nlohmann::json::array();
+};
+
+inline uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Nearest-rank percentile, p in [0, 100].
+ */
+double percentile(std::vector<double> values, double p);
+
+/**
+ * Dialog config for the stub Genie library, see stub/genie_stub.cpp.
+ */
+std::string stubConfig(uint32_t max_tokens, double token_rate, double first_token_ms = 0,
+                       double prefill_rate = 0);
+
+void benchUnpack(const BenchOptions &options, Report &report);
+void benchCallback(const BenchOptions &options, Report &report);
+void benchQuery(const BenchOptions &options, Report &report);
+void benchContention(const BenchOptions &options, Report &report);
+void benchDecoding(const BenchOptions &options, Report &report);
+void benchPool(const BenchOptions &options, Report &report);
+void benchSampler(const BenchOptions &options, Report &report);
+void benchSnapshot(const BenchOptions &options, Report &report);
+void benchLogging(const BenchOptions &options, Report &report);
+void benchTracing(const BenchOptions &options, Report &report);
+
+}  // namespace bench
+}  // namespace qnnllm
@@ -0,0 +1,624 @@
+#include "bench.h"
+#include "context.h"
+#include "context_pool.h"
+#include "json_grammar.h"
+#include "log.h"
+#include "sampler_kernels.h"
+#include "token_ring.h"
+#include "trace.h"
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace qnnllm {
+namespace bench {
+
+static void noopCallback(const char *, const GenieDialog_SentenceCode_t, const void *) {}
+
+static uint32_t scaled(double value, double scale, uint32_t minimum) {
+  return std::max<uint32_t>(minimum, (uint32_t)(value * scale));
+}
+
+// -----------------------------------------------------------------------------
+// Consumer side of TokenRing, drained on the doorbell like TokenStream.kt
+// -----------------------------------------------------------------------------
+class RingDrain {
+public:
+  explicit RingDrain(TokenRing &ring) : ring_(ring) {
+    ring_.setDoorbell([this]() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rung_ = true;
+      }
+      cv_.notify_one();
+    });
+    thread_ = std::thread([this]() { run(); });
+  }
+
+  ~RingDrain() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  /**
+   * Wait until every record written so far has been read.
+   */
+  void sync() {
+    while (readPos_.load() < ring_.writePosition()) {
+      std::this_thread::yield();
+    }
+  }
+
+  uint64_t records() const { return records_.load(); }
+
+private:
+  void run() {
+    std::string text;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return stop_ || rung_; });
+        if (stop_) return;
+        rung_ = false;
+      }
+      uint64_t pos = readPos_.load();
+      uint64_t end = ring_.writePosition();
+      do {
+        while (pos < end) {
+          size_t offset = pos % ring_.capacity();
+          size_t remaining = ring_.capacity() - offset;
+          uint32_t length = 0;
+          if (remaining >= RING_HEADER_SIZE) std::memcpy(&length, ring_.data() + offset, sizeof(length));
+          if (remaining < RING_HEADER_SIZE || length == RING_WRAP) {
+            pos += remaining;
+            continue;
+          }
+          text.assign(reinterpret_cast<const char *>(ring_.data() + offset + RING_HEADER_SIZE), length);
+          pos += RING_HEADER_SIZE + ((length + 3) & ~3u);
+          ++records_;
+        }
+        readPos_.store(pos);
+        end = ring_.consume(pos);
+      } while (pos < end);
+    }
+  }
+
+  TokenRing              &ring_;
+  std::thread             thread_;
+  std::mutex              mutex_;
+  std::condition_variable cv_;
+  bool                    rung_ = false;
+  bool                    stop_ = false;
+  std::atomic<uint64_t>   readPos_{0};
+  std::atomic<uint64_t>   records_{0};
+};
+
+void benchCallback(const BenchOptions &options, Report &report) {
+  const uint32_t tokens = scaled(20000, options.scale, 1000);
+  const std::string config = stubConfig(tokens, 0);
+  const nlohmann::json params = {{"tokens", tokens}};
+
+  // Stub cost alone, subtracted from the other cases
+  std::vector<double> baseline;
+  {
+    GenieDialogConfig_Handle_t configHandle = nullptr;
+    GenieDialog_Handle_t dialog = nullptr;
+    if (GenieDialogConfig_createFromJson(config.c_str(), &configHandle) != GENIE_STATUS_SUCCESS ||
+        GenieDialog_create(configHandle, &dialog) != GENIE_STATUS_SUCCESS) {
+      throw std::runtime_error("Failed to create stub dialog");
+    }
+    for (int i = 0; i < options.iterations; ++i) {
+      GenieDialog_reset(dialog);
+      uint64_t start = nowNs();
+      GenieDialog_query(dialog, "Hello", GENIE_DIALOG_SENTENCE_COMPLETE, noopCallback, nullptr);
+      baseline.push_back((double)(nowNs() - start) / tokens);
+    }
+    GenieDialog_free(dialog);
+    GenieDialogConfig_free(configHandle);
+  }
+  const double baselineNs = percentile(baseline, 50);
+  report.add("callback", "genie-baseline", params, {{"ns_per_token", baselineNs}});
+
+  auto measure = [&](const std::string &name, const CoalesceOptions &coalesce, bool ring) {
+    Context context(config.c_str());
+    context.setResponseCoalescing(coalesce);
+    TokenRing tokenRing(64 * 1024);
+    std::unique_ptr<RingDrain> drain;
+    if (ring) drain.reset(new RingDrain(tokenRing));
+    uint64_t deliveries = 0;
+    Context::Callback callback = [&](const char *response, const GenieDialog_SentenceCode_t sentenceCode,
+                                     const ResponseBatch &batch) {
+      ++deliveries;
+      if (ring) {
+        tokenRing.write(response, strlen(response), sentenceCode, batch.fragments,
+                        (uint32_t)((batch.flush_ns - batch.first_ns) / 1000));
+      }
+    };
+    std::vector<double> perToken;
+    for (int i = 0; i < options.iterations; ++i) {
+      deliveries = 0;
+      uint64_t start = nowNs();
+      // A different prompt each time so the dialog is never rewound
+      context.query("Hello " + std::to_string(i), callback);
+      if (drain) drain->sync();
+      perToken.push_back((double)(nowNs() - start) / tokens);
+    }
+    double ns = percentile(perToken, 50);
+    report.add("callback", name, params,
+               {{"ns_per_token", ns}, {"overhead_ns_per_token", ns - baselineNs},
+                {"deliveries_per_query", deliveries}});
+  };
+  measure("context", CoalesceOptions(), false);
+  measure("context-coalesced", CoalesceOptions{16, 8}, false);
+  measure("token-ring", CoalesceOptions(), true);
+  measure("token-ring-coalesced", CoalesceOptions{16, 8}, true);
+}
+
+void benchQuery(const BenchOptions &options, Report &report) {
+  const uint32_t turns = scaled(20, options.scale, 4);
+  const std::string config = stubConfig(16, 0);
+  const std::string system(scaled(4096, options.scale, 256), 's');
+  auto noop = [](const char *, const GenieDialog_SentenceCode_t, const ResponseBatch &) {};
+
+  struct Outcome {
+    std::vector<double> latencyMs;
+    std::vector<double> promptTokens;
+    std::vector<double> inputTokens;
+  };
+  auto record = [](Outcome &outcome, uint64_t start, const QueryMetrics &metrics, const std::string &input) {
+    outcome.latencyMs.push_back((nowNs() - start) / 1e6);
+    outcome.promptTokens.push_back(metrics.genie.prompt_tokens);
+    outcome.inputTokens.push_back(input.size() / 4.0);
+  };
+  auto add = [&](const std::string &name, const Outcome &outcome, nlohmann::json params) {
+    double prompt = 0, input = 0;
+    for (double value : outcome.promptTokens) prompt += value;
+    for (double value : outcome.inputTokens) input += value;
+    params["turns"] = turns;
+    report.add("query", name, params,
+               {{"p50_ms", percentile(outcome.latencyMs, 50)}, {"p99_ms", percentile(outcome.latencyMs, 99)},
+                {"prefill_ratio", input > 0 ? prompt / input : 0}});
+  };
+
+  // Each turn extends the previous one, Genie rewinds to the shared prefix
+  {
+    Outcome outcome;
+    Context context(config.c_str());
+    std::string conversation = system;
+    for (uint32_t turn = 0; turn < turns; ++turn) {
+      std::string input = conversation + "\nuser: turn " + std::to_string(turn) + "\n";
+      std::string response;
+      uint64_t start = nowNs();
+      QueryMetrics metrics = context.query(input, [&](const char *text, const GenieDialog_SentenceCode_t,
+                                                      const ResponseBatch &) { response += text; });
+      record(outcome, start, metrics, input);
+      conversation = input + response;
+    }
+    add("extend", outcome, {});
+  }
+
+  // Alternate between two conversations, with and without the session cache
+  for (bool cached : {false, true}) {
+    Outcome outcome;
+    Context context(config.c_str());
+    const std::string cacheDir = (fs::path(options.work_dir) / "session-cache").string();
+    if (cached) {
+      fs::remove_all(cacheDir);
+      context.setSessionCache(cacheDir, 1ull << 30, 16);
+    }
+    std::string conversations[2] = {system + "\nconversation A", system + "\nconversation B"};
+    for (uint32_t turn = 0; turn < turns; ++turn) {
+      std::string &conversation = conversations[turn % 2];
+      std::string input = conversation + "\nuser: turn " + std::to_string(turn) + "\n";
+      std::string response;
+      uint64_t start = nowNs();
+      QueryMetrics metrics = context.query(input, [&](const char *text, const GenieDialog_SentenceCode_t,
+                                                      const ResponseBatch &) { response += text; });
+      record(outcome, start, metrics, input);
+      conversation = input + response;
+    }
+    if (cached) {
+      SessionCacheStats stats = context.sessionCacheStats();
+      fs::remove_all(cacheDir);
+      add("switch-cached", outcome, {{"hits", stats.hits}, {"misses", stats.misses}});
+    } else {
+      add("switch", outcome, {});
+    }
+  }
+
+  // Fresh prompt every time, the full input is prefilled
+  {
+    Outcome outcome;
+    Context context(config.c_str());
+    for (uint32_t turn = 0; turn < turns; ++turn) {
+      std::string input = std::to_string(turn) + system;
+      uint64_t start = nowNs();
+      QueryMetrics metrics = context.query(input, noop);
+      record(outcome, start, metrics, input);
+    }
+    add("unrelated", outcome, {});
+  }
+
+  // Fresh prompt prefilled ahead of the query, as while the user is typing
+  {
+    Outcome outcome;
+    Context context(config.c_str());
+    for (uint32_t turn = 0; turn < turns; ++turn) {
+      std::string prompt = std::to_string(turn) + system;
+      context.process(prompt);
+      std::string input = prompt + "\nuser: turn " + std::to_string(turn) + "\n";
+      uint64_t start = nowNs();
+      QueryMetrics metrics = context.query(input, noop);
+      record(outcome, start, metrics, input);
+    }
+    add("prefilled", outcome, {});
+  }
+}
+
+void benchContention(const BenchOptions &options, Report &report) {
+  const uint32_t queries = scaled(20, options.scale, 4);
+  const uint32_t tokens = scaled(256, options.scale, 16);
+  const std::string config = stubConfig(tokens, 0);
+  auto noop = [](const char *, const GenieDialog_SentenceCode_t, const ResponseBatch &) {};
+
+  for (bool shared : {false, true}) {
+    for (uint32_t threads : {1u, 2u, 4u, 8u}) {
+      std::vector<std::unique_ptr<Context>> contexts;
+      for (uint32_t i = 0; i < (shared ? 1 : threads); ++i) {
+        contexts.emplace_back(new Context(config.c_str()));
+      }
+      std::vector<std::vector<double>> latencies(threads);
+      std::vector<std::thread> workers;
+      uint64_t start = nowNs();
+      for (uint32_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+          Context &context = *contexts[shared ? 0 : t];
+          for (uint32_t q = 0; q < queries; ++q) {
+            uint64_t begin = nowNs();
+            context.query("thread " + std::to_string(t) + " query " + std::to_string(q), noop);
+            latencies[t].push_back((nowNs() - begin) / 1e6);
+          }
+        });
+      }
+      for (auto &worker : workers) worker.join();
+      double elapsedS = (nowNs() - start) / 1e9;
+
+      std::vector<double> all;
+      for (auto &latency : latencies) all.insert(all.end(), latency.begin(), latency.end());
+      nlohmann::json metrics = {
+        {"tokens_per_s", elapsedS > 0 ? (double)threads * queries * tokens / elapsedS : 0},
+        {"p50_ms", percentile(all, 50)},
+        {"p99_ms", percentile(all, 99)},
+      };
+      if (shared) {
+        SchedulerStats stats = contexts[0]->queueStats();
+        metrics["avg_wait_ms"] = stats.avg_wait_ms;
+        metrics["max_wait_ms"] = stats.max_wait_ms;
+      }
+      report.add("contention", std::string(shared ? "shared" : "independent") + "-" + std::to_string(threads),
+                 {{"threads", threads}, {"contexts", contexts.size()}, {"queries_per_thread", queries},
+                  {"tokens", tokens}},
+                 metrics);
+    }
+  }
+}
+
+void benchDecoding(const BenchOptions &options, Report &report) {
+  const uint32_t tokens = scaled(256, options.scale, 32);
+  // One byte per token so the stub tokenizer sees one token per generated token
+  auto config = [&](const std::string &type, const nlohmann::json &mode, double acceptRate) {
+    nlohmann::json config = nlohmann::json::parse(stubConfig(tokens, 1000));
+    config["dialog"]["type"] = type;
+    if (!mode.is_null()) config["dialog"][type] = mode;
+    config["stub"]["token"] = "x";
+    config["stub"]["accept_rate"] = acceptRate;
+    return config.dump();
+  };
+  struct Case {
+    std::string name;
+    std::string config;
+  };
+  const std::vector<Case> cases = {
+    {"basic", config("basic", nullptr, 0)},
+    {"ssd-q1", config("ssd-q1", {{"version", 1}, {"forecast-token-count", 4}}, 0.5)},
+    {"lade", config("lade", {{"version", 1}, {"ngram", 4}, {"window", 8}, {"gcap", 8}}, 0.3)},
+    {"spd", config("spd", {{"version", 1}, {"draft-len", 6}}, 0.7)},
+  };
+  auto noop = [](const char *, const GenieDialog_SentenceCode_t, const ResponseBatch &) {};
+  for (auto &test : cases) {
+    Context context(test.config.c_str());
+    std::vector<double> rate, perStep, acceptance;
+    for (int i = 0; i < options.iterations; ++i) {
+      QueryMetrics metrics = context.query("Hello " + std::to_string(i), noop);
+      rate.push_back(metrics.tokens_per_s);
+      perStep.push_back(metrics.tokens_per_step);
+      acceptance.push_back(metrics.acceptance_rate);
+    }
+    report.add("decoding", test.name, {{"tokens", tokens}, {"steps_per_s", 1000}},
+               {{"tokens_per_s", percentile(rate, 50)}, {"tokens_per_step", percentile(perStep, 50)},
+                {"acceptance_rate", percentile(acceptance, 50)}});
+  }
+}
+
+void benchPool(const BenchOptions &options, Report &report) {
+  const double loadMs = std::max(10.0, 200 * options.scale);
+  nlohmann::json config = nlohmann::json::parse(stubConfig(16, 0));
+  config["stub"]["load_ms"] = loadMs;
+  // The same config formatted differently still hits
+  const std::string configs[] = {config.dump(), config.dump(2)};
+  for (uint32_t idleMs : {0u, 30000u}) {
+    ContextPoolOptions poolOptions;
+    poolOptions.idle_ms = idleMs;
+    ContextPool pool(poolOptions);
+    std::vector<double> acquireMs;
+    // Mount and unmount a screen, the first acquire loads either way
+    for (int i = 0; i <= options.iterations; ++i) {
+      uint64_t start = nowNs();
+      Context *context = pool.acquire(configs[i % 2].c_str());
+      if (i > 0) acquireMs.push_back((nowNs() - start) / 1e6);
+      pool.release(context);
+    }
+    ContextPoolStats stats = pool.stats();
+    report.add("pool", idleMs == 0 ? "unpooled" : "warm", {{"load_ms", loadMs}, {"idle_ms", idleMs}},
+               {{"acquire_ms", percentile(acquireMs, 50)}, {"hits", stats.hits}, {"misses", stats.misses},
+                {"avg_load_ms", stats.avg_load_ms}});
+  }
+}
+
+// Token texts shaped like a BPE vocabulary: bytes, then word pieces with and without a leading space
+static std::vector<std::string> syntheticVocab(size_t size, std::mt19937 &rng) {
+  static const char alphabet[] = "etaoinshrdlucmfwypvbgkjqxz0123456789_-.,:{}[]\"'";
+  std::vector<std::string> vocab(size);
+  for (size_t i = 0; i < size; ++i) {
+    if (i < 256) {
+      vocab[i] = std::string(1, (char)i);
+      continue;
+    }
+    std::string &text = vocab[i];
+    if (rng() % 2) text += ' ';
+    const size_t length = 1 + rng() % 8;
+    for (size_t j = 0; j < length; ++j) text += alphabet[rng() % (sizeof(alphabet) - 1)];
+  }
+  vocab[0].clear();  // EOS
+  return vocab;
+}
+
+void benchSampler(const BenchOptions &options, Report &report) {
+  std::mt19937 rng(42);
+  const int steps = (int)scaled(2000, options.scale, 100);
+  for (size_t vocabSize : {32000u, 151936u}) {
+    std::vector<std::string> vocab = syntheticVocab(vocabSize, rng);
+    JsonTokenMask masks(vocab, 0);
+    // Inside a string most tokens are allowed, between values few are
+    JsonState inString, afterKey;
+    inString.advance(std::string("{\"key"));
+    afterKey.advance(std::string("{\"key\""));
+    uint64_t start = nowNs();
+    masks.allowed(inString);
+    const double maskMs = (nowNs() - start) / 1e6;
+    std::vector<float> logits(vocabSize);
+    for (auto &logit : logits) logit = std::uniform_real_distribution<float>(-8, 8)(rng);
+    std::vector<uint32_t> ids(vocabSize), reference(vocabSize);
+    for (const JsonState *state : {&inString, &afterKey}) {
+      const std::vector<uint64_t> allowed(masks.allowed(*state), masks.allowed(*state) + masks.words());
+      size_t count = 0, referenceCount = 0;
+      bool match = true;
+      start = nowNs();
+      for (int i = 0; i < steps; ++i) {
+        const float max = kernels::maskedMax(logits.data(), allowed.data(), vocabSize);
+        count = kernels::maskedCollect(logits.data(), allowed.data(), vocabSize, max - 12.8f, ids.data());
+      }
+      const double vectorUs = (nowNs() - start) / 1e3 / steps;
+      start = nowNs();
+      for (int i = 0; i < steps; ++i) {
+        const float max = kernels::scalar::maskedMax(logits.data(), allowed.data(), vocabSize);
+        referenceCount =
+          kernels::scalar::maskedCollect(logits.data(), allowed.data(), vocabSize, max - 12.8f, reference.data());
+      }
+      const double scalarUs = (nowNs() - start) / 1e3 / steps;
+      match = count == referenceCount && std::equal(ids.begin(), ids.begin() + count, reference.begin());
+      report.add("sampler", std::string(state == &inString ? "string-" : "structure-") + std::to_string(vocabSize),
+                 {{"vocab", vocabSize}, {"steps", steps}, {"kernel", kernels::name()}},
+                 {{"mask_ms", maskMs}, {"candidates", count}, {"vector_us", vectorUs}, {"scalar_us", scalarUs},
+                  {"speedup", vectorUs > 0 ? scalarUs / vectorUs : 0}, {"match", match}});
+    }
+  }
+
+  // End to end through the stub, which samples one byte token per step
+  nlohmann::json config = nlohmann::json::parse(stubConfig(512, 0));
+  config["dialog"]["context"] = {{"n-vocab", 128}, {"bos-token", 1}, {"eos-token", 2}};
+  Context context(config.dump().c_str());
+  std::vector<double> rate;
+  int valid = 0;
+  context.setGrammar("{\"type\": \"json\", \"root\": \"object\", \"seed\": 1}");
+  for (int i = 0; i < options.iterations; ++i) {
+    std::string response;
+    QueryMetrics metrics = context.query("Reply in JSON " + std::to_string(i), [&](
+      const char *text, const GenieDialog_SentenceCode_t, const ResponseBatch &) { response += text; });
+    rate.push_back(metrics.tokens_per_s);
+    if (!nlohmann::json::parse(response, nullptr, false).is_discarded()) ++valid;
+  }
+  SamplerStats stats = context.samplerStats();
+  report.add("sampler", "json", {{"vocab", 128}, {"queries", options.iterations}},
+             {{"valid", (double)valid / options.iterations}, {"tokens_per_s", percentile(rate, 50)},
+              {"avg_mask_us", stats.avg_mask_us}, {"avg_sample_us", stats.avg_sample_us}});
+}
+
+void benchSnapshot(const BenchOptions &options, Report &report) {
+  const uint64_t stateBytes = (uint64_t)scaled(64, options.scale, 4) << 20;
+  nlohmann::json config = nlohmann::json::parse(stubConfig(16, 0));
+  config["stub"]["state_bytes"] = stateBytes;
+  const std::string dir = (fs::path(options.work_dir) / "snapshot").string();
+  auto noop = [](const char *, const GenieDialog_SentenceCode_t, const ResponseBatch &) {};
+  struct Case {
+    const char *name;
+    int         level;
+    bool        background;
+  };
+  const Case cases[] = {{"raw", 0, false}, {"compressed", 3, false}, {"background", 3, true}};
+  for (const Case &test : cases) {
+    Context context(config.dump().c_str());
+    context.query("Hello", noop);
+    SnapshotOptions snapshotOptions;
+    snapshotOptions.level = test.level;
+    snapshotOptions.background = test.background;
+    std::vector<double> callMs, writeMs, restoreMs;
+    SnapshotStats stats{};
+    for (int i = 0; i < options.iterations; ++i) {
+      fs::remove_all(dir);
+      uint64_t start = nowNs();
+      context.saveSession(dir.c_str(), Priority::Normal, snapshotOptions);
+      callMs.push_back((nowNs() - start) / 1e6);
+      context.restoreSession(dir.c_str());
+      stats = context.snapshotStats();
+      writeMs.push_back(stats.last_write_ms);
+      restoreMs.push_back(stats.last_restore_ms);
+    }
+    report.add("snapshot", test.name, {{"state_bytes", stateBytes}, {"level", test.level},
+                                       {"background", test.background}},
+               {{"call_ms", percentile(callMs, 50)}, {"handoff_ms", stats.last_handoff_ms},
+                {"write_ms", percentile(writeMs, 50)}, {"bytes", stats.last_bytes},
+                {"ratio", stats.last_bytes > 0 ? (double)stats.last_raw_bytes / stats.last_bytes : 0},
+                {"restore_ms", percentile(restoreMs, 50)}});
+  }
+
+  // A snapshot of another model is refused from its header
+  nlohmann::json other = config;
+  other["dialog"]["other-model"] = true;
+  Context context(other.dump().c_str());
+  std::vector<double> rejectMs;
+  for (int i = 0; i < options.iterations; ++i) {
+    uint64_t start = nowNs();
+    try {
+      context.restoreSession(dir.c_str());
+    } catch (const std::runtime_error &) {
+    }
+    rejectMs.push_back((nowNs() - start) / 1e6);
+  }
+  report.add("snapshot", "stale", {{"state_bytes", stateBytes}},
+             {{"reject_ms", percentile(rejectMs, 50)}, {"rejected", context.snapshotStats().rejected}});
+  fs::remove_all(dir);
+}
+
+// How Genie messages were logged before log.h queued them: formatted and written on the calling thread
+static FILE *g_devNull = nullptr;
+static void syncLogCallback(GenieLog_Handle_t, const char *fmt, GenieLog_Level_t, uint64_t, va_list args) {
+  char buffer[1024];
+  vsnprintf(buffer, sizeof(buffer), fmt, args);
+  fprintf(g_devNull, LOG_TAG ": %s\n", buffer);
+  fflush(g_devNull);
+}
+
+static void genieLog(GenieLog_Callback_t callback, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  callback(nullptr, fmt, GENIE_LOG_LEVEL_INFO, 0, args);
+  va_end(args);
+}
+
+void benchLogging(const BenchOptions &options, Report &report) {
+  // Per message, paced like a decoding thread so the drainer keeps up
+  const int records = (int)scaled(5000, options.scale, 500);
+  g_devNull = fopen("/dev/null", "w");
+  for (GenieLog_Callback_t callback : {(GenieLog_Callback_t)syncLogCallback, (GenieLog_Callback_t)logStdoutCallback}) {
+    const log::LogStats before = log::stats();
+    std::vector<double> perRecord;
+    for (int i = 0; i < records; ++i) {
+      uint64_t start = nowNs();
+      genieLog(callback, "step %d: %u tokens, %.3f ms since prefill (%s)", i, 1u, i * 0.021, "decode");
+      perRecord.push_back((double)(nowNs() - start));
+      if (i % 64 == 63) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    log::flush();
+    const log::LogStats after = log::stats();
+    report.add("logging", callback == logStdoutCallback ? "record-async" : "record-sync", {{"records", records}},
+               {{"ns_p50", percentile(perRecord, 50)}, {"ns_p99", percentile(perRecord, 99)},
+                {"dropped", after.dropped - before.dropped}});
+  }
+  fclose(g_devNull);
+
+  // Decoding with a message per step against none
+  const uint32_t tokens = scaled(20000, options.scale, 1000);
+  auto noop = [](const char *, const GenieDialog_SentenceCode_t, const ResponseBatch &) {};
+  double baselineNs = 0;
+  for (int level : {0, (int)GENIE_LOG_LEVEL_INFO}) {
+    nlohmann::json config = nlohmann::json::parse(stubConfig(tokens, 0));
+    config["stub"]["log_steps"] = level;
+    Context context(config.dump().c_str());
+    const log::LogStats before = log::stats();
+    std::vector<double> perToken;
+    for (int i = 0; i < options.iterations; ++i) {
+      uint64_t start = nowNs();
+      context.query("Hello " + std::to_string(i), noop);
+      perToken.push_back((double)(nowNs() - start) / tokens);
+    }
+    log::flush();
+    const log::LogStats after = log::stats();
+    const double ns = percentile(perToken, 50);
+    if (level == 0) baselineNs = ns;
+    report.add("logging", level == 0 ? "decode" : "decode-logged", {{"tokens", tokens}},
+               {{"ns_per_token", ns}, {"overhead_ns_per_token", ns - baselineNs},
+                {"dropped", after.dropped - before.dropped}});
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Scoped trace spans: cost per span while stopped and while recording, the
+// decode overhead of the per-token spans and the export
+
+void benchTracing(const BenchOptions &options, Report &report) {
+  const int spans = (int)scaled(10000, options.scale, 1000);
+  for (bool enabled : {false, true}) {
+    if (enabled) trace::start();
+    uint64_t start = nowNs();
+    for (int i = 0; i < spans; ++i) {
+      QNN_TRACE_SPAN(span, "bench span");
+      span.arg("index", i);
+    }
+    const double ns = (double)(nowNs() - start) / spans;
+    trace::stop();
+    report.add("tracing", enabled ? "span-recording" : "span-stopped", {{"spans", spans}},
+               {{"ns_per_span", ns}});
+  }
+
+  const uint32_t tokens = scaled(20000, options.scale, 1000);
+  auto noop = [](const char *, const GenieDialog_SentenceCode_t, const ResponseBatch &) {};
+  Context context(stubConfig(tokens, 0).c_str());
+  double baselineNs = 0;
+  for (bool enabled : {false, true}) {
+    std::vector<double> perToken;
+    for (int i = 0; i < options.iterations; ++i) {
+      if (enabled) trace::start();
+      uint64_t start = nowNs();
+      context.query("Hello " + std::to_string(i), noop);
+      perToken.push_back((double)(nowNs() - start) / tokens);
+      trace::stop();
+    }
+    const double ns = percentile(perToken, 50);
+    if (!enabled) baselineNs = ns;
+    const trace::TraceStats stats = trace::stats();
+    report.add("tracing", enabled ? "decode-traced" : "decode", {{"tokens", tokens}},
+               {{"ns_per_token", ns}, {"overhead_ns_per_token", ns - baselineNs},
+                {"events", enabled ? stats.events : 0}, {"dropped", enabled ? stats.dropped : 0}});
+  }
+
+  uint64_t start = nowNs();
+  const std::string json = trace::exportJson();
+  report.add("tracing", "export", {{"events", trace::stats().events}},
+             {{"ms", (nowNs() - start) / 1e6}, {"bytes", json.size()}});
+}
+
+}  // namespace bench
+}  // namespace qnnllm
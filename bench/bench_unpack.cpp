@@ -0,0 +1,195 @@
+#include "bench.h"
+#include "unpack.h"
+#include <zlib.h>
+#include <zstd.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace qnnllm {
+namespace bench {
+
+static constexpr size_t MiB = 1 << 20;
+static constexpr size_t FRAME_SIZE = 4 * MiB;
+static constexpr int    ZSTD_LEVEL = 3;
+
+struct SectionSpec {
+  std::string name;
+  size_t      size;
+  uint8_t     method;
+  bool        framed;
+};
+
+struct BundleSpec {
+  std::string              name;
+  std::vector<SectionSpec> sections;
+};
+
+// Half random, half repeated bytes, roughly what quantized weights compress to
+static std::string syntheticData(size_t size, uint64_t seed) {
+  std::string data(size, '\0');
+  uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+  for (size_t i = 0; i < size / 2; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    data[i] = (char)state;
+  }
+  std::memset(&data[size / 2], 0x5A, size - size / 2);
+  return data;
+}
+
+static std::string compress(const char *data, size_t size) {
+  std::string out(ZSTD_compressBound(size), '\0');
+  size_t written = ZSTD_compress(&out[0], out.size(), data, size, ZSTD_LEVEL);
+  if (ZSTD_isError(written)) throw std::runtime_error(ZSTD_getErrorName(written));
+  out.resize(written);
+  return out;
+}
+
+template <typename T>
+static void putLE(std::string &out, T value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+/**
+ * Write a version 2 container, see the format notes in cpp/unpack.h.
+ * @return Total raw bytes of the sections
+ */
+static uint64_t writeBundle(const std::string &path, const BundleSpec &spec) {
+  std::string body = std::string(37, '\0');
+  const std::string config = compress("{\"dialog\":{\"type\":\"basic\"}}", 27);
+  const uint64_t configOffset = body.size();
+  body += config;
+
+  std::string toc;
+  uint64_t rawTotal = 0;
+  for (size_t s = 0; s < spec.sections.size(); ++s) {
+    const SectionSpec &section = spec.sections[s];
+    const std::string raw = syntheticData(section.size, s + 1);
+    std::string comp;
+    std::vector<std::pair<uint64_t, uint64_t>> frames;
+    if (section.method == METHOD_STORED) {
+      body.resize((body.size() + STORED_ALIGNMENT - 1) / STORED_ALIGNMENT * STORED_ALIGNMENT, '\0');
+      comp = raw;
+    } else if (section.framed) {
+      for (size_t pos = 0; pos < raw.size(); pos += FRAME_SIZE) {
+        size_t length = std::min(FRAME_SIZE, raw.size() - pos);
+        std::string frame = compress(raw.data() + pos, length);
+        frames.push_back({frame.size(), length});
+        comp += frame;
+      }
+    } else {
+      comp = compress(raw.data(), raw.size());
+    }
+    const uint64_t offset = body.size();
+    body += comp;
+    rawTotal += raw.size();
+
+    putLE<uint16_t>(toc, (uint16_t)section.name.size());
+    toc += section.name;
+    putLE<uint64_t>(toc, offset);
+    putLE<uint64_t>(toc, comp.size());
+    putLE<uint64_t>(toc, raw.size());
+    putLE<uint32_t>(toc, (uint32_t)crc32(0, reinterpret_cast<const Bytef *>(comp.data()), comp.size()));
+    putLE<uint8_t>(toc, section.method);
+    putLE<uint32_t>(toc, (uint32_t)frames.size());
+    for (auto &frame : frames) {
+      putLE<uint64_t>(toc, frame.first);
+      putLE<uint64_t>(toc, frame.second);
+    }
+  }
+
+  std::string header(CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+  putLE<uint16_t>(header, CONTAINER_VERSION);
+  header.append(4, '\0');
+  putLE<uint64_t>(header, configOffset);
+  putLE<uint64_t>(header, config.size());
+  putLE<uint64_t>(header, body.size());
+  body.replace(0, header.size(), header);
+  body += toc;
+  putLE<uint32_t>(body, (uint32_t)crc32(0, reinterpret_cast<const Bytef *>(body.data()), body.size()));
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(body.data(), body.size());
+  if (!file) throw std::runtime_error("Failed to write " + path);
+  return rawTotal;
+}
+
+static std::vector<BundleSpec> bundleSpecs(double scale) {
+  auto bytes = [scale](size_t size) { return std::max<size_t>(4096, (size_t)(size * scale)); };
+  std::vector<BundleSpec> specs;
+  BundleSpec many{"many-small", {}};
+  for (int i = 0; i < 64; ++i) {
+    many.sections.push_back({"small-" + std::to_string(i) + ".bin", bytes(256 * 1024), METHOD_ZSTD, false});
+  }
+  specs.push_back(many);
+  specs.push_back({"large-framed", {
+    {"weights-0.bin", bytes(64 * MiB), METHOD_ZSTD, true},
+    {"weights-1.bin", bytes(64 * MiB), METHOD_ZSTD, true},
+  }});
+  specs.push_back({"large-single-frame", {
+    {"weights.bin", bytes(64 * MiB), METHOD_ZSTD, false},
+  }});
+  specs.push_back({"stored-mix", {
+    {"weights.bin", bytes(64 * MiB), METHOD_STORED, false},
+    {"tokenizer.json", bytes(4 * MiB), METHOD_ZSTD, false},
+    {"lora-0.bin", bytes(4 * MiB), METHOD_ZSTD, true},
+    {"lora-1.bin", bytes(4 * MiB), METHOD_ZSTD, true},
+  }});
+  return specs;
+}
+
+void benchUnpack(const BenchOptions &options, Report &report) {
+  const std::pair<const char *, WriterBackend> writers[] = {
+    {"pwrite", WriterBackend::Pwrite},
+    {"uring", WriterBackend::Uring},
+    {"stream", WriterBackend::Stream},
+  };
+  for (const BundleSpec &spec : bundleSpecs(options.scale)) {
+    const std::string bundle = (fs::path(options.work_dir) / (spec.name + ".bundle")).string();
+    const std::string outDir = (fs::path(options.work_dir) / (spec.name + ".out")).string();
+    const uint64_t rawTotal = writeBundle(bundle, spec);
+    const uint64_t bundleSize = fs::file_size(bundle);
+
+    for (auto &writer : writers) {
+      UnpackOptions unpackOptions;
+      unpackOptions.writer = writer.second;
+      std::vector<double> elapsedMs, crcMs;
+      for (int i = 0; i < options.iterations; ++i) {
+        fs::remove_all(outDir);
+        uint64_t start = nowNs();
+        UnpackProgress summary = unpackModel(bundle, outDir, unpackOptions);
+        elapsedMs.push_back((nowNs() - start) / 1e6);
+        crcMs.push_back(summary.crc_ms);
+      }
+      double medianMs = percentile(elapsedMs, 50);
+      report.add("unpack", spec.name + "/" + writer.first,
+                 {{"sections", spec.sections.size()}, {"bundle_bytes", bundleSize},
+                  {"raw_bytes", rawTotal}, {"writer", writer.first}},
+                 {{"median_ms", medianMs}, {"min_ms", percentile(elapsedMs, 0)},
+                  {"max_ms", percentile(elapsedMs, 100)}, {"crc_ms", percentile(crcMs, 50)},
+                  {"in_mb_per_s", medianMs > 0 ? bundleSize / 1e3 / medianMs : 0},
+                  {"out_mb_per_s", medianMs > 0 ? rawTotal / 1e3 / medianMs : 0}});
+    }
+
+    // Second run over the same output, served by the manifest
+    std::vector<double> warmMs;
+    for (int i = 0; i < options.iterations; ++i) {
+      uint64_t start = nowNs();
+      unpackModel(bundle, outDir);
+      warmMs.push_back((nowNs() - start) / 1e6);
+    }
+    report.add("unpack", spec.name + "/warm", {{"sections", spec.sections.size()}, {"raw_bytes", rawTotal}},
+               {{"median_ms", percentile(warmMs, 50)}, {"max_ms", percentile(warmMs, 100)}});
+
+    fs::remove_all(outDir);
+    fs::remove(bundle);
+  }
+}
+
+}  // namespace bench
+}  // namespace qnnllm
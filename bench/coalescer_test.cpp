@@ -0,0 +1,184 @@
+#include "coalescer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Host test of ResponseCoalescer against a recording sink, run by ctest
+
+namespace qnnllm {
+namespace test {
+
+static int failures = 0;
+
+#define CHECK(condition)                                                            \
+  do {                                                                              \
+    if (!(condition)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+      ++failures;                                                                   \
+    }                                                                               \
+  } while (0)
+
+static constexpr uint64_t MS = 1000000;
+
+struct Delivery {
+  std::string                response;
+  GenieDialog_SentenceCode_t code;
+  ResponseBatch              batch;
+};
+
+// Records deliveries and checks the sink is never entered twice at once
+class FakeSink {
+public:
+  ResponseCoalescer::Sink sink(std::chrono::milliseconds delay = std::chrono::milliseconds(0)) {
+    return [this, delay](const std::string &response, const GenieDialog_SentenceCode_t code,
+                         const ResponseBatch &batch) {
+      if (inside_.fetch_add(1) != 0) concurrent_ = true;
+      if (delay.count() > 0) std::this_thread::sleep_for(delay);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        deliveries_.push_back({response, code, batch});
+      }
+      inside_.fetch_sub(1);
+      cv_.notify_all();
+    };
+  }
+
+  bool waitFor(size_t count, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, timeout, [&] { return deliveries_.size() >= count; });
+  }
+
+  std::vector<Delivery> deliveries() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return deliveries_;
+  }
+
+  bool concurrent() const { return concurrent_; }
+
+private:
+  std::mutex              mutex_;
+  std::condition_variable cv_;
+  std::vector<Delivery>   deliveries_;
+  std::atomic<int>        inside_{0};
+  std::atomic<bool>       concurrent_{false};
+};
+
+// Decoding stalls after two fragments, the alarm delivers them once the interval is up
+static void flushOnStall() {
+  FakeSink sink;
+  CoalesceOptions options;
+  options.interval_ms = 10;
+  options.max_fragments = 0;
+  ResponseCoalescer coalescer(options, sink.sink());
+  coalescer.push("a", GENIE_DIALOG_SENTENCE_CONTINUE);
+  coalescer.push("b", GENIE_DIALOG_SENTENCE_CONTINUE);
+  CHECK(sink.deliveries().empty());
+  CHECK(sink.waitFor(1, std::chrono::milliseconds(1000)));
+  auto deliveries = sink.deliveries();
+  CHECK(deliveries.size() == 1);
+  if (deliveries.empty()) return;
+  CHECK(deliveries[0].response == "ab");
+  CHECK(deliveries[0].code == GENIE_DIALOG_SENTENCE_CONTINUE);
+  CHECK(deliveries[0].batch.fragments == 2);
+  CHECK(deliveries[0].batch.flush_ns - deliveries[0].batch.first_ns >= options.interval_ms * MS);
+}
+
+// The batch the alarm was armed for goes out early on max_fragments, the alarm
+// then has to wait for the deadline of the next batch instead of flushing it
+static void rearmAfterEarlyDelivery() {
+  FakeSink sink;
+  CoalesceOptions options;
+  options.interval_ms = 30;
+  options.max_fragments = 2;
+  ResponseCoalescer coalescer(options, sink.sink());
+  coalescer.push("a", GENIE_DIALOG_SENTENCE_CONTINUE);
+  coalescer.push("b", GENIE_DIALOG_SENTENCE_CONTINUE);
+  CHECK(sink.deliveries().size() == 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  coalescer.push("c", GENIE_DIALOG_SENTENCE_CONTINUE);
+  CHECK(sink.waitFor(2, std::chrono::milliseconds(1000)));
+  auto deliveries = sink.deliveries();
+  CHECK(deliveries.size() == 2);
+  if (deliveries.size() < 2) return;
+  CHECK(deliveries[0].response == "ab");
+  CHECK(deliveries[1].response == "c");
+  CHECK(deliveries[1].batch.fragments == 1);
+  // Not flushed by the alarm of the first batch, which fired 10 ms into this one
+  CHECK(deliveries[1].batch.flush_ns - deliveries[1].batch.first_ns >= options.interval_ms * MS);
+}
+
+// Destroyed before its alarm fires, the sink must not be called afterwards
+static void destroyWithPendingAlarm() {
+  FakeSink sink;
+  CoalesceOptions options;
+  options.interval_ms = 20;
+  options.max_fragments = 0;
+  {
+    ResponseCoalescer coalescer(options, sink.sink());
+    coalescer.push("a", GENIE_DIALOG_SENTENCE_CONTINUE);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(sink.deliveries().empty());
+}
+
+// Destroyed while the alarm's flush is still in a slow sink, the destructor waits for it
+static void destroyDuringExpiredFlush() {
+  FakeSink sink;
+  CoalesceOptions options;
+  options.interval_ms = 5;
+  options.max_fragments = 0;
+  std::atomic<bool> flushing{false};
+  auto record = sink.sink(std::chrono::milliseconds(50));
+  {
+    ResponseCoalescer coalescer(options, [&](const std::string &response, const GenieDialog_SentenceCode_t code,
+                                             const ResponseBatch &batch) {
+      flushing = true;
+      record(response, code, batch);
+    });
+    coalescer.push("a", GENIE_DIALOG_SENTENCE_CONTINUE);
+    while (!flushing) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  CHECK(sink.deliveries().size() == 1);
+}
+
+// A stalled batch and the decode thread pushing again race for the sink
+static void pushDuringExpiredFlush() {
+  FakeSink sink;
+  CoalesceOptions options;
+  options.interval_ms = 1;
+  options.max_fragments = 0;
+  ResponseCoalescer coalescer(options, sink.sink(std::chrono::milliseconds(1)));
+  for (int i = 0; i < 200; ++i) {
+    coalescer.push("x", GENIE_DIALOG_SENTENCE_CONTINUE);
+    if (i % 7 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  coalescer.push("", GENIE_DIALOG_SENTENCE_END);
+  std::string text;
+  for (auto &delivery : sink.deliveries()) text += delivery.response;
+  CHECK(text == std::string(200, 'x'));
+  CHECK(sink.deliveries().back().code == GENIE_DIALOG_SENTENCE_END);
+  CHECK(!sink.concurrent());
+}
+
+}  // namespace test
+}  // namespace qnnllm
+
+int main() {
+  using namespace qnnllm::test;
+  flushOnStall();
+  rearmAfterEarlyDelivery();
+  destroyWithPendingAlarm();
+  destroyDuringExpiredFlush();
+  pushDuringExpiredFlush();
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("coalescer: all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,169 @@
+#include "bench.h"
+#include "context.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace qnnllm {
+namespace bench {
+
+void Report::add(const std::string &suite, const std::string &name, nlohmann::json params,
+                 nlohmann::json metrics) {
+  results_.push_back({
+    {"suite", suite},
+    {"case", name},
+    {"params", std::move(params)},
+    {"metrics", std::move(metrics)},
+  });
+}
+
+nlohmann::json Report::results() const {
+  return results_;
+}
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+  return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+std::string stubConfig(uint32_t max_tokens, double token_rate, double first_token_ms, double prefill_rate) {
+  nlohmann::json config = {
+    {"dialog", {{"version", 1}, {"type", "basic"}}},
+    {"stub", {
+      {"max_tokens", max_tokens},
+      {"token_rate", token_rate},
+      {"first_token_ms", first_token_ms},
+      {"prefill_rate", prefill_rate},
+    }},
+  };
+  return config.dump();
+}
+
+}  // namespace bench
+}  // namespace qnnllm
+
+using namespace qnnllm::bench;
+
+static void usage() {
+  std::cerr << "Usage: qnn-llm-bench [options]\n"
+               "  --suite LIST       Comma separated: unpack,callback,query,contention,\n"
+               "                     decoding,pool,sampler,snapshot,logging,\n"
+               "                     tracing\n"
+               "                     (default: all)\n"
+               "  --scale N          Multiply data sizes and token counts (default: 1)\n"
+               "  --iterations N     Timed runs per case (default: 5)\n"
+               "  --work-dir DIR     Scratch directory (default: <tmp>/qnn-llm-bench)\n"
+               "  --output FILE      Write the JSON report to FILE instead of stdout\n";
+}
+
+static std::string timestamp() {
+  std::time_t now = std::time(nullptr);
+  char buffer[32];
+  std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+  return buffer;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  options.work_dir = (fs::temp_directory_path() / "qnn-llm-bench").string();
+  std::string output;
+  std::vector<std::string> suites = {"unpack", "callback", "query", "contention", "decoding", "pool", "sampler",
+                                     "snapshot", "logging", "tracing"};
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        usage();
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+    if (arg == "--suite") {
+      suites.clear();
+      std::stringstream list(value());
+      for (std::string name; std::getline(list, name, ',');) suites.push_back(name);
+    } else if (arg == "--scale") {
+      options.scale = std::atof(value().c_str());
+    } else if (arg == "--iterations") {
+      options.iterations = std::max(1, std::atoi(value().c_str()));
+    } else if (arg == "--work-dir") {
+      options.work_dir = value();
+    } else if (arg == "--output") {
+      output = value();
+    } else {
+      usage();
+      return arg == "--help" ? 0 : 2;
+    }
+  }
+
+  const std::map<std::string, std::function<void(const BenchOptions &, Report &)>> runners = {
+    {"unpack", benchUnpack},
+    {"callback", benchCallback},
+    {"query", benchQuery},
+    {"contention", benchContention},
+    {"decoding", benchDecoding},
+    {"pool", benchPool},
+    {"sampler", benchSampler},
+    {"snapshot", benchSnapshot},
+    {"logging", benchLogging},
+    {"tracing", benchTracing},
+  };
+  Report report;
+  try {
+    fs::create_directories(options.work_dir);
+    for (auto &suite : suites) {
+      auto it = runners.find(suite);
+      if (it == runners.end()) {
+        std::cerr << "Unknown suite: " << suite << "\n";
+        return 2;
+      }
+      std::cerr << "Running " << suite << "\n";
+      it->second(options, report);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Benchmark failed: " << e.what() << "\n";
+    return 1;
+  }
+
+  nlohmann::json document = {
+    {"schema", 1},
+    {"timestamp", timestamp()},
+    {"genie", qnnllm::Context::version()},
+    {"host", {
+      {"cpus", std::thread::hardware_concurrency()},
+#if defined(__clang__)
+      {"compiler", "clang " __clang_version__},
+#elif defined(__GNUC__)
+      {"compiler", "gcc " __VERSION__},
+#endif
+    }},
+    {"options", {{"scale", options.scale}, {"iterations", options.iterations}}},
+    {"results", report.results()},
+  };
+  if (output.empty()) {
+    std::cout << document.dump(2) << std::endl;
+  } else {
+    std::ofstream file(output);
+    file << document.dump(2) << std::endl;
+    if (!file) {
+      std::cerr << "Failed to write " << output << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
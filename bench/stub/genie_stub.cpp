@@ -0,0 +1,640 @@
+// Host stand-in for libGenie. Dialogs stream a synthetic token at a configured
+// rate so the native layer can be measured without a device. Timing is read
+// from the "stub" object of the dialog config:
+//
+//   {
+//     "dialog": { ... },
+//     "stub": {
+//       "token": " tok",          // Text of every generated token
+//       "max_tokens": 64,         // Tokens generated per query
+//       "token_rate": 0,          // Decode steps per second, 0 generates without delay
+//       "first_token_ms": 0,      // Latency before the first token
+//       "prefill_rate": 0,        // Prompt tokens per second, 0 is instant
+//       "accept_rate": 0,         // Share of draft tokens accepted per step
+//       "lora_ms": 0,             // Latency of applying a LoRA adapter
+//       "load_ms": 0,             // Latency of creating the dialog
+//       "state_bytes": 0,         // Size of the KV cache file a save writes
+//       "log_steps": 0            // GenieLog_Level_t of a log message per step, 0 for none
+//     }
+//   }
+//
+// Speculative dialogs (ssd-q1, lade, spd) draft tokens as configured in the
+// dialog and emit the accepted ones together with the decoded token, so a step
+// carries up to 1 + draft length tokens.
+//
+// With a custom sampler applied ("type": "custom" naming a registered callback)
+// every step hands the callback one row of pseudo-random logits over the
+// n-vocab tokens of dialog.context and emits the token it picks, as one byte of
+// text, until it picks the eos-token. The logits drift toward quotes, closing
+// brackets and EOS as the response grows, so constrained documents end.
+//
+// Embedding configs read "embed_size" (floats per vector, default 384) and
+// "embed_rate" (inputs per second, 0 is instant) from the same object, and
+// produce a deterministic vector per input.
+//
+// A prompt token is 4 bytes of text. REWIND queries only prefill the part of
+// the prompt that does not extend the dialog history, as Genie does. BEGIN and
+// CONTINUE queries are parts of a multi-part prompt: they are prefilled and
+// nothing is generated until the END part.
+
+#include "GenieDialog.h"
+#include "GenieEmbedding.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr uint32_t BYTES_PER_TOKEN = 4;
+static constexpr const char *STATE_FILE = "stub-dialog.bin";
+static constexpr const char *KV_FILE = "stub-kv.bin";
+
+struct StubOptions {
+  std::string token = " tok";
+  uint32_t    max_tokens = 64;
+  double      token_rate = 0;
+  double      first_token_ms = 0;
+  double      prefill_rate = 0;
+  double      accept_rate = 0;
+  double      lora_ms = 0;
+  double      load_ms = 0;
+  uint64_t    state_bytes = 0;
+  int         log_steps = 0;
+  uint32_t    draft_tokens = 0;  // From the dialog config, 0 for basic dialogs
+  uint32_t    n_vocab = 0;       // From dialog.context
+  int32_t     eos_token = -1;
+};
+
+struct _GenieSampler_Handle_t {
+  GenieSampler_UserDataCallback_t callback = nullptr;  // Custom sampler, null for the built-in one
+  const void                     *userData = nullptr;
+};
+
+struct _GenieDialogConfig_Handle_t {
+  StubOptions           options;
+  GenieProfile_Handle_t profile = nullptr;
+  GenieLog_Handle_t     log = nullptr;
+};
+
+struct _GenieProfile_Handle_t {
+  mutable std::mutex             mutex;
+  mutable std::vector<nlohmann::json> events;
+};
+
+struct _GenieDialog_Handle_t {
+  StubOptions               options;
+  GenieProfile_Handle_t     profile = nullptr;
+  GenieLog_Handle_t         log = nullptr;
+  mutable std::string       history;
+  mutable std::atomic<bool> aborted{false};
+  _GenieSampler_Handle_t    sampler;
+};
+
+struct _GenieEmbeddingConfig_Handle_t {
+  uint32_t embed_size = 384;
+  double   embed_rate = 0;
+};
+
+struct _GenieEmbedding_Handle_t {
+  _GenieEmbeddingConfig_Handle_t options;
+};
+
+struct _GenieLog_Handle_t {
+  GenieLog_Callback_t callback;
+  GenieLog_Level_t    maxLevel;
+};
+
+struct _GenieSamplerConfig_Handle_t {
+  nlohmann::json config;
+};
+
+struct _GenieTokenizer_Handle_t {};
+
+static _GenieTokenizer_Handle_t g_tokenizer;
+
+struct SamplerCallback {
+  GenieSampler_UserDataCallback_t callback;
+  const void                     *userData;
+};
+
+static std::mutex                             g_samplersMutex;
+static std::map<std::string, SamplerCallback> g_samplers;  // By registered name
+
+static uint64_t nowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void sleepUntil(uint64_t us) {
+  std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(us)));
+}
+
+// Hands a message to the bound logger if it takes the level
+static void stubLog(GenieLog_Handle_t log, GenieLog_Level_t level, const char *fmt, ...) {
+  if (!log || !log->callback || level > log->maxLevel) return;
+  va_list args;
+  va_start(args, fmt);
+  log->callback(log, fmt, level, nowUs(), args);
+  va_end(args);
+}
+
+// Logits of one custom sampler step, deterministic for a given history and step
+static void stepLogits(const _GenieDialog_Handle_t *dialog, uint32_t step, std::vector<float> &logits) {
+  const StubOptions &options = dialog->options;
+  uint64_t state = (std::hash<std::string>()(dialog->history) ^ (step * 0x9e3779b97f4a7c15ULL)) | 1;
+  for (float &logit : logits) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    logit = (float)(state >> 40) / (1 << 24) * 8.0f - 4.0f;
+  }
+  const float drift = step * 0.25f;
+  for (int32_t token : {(int32_t)'"', (int32_t)'}', (int32_t)']', options.eos_token}) {
+    if (token >= 0 && (uint32_t)token < logits.size()) logits[token] += drift;
+  }
+}
+
+static nlohmann::json metric(double value, const char *unit) {
+  return {{"value", value}, {"unit", unit}};
+}
+
+// Runs one query: prefill, then max_tokens tokens handed to emit
+template <typename Emit>
+static Genie_Status_t generate(const _GenieDialog_Handle_t *dialog, const std::string &prompt,
+                               GenieDialog_SentenceCode_t sentenceCode, Emit emit) {
+  const StubOptions &options = dialog->options;
+  const uint64_t start = nowUs();
+  dialog->aborted = false;
+
+  size_t prefill = prompt.size();
+  if (sentenceCode == GENIE_DIALOG_SENTENCE_REWIND) {
+    auto mismatch = std::mismatch(prompt.begin(), prompt.end(), dialog->history.begin(),
+                                  dialog->history.end());
+    size_t common = mismatch.first - prompt.begin();
+    prefill -= common;
+    dialog->history.resize(common);
+    dialog->history.append(prompt, common, std::string::npos);
+  } else {
+    dialog->history += prompt;
+  }
+  const uint32_t promptTokens = (uint32_t)((prefill + BYTES_PER_TOKEN - 1) / BYTES_PER_TOKEN);
+  const bool generating =
+    sentenceCode != GENIE_DIALOG_SENTENCE_BEGIN && sentenceCode != GENIE_DIALOG_SENTENCE_CONTINUE;
+  uint64_t firstAt = start + (generating ? (uint64_t)(options.first_token_ms * 1000) : 0);
+  if (options.prefill_rate > 0) {
+    firstAt += (uint64_t)(promptTokens * 1e6 / options.prefill_rate);
+  }
+  sleepUntil(firstAt);
+  const uint64_t prefillEnd = nowUs();
+
+  uint32_t generated = 0;
+  bool aborted = false;
+  double credit = 0;  // Accepted draft tokens owed, spreads accept_rate evenly over the steps
+  std::string text;
+  const _GenieSampler_Handle_t &sampler = dialog->sampler;
+  std::vector<float> logits(sampler.callback ? options.n_vocab : 0);
+  for (uint32_t step = 0; generating && generated < options.max_tokens; ++step) {
+    if (dialog->aborted) {
+      aborted = true;
+      break;
+    }
+    if (options.token_rate > 0) {
+      sleepUntil(prefillEnd + (uint64_t)(step * 1e6 / options.token_rate));
+    }
+    // The first token comes out of the prefill, later steps verify a draft
+    uint32_t count = 1;
+    if (step > 0) {
+      credit += options.accept_rate * options.draft_tokens;
+      const uint32_t accepted = std::min((uint32_t)credit, options.draft_tokens);
+      credit -= accepted;
+      count = std::min(1 + accepted, options.max_tokens - generated);
+    }
+    text.clear();
+    if (sampler.callback && !logits.empty()) {
+      stepLogits(dialog, step, logits);
+      int32_t token = options.eos_token;
+      sampler.callback((uint32_t)logits.size(), logits.data(), 1, &token, sampler.userData);
+      if (token == options.eos_token) break;
+      text.push_back((char)token);
+      count = 1;
+    } else {
+      for (uint32_t i = 0; i < count; ++i) text += options.token;
+    }
+    emit(text, generated == 0 ? GENIE_DIALOG_SENTENCE_BEGIN : GENIE_DIALOG_SENTENCE_CONTINUE);
+    if (options.log_steps > 0) {
+      stubLog(dialog->log, (GenieLog_Level_t)options.log_steps, "step %u: %u tokens, %.3f ms since prefill (%s)",
+              step, count, (nowUs() - prefillEnd) / 1e3, "decode");
+    }
+    dialog->history += text;
+    generated += count;
+  }
+  if (generating) {
+    emit(std::string(), aborted ? GENIE_DIALOG_SENTENCE_ABORT : GENIE_DIALOG_SENTENCE_END);
+  }
+  const uint64_t stop = nowUs();
+
+  if (dialog->profile) {
+    const double generationUs = (double)(stop - prefillEnd);
+    nlohmann::json event = {
+      {"type", "GenieDialog_query"},
+      {"start", start},
+      {"stop", stop},
+      {"duration", stop - start},
+      {"num-prompt-tokens", metric(promptTokens, "")},
+      {"prompt-processing-rate",
+       metric(prefillEnd > start ? promptTokens * 1e6 / (prefillEnd - start) : 0, "toks/sec")},
+      {"time-to-first-token", metric((double)(prefillEnd - start), "us")},
+      {"num-generated-tokens", metric(generated, "")},
+      {"token-generation-rate", metric(generationUs > 0 ? generated * 1e6 / generationUs : 0, "toks/sec")},
+      {"token-generation-time", metric(generationUs, "us")},
+    };
+    std::lock_guard<std::mutex> lock(dialog->profile->mutex);
+    dialog->profile->events.push_back(std::move(event));
+  }
+  return aborted ? GENIE_STATUS_WARNING_ABORTED : GENIE_STATUS_SUCCESS;
+}
+
+static Genie_Status_t allocCopy(const std::string &data, const Genie_AllocCallback_t callback,
+                                const char **out) {
+  if (!callback || !out) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  callback(data.size() + 1, out);
+  if (!*out) return GENIE_STATUS_ERROR_MEM_ALLOC;
+  std::memcpy(const_cast<char *>(*out), data.c_str(), data.size() + 1);
+  return GENIE_STATUS_SUCCESS;
+}
+
+extern "C" {
+
+uint32_t Genie_getApiMajorVersion(void) { return 1; }
+uint32_t Genie_getApiMinorVersion(void) { return 0; }
+uint32_t Genie_getApiPatchVersion(void) { return 0; }
+
+Genie_Status_t GenieLog_create(const GenieLogConfig_Handle_t configHandle, const GenieLog_Callback_t callback,
+                               const GenieLog_Level_t maxLogLevel, GenieLog_Handle_t *logHandle) {
+  if (!logHandle) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  *logHandle = new _GenieLog_Handle_t{callback, maxLogLevel};
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieLog_free(const GenieLog_Handle_t logHandle) {
+  delete logHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieProfile_create(const GenieProfileConfig_Handle_t configHandle,
+                                   GenieProfile_Handle_t *profileHandle) {
+  if (!profileHandle) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  *profileHandle = new _GenieProfile_Handle_t();
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieProfile_getJsonData(const GenieProfile_Handle_t profileHandle,
+                                        const Genie_AllocCallback_t callback, const char **jsonData) {
+  if (!profileHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  nlohmann::json events;
+  {
+    std::lock_guard<std::mutex> lock(profileHandle->mutex);
+    events = nlohmann::json(profileHandle->events);
+    profileHandle->events.clear();
+  }
+  nlohmann::json profile = {
+    {"header", {{"header_version", {{"major", 0}, {"minor", 1}, {"patch", 0}}},
+                {"version", {{"major", Genie_getApiMajorVersion()},
+                             {"minor", Genie_getApiMinorVersion()},
+                             {"patch", Genie_getApiPatchVersion()}}},
+                {"artifact_type", "GENIE_PROFILE"}}},
+    {"metadata", {{"timestamp", nowUs()}}},
+    {"components", {{{"name", "stub-dialog"}, {"type", "dialog"}, {"events", events}}}},
+  };
+  return allocCopy(profile.dump(), callback, jsonData);
+}
+
+Genie_Status_t GenieProfile_free(const GenieProfile_Handle_t profileHandle) {
+  delete profileHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialogConfig_createFromJson(const char *str, GenieDialogConfig_Handle_t *configHandle) {
+  if (!str || !configHandle) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  nlohmann::json config = nlohmann::json::parse(str, nullptr, false);
+  if (config.is_discarded()) return GENIE_STATUS_ERROR_JSON_FORMAT;
+  if (!config.contains("dialog")) return GENIE_STATUS_ERROR_JSON_SCHEMA;
+  auto *handle = new _GenieDialogConfig_Handle_t();
+  if (config.contains("stub")) {
+    const auto &stub = config["stub"];
+    StubOptions &options = handle->options;
+    options.token = stub.value("token", options.token);
+    options.max_tokens = stub.value("max_tokens", options.max_tokens);
+    options.token_rate = stub.value("token_rate", options.token_rate);
+    options.first_token_ms = stub.value("first_token_ms", options.first_token_ms);
+    options.prefill_rate = stub.value("prefill_rate", options.prefill_rate);
+    options.accept_rate = stub.value("accept_rate", options.accept_rate);
+    options.lora_ms = stub.value("lora_ms", options.lora_ms);
+    options.load_ms = stub.value("load_ms", options.load_ms);
+    options.state_bytes = stub.value("state_bytes", options.state_bytes);
+    options.log_steps = stub.value("log_steps", options.log_steps);
+  }
+  const auto &dialog = config["dialog"];
+  const std::string type = dialog.value("type", "basic");
+  if (dialog.contains(type) && dialog[type].is_object()) {
+    const auto &mode = dialog[type];
+    if (type == "spd") handle->options.draft_tokens = mode.value("draft-len", 0u);
+    if (type == "ssd-q1") handle->options.draft_tokens = mode.value("forecast-token-count", 0u);
+    if (type == "lade") handle->options.draft_tokens = std::max(mode.value("ngram", 1u), 1u) - 1;
+  }
+  if (dialog.contains("context") && dialog["context"].is_object()) {
+    const auto &context = dialog["context"];
+    handle->options.n_vocab = context.value("n-vocab", 0u);
+    const auto &eos = context.value("eos-token", nlohmann::json());
+    if (eos.is_number_integer()) handle->options.eos_token = eos.get<int32_t>();
+    if (eos.is_array() && !eos.empty() && eos[0].is_number_integer()) {
+      handle->options.eos_token = eos[0].get<int32_t>();
+    }
+  }
+  *configHandle = handle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialogConfig_bindProfiler(const GenieDialogConfig_Handle_t configHandle,
+                                              const GenieProfile_Handle_t profileHandle) {
+  if (!configHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  const_cast<_GenieDialogConfig_Handle_t *>(configHandle)->profile = profileHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialogConfig_bindLogger(const GenieDialogConfig_Handle_t configHandle,
+                                            const GenieLog_Handle_t logHandle) {
+  if (!configHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  const_cast<_GenieDialogConfig_Handle_t *>(configHandle)->log = logHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialogConfig_free(const GenieDialogConfig_Handle_t configHandle) {
+  delete configHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialog_create(const GenieDialogConfig_Handle_t configHandle,
+                                  GenieDialog_Handle_t *dialogHandle) {
+  if (!configHandle || !dialogHandle) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  auto *dialog = new _GenieDialog_Handle_t();
+  dialog->options = configHandle->options;
+  dialog->profile = configHandle->profile;
+  dialog->log = configHandle->log;
+  sleepUntil(nowUs() + (uint64_t)(dialog->options.load_ms * 1000));
+  *dialogHandle = dialog;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialog_query(const GenieDialog_Handle_t dialogHandle, const char *queryStr,
+                                 const GenieDialog_SentenceCode_t sentenceCode,
+                                 const GenieDialog_QueryCallback_t callback, const void *userData) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  if (!queryStr || !callback) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  return generate(dialogHandle, queryStr, sentenceCode,
+                  [&](const std::string &text, GenieDialog_SentenceCode_t code) {
+                    callback(text.c_str(), code, userData);
+                  });
+}
+
+Genie_Status_t GenieDialog_tokenQuery(const GenieDialog_Handle_t dialogHandle, const uint32_t *inputTokens,
+                                      const uint32_t numTokens, const GenieDialog_SentenceCode_t sentenceCode,
+                                      const GenieDialog_TokenQueryCallback_t callback, const void *userData) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  if ((!inputTokens && numTokens > 0) || !callback) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  // The stub tokenizer maps every byte to one token
+  std::string prompt(numTokens, '\0');
+  for (uint32_t i = 0; i < numTokens; ++i) prompt[i] = (char)inputTokens[i];
+  std::vector<uint32_t> tokens;
+  return generate(dialogHandle, prompt, sentenceCode,
+                  [&](const std::string &text, GenieDialog_SentenceCode_t code) {
+                    tokens.assign(text.begin(), text.end());
+                    callback(tokens.data(), (uint32_t)tokens.size(), code, userData);
+                  });
+}
+
+Genie_Status_t GenieDialog_save(const GenieDialog_Handle_t dialogHandle, const char *path) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  std::ofstream file(std::string(path) + "/" + STATE_FILE, std::ios::binary | std::ios::trunc);
+  file.write(dialogHandle->history.data(), dialogHandle->history.size());
+  if (!file) return GENIE_STATUS_ERROR_GENERAL;
+  if (dialogHandle->options.state_bytes == 0) return GENIE_STATUS_SUCCESS;
+  // Quantized activations: small values around zero, about half of them compressible away
+  std::ofstream kv(std::string(path) + "/" + KV_FILE, std::ios::binary | std::ios::trunc);
+  std::vector<char> block(1 << 16);
+  uint32_t state = (uint32_t)dialogHandle->history.size() | 1;
+  for (uint64_t left = dialogHandle->options.state_bytes; left > 0 && kv;) {
+    for (char &byte : block) {
+      state = state * 1664525u + 1013904223u;
+      byte = (char)((int)(state >> 28) - 8);
+    }
+    const size_t count = (size_t)std::min<uint64_t>(left, block.size());
+    kv.write(block.data(), count);
+    left -= count;
+  }
+  return kv ? GENIE_STATUS_SUCCESS : GENIE_STATUS_ERROR_GENERAL;
+}
+
+Genie_Status_t GenieDialog_restore(const GenieDialog_Handle_t dialogHandle, const char *path) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  std::ifstream file(std::string(path) + "/" + STATE_FILE, std::ios::binary);
+  if (!file) return GENIE_STATUS_ERROR_GENERAL;
+  dialogHandle->history.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialog_reset(const GenieDialog_Handle_t dialogHandle) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  dialogHandle->history.clear();
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialog_applyLora(const GenieDialog_Handle_t dialogHandle, const char *engine,
+                                     const char *loraAdapterName) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  if (!engine || !loraAdapterName) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  sleepUntil(nowUs() + (uint64_t)(dialogHandle->options.lora_ms * 1000));
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialog_setLoraStrength(const GenieDialog_Handle_t dialogHandle, const char *engine,
+                                           const char *tensorName, const float alpha) {
+  return dialogHandle ? GENIE_STATUS_SUCCESS : GENIE_STATUS_ERROR_INVALID_HANDLE;
+}
+
+Genie_Status_t GenieDialog_getSampler(const GenieDialog_Handle_t dialogHandle,
+                                      GenieSampler_Handle_t *dialogSamplerHandle) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  *dialogSamplerHandle = &dialogHandle->sampler;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialog_getTokenizer(const GenieDialog_Handle_t dialogHandle,
+                                        GenieTokenizer_Handle_t *tokenizerHandle) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  *tokenizerHandle = &g_tokenizer;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialog_setStopSequence(const GenieDialog_Handle_t dialogHandle,
+                                           const char *newStopSequences) {
+  return dialogHandle ? GENIE_STATUS_SUCCESS : GENIE_STATUS_ERROR_INVALID_HANDLE;
+}
+
+Genie_Status_t GenieDialog_signal(const GenieDialog_Handle_t dialogHandle, const GenieDialog_Action_t action) {
+  if (!dialogHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  if (action == GENIE_DIALOG_ACTION_ABORT) dialogHandle->aborted = true;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieDialog_free(const GenieDialog_Handle_t dialogHandle) {
+  delete dialogHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieSamplerConfig_createFromJson(const char *str, GenieSamplerConfig_Handle_t *configHandle) {
+  if (!str || !configHandle) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  nlohmann::json config = nlohmann::json::parse(str, nullptr, false);
+  if (config.is_discarded()) return GENIE_STATUS_ERROR_JSON_FORMAT;
+  *configHandle = new _GenieSamplerConfig_Handle_t{std::move(config)};
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieSamplerConfig_setParam(const GenieSamplerConfig_Handle_t configHandle, const char *keyStr,
+                                           const char *valueStr) {
+  return configHandle ? GENIE_STATUS_SUCCESS : GENIE_STATUS_ERROR_INVALID_HANDLE;
+}
+
+Genie_Status_t GenieSamplerConfig_free(const GenieSamplerConfig_Handle_t configHandle) {
+  delete configHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieSampler_applyConfig(const GenieSampler_Handle_t samplerHandle,
+                                        const GenieSamplerConfig_Handle_t configHandle) {
+  if (!samplerHandle || !configHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  auto *sampler = const_cast<_GenieSampler_Handle_t *>(samplerHandle);
+  const auto &config = configHandle->config.value("sampler", nlohmann::json::object());
+  if (config.value("type", "basic") != "custom") {
+    *sampler = _GenieSampler_Handle_t();
+    return GENIE_STATUS_SUCCESS;
+  }
+  std::lock_guard<std::mutex> lock(g_samplersMutex);
+  auto it = g_samplers.find(config.value("callback-name", ""));
+  if (it == g_samplers.end()) return GENIE_STATUS_ERROR_INVALID_CONFIG;
+  sampler->callback = it->second.callback;
+  sampler->userData = it->second.userData;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieSampler_registerCallback(const char *name, GenieSampler_ProcessCallback_t samplerCallback) {
+  return name && samplerCallback ? GENIE_STATUS_SUCCESS : GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+}
+
+Genie_Status_t GenieSampler_registerUserDataCallback(const char *name,
+                                                     GenieSampler_UserDataCallback_t samplerCallback,
+                                                     const void *userData) {
+  if (!name || !samplerCallback) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  std::lock_guard<std::mutex> lock(g_samplersMutex);
+  g_samplers[name] = {samplerCallback, userData};
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieTokenizer_encode(const GenieTokenizer_Handle_t tokenizerHandle, const char *inputString,
+                                     const Genie_AllocCallback_t callback, const int32_t **tokenIds,
+                                     uint32_t *numTokenIds) {
+  if (!tokenizerHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  if (!inputString || !callback || !tokenIds || !numTokenIds) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  size_t length = std::strlen(inputString);
+  callback(length * sizeof(int32_t), reinterpret_cast<const char **>(tokenIds));
+  if (length > 0 && !*tokenIds) return GENIE_STATUS_ERROR_MEM_ALLOC;
+  int32_t *ids = const_cast<int32_t *>(*tokenIds);
+  for (size_t i = 0; i < length; ++i) ids[i] = (uint8_t)inputString[i];
+  *numTokenIds = (uint32_t)length;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieTokenizer_decode(const GenieTokenizer_Handle_t tokenizerHandle, const int32_t *tokenIds,
+                                     const uint32_t numTokenIds, const Genie_AllocCallback_t callback,
+                                     const char **outputString) {
+  if (!tokenizerHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  if ((!tokenIds && numTokenIds > 0) || !callback || !outputString) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  std::string text(numTokenIds, '\0');
+  for (uint32_t i = 0; i < numTokenIds; ++i) text[i] = (char)tokenIds[i];
+  return allocCopy(text, callback, outputString);
+}
+
+Genie_Status_t GenieEmbeddingConfig_createFromJson(const char *str, GenieEmbeddingConfig_Handle_t *configHandle) {
+  if (!str || !configHandle) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  nlohmann::json config = nlohmann::json::parse(str, nullptr, false);
+  if (config.is_discarded()) return GENIE_STATUS_ERROR_JSON_FORMAT;
+  if (!config.contains("embedding")) return GENIE_STATUS_ERROR_JSON_SCHEMA;
+  auto *handle = new _GenieEmbeddingConfig_Handle_t();
+  if (config.contains("stub")) {
+    handle->embed_size = config["stub"].value("embed_size", handle->embed_size);
+    handle->embed_rate = config["stub"].value("embed_rate", handle->embed_rate);
+  }
+  if (handle->embed_size == 0) {
+    delete handle;
+    return GENIE_STATUS_ERROR_JSON_VALUE;
+  }
+  *configHandle = handle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieEmbeddingConfig_bindProfiler(const GenieEmbeddingConfig_Handle_t configHandle,
+                                                 const GenieProfile_Handle_t profileHandle) {
+  return configHandle ? GENIE_STATUS_SUCCESS : GENIE_STATUS_ERROR_INVALID_HANDLE;
+}
+
+Genie_Status_t GenieEmbeddingConfig_bindLogger(const GenieEmbeddingConfig_Handle_t configHandle,
+                                               const GenieLog_Handle_t logHandle) {
+  return configHandle ? GENIE_STATUS_SUCCESS : GENIE_STATUS_ERROR_INVALID_HANDLE;
+}
+
+Genie_Status_t GenieEmbeddingConfig_free(const GenieEmbeddingConfig_Handle_t configHandle) {
+  delete configHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieEmbedding_create(const GenieEmbeddingConfig_Handle_t configHandle,
+                                     GenieEmbedding_Handle_t *embeddingHandle) {
+  if (!configHandle || !embeddingHandle) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  auto *embedding = new _GenieEmbedding_Handle_t();
+  embedding->options = *configHandle;
+  *embeddingHandle = embedding;
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieEmbedding_generate(const GenieEmbedding_Handle_t embeddingHandle, const char *queryStr,
+                                       const GenieEmbedding_GenerateCallback_t callback, const void *userData) {
+  if (!embeddingHandle) return GENIE_STATUS_ERROR_INVALID_HANDLE;
+  if (!queryStr || !callback) return GENIE_STATUS_ERROR_INVALID_ARGUMENT;
+  const auto &options = embeddingHandle->options;
+  const uint64_t start = nowUs();
+  // FNV-1a of the input seeds the vector, equal inputs embed equally
+  uint64_t seed = 14695981039346656037ull;
+  for (const char *c = queryStr; *c; ++c) seed = (seed ^ (uint8_t)*c) * 1099511628211ull;
+  std::vector<float> vector(options.embed_size);
+  for (uint32_t i = 0; i < options.embed_size; ++i) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    vector[i] = (float)((int32_t)(seed >> 32)) / 2147483648.0f;
+  }
+  if (options.embed_rate > 0) sleepUntil(start + (uint64_t)(1e6 / options.embed_rate));
+  const uint32_t dimensions[2] = {1, options.embed_size};
+  callback(dimensions, 2, vector.data(), userData);
+  return GENIE_STATUS_SUCCESS;
+}
+
+Genie_Status_t GenieEmbedding_free(const GenieEmbedding_Handle_t embeddingHandle) {
+  delete embeddingHandle;
+  return GENIE_STATUS_SUCCESS;
+}
+
+}  // extern "C"
@@ -0,0 +1,32 @@
+// Stub of the Genie API for host builds, declares only what the bindings use.
+// Device builds use the headers of the QNN SDK.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+typedef int32_t Genie_Status_t;
+#define GENIE_STATUS_SUCCESS 0
+#define GENIE_STATUS_WARNING_ABORTED 1
+#define GENIE_STATUS_ERROR_GENERAL -1
+#define GENIE_STATUS_ERROR_INVALID_ARGUMENT -2
+#define GENIE_STATUS_ERROR_MEM_ALLOC -3
+#define GENIE_STATUS_ERROR_INVALID_CONFIG -4
+#define GENIE_STATUS_ERROR_INVALID_HANDLE -5
+#define GENIE_STATUS_ERROR_QUERY_FAILED -6
+#define GENIE_STATUS_ERROR_JSON_FORMAT -7
+#define GENIE_STATUS_ERROR_JSON_SCHEMA -8
+#define GENIE_STATUS_ERROR_JSON_VALUE -9
+#define GENIE_STATUS_ERROR_GENERATE_FAILED -10
+#define GENIE_STATUS_ERROR_GET_HANDLE_FAILED -11
+#define GENIE_STATUS_ERROR_APPLY_CONFIG_FAILED -12
+#define GENIE_STATUS_ERROR_SET_PARAMS_FAILED -13
+#define GENIE_STATUS_ERROR_BOUND_HANDLE -14
+typedef void (*Genie_AllocCallback_t)(const size_t size, const char** allocatedData);
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t Genie_getApiMajorVersion(void);
+uint32_t Genie_getApiMinorVersion(void);
+uint32_t Genie_getApiPatchVersion(void);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,48 @@
+// Stub of the Genie API for host builds, declares only what the bindings use.
+// Device builds use the headers of the QNN SDK.
+#pragma once
+#include "GenieCommon.h"
+#include "GenieLog.h"
+#include "GenieProfile.h"
+#include "GenieSampler.h"
+#include "GenieTokenizer.h"
+typedef const struct _GenieDialogConfig_Handle_t* GenieDialogConfig_Handle_t;
+typedef const struct _GenieDialog_Handle_t* GenieDialog_Handle_t;
+typedef enum {
+  GENIE_DIALOG_SENTENCE_COMPLETE = 0,
+  GENIE_DIALOG_SENTENCE_BEGIN = 1,
+  GENIE_DIALOG_SENTENCE_CONTINUE = 2,
+  GENIE_DIALOG_SENTENCE_END = 3,
+  GENIE_DIALOG_SENTENCE_ABORT = 4,
+  GENIE_DIALOG_SENTENCE_REWIND = 5,
+  GENIE_DIALOG_SENTENCE_RESUME = 6,
+} GenieDialog_SentenceCode_t;
+typedef enum {
+  GENIE_DIALOG_ACTION_ABORT = 1,
+  GENIE_DIALOG_ACTION_PAUSE = 2,
+} GenieDialog_Action_t;
+typedef void (*GenieDialog_QueryCallback_t)(const char* response, const GenieDialog_SentenceCode_t sentenceCode, const void* userData);
+typedef void (*GenieDialog_TokenQueryCallback_t)(const uint32_t* response, const uint32_t numTokens, const GenieDialog_SentenceCode_t sentenceCode, const void* userData);
+#ifdef __cplusplus
+extern "C" {
+#endif
+Genie_Status_t GenieDialogConfig_createFromJson(const char* str, GenieDialogConfig_Handle_t* configHandle);
+Genie_Status_t GenieDialogConfig_bindProfiler(const GenieDialogConfig_Handle_t configHandle, const GenieProfile_Handle_t profileHandle);
+Genie_Status_t GenieDialogConfig_bindLogger(const GenieDialogConfig_Handle_t configHandle, const GenieLog_Handle_t logHandle);
+Genie_Status_t GenieDialogConfig_free(const GenieDialogConfig_Handle_t configHandle);
+Genie_Status_t GenieDialog_create(const GenieDialogConfig_Handle_t configHandle, GenieDialog_Handle_t* dialogHandle);
+Genie_Status_t GenieDialog_query(const GenieDialog_Handle_t dialogHandle, const char* queryStr, const GenieDialog_SentenceCode_t sentenceCode, const GenieDialog_QueryCallback_t callback, const void* userData);
+Genie_Status_t GenieDialog_tokenQuery(const GenieDialog_Handle_t dialogHandle, const uint32_t* inputTokens, const uint32_t numTokens, const GenieDialog_SentenceCode_t sentenceCode, const GenieDialog_TokenQueryCallback_t callback, const void* userData);
+Genie_Status_t GenieDialog_save(const GenieDialog_Handle_t dialogHandle, const char* path);
+Genie_Status_t GenieDialog_restore(const GenieDialog_Handle_t dialogHandle, const char* path);
+Genie_Status_t GenieDialog_reset(const GenieDialog_Handle_t dialogHandle);
+Genie_Status_t GenieDialog_applyLora(const GenieDialog_Handle_t dialogHandle, const char* engine, const char* loraAdapterName);
+Genie_Status_t GenieDialog_setLoraStrength(const GenieDialog_Handle_t dialogHandle, const char* engine, const char* tensorName, const float alpha);
+Genie_Status_t GenieDialog_getSampler(const GenieDialog_Handle_t dialogHandle, GenieSampler_Handle_t* dialogSamplerHandle);
+Genie_Status_t GenieDialog_getTokenizer(const GenieDialog_Handle_t dialogHandle, GenieTokenizer_Handle_t* tokenizerHandle);
+Genie_Status_t GenieDialog_setStopSequence(const GenieDialog_Handle_t dialogHandle, const char* newStopSequences);
+Genie_Status_t GenieDialog_signal(const GenieDialog_Handle_t dialogHandle, const GenieDialog_Action_t action);
+Genie_Status_t GenieDialog_free(const GenieDialog_Handle_t dialogHandle);
+#ifdef __cplusplus
+}
+#endif
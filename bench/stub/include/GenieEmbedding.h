@@ -0,0 +1,22 @@
+// Stub of the Genie API for host builds, declares only what the bindings use.
+// Device builds use the headers of the QNN SDK.
+#pragma once
+#include "GenieCommon.h"
+#include "GenieLog.h"
+#include "GenieProfile.h"
+typedef const struct _GenieEmbeddingConfig_Handle_t* GenieEmbeddingConfig_Handle_t;
+typedef const struct _GenieEmbedding_Handle_t* GenieEmbedding_Handle_t;
+typedef void (*GenieEmbedding_GenerateCallback_t)(const uint32_t* dimensions, const uint32_t rank, const float* embeddingBuffer, const void* userData);
+#ifdef __cplusplus
+extern "C" {
+#endif
+Genie_Status_t GenieEmbeddingConfig_createFromJson(const char* str, GenieEmbeddingConfig_Handle_t* configHandle);
+Genie_Status_t GenieEmbeddingConfig_bindProfiler(const GenieEmbeddingConfig_Handle_t configHandle, const GenieProfile_Handle_t profileHandle);
+Genie_Status_t GenieEmbeddingConfig_bindLogger(const GenieEmbeddingConfig_Handle_t configHandle, const GenieLog_Handle_t logHandle);
+Genie_Status_t GenieEmbeddingConfig_free(const GenieEmbeddingConfig_Handle_t configHandle);
+Genie_Status_t GenieEmbedding_create(const GenieEmbeddingConfig_Handle_t configHandle, GenieEmbedding_Handle_t* embeddingHandle);
+Genie_Status_t GenieEmbedding_generate(const GenieEmbedding_Handle_t embeddingHandle, const char* queryStr, const GenieEmbedding_GenerateCallback_t callback, const void* userData);
+Genie_Status_t GenieEmbedding_free(const GenieEmbedding_Handle_t embeddingHandle);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,22 @@
+// Stub of the Genie API for host builds, declares only what the bindings use.
+// Device builds use the headers of the QNN SDK.
+#pragma once
+#include "GenieCommon.h"
+#include <stdarg.h>
+typedef const struct _GenieLogConfig_Handle_t* GenieLogConfig_Handle_t;
+typedef const struct _GenieLog_Handle_t* GenieLog_Handle_t;
+typedef enum {
+  GENIE_LOG_LEVEL_ERROR = 1,
+  GENIE_LOG_LEVEL_WARN = 2,
+  GENIE_LOG_LEVEL_INFO = 3,
+  GENIE_LOG_LEVEL_VERBOSE = 4,
+} GenieLog_Level_t;
+typedef void (*GenieLog_Callback_t)(const GenieLog_Handle_t handle, const char* fmt, GenieLog_Level_t level, uint64_t timestamp, va_list args);
+#ifdef __cplusplus
+extern "C" {
+#endif
+Genie_Status_t GenieLog_create(const GenieLogConfig_Handle_t configHandle, const GenieLog_Callback_t callback, const GenieLog_Level_t maxLogLevel, GenieLog_Handle_t* logHandle);
+Genie_Status_t GenieLog_free(const GenieLog_Handle_t logHandle);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,15 @@
+// Stub of the Genie API for host builds, declares only what the bindings use.
+// Device builds use the headers of the QNN SDK.
+#pragma once
+#include "GenieCommon.h"
+typedef const struct _GenieProfileConfig_Handle_t* GenieProfileConfig_Handle_t;
+typedef const struct _GenieProfile_Handle_t* GenieProfile_Handle_t;
+#ifdef __cplusplus
+extern "C" {
+#endif
+Genie_Status_t GenieProfile_create(const GenieProfileConfig_Handle_t configHandle, GenieProfile_Handle_t* profileHandle);
+Genie_Status_t GenieProfile_getJsonData(const GenieProfile_Handle_t profileHandle, const Genie_AllocCallback_t callback, const char** jsonData);
+Genie_Status_t GenieProfile_free(const GenieProfile_Handle_t profileHandle);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,20 @@
+// Stub of the Genie API for host builds, declares only what the bindings use.
+// Device builds use the headers of the QNN SDK.
+#pragma once
+#include "GenieCommon.h"
+typedef const struct _GenieSamplerConfig_Handle_t* GenieSamplerConfig_Handle_t;
+typedef const struct _GenieSampler_Handle_t* GenieSampler_Handle_t;
+typedef void (*GenieSampler_ProcessCallback_t)(const uint32_t logitsSize, const void* logits, const uint32_t numTokens, int32_t* tokens);
+typedef void (*GenieSampler_UserDataCallback_t)(const uint32_t logitsSize, const void* logits, const uint32_t numTokens, int32_t* tokens, const void* userData);
+#ifdef __cplusplus
+extern "C" {
+#endif
+Genie_Status_t GenieSamplerConfig_createFromJson(const char* str, GenieSamplerConfig_Handle_t* configHandle);
+Genie_Status_t GenieSamplerConfig_setParam(const GenieSamplerConfig_Handle_t configHandle, const char* keyStr, const char* valueStr);
+Genie_Status_t GenieSamplerConfig_free(const GenieSamplerConfig_Handle_t configHandle);
+Genie_Status_t GenieSampler_applyConfig(const GenieSampler_Handle_t samplerHandle, const GenieSamplerConfig_Handle_t configHandle);
+Genie_Status_t GenieSampler_registerCallback(const char* name, GenieSampler_ProcessCallback_t samplerCallback);
+Genie_Status_t GenieSampler_registerUserDataCallback(const char* name, GenieSampler_UserDataCallback_t samplerCallback, const void* userData);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,13 @@
+// Stub of the Genie API for host builds, declares only what the bindings use.
+// Device builds use the headers of the QNN SDK.
+#pragma once
+#include "GenieCommon.h"
+typedef const struct _GenieTokenizer_Handle_t* GenieTokenizer_Handle_t;
+#ifdef __cplusplus
+extern "C" {
+#endif
+Genie_Status_t GenieTokenizer_encode(const GenieTokenizer_Handle_t tokenizerHandle, const char* inputString, const Genie_AllocCallback_t callback, const int32_t** tokenIds, uint32_t* numTokenIds);
+Genie_Status_t GenieTokenizer_decode(const GenieTokenizer_Handle_t tokenizerHandle, const int32_t* tokenIds, const uint32_t numTokenIds, const Genie_AllocCallback_t callback, const char** outputString);
+#ifdef __cplusplus
+}
+#endif
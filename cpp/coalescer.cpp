@@ -0,0 +1,118 @@
+#include "coalescer.h"
+#include "watchdog.h"
+#include <chrono>
+
+namespace qnnllm {
+
+// The sink may wait for its consumer, e.g. on a full token ring
+static const TaskHints EXPIRY_HINTS{Priority::High, CoreHint::Any, true};
+
+ResponseCoalescer::ResponseCoalescer(const CoalesceOptions &options, Sink sink)
+    : options_(options), sink_(std::move(sink)), expiries_(Executor::shared(), EXPIRY_HINTS) {}
+
+ResponseCoalescer::~ResponseCoalescer() {
+  uint64_t alarms[2];
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing_ = true;
+    alarms[0] = alarm_;
+    alarms[1] = prev_alarm_;
+  }
+  // Waits for a running callback, it captured this
+  for (uint64_t alarm : alarms) {
+    if (alarm != 0) Watchdog::shared().disarm(alarm);
+  }
+  // No alarm is left to queue another task, the queued ones return on closing_
+  expiries_.wait();
+}
+
+uint64_t ResponseCoalescer::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ResponseCoalescer::push(const char *response, const GenieDialog_SentenceCode_t sentenceCode) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t time = now();
+  if (sentenceCode != GENIE_DIALOG_SENTENCE_CONTINUE &&
+      sentenceCode != GENIE_DIALOG_SENTENCE_END &&
+      sentenceCode != GENIE_DIALOG_SENTENCE_COMPLETE &&
+      sentenceCode != GENIE_DIALOG_SENTENCE_ABORT) {
+    // BEGIN and control codes start a new sentence, keep them apart from pending text
+    flushLocked();
+  }
+  if (fragments_ == 0) {
+    first_ns_ = time;
+  }
+  if (response) {
+    pending_ += response;
+  }
+  last_ns_ = time;
+  ++fragments_;
+  if (sentenceCode != GENIE_DIALOG_SENTENCE_CONTINUE) {
+    deliver(sentenceCode, time);
+    return;
+  }
+  bool full = options_.max_fragments > 0 && fragments_ >= options_.max_fragments;
+  bool expired = options_.interval_ms > 0 &&
+                 time - first_ns_ >= (uint64_t)options_.interval_ms * 1000000;
+  if (full || expired) {
+    deliver(sentenceCode, time);
+  } else if (options_.interval_ms > 0 && alarm_ == 0 && !flush_queued_) {
+    // Decoding may stall before the next fragment, e.g. on a slow step
+    alarm_ = Watchdog::shared().arm(first_ns_ + (uint64_t)options_.interval_ms * 1000000, [this] { expire(); });
+  }
+}
+
+void ResponseCoalescer::flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  flushLocked();
+}
+
+void ResponseCoalescer::flushLocked() {
+  if (fragments_ > 0) {
+    deliver(GENIE_DIALOG_SENTENCE_CONTINUE, now());
+  }
+}
+
+// Watchdog callback. The alarm may belong to a batch already delivered, then it
+// is moved to the deadline of the pending one. The sink may block, so an expired
+// batch is left to an executor task rather than delivered on the watchdog thread.
+void ResponseCoalescer::expire() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  prev_alarm_ = alarm_;
+  alarm_ = 0;
+  if (closing_ || fragments_ == 0) return;
+  const uint64_t deadline = first_ns_ + (uint64_t)options_.interval_ms * 1000000;
+  if (now() >= deadline) {
+    flush_queued_ = true;
+    expiries_.submit([this] { flushExpired(); });
+  } else {
+    alarm_ = Watchdog::shared().arm(deadline, [this] { expire(); });
+  }
+}
+
+// Expiry task. push() may have delivered the batch meanwhile and started a new
+// one, which gets an alarm of its own.
+void ResponseCoalescer::flushExpired() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  flush_queued_ = false;
+  if (closing_ || fragments_ == 0) return;
+  const uint64_t deadline = first_ns_ + (uint64_t)options_.interval_ms * 1000000;
+  const uint64_t time = now();
+  if (time >= deadline) {
+    deliver(GENIE_DIALOG_SENTENCE_CONTINUE, time);
+  } else if (alarm_ == 0) {
+    alarm_ = Watchdog::shared().arm(deadline, [this] { expire(); });
+  }
+}
+
+void ResponseCoalescer::deliver(const GenieDialog_SentenceCode_t sentenceCode, uint64_t time) {
+  ResponseBatch batch{fragments_, first_ns_, last_ns_, time};
+  std::string response;
+  response.swap(pending_);
+  fragments_ = 0;
+  sink_(response, sentenceCode, batch);
+}
+
+}  // namespace qnnllm
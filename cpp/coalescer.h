@@ -0,0 +1,73 @@
+#pragma once
+
+#include "GenieDialog.h"
+#include "executor.h"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace qnnllm {
+
+struct CoalesceOptions {
+  uint32_t interval_ms = 0;    // Flush once the oldest pending fragment is this old, 0 disables.
+                               // Kept by a watchdog alarm while decoding stalls.
+  uint32_t max_fragments = 1;  // Flush once this many fragments are pending, 0 disables
+};
+
+struct ResponseBatch {
+  uint32_t fragments;  // Genie fragments merged into this batch
+  uint64_t first_ns;   // Monotonic time the first fragment arrived
+  uint64_t last_ns;    // Monotonic time the last fragment arrived
+  uint64_t flush_ns;   // Monotonic time the batch was handed to the sink
+};
+
+// -----------------------------------------------------------------------------
+// Merges consecutive CONTINUE fragments into batches bounded by time and count.
+// BEGIN, END, COMPLETE and ABORT are never held back, so the sink still sees the
+// sentence boundaries Genie reported. With an interval, a batch that outlives it
+// is flushed by an executor task the watchdog alarm hands it to, so a sink that
+// blocks never holds up the other alarms. The sink is never called concurrently.
+// -----------------------------------------------------------------------------
+class ResponseCoalescer {
+public:
+  typedef std::function<void(const std::string &response,
+                             const GenieDialog_SentenceCode_t sentenceCode,
+                             const ResponseBatch &batch)> Sink;
+
+  ResponseCoalescer(const CoalesceOptions &options, Sink sink);
+  ~ResponseCoalescer();
+
+  ResponseCoalescer(const ResponseCoalescer &) = delete;
+  ResponseCoalescer &operator=(const ResponseCoalescer &) = delete;
+
+  void push(const char *response, const GenieDialog_SentenceCode_t sentenceCode);
+
+  /**
+   * Deliver pending fragments, if any, as a CONTINUE batch.
+   */
+  void flush();
+
+  static uint64_t now();
+
+private:
+  void deliver(const GenieDialog_SentenceCode_t sentenceCode, uint64_t time);
+  void flushLocked();
+  void expire();
+  void flushExpired();
+
+  CoalesceOptions options_;
+  Sink sink_;
+  std::string pending_;
+  uint32_t fragments_ = 0;
+  uint64_t first_ns_ = 0;
+  uint64_t last_ns_ = 0;
+  std::mutex mutex_;           // Guards the batch, push() and the expiry task both deliver it
+  uint64_t alarm_ = 0;         // Pending alarm, at most one at a time
+  uint64_t prev_alarm_ = 0;    // Alarm whose callback may still be returning
+  bool flush_queued_ = false;  // Expiry task submitted and not yet run
+  bool closing_ = false;
+  TaskGroup expiries_;
+};
+
+}  // namespace qnnllm
@@ -1,5 +1,12 @@
 #include "context.h"
 #include "log.h"
+#include "trace.h"
+#include "watchdog.h"
+#include <algorithm>
+#include <filesystem>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
 
 namespace qnnllm {
 
@@ -45,45 +52,110 @@ const char *genie_status_to_string(int status) {
 void alloc_json_data(size_t size, const char **data) { *data = (char *)malloc(size); }
 
 void logStdoutCallback(GenieLog_Handle_t handle, const char* fmt, GenieLog_Level_t level, uint64_t timestamp, va_list argp) {
-  char buffer[1024];
-  vsnprintf(buffer, sizeof(buffer), fmt, argp);
-  switch (level) {
-    case GENIE_LOG_LEVEL_ERROR: LOGE("%s", buffer); break;
-    case GENIE_LOG_LEVEL_WARN: LOGW("%s", buffer); break;
-    case GENIE_LOG_LEVEL_INFO: LOGI("%s", buffer); break;
-    case GENIE_LOG_LEVEL_VERBOSE: LOGD("%s", buffer); break;
+  // Runs on Genie's threads, formatting and output happen on the log drainer
+  log::vwrite(level, fmt, argp);
+}
+
+// Upper bound on the tokens a speculative dialog accepts per step on top of the one it decodes
+static uint32_t draftLength(const char *config_str) {
+  auto config = nlohmann::json::parse(config_str, nullptr, false);
+  if (config.is_discarded() || !config.contains("dialog")) return 0;
+  const auto &dialog = config["dialog"];
+  const std::string type = dialog.value("type", "basic");
+  if (!dialog.contains(type) || !dialog[type].is_object()) return 0;
+  const auto &mode = dialog[type];
+  if (type == "spd") return mode.value("draft-len", 0u);
+  if (type == "ssd-q1") return mode.value("forecast-token-count", 0u);
+  if (type == "lade") return std::max(mode.value("ngram", 1u), 1u) - 1;
+  return 0;
+}
+
+static std::vector<int32_t> tokenList(const nlohmann::json &value) {
+  std::vector<int32_t> tokens;
+  if (value.is_number_integer()) tokens.push_back(value.get<int32_t>());
+  if (value.is_array()) {
+    for (const auto &token : value) {
+      if (token.is_number_integer()) tokens.push_back(token.get<int32_t>());
+    }
   }
+  return tokens;
+}
+
+// Vocabulary size and special tokens from dialog.context, the sampler config from dialog.sampler
+static void readDialogContext(const char *config_str, uint32_t *n_vocab, int32_t *eos_token,
+                              std::vector<int32_t> *special_tokens, std::string *sampler_config) {
+  auto config = nlohmann::json::parse(config_str, nullptr, false);
+  if (config.is_discarded() || !config.contains("dialog")) return;
+  const auto &dialog = config["dialog"];
+  if (dialog.contains("sampler") && dialog["sampler"].is_object()) {
+    *sampler_config = nlohmann::json{{"sampler", dialog["sampler"]}}.dump();
+  }
+  if (!dialog.contains("context") || !dialog["context"].is_object()) return;
+  const auto &context = dialog["context"];
+  *n_vocab = context.value("n-vocab", 0u);
+  std::vector<int32_t> eos = tokenList(context.value("eos-token", nlohmann::json()));
+  if (!eos.empty()) *eos_token = eos[0];
+  *special_tokens = tokenList(context.value("bos-token", nlohmann::json()));
+  special_tokens->insert(special_tokens->end(), eos.begin(), eos.end());
 }
 
 Context::Context(const char *config_str) {
+  QNN_TRACE_SCOPE("Context::Context");
   Genie_Status_t status;
   GenieLog_create((GenieLogConfig_Handle_t)NULL, logStdoutCallback, QNN_LOG_LEVEL, &logHandle);
   status = GenieProfile_create(NULL, &profileHandle);
   if (status != GENIE_STATUS_SUCCESS) {
     throw std::runtime_error(genie_status_to_string(status));
   }
-  status = GenieDialogConfig_createFromJson(config_str, &configHandle);
+  {
+    QNN_TRACE_SCOPE("GenieDialogConfig_createFromJson");
+    status = GenieDialogConfig_createFromJson(config_str, &configHandle);
+  }
   if (status != GENIE_STATUS_SUCCESS) {
     GenieProfile_free(profileHandle);
     throw std::runtime_error(genie_status_to_string(status));
   }
   status = GenieDialogConfig_bindProfiler(configHandle, profileHandle);
+  if (status == GENIE_STATUS_SUCCESS && logHandle != NULL) {
+    status = GenieDialogConfig_bindLogger(configHandle, logHandle);
+  }
   if (status != GENIE_STATUS_SUCCESS) {
     GenieDialogConfig_free(configHandle);
     GenieProfile_free(profileHandle);
     throw std::runtime_error(genie_status_to_string(status));
   }
-  status = GenieDialog_create(configHandle, &handle);
+  {
+    QNN_TRACE_SCOPE("GenieDialog_create");
+    status = GenieDialog_create(configHandle, &handle);
+  }
   if (status != GENIE_STATUS_SUCCESS) {
     GenieDialogConfig_free(configHandle);
     GenieProfile_free(profileHandle);
     throw std::runtime_error(genie_status_to_string(status));
   }
-  busy = false;
+  GenieTokenizer_Handle_t tokenizerHandle = NULL;
+  if (GenieDialog_getTokenizer(handle, &tokenizerHandle) == GENIE_STATUS_SUCCESS && tokenizerHandle != NULL) {
+    tokenizer.reset(new Tokenizer(tokenizerHandle));
+    decoder.reset(new TokenDecoder(*tokenizer));
+  } else {
+    LOGW("Tokenizer unavailable, prompts are matched against the history as text");
+  }
+  draft_tokens = draftLength(config_str);
+  sampler_config = "{\"sampler\":{\"version\":1}}";
+  readDialogContext(config_str, &n_vocab, &eos_token, &special_tokens, &sampler_config);
+  loaded_sampler_config = sampler_config;
+  lora.reset(new LoraAdapters(config_str));
+  model_fingerprint = SnapshotStore::modelFingerprint(config_str);
+  snapshots.reset(new SnapshotStore(model_fingerprint));
   last_context_data = "";
 }
 
 Context::~Context() {
+  scheduler.cancelPending();
+  if (scheduler.running() && handle != NULL) {
+    GenieDialog_signal(handle, GENIE_DIALOG_ACTION_ABORT);
+  }
+  scheduler.shutdown();
   if (callback != nullptr) {
     callback = nullptr;
   }
@@ -119,120 +191,548 @@ std::string Context::version() {
 }
 
 void Context::setStopWords(const char *stop_words) {
-  Genie_Status_t status = GenieDialog_setStopSequence(handle, stop_words);
-  if (status != GENIE_STATUS_SUCCESS) {
-    throw std::runtime_error(genie_status_to_string(status));
-  }
+  scheduler.run(Priority::Normal, [&] {
+    Genie_Status_t status = GenieDialog_setStopSequence(handle, stop_words);
+    if (status != GENIE_STATUS_SUCCESS) {
+      throw std::runtime_error(genie_status_to_string(status));
+    }
+  });
 }
 
 void Context::applySamplerConfig(const char *config_str) {
   if (handle == NULL) {
     throw std::runtime_error("Context handle is NULL");
   }
+  scheduler.run(Priority::Normal, [&] {
+    applySampler(config_str);
+    sampler_config = config_str;
+    std::atomic_store(&sampler, std::shared_ptr<ConstrainedSampler>());
+  });
+}
+
+void Context::applySampler(const std::string &config_str) {
   GenieSampler_Handle_t samplerHandle = NULL;
   Genie_Status_t status = GenieDialog_getSampler(handle, &samplerHandle);
   if (status != GENIE_STATUS_SUCCESS) {
     throw std::runtime_error(genie_status_to_string(status));
   }
   GenieSamplerConfig_Handle_t configHandle = NULL;
-  status = GenieSamplerConfig_createFromJson(config_str, &configHandle);
+  status = GenieSamplerConfig_createFromJson(config_str.c_str(), &configHandle);
   if (status != GENIE_STATUS_SUCCESS) {
     throw std::runtime_error(genie_status_to_string(status));
   }
   status = GenieSampler_applyConfig(samplerHandle, configHandle);
+  GenieSamplerConfig_free(configHandle);
   if (status != GENIE_STATUS_SUCCESS) {
     throw std::runtime_error(genie_status_to_string(status));
   }
 }
-  
-void Context::saveSession(const char *filename) {
+
+void Context::setGrammar(const std::string &grammar_json, Priority priority) {
   if (handle == NULL) {
     throw std::runtime_error("Context handle is NULL");
   }
-  Genie_Status_t status = GenieDialog_save(handle, filename);
-  if (status != GENIE_STATUS_SUCCESS) {
-    throw std::runtime_error(genie_status_to_string(status));
+  scheduler.run(priority, [&] {
+    if (grammar_json.empty()) {
+      if (!sampler) return;
+      applySampler(sampler_config);
+      std::atomic_store(&sampler, std::shared_ptr<ConstrainedSampler>());
+      return;
+    }
+    if (!tokenizer || n_vocab == 0 || eos_token < 0) {
+      throw std::runtime_error("A grammar needs the tokenizer, and n-vocab and eos-token in dialog.context");
+    }
+    if (draft_tokens > 0) {
+      // Drafted tokens are verified against Genie's own sampling, bypassing the grammar
+      throw std::runtime_error("A grammar needs a basic dialog");
+    }
+    JsonGrammarOptions grammar;
+    SamplingParams params;
+    ConstrainedSampler::parseConfig(grammar_json, &grammar, &params);
+    auto next = std::make_shared<ConstrainedSampler>(vocabTexts(), eos_token, grammar, params);
+    if (sampler_name.empty()) {
+      char name[32];
+      snprintf(name, sizeof(name), "qnnllm-%p", (void *)this);
+      Genie_Status_t status = GenieSampler_registerUserDataCallback(name, on_sample, this);
+      if (status != GENIE_STATUS_SUCCESS) {
+        throw std::runtime_error(genie_status_to_string(status));
+      }
+      sampler_name = name;
+    }
+    const bool active = sampler != nullptr;
+    std::atomic_store(&sampler, next);
+    if (active) return;
+    try {
+      applySampler(nlohmann::json{
+        {"sampler", {{"version", 1}, {"type", "custom"}, {"callback-name", sampler_name}}}}.dump());
+    } catch (...) {
+      std::atomic_store(&sampler, std::shared_ptr<ConstrainedSampler>());
+      throw;
+    }
+  });
+}
+
+SamplerStats Context::samplerStats() const {
+  auto current = std::atomic_load(&sampler);
+  if (!current) return {};
+  return current->stats();
+}
+
+const std::vector<std::string> &Context::vocabTexts() {
+  if (vocab_texts.size() == n_vocab) return vocab_texts;
+  // Decoders may drop the leading space of a lone token, decode each one after an anchor instead
+  const std::vector<int32_t> anchor = tokenizer->encode("{");
+  const std::string anchorText = anchor.empty() ? std::string() : tokenizer->decode({anchor.back()});
+  std::vector<int32_t> pair = {anchor.empty() ? 0 : anchor.back(), 0};
+  vocab_texts.resize(n_vocab);
+  for (uint32_t token = 0; token < n_vocab; ++token) {
+    pair[1] = (int32_t)token;
+    std::string text = anchor.empty() ? std::string() : tokenizer->decode(pair);
+    if (!anchorText.empty() && text.compare(0, anchorText.size(), anchorText) == 0) {
+      vocab_texts[token] = text.substr(anchorText.size());
+    } else {
+      vocab_texts[token] = tokenizer->decode({(int32_t)token});
+    }
   }
+  for (int32_t token : special_tokens) {
+    if (token >= 0 && (uint32_t)token < n_vocab) vocab_texts[token].clear();
+  }
+  return vocab_texts;
 }
 
-void Context::restoreSession(const char *filename) {
+void Context::saveSession(const char *filename, Priority priority, const SnapshotOptions &options) {
   if (handle == NULL) {
     throw std::runtime_error("Context handle is NULL");
   }
-  Genie_Status_t status = GenieDialog_restore(handle, filename);
-  if (status != GENIE_STATUS_SUCCESS) {
-    throw std::runtime_error(genie_status_to_string(status));
+  scheduler.run(priority, [&] {
+    snapshots->save(filename, [this](const std::string &dir) {
+      Genie_Status_t status = GenieDialog_save(handle, dir.c_str());
+      if (status != GENIE_STATUS_SUCCESS) {
+        throw std::runtime_error(genie_status_to_string(status));
+      }
+    }, options);
+  });
+}
+
+void Context::restoreSession(const char *filename, Priority priority) {
+  if (handle == NULL) {
+    throw std::runtime_error("Context handle is NULL");
   }
+  scheduler.run(priority, [&] {
+    snapshots->restore(filename, [this](const std::string &dir) {
+      Genie_Status_t status = GenieDialog_restore(handle, dir.c_str());
+      if (status != GENIE_STATUS_SUCCESS) {
+        throw std::runtime_error(genie_status_to_string(status));
+      }
+    });
+    // The restored state no longer matches last_context_data, keep it out of the cache
+    context_tracked = false;
+    history.untrack();
+    prefill_open = false;
+  });
+}
+
+SnapshotStats Context::snapshotStats() const {
+  return snapshots->stats();
+}
+
+PrefillProgress Context::process(std::string prompt, Priority priority, const PrefillOptions &options,
+                                 PrefillCallback progress) {
+  QNN_TRACE_SCOPE("Context::process");
+  PrefillProgress result{};
+  // Counted at the call, an abort() while queued cancels too
+  const uint64_t aborted = aborts.load();
+  scheduler.run(priority, [&] {
+    if (aborts.load() != aborted) {
+      result.cancelled = true;
+      return;
+    }
+    result = tokenizer ? runPrefill(prompt, options, progress, aborted) : runProcess(prompt);
+  });
+  return result;
 }
 
-void Context::process(std::string prompt) {
-  if (busy) {
-    throw std::runtime_error("Context is busy");
+// Without a tokenizer the prompt is queried as a whole and aborted on the first token
+PrefillProgress Context::runProcess(const std::string &prompt) {
+  QNN_TRACE_SCOPE("Context::runProcess");
+  const uint64_t start = QueryTimer::now();
+  prefill_discarded = 0;
+  Genie_Status_t status = dispatch(prompt, process_callback, process_tokens_callback);
+  if (status != GENIE_STATUS_SUCCESS && status != GENIE_STATUS_WARNING_ABORTED) {
+    throw std::runtime_error(genie_status_to_string(status));
   }
-  std::string query = prompt;
+  last_context_data = prompt;
+  context_tracked = true;
+  PrefillProgress progress{};
+  progress.chunks = 1;
+  progress.discarded_steps = prefill_discarded;
+  progress.elapsed_ms = (QueryTimer::now() - start) / 1e6;
+  progress.finished = true;
+  return progress;
+}
+
+PrefillProgress Context::runPrefill(const std::string &prompt, const PrefillOptions &options,
+                                    const PrefillCallback &onProgress, uint64_t aborted) {
+  QNN_TRACE_SCOPE("Context::runPrefill");
+  const uint64_t start = QueryTimer::now();
+  switchTokens(prompt);
+  TokenPlan plan = history.plan(prompt, last_context_data, *tokenizer);
+  PrefillProgress progress{};
+  progress.total_tokens = (uint32_t)plan.tokens.size();
+  progress.reused_tokens = (uint32_t)plan.reused;
+  const size_t chunk = std::max<uint32_t>(1, options.chunk_tokens);
+  // Genie only has logits for the last token it was fed, so that one is left to the query
+  const size_t end = plan.tokens.empty() ? 0 : plan.tokens.size() - 1;
+  if (plan.reused >= end) {
+    progress.finished = true;
+    progress.elapsed_ms = (QueryTimer::now() - start) / 1e6;
+    return progress;
+  }
+  size_t pos = plan.reused;
+  prefill_discarded = 0;
+
   Genie_Status_t status;
-  GenieDialog_SentenceCode_t sentenceCode = GENIE_DIALOG_SENTENCE_COMPLETE;
-  if (!last_context_data.empty()) {
+  GenieDialog_SentenceCode_t sentenceCode;
+  if (history.tracked() && plan.reused == history.size()) {
+    sentenceCode = prefill_open ? GENIE_DIALOG_SENTENCE_CONTINUE : GENIE_DIALOG_SENTENCE_BEGIN;
+  } else if (history.tracked() && plan.reused == 0) {
+    status = GenieDialog_reset(handle);
+    if (status != GENIE_STATUS_SUCCESS) {
+      history.untrack();
+      throw std::runtime_error(genie_status_to_string(status));
+    }
+    prefill_open = false;
+    sentenceCode = GENIE_DIALOG_SENTENCE_BEGIN;
+  } else {
+    // The first chunk rewinds to the common prefix. Genie has no rewind without a
+    // query and decodes one step after it, which is aborted and counted in
+    // discarded_steps. Resetting instead would prefill the common prefix again.
     sentenceCode = GENIE_DIALOG_SENTENCE_REWIND;
   }
-  busy = true;
-  status = GenieDialog_query(handle, query.c_str(), sentenceCode, process_callback, this);
+  if (sentenceCode != GENIE_DIALOG_SENTENCE_REWIND) {
+    history.truncate(plan, pos);
+  }
+
+  while (pos < end) {
+    const size_t count = std::min(chunk, end - pos);
+    QNN_TRACE_SPAN(chunkSpan, "prefill chunk");
+    chunkSpan.arg("tokens", count);
+    if (sentenceCode == GENIE_DIALOG_SENTENCE_REWIND) {
+      status = GenieDialog_tokenQuery(handle, reinterpret_cast<const uint32_t *>(plan.tokens.data()),
+                                      (uint32_t)(pos + count), sentenceCode, process_tokens_callback, this);
+    } else {
+      status = GenieDialog_tokenQuery(handle, reinterpret_cast<const uint32_t *>(plan.tokens.data() + pos),
+                                      (uint32_t)count, sentenceCode, process_tokens_callback, this);
+    }
+    if (status != GENIE_STATUS_SUCCESS && status != GENIE_STATUS_WARNING_ABORTED) {
+      history.untrack();
+      prefill_open = false;
+      throw std::runtime_error(genie_status_to_string(status));
+    }
+    pos += count;
+    if (sentenceCode == GENIE_DIALOG_SENTENCE_REWIND) {
+      history.truncate(plan, pos);
+      sentenceCode = GENIE_DIALOG_SENTENCE_BEGIN;
+    } else {
+      history.append(reinterpret_cast<const uint32_t *>(plan.tokens.data() + pos - count), (uint32_t)count);
+      prefill_open = true;
+      sentenceCode = GENIE_DIALOG_SENTENCE_CONTINUE;
+    }
+    progress.prefilled_tokens += (uint32_t)count;
+    progress.discarded_steps = prefill_discarded;
+    ++progress.chunks;
+    progress.elapsed_ms = (QueryTimer::now() - start) / 1e6;
+    if (onProgress) onProgress(progress);
+    if (pos < end && aborts.load() != aborted) {
+      progress.cancelled = true;
+      break;
+    }
+  }
+
+  last_context_data = prompt;
+  // The KV cache lacks the last prompt token, keep it out of the session cache
+  context_tracked = false;
+  progress.elapsed_ms = (QueryTimer::now() - start) / 1e6;
+  progress.finished = !progress.cancelled;
+  return progress;
+}
+
+Genie_Status_t Context::dispatch(const std::string &input, GenieDialog_QueryCallback_t callback,
+                                 GenieDialog_TokenQueryCallback_t tokenCallback) {
+  if (tokenizer) {
+    return dispatchTokens(input, tokenCallback);
+  }
+  return dispatchText(input, callback);
+}
+
+Genie_Status_t Context::dispatchText(const std::string &input, GenieDialog_QueryCallback_t callback) {
+  std::string query = input;
+  Genie_Status_t status;
+  GenieDialog_SentenceCode_t sentenceCode =
+    last_context_data.empty() ? GENIE_DIALOG_SENTENCE_COMPLETE : GENIE_DIALOG_SENTENCE_REWIND;
+  // An empty dialog, e.g. after a LoRA switch, may still resume a cached conversation
+  if ((last_context_data.empty() || input.compare(0, last_context_data.length(), last_context_data) != 0) &&
+      switchSession(input)) {
+    query = input.substr(last_context_data.length());
+    sentenceCode = GENIE_DIALOG_SENTENCE_COMPLETE;
+  }
+  response_data.clear();
+  timer.dispatched();
+  status = GenieDialog_query(handle, query.c_str(), sentenceCode, callback, this);
   if (status != GENIE_STATUS_SUCCESS && status != GENIE_STATUS_WARNING_ABORTED) {
     // retry normal query
-    if (prompt.find(last_context_data) == 0) {
-      query = prompt.substr(last_context_data.length());
+    if (input.compare(0, last_context_data.length(), last_context_data) == 0) {
+      query = input.substr(last_context_data.length());
     } else {
       status = GenieDialog_reset(handle);
       if (status != GENIE_STATUS_SUCCESS) {
         throw std::runtime_error(genie_status_to_string(status));
       }
+      query = input;
     }
-    status = GenieDialog_query(handle, query.c_str(), sentenceCode, process_callback, this);
+    response_data.clear();
+    timer.dispatched();
+    status = GenieDialog_query(handle, query.c_str(), sentenceCode, callback, this);
   }
-  busy = false;
+  return status;
+}
+
+bool Context::switchTokens(const std::string &input) {
+  if ((!last_context_data.empty() && input.compare(0, last_context_data.length(), last_context_data) == 0) ||
+      !switchSession(input)) {
+    return false;
+  }
+  history.assign(tokenizer->encode(last_context_data), last_context_data.length());
+  prefill_open = false;
+  return true;
+}
+
+Genie_Status_t Context::dispatchTokens(const std::string &input, GenieDialog_TokenQueryCallback_t callback) {
+  switchTokens(input);
+  TokenPlan plan = history.plan(input, last_context_data, *tokenizer);
+  Genie_Status_t status;
+  // Genie rewinds the KV cache to the first token that differs and prefills the rest
+  GenieDialog_SentenceCode_t sentenceCode = GENIE_DIALOG_SENTENCE_REWIND;
+  size_t offset = 0;
+  if (prefill_open && history.tracked() && plan.reused == history.size() && plan.reused < plan.tokens.size()) {
+    // Complete the prompt process() started, only the tokens after it are prefilled
+    sentenceCode = GENIE_DIALOG_SENTENCE_END;
+    offset = plan.reused;
+  } else if (history.tracked() && plan.reused == 0) {
+    if (history.size() > 0) {
+      status = GenieDialog_reset(handle);
+      if (status != GENIE_STATUS_SUCCESS) {
+        history.untrack();
+        throw std::runtime_error(genie_status_to_string(status));
+      }
+    }
+    sentenceCode = GENIE_DIALOG_SENTENCE_COMPLETE;
+  }
+  prompt_tokens = (uint32_t)plan.tokens.size();
+  reused_tokens = (uint32_t)plan.reused;
+  history.begin(plan, input.length());
+  decoder->reset();
+  response_data.clear();
+  timer.dispatched();
+  prefill_open = false;
+  status = GenieDialog_tokenQuery(handle, reinterpret_cast<const uint32_t *>(plan.tokens.data() + offset),
+                                  (uint32_t)(plan.tokens.size() - offset), sentenceCode, callback, this);
   if (status != GENIE_STATUS_SUCCESS && status != GENIE_STATUS_WARNING_ABORTED) {
-    throw std::runtime_error(genie_status_to_string(status));
+    // The KV cache content is unknown, prefill everything from scratch
+    status = GenieDialog_reset(handle);
+    if (status != GENIE_STATUS_SUCCESS) {
+      history.untrack();
+      throw std::runtime_error(genie_status_to_string(status));
+    }
+    plan.reused = 0;
+    reused_tokens = 0;
+    history.begin(plan, input.length());
+    decoder->reset();
+    response_data.clear();
+    timer.dispatched();
+    status = GenieDialog_tokenQuery(handle, reinterpret_cast<const uint32_t *>(plan.tokens.data()),
+                                    (uint32_t)plan.tokens.size(), GENIE_DIALOG_SENTENCE_COMPLETE, callback, this);
+    if (status != GENIE_STATUS_SUCCESS && status != GENIE_STATUS_WARNING_ABORTED) {
+      history.untrack();
+    }
+  }
+  return status;
+}
+
+void Context::snapshotSession() {
+  auto cache = sessionCache;
+  if (!cache || !context_tracked || last_context_data.empty() || cache->contains(last_context_data)) return;
+  std::string path = cache->pathFor(last_context_data);
+  std::error_code ec;
+  fs::create_directories(path, ec);
+  Genie_Status_t status = GenieDialog_save(handle, path.c_str());
+  if (status == GENIE_STATUS_SUCCESS) {
+    cache->insert(last_context_data);
+  } else {
+    LOGW("Failed to snapshot session: %s", genie_status_to_string(status));
+    fs::remove_all(path, ec);
+  }
+}
+
+bool Context::switchSession(const std::string &input) {
+  auto cache = sessionCache;
+  if (!cache) return false;
+  snapshotSession();
+  auto entry = cache->lookup(input);
+  if (entry == nullptr) return false;
+  Genie_Status_t status = GenieDialog_restore(handle, entry->path.c_str());
+  if (status != GENIE_STATUS_SUCCESS) {
+    LOGW("Failed to restore cached session: %s", genie_status_to_string(status));
+    cache->remove(entry);
+    return false;
+  }
+  last_context_data = input.substr(0, entry->length);
+  context_tracked = true;
+  return true;
+}
+
+void Context::on_sample(uint32_t logitsSize, const void *logits, uint32_t numTokens, int32_t *tokens,
+                        const void *userData) {
+  auto self = (Context *)userData;
+  ConstrainedSampler *current = self ? self->sampler.get() : nullptr;
+  if (current == nullptr) {
+    // The grammar was dropped while Genie still had the custom sampler
+    for (uint32_t i = 0; i < numTokens; ++i) tokens[i] = self ? self->eos_token : 0;
+    return;
+  }
+  try {
+    ConstrainedSampler::callback(logitsSize, logits, numTokens, tokens, current);
+  } catch (const std::exception &e) {
+    // Never unwind through Genie
+    LOGE("Failed to sample: %s", e.what());
+    for (uint32_t i = 0; i < numTokens; ++i) tokens[i] = self->eos_token;
   }
-  last_context_data = prompt;
 }
 
 void Context::process_callback(const char *response,
   const GenieDialog_SentenceCode_t sentenceCode,
   const void *userData) {
   Context *self = (Context *)userData;
+  if (response != nullptr && response[0] != '\0') ++self->prefill_discarded;
+  GenieDialog_signal(self->handle, GENIE_DIALOG_ACTION_ABORT);
+}
+
+void Context::process_tokens_callback(const uint32_t * /*tokens*/, const uint32_t numTokens,
+                                      const GenieDialog_SentenceCode_t /*sentenceCode*/, const void *userData) {
+  Context *self = (Context *)userData;
+  if (numTokens > 0) ++self->prefill_discarded;
   GenieDialog_signal(self->handle, GENIE_DIALOG_ACTION_ABORT);
 }
   
-std::string Context::query(std::string input, Callback callback) {
-  if (busy) {
-    throw std::runtime_error("Context is busy");
-  }
-  std::string query = input;
-  Genie_Status_t status;
-  GenieDialog_SentenceCode_t sentenceCode = GENIE_DIALOG_SENTENCE_COMPLETE;
-  if (!last_context_data.empty()) {
-    sentenceCode = GENIE_DIALOG_SENTENCE_REWIND;
-  }
-  busy = true;
-  this->callback = std::move(callback);
-  status = GenieDialog_query(handle, query.c_str(), sentenceCode, on_response, this);
-  if (status != GENIE_STATUS_SUCCESS && status != GENIE_STATUS_WARNING_ABORTED) {
-    // retry normal query
-    if (input.find(last_context_data) == 0) {
-      query = input.substr(last_context_data.length());
-    } else {
-      status = GenieDialog_reset(handle);
-      if (status != GENIE_STATUS_SUCCESS) {
-        throw std::runtime_error(genie_status_to_string(status));
+QueryMetrics Context::query(std::string input, Callback callback, Priority priority,
+                            const QueryOptions &options) {
+  QNN_TRACE_SCOPE("Context::query");
+  QueryMetrics result;
+  const uint64_t call_ns = QueryTimer::now();
+  scheduler.run(priority, [&] {
+    const uint64_t run_ns = QueryTimer::now();
+    timer.begin(call_ns);
+    prompt_tokens = reused_tokens = 0;
+    if (options.deadline_ms > 0 && QueryTimer::now() >= call_ns + options.deadline_ms * 1000000ull) {
+      // Spent the whole budget in the queue, leave the dialog as it is
+      timer.abort();
+      result = timer.finish();
+      result.stop_reason = StopReason::Deadline;
+      metrics.add(result, timer.gaps());
+      return;
+    }
+    this->callback = std::move(callback);
+    coalescer.reset(new ResponseCoalescer(coalesce_options, [this](
+      const std::string &response, const GenieDialog_SentenceCode_t sentenceCode,
+      const ResponseBatch &batch) {
+      if (this->callback != nullptr) {
+        this->callback(response.c_str(), sentenceCode, batch);
       }
+    }));
+    std::string profile;
+    armLimits(call_ns, options);
+    try {
+      profile = runQuery(input);
+    } catch (...) {
+      disarmLimits();
+      // The coalescer alarm may still call the sink until it is gone
+      coalescer.reset();
+      this->callback = nullptr;
+      throw;
+    }
+    disarmLimits();
+    coalescer->flush();
+    coalescer.reset();
+    if (trace::enabled()) traceGenieProfile(profile, run_ns, QueryTimer::now());
+    result = timer.finish();
+    if (result.aborted) {
+      result.stop_reason = limit_stop != 0 ? (StopReason)limit_stop.load() : StopReason::Aborted;
     }
-    status = GenieDialog_query(handle, query.c_str(), sentenceCode, on_response, this);
+    result.prompt_tokens = prompt_tokens;
+    result.reused_tokens = reused_tokens;
+    // A basic dialog drafts nothing, tokens a fragment carries beyond one are not accepted drafts
+    if (draft_tokens == 0) {
+      result.accepted_tokens = 0;
+    } else if (result.decode_steps > 0) {
+      result.acceptance_rate = (double)result.accepted_tokens / ((double)result.decode_steps * draft_tokens);
+    }
+    result.genie = parseGenieProfile(profile);
+    result.profile = std::move(profile);
+    metrics.add(result, timer.gaps());
+  });
+  return result;
+}
+
+void Context::armLimits(uint64_t call_ns, const QueryOptions &options) {
+  limits = options;
+  limit_stop = 0;
+  first_token = false;
+  {
+    std::lock_guard<std::mutex> lock(limit_mutex);
+    limits_armed = true;
+  }
+  if (options.deadline_ms > 0) {
+    limit_alarms.push_back(Watchdog::shared().arm(call_ns + options.deadline_ms * 1000000ull, [this] {
+      stopForLimit(StopReason::Deadline);
+    }));
+  }
+  if (options.max_ttft_ms > 0) {
+    limit_alarms.push_back(Watchdog::shared().arm(call_ns + options.max_ttft_ms * 1000000ull, [this] {
+      if (!first_token) stopForLimit(StopReason::MaxTtft);
+    }));
   }
-  busy = false;
+}
+
+void Context::disarmLimits() {
+  {
+    std::lock_guard<std::mutex> lock(limit_mutex);
+    limits_armed = false;
+  }
+  for (uint64_t alarm : limit_alarms) Watchdog::shared().disarm(alarm);
+  limit_alarms.clear();
+}
+
+void Context::stopForLimit(StopReason reason) {
+  std::lock_guard<std::mutex> lock(limit_mutex);
+  int none = 0;
+  if (!limits_armed || !limit_stop.compare_exchange_strong(none, (int)reason)) return;
+  LOGI("Query stopped: %s", stopReasonName(reason));
+  GenieDialog_signal(handle, GENIE_DIALOG_ACTION_ABORT);
+}
+
+std::string Context::runQuery(const std::string &input) {
+  QNN_TRACE_SCOPE("Context::runQuery");
+  if (sampler) sampler->reset();
+  Genie_Status_t status = dispatch(input, on_response, on_tokens);
   if (status != GENIE_STATUS_SUCCESS && status != GENIE_STATUS_WARNING_ABORTED) {
     throw std::runtime_error(genie_status_to_string(status));
   }
-  last_context_data = input;
+  // The dialog now holds the prompt followed by the generated response
+  last_context_data = input + response_data;
+  context_tracked = true;
+  if (tokenizer) {
+    history.split(last_context_data.length());
+  }
   const char* profile_json = nullptr;
   GenieProfile_getJsonData(profileHandle, alloc_json_data, &profile_json);
   std::string profile_json_str(profile_json);
@@ -244,27 +744,204 @@ void Context::abort() {
   if (handle == NULL) {
     throw std::runtime_error("Context handle is NULL");
   }
+  ++aborts;
   Genie_Status_t status = GenieDialog_signal(handle, GENIE_DIALOG_ACTION_ABORT);
   if (status != GENIE_STATUS_SUCCESS) {
     throw std::runtime_error(genie_status_to_string(status));
   }
 }
+
+size_t Context::cancelPending() {
+  return scheduler.cancelPending();
+}
+
+SchedulerStats Context::queueStats() const {
+  return scheduler.stats();
+}
+
+MetricsStats Context::metricsStats() const {
+  return metrics.stats();
+}
+
+void Context::resetMetrics() {
+  metrics.reset();
+}
+
+void Context::setSessionCache(const std::string &dir, uint64_t budget, size_t max_entries) {
+  scheduler.run(Priority::Normal, [&] {
+    std::shared_ptr<SessionCache> cache;
+    std::atomic_store(&sessionCache, cache);
+    if (budget > 0 && max_entries > 0) {
+      cache = std::make_shared<SessionCache>(dir, model_fingerprint, budget, max_entries);
+      cache->setScope(lora_scope);
+      std::atomic_store(&sessionCache, cache);
+    }
+  });
+}
+
+void Context::applyLora(const std::string &adapter, const std::string &engine, Priority priority) {
+  if (handle == NULL) {
+    throw std::runtime_error("Context handle is NULL");
+  }
+  scheduler.run(priority, [&] {
+    const std::string scope = engine + ":" + adapter;
+    if (scope == lora_scope) {
+      lora->recordSkip();
+      return;
+    }
+    if (!lora->contains(adapter)) {
+      LOGW("LoRA adapter %s is not declared in the config", adapter.c_str());
+    }
+    const uint64_t start = QueryTimer::now();
+    const bool resident = lora->touch(adapter);
+    snapshotSession();
+    Genie_Status_t status = GenieDialog_applyLora(handle, engine.c_str(), adapter.c_str());
+    if (status != GENIE_STATUS_SUCCESS) {
+      throw std::runtime_error(genie_status_to_string(status));
+    }
+    lora_scope = scope;
+    resetForWeights();
+    lora->recordSwap(engine, adapter, (QueryTimer::now() - start) / 1e6, resident);
+  });
+}
+
+void Context::setLoraStrength(const std::string &tensor, float alpha, const std::string &engine,
+                              Priority priority) {
+  if (handle == NULL) {
+    throw std::runtime_error("Context handle is NULL");
+  }
+  scheduler.run(priority, [&] {
+    snapshotSession();
+    Genie_Status_t status = GenieDialog_setLoraStrength(handle, engine.c_str(), tensor.c_str(), alpha);
+    if (status != GENIE_STATUS_SUCCESS) {
+      throw std::runtime_error(genie_status_to_string(status));
+    }
+    // Strengths set after the adapter are part of the scope, applying an adapter starts a new one
+    lora_scope += "|" + engine + ":" + tensor + "=" + std::to_string(alpha);
+    resetForWeights();
+  });
+}
+
+void Context::resetForWeights() {
+  Genie_Status_t status = GenieDialog_reset(handle);
+  if (status != GENIE_STATUS_SUCCESS) {
+    history.untrack();
+    throw std::runtime_error(genie_status_to_string(status));
+  }
+  last_context_data.clear();
+  context_tracked = true;
+  history.assign({}, 0);
+  prefill_open = false;
+  if (sessionCache) sessionCache->setScope(lora_scope);
+}
+
+void Context::setLoraResidency(size_t max_adapters) {
+  lora->setCapacity(max_adapters);
+}
+
+LoraStats Context::loraStats() const {
+  return lora->stats();
+}
+
+void Context::setResponseCoalescing(const CoalesceOptions &options) {
+  scheduler.run(Priority::Normal, [&] { coalesce_options = options; });
+}
+
+bool Context::resetLease() {
+  if (handle == NULL) {
+    throw std::runtime_error("Context handle is NULL");
+  }
+  bool reusable = true;
+  scheduler.run(Priority::High, [&] {
+    if (!lora_scope.empty()) {
+      reusable = false;
+      return;
+    }
+    Genie_Status_t status = GenieDialog_setStopSequence(handle, "{}");
+    if (status != GENIE_STATUS_SUCCESS) {
+      throw std::runtime_error(genie_status_to_string(status));
+    }
+    if (sampler || sampler_config != loaded_sampler_config) {
+      applySampler(loaded_sampler_config);
+      sampler_config = loaded_sampler_config;
+      std::atomic_store(&sampler, std::shared_ptr<ConstrainedSampler>());
+    }
+    std::atomic_store(&sessionCache, std::shared_ptr<SessionCache>());
+    coalesce_options = CoalesceOptions();
+    // Same as after a weight change: empty KV cache and history
+    resetForWeights();
+    metrics.reset();
+  });
+  return reusable;
+}
+
+SessionCacheStats Context::sessionCacheStats() const {
+  auto cache = std::atomic_load(&sessionCache);
+  if (!cache) return {};
+  return cache->stats();
+}
   
 void Context::on_response(const char *response, const GenieDialog_SentenceCode_t sentenceCode,
                           const void *userData) {
+  QNN_TRACE_SCOPE("Context::on_response");
   auto self = (Context *)userData;
   if (self == nullptr || self->callback == nullptr) return;
+  self->deliver(response, sentenceCode, response && *response ? 1 : 0);
+}
+
+void Context::on_tokens(const uint32_t *tokens, const uint32_t numTokens,
+                        const GenieDialog_SentenceCode_t sentenceCode, const void *userData) {
+  QNN_TRACE_SPAN(span, "Context::on_tokens");
+  span.arg("tokens", numTokens);
+  auto self = (Context *)userData;
+  if (self == nullptr) return;
+  self->history.append(tokens, numTokens);
+  if (self->callback == nullptr) return;
+  std::string response;
+  try {
+    response = self->decoder->push(tokens, numTokens);
+    if (
+      sentenceCode == GENIE_DIALOG_SENTENCE_COMPLETE ||
+      sentenceCode == GENIE_DIALOG_SENTENCE_END ||
+      sentenceCode == GENIE_DIALOG_SENTENCE_ABORT
+    ) {
+      response += self->decoder->flush();
+    }
+  } catch (const std::exception &e) {
+    // Never unwind through Genie
+    LOGE("Failed to decode response tokens: %s", e.what());
+  }
+  self->deliver(response.c_str(), sentenceCode, numTokens);
+}
+
+void Context::deliver(const char *response, const GenieDialog_SentenceCode_t sentenceCode, uint32_t tokens) {
+  timer.fragment(tokens);
+  if (sentenceCode == GENIE_DIALOG_SENTENCE_ABORT) {
+    timer.abort();
+  }
+  const bool last = sentenceCode == GENIE_DIALOG_SENTENCE_COMPLETE ||
+                    sentenceCode == GENIE_DIALOG_SENTENCE_END ||
+                    sentenceCode == GENIE_DIALOG_SENTENCE_ABORT;
+  if (tokens > 0) first_token = true;
+  if (last) {
+    // Done generating, a late alarm must not abort the next query
+    std::lock_guard<std::mutex> lock(limit_mutex);
+    limits_armed = false;
+  } else if (limit_stop != 0) {
+    // Signalled before Genie started generating, which may have dropped the signal
+    GenieDialog_signal(handle, GENIE_DIALOG_ACTION_ABORT);
+  } else if (limits.max_new_tokens > 0 && timer.tokens() >= limits.max_new_tokens) {
+    stopForLimit(StopReason::MaxTokens);
+  }
   if (response) {
-    self->last_context_data += response;
-  }
-  self->callback(response, sentenceCode);
-  if (
-    sentenceCode == GENIE_DIALOG_SENTENCE_COMPLETE ||
-    sentenceCode == GENIE_DIALOG_SENTENCE_END ||
-    sentenceCode == GENIE_DIALOG_SENTENCE_ABORT
-  ) {
+    response_data += response;
+  }
+  if (coalescer) {
+    coalescer->push(response, sentenceCode);
+  }
+  if (last) {
     LOGI("Response complete");
-    self->callback = nullptr;
+    callback = nullptr;
   }
 }
 
@@ -1,59 +1,288 @@
 #pragma once
 
 #include "GenieDialog.h"
+#include "coalescer.h"
 #include "log.h"
-#include <string>
+#include "lora.h"
+#include "metrics.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include "session_cache.h"
+#include "snapshot.h"
+#include "tokens.h"
 #include <atomic>
+#include <memory>
+#include <string>
 #include <stdexcept>
 #include <cstdlib>
 #include <functional>
+#include <mutex>
+#include <vector>
 
-#ifndef QNN_LOG_LEVEL
-#define QNN_LOG_LEVEL GENIE_LOG_LEVEL_INFO
+#ifndef QNN_QUEUE_CAPACITY
+#define QNN_QUEUE_CAPACITY 32
 #endif
 
 namespace qnnllm {
 
 const char *genie_status_to_string(int status);
 
+// Forwards Genie log messages to log.h
+void logStdoutCallback(GenieLog_Handle_t handle, const char *fmt, GenieLog_Level_t level, uint64_t timestamp,
+                       va_list argp);
+
+struct PrefillOptions {
+  uint32_t chunk_tokens = 256;  // Tokens fed to Genie per call, bounds the time to notice an abort
+};
+
+// Limits of one query, 0 disables a limit. The dialog is aborted as soon as one is hit.
+struct QueryOptions {
+  uint32_t max_new_tokens = 0;  // A speculative step may overshoot by its accepted draft tokens
+  uint32_t deadline_ms = 0;     // From the query call to the end of generation, queue wait included
+  uint32_t max_ttft_ms = 0;     // From the query call to the first token
+};
+
+struct PrefillProgress {
+  uint32_t total_tokens;      // Tokens of the prompt
+  uint32_t reused_tokens;     // Leading tokens the KV cache already held
+  uint32_t prefilled_tokens;  // Tokens fed so far, the reused ones excluded
+  uint32_t chunks;            // Genie calls made so far
+  uint32_t discarded_steps;   // Decode steps run and aborted, one when the first chunk rewinds the dialog
+  double   elapsed_ms;
+  bool     cancelled;         // Stopped by abort(), between chunks or while queued
+  bool     finished;
+};
+
 class Context {
 public:
-  typedef std::function<void(const char *response, const GenieDialog_SentenceCode_t sentenceCode)> Callback;
+  typedef std::function<void(const char *response, const GenieDialog_SentenceCode_t sentenceCode,
+                             const ResponseBatch &batch)> Callback;
 
   Context(const char *config_str);
   ~Context();
 
   void setStopWords(const char *stop_words);
 
+  /**
+   * Replace the dialog's sampler config, dropping a grammar set with setGrammar.
+   */
   void applySamplerConfig(const char *config_str);
 
-  void saveSession(const char *filename);
+  /**
+   * Constrain sampling to a grammar through Genie's custom sampler hook, see
+   * ConstrainedSampler::parseConfig. Needs the tokenizer and the vocabulary
+   * size and EOS token of dialog.context in the config, and a basic dialog.
+   * An empty grammar restores the previous sampler config.
+   */
+  void setGrammar(const std::string &grammar_json, Priority priority = Priority::Normal);
+
+  /**
+   * Counters of the grammar set last, zero without one.
+   */
+  SamplerStats samplerStats() const;
+
+  /**
+   * Snapshot the dialog into the directory filename, see SnapshotStore. The
+   * dialog is only blocked while Genie dumps its state; with
+   * options.background this returns then, and the snapshot is compressed and
+   * committed on the shared executor.
+   */
+  void saveSession(const char *filename, Priority priority = Priority::Normal,
+                   const SnapshotOptions &options = SnapshotOptions());
 
-  void restoreSession(const char *filename);
+  /**
+   * Restore a snapshot saved by saveSession, or a directory GenieDialog_save
+   * wrote. Throws if the snapshot was saved with another model.
+   */
+  void restoreSession(const char *filename, Priority priority = Priority::Normal);
 
-  void process(std::string prompt);
+  SnapshotStats snapshotStats() const;
 
-  std::string query(std::string input, Callback callback);
+  typedef std::function<void(const PrefillProgress &progress)> PrefillCallback;
+
+  /**
+   * Prefill prompt without generating, in chunks of options.chunk_tokens, so a
+   * later query extending it only has its own tokens left to prefill. The last
+   * prompt token is left for that query, which then decodes right away.
+   * abort() stops between chunks, what was fed so far stays in the KV cache,
+   * or skips the prefill when it is still queued.
+   * @param progress Called on the worker thread after every chunk
+   * @return The final progress
+   */
+  PrefillProgress process(std::string prompt, Priority priority = Priority::Normal,
+                          const PrefillOptions &options = PrefillOptions(),
+                          PrefillCallback progress = nullptr);
+
+  /**
+   * Generate a response to input, streaming it to callback. Limits in options
+   * are enforced natively, on every response fragment and by a watchdog timer.
+   * @return Latency measured on every response fragment, merged with the Genie
+   *         profile, and why generation stopped
+   */
+  QueryMetrics query(std::string input, Callback callback, Priority priority = Priority::Normal,
+                     const QueryOptions &options = QueryOptions());
 
   void abort();
 
+  size_t cancelPending();
+
+  SchedulerStats queueStats() const;
+
+  /**
+   * Rolling latency aggregates of the queries run so far.
+   */
+  MetricsStats metricsStats() const;
+
+  void resetMetrics();
+
+  /**
+   * Enable the prefix-keyed session cache, a zero budget disables it.
+   * When a query does not extend the current conversation, the dialog state is
+   * snapshotted into the cache and the longest cached prefix of the new input
+   * is restored before prefilling the remainder.
+   */
+  void setSessionCache(const std::string &dir, uint64_t budget, size_t max_entries);
+
+  SessionCacheStats sessionCacheStats() const;
+
+  /**
+   * Switch to a LoRA adapter declared in the config, without reloading the
+   * model. The KV cache was computed with the previous weights, so the dialog
+   * is reset; with a session cache it is snapshotted first and restored when
+   * the conversation resumes under the same adapter.
+   * @param engine Engine role the adapter belongs to, "primary" for basic dialogs
+   */
+  void applyLora(const std::string &adapter, const std::string &engine = "primary",
+                 Priority priority = Priority::Normal);
+
+  /**
+   * Scale the applied adapter through its alpha tensor, resets the dialog like applyLora.
+   */
+  void setLoraStrength(const std::string &tensor, float alpha, const std::string &engine = "primary",
+                       Priority priority = Priority::Normal);
+
+  /**
+   * Number of recently used adapters kept in the page cache.
+   */
+  void setLoraResidency(size_t max_adapters);
+
+  LoraStats loraStats() const;
+
+  /**
+   * Merge response fragments before they reach the query callback.
+   */
+  void setResponseCoalescing(const CoalesceOptions &options);
+
+  /**
+   * Return to the state the config loaded: empty conversation, no stop words,
+   * grammar, session cache or coalescing, and fresh metrics.
+   * @return false if the weights changed, an adapter cannot be taken off again
+   */
+  bool resetLease();
+
   static std::string version();
 
 protected:
   static void on_response(const char *response, const GenieDialog_SentenceCode_t sentenceCode,
                           const void *userData);
 
+  static void on_tokens(const uint32_t *tokens, const uint32_t numTokens,
+                        const GenieDialog_SentenceCode_t sentenceCode, const void *userData);
+
+  static void on_sample(uint32_t logitsSize, const void *logits, uint32_t numTokens, int32_t *tokens,
+                        const void *userData);
+
   static void process_callback(const char *response, const GenieDialog_SentenceCode_t sentenceCode,
                                const void *userData);
 
+  static void process_tokens_callback(const uint32_t *tokens, const uint32_t numTokens,
+                                      const GenieDialog_SentenceCode_t sentenceCode, const void *userData);
+
 private:
+  PrefillProgress runProcess(const std::string &prompt);
+
+  PrefillProgress runPrefill(const std::string &prompt, const PrefillOptions &options,
+                             const PrefillCallback &progress, uint64_t aborted);
+
+  bool switchTokens(const std::string &input);
+
+  std::string runQuery(const std::string &input);
+
+  Genie_Status_t dispatch(const std::string &input, GenieDialog_QueryCallback_t callback,
+                          GenieDialog_TokenQueryCallback_t tokenCallback);
+
+  Genie_Status_t dispatchText(const std::string &input, GenieDialog_QueryCallback_t callback);
+
+  Genie_Status_t dispatchTokens(const std::string &input, GenieDialog_TokenQueryCallback_t callback);
+
+  void deliver(const char *response, const GenieDialog_SentenceCode_t sentenceCode, uint32_t tokens);
+
+  void armLimits(uint64_t call_ns, const QueryOptions &options);
+
+  void disarmLimits();
+
+  /**
+   * Abort the running query for reason, the first limit hit wins.
+   */
+  void stopForLimit(StopReason reason);
+
+  bool switchSession(const std::string &input);
+
+  void snapshotSession();
+
+  /**
+   * Empty the KV cache after the weights changed, moving the session cache to the new scope.
+   */
+  void resetForWeights();
+
+  void applySampler(const std::string &config_str);
+
+  /**
+   * Text of every token ID, decoded once.
+   */
+  const std::vector<std::string> &vocabTexts();
+
   GenieDialog_Handle_t handle = NULL;
   GenieDialogConfig_Handle_t configHandle = NULL;
   GenieProfile_Handle_t profileHandle = NULL;
   GenieLog_Handle_t logHandle = NULL;
   std::string last_context_data;
-  std::atomic<bool> busy;
+  std::string response_data;
+  bool context_tracked = true;
+  std::unique_ptr<Tokenizer> tokenizer;
+  std::unique_ptr<TokenDecoder> decoder;
+  TokenHistory history;
+  uint32_t prompt_tokens = 0;
+  uint32_t reused_tokens = 0;
+  uint32_t draft_tokens = 0;  // Tokens drafted per decode step, 0 for basic dialogs
+  bool prefill_open = false;  // The dialog holds a multi-part prompt awaiting its END part
+  std::atomic<uint64_t> aborts{0};  // abort() calls, a prefill stops once they pass the count at its call
+  uint32_t prefill_discarded = 0;  // Decode steps the process callbacks aborted
+  std::shared_ptr<SessionCache> sessionCache;
+  std::unique_ptr<LoraAdapters> lora;
+  std::unique_ptr<SnapshotStore> snapshots;
+  uint64_t model_fingerprint = 0;  // Of the config, names the snapshots and session cache files
+  std::string lora_scope;  // Adapter and strengths the KV cache is computed with
+  uint32_t n_vocab = 0;    // dialog.context of the config, 0 if missing
+  int32_t eos_token = -1;
+  std::string sampler_config;  // Applied when no grammar is set
+  std::string loaded_sampler_config;  // sampler_config of the config
+  std::vector<std::string> vocab_texts;
+  std::vector<int32_t> special_tokens;  // bos-token and eos-token of dialog.context
+  std::shared_ptr<ConstrainedSampler> sampler;  // Null without a grammar
+  std::string sampler_name;  // Of the registered custom sampler callback, empty until a grammar is set
   Callback callback;
+  CoalesceOptions coalesce_options;
+  std::unique_ptr<ResponseCoalescer> coalescer;
+  QueryTimer timer;
+  QueryOptions limits;
+  std::mutex limit_mutex;
+  bool limits_armed = false;  // A query is generating, guarded by limit_mutex
+  std::atomic<int> limit_stop{0};  // StopReason of the limit hit, 0 for none
+  std::atomic<bool> first_token{false};
+  std::vector<uint64_t> limit_alarms;
+  MetricsAggregator metrics;
+  Scheduler scheduler{QNN_QUEUE_CAPACITY};
 };
 
 }  // namespace qnnllm
@@ -0,0 +1,316 @@
+#include "context_pool.h"
+#include "executor.h"
+#include "log.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace qnnllm {
+
+typedef std::chrono::steady_clock Clock;
+
+static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+static constexpr uint64_t FNV_PRIME  = 0x100000001b3ULL;
+
+static std::string hashKey(const std::string &config) {
+  uint64_t hash = FNV_OFFSET;
+  for (char c : config) hash = (hash ^ (uint8_t)c) * FNV_PRIME;
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+  return key;
+}
+
+static double elapsedMs(Clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+//------------------------------------------------------------------------------
+// ContextPool implementation (PImpl idiom)
+//------------------------------------------------------------------------------
+
+struct PoolEntry {
+  std::string              config;  // Normalized
+  std::string              key;
+  std::unique_ptr<Context> context;  // Null while loading
+  size_t                   leases = 0;
+  bool                     shared = false;
+  bool                     resetting = false;  // Released, the context is being reset
+  Clock::time_point        released;
+  double                   load_ms = 0;
+  uint64_t                 hits = 0;
+
+  bool idle() const { return leases == 0 && context && !resetting; }
+};
+
+struct ContextPool::Impl {
+  std::thread                     reaper;
+  std::list<PoolEntry>            entries;
+  mutable std::mutex              mutex;
+  std::condition_variable         cvLoaded;
+  std::condition_variable         cvReap;
+  ContextPoolOptions              options;
+  bool                            stop = false;
+  ContextPoolStats                stats{};
+  double                          totalLoadMs = 0;
+  uint64_t                        loads = 0;
+
+  // An idle entry for config, else one being reset or a shared one the caller may join
+  std::list<PoolEntry>::iterator find(const std::string &config, bool share) {
+    auto found = entries.end();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (it->config != config) continue;
+      if (it->idle()) return it;
+      if (found == entries.end() && (it->resetting || (share && it->shared))) found = it;
+    }
+    return found;
+  }
+
+  // Least recently released idle entry
+  std::list<PoolEntry>::iterator oldestIdle() {
+    auto oldest = entries.end();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (it->idle() && (oldest == entries.end() || it->released < oldest->released)) oldest = it;
+    }
+    return oldest;
+  }
+
+  // Take idle contexts out beyond max_contexts - reserve, freed by the caller outside the lock
+  void evict(size_t reserve, std::vector<std::unique_ptr<Context>> &freed) {
+    while (entries.size() + reserve > options.max_contexts) {
+      auto it = oldestIdle();
+      if (it == entries.end()) return;
+      freed.push_back(std::move(it->context));
+      entries.erase(it);
+      ++stats.evictions;
+    }
+  }
+
+  void reap() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop) {
+      std::vector<std::unique_ptr<Context>> freed;
+      auto deadline = Clock::time_point::max();
+      const auto now = Clock::now();
+      const auto grace = std::chrono::milliseconds(options.idle_ms);
+      for (auto it = entries.begin(); it != entries.end();) {
+        if (!it->idle()) {
+          ++it;
+        } else if (it->released + grace <= now) {
+          freed.push_back(std::move(it->context));
+          it = entries.erase(it);
+          ++stats.expirations;
+        } else {
+          deadline = std::min(deadline, it->released + grace);
+          ++it;
+        }
+      }
+      if (!freed.empty()) {
+        // Freeing a dialog takes a while, acquires go on meanwhile
+        lock.unlock();
+        freed.clear();
+        lock.lock();
+        continue;
+      }
+      if (deadline == Clock::time_point::max()) {
+        cvReap.wait(lock);
+      } else {
+        cvReap.wait_until(lock, deadline);
+      }
+    }
+  }
+};
+
+ContextPool::ContextPool(const ContextPoolOptions &options)
+    : impl_(new Impl()) {
+  impl_->options = options;
+  impl_->options.max_contexts = std::max<size_t>(options.max_contexts, 1);
+  impl_->reaper = std::thread([this] { impl_->reap(); });
+}
+
+ContextPool::~ContextPool() {
+  {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    impl_->stop = true;
+  }
+  impl_->cvReap.notify_one();
+  impl_->reaper.join();
+  delete impl_;
+}
+
+ContextPool &ContextPool::shared() {
+  // Never destroyed, like the executor: contexts may still be leased at exit
+  static ContextPool *instance = new ContextPool();
+  return *instance;
+}
+
+std::string ContextPool::normalizeConfig(const char *config_str) {
+  auto config = nlohmann::json::parse(config_str, nullptr, false);
+  // Objects are ordered by key, so dump() is canonical. Invalid configs fail to load anyway.
+  return config.is_discarded() ? std::string(config_str) : config.dump();
+}
+
+Context *ContextPool::acquire(const char *config_str, bool share) {
+  // Waits for or runs a model load of seconds
+  BlockingScope blocking;
+  auto &I = *impl_;
+  const std::string config = normalizeConfig(config_str);
+  std::vector<std::unique_ptr<Context>> freed;
+  std::list<PoolEntry>::iterator entry;
+  {
+    std::unique_lock<std::mutex> lock(I.mutex);
+    while (true) {
+      entry = I.find(config, share);
+      if (entry == I.entries.end()) break;
+      if (entry->context && !entry->resetting) {
+        if (entry->leases == 0) entry->shared = share;
+        ++entry->leases;
+        ++entry->hits;
+        ++I.stats.hits;
+        return entry->context.get();
+      }
+      I.cvLoaded.wait(lock);
+    }
+    const size_t used = std::count_if(I.entries.begin(), I.entries.end(),
+                                      [](const PoolEntry &item) { return !item.idle(); });
+    if (used >= I.options.max_contexts) {
+      throw std::runtime_error("Context pool is full, " + std::to_string(used) + " contexts are in use");
+    }
+    I.evict(1, freed);
+    ++I.stats.misses;
+    entry = I.entries.emplace(I.entries.end());
+    entry->config = config;
+    entry->key = hashKey(config);
+    entry->leases = 1;
+    entry->shared = share;
+  }
+  // Release the evicted models before loading the next one
+  freed.clear();
+  const auto start = Clock::now();
+  std::unique_ptr<Context> context;
+  try {
+    context.reset(new Context(config_str));
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(I.mutex);
+      I.entries.erase(entry);
+      ++I.stats.load_failures;
+    }
+    I.cvLoaded.notify_all();
+    throw;
+  }
+  const double loadMs = elapsedMs(start);
+  Context *result = context.get();
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    entry->context = std::move(context);
+    entry->load_ms = loadMs;
+    I.totalLoadMs += loadMs;
+    ++I.loads;
+    I.stats.last_load_ms = loadMs;
+    I.stats.max_load_ms = std::max(I.stats.max_load_ms, loadMs);
+  }
+  I.cvLoaded.notify_all();
+  return result;
+}
+
+void ContextPool::release(Context *context) {
+  auto &I = *impl_;
+  std::unique_ptr<Context> freed;
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    auto entry = std::find_if(I.entries.begin(), I.entries.end(),
+                              [&](const PoolEntry &item) { return item.context.get() == context; });
+    if (entry == I.entries.end() || entry->leases == 0) {
+      throw std::runtime_error("Context is not leased from the pool");
+    }
+    if (--entry->leases > 0) return;
+    if (I.options.idle_ms == 0) {
+      freed = std::move(entry->context);
+      I.entries.erase(entry);
+      ++I.stats.expirations;
+      return;
+    }
+    // Not idle until reset, so neither evicted nor leased meanwhile
+    entry->resetting = true;
+  }
+  // The next holder must not see this one's conversation or settings
+  bool reusable = false;
+  try {
+    reusable = context->resetLease();
+  } catch (const std::runtime_error &e) {
+    LOGW("Failed to reset released context: %s", e.what());
+  }
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    auto entry = std::find_if(I.entries.begin(), I.entries.end(),
+                              [&](const PoolEntry &item) { return item.context.get() == context; });
+    entry->resetting = false;
+    entry->released = Clock::now();
+    if (!reusable) {
+      freed = std::move(entry->context);
+      I.entries.erase(entry);
+      ++I.stats.expirations;
+    }
+  }
+  I.cvLoaded.notify_all();
+  I.cvReap.notify_one();
+}
+
+void ContextPool::setOptions(const ContextPoolOptions &options) {
+  auto &I = *impl_;
+  std::vector<std::unique_ptr<Context>> freed;
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    I.options = options;
+    I.options.max_contexts = std::max<size_t>(options.max_contexts, 1);
+    I.evict(0, freed);
+  }
+  // The reaper picks up the new grace period
+  I.cvReap.notify_one();
+}
+
+size_t ContextPool::trim() {
+  auto &I = *impl_;
+  std::vector<std::unique_ptr<Context>> freed;
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    for (auto it = I.entries.begin(); it != I.entries.end();) {
+      if (it->idle()) {
+        freed.push_back(std::move(it->context));
+        it = I.entries.erase(it);
+        ++I.stats.evictions;
+      } else {
+        ++it;
+      }
+    }
+  }
+  return freed.size();
+}
+
+ContextPoolStats ContextPool::stats() const {
+  auto &I = *impl_;
+  std::lock_guard<std::mutex> lock(I.mutex);
+  ContextPoolStats stats = I.stats;
+  stats.loaded = I.entries.size();
+  stats.leased = 0;
+  stats.max_contexts = I.options.max_contexts;
+  stats.idle_ms = I.options.idle_ms;
+  stats.avg_load_ms = I.loads > 0 ? I.totalLoadMs / I.loads : 0;
+  for (auto &entry : I.entries) {
+    if (entry.leases > 0) ++stats.leased;
+    stats.entries.push_back({entry.key, entry.leases, entry.shared, !entry.context,
+                             entry.idle() ? elapsedMs(entry.released) : 0, entry.load_ms, entry.hits});
+  }
+  std::sort(stats.entries.begin(), stats.entries.end(),
+            [](const ContextPoolEntry &a, const ContextPoolEntry &b) { return a.idle_ms > b.idle_ms; });
+  return stats;
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "context.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace qnnllm {
+
+struct ContextPoolOptions {
+  size_t   max_contexts = 4;    // Contexts kept loaded, leased or idle
+  uint32_t idle_ms = 30000;     // How long an unleased context stays loaded, 0 frees it on release
+};
+
+struct ContextPoolEntry {
+  std::string key;      // Hash of the normalized config
+  size_t      leases;
+  bool        shared;   // Leased with share, other sharing acquires join it
+  bool        loading;
+  double      idle_ms;  // Time since the last lease was released, 0 while leased
+  double      load_ms;
+  uint64_t    hits;
+};
+
+struct ContextPoolStats {
+  size_t                        loaded;         // Contexts loaded or loading
+  size_t                        leased;         // Contexts with at least one lease
+  size_t                        max_contexts;
+  uint32_t                      idle_ms;
+  uint64_t                      hits;           // Acquires served by a loaded context
+  uint64_t                      misses;         // Acquires that loaded a context
+  uint64_t                      evictions;      // Idle contexts freed to stay within max_contexts
+  uint64_t                      expirations;    // Idle contexts freed after idle_ms
+  uint64_t                      load_failures;
+  double                        last_load_ms;
+  double                        avg_load_ms;
+  double                        max_load_ms;
+  std::vector<ContextPoolEntry> entries;        // Least recently released first
+};
+
+// -----------------------------------------------------------------------------
+// Loaded contexts keyed by their normalized config, so acquiring a config that
+// is already loaded reuses an idle Context instead of creating the dialog
+// again. A Context is leased to one holder unless every holder acquires it
+// with share, then leases are refcounted and the holders share conversation
+// and settings. With the last lease the Context is reset to its loaded state
+// and stays loaded for idle_ms. Creating, resetting and freeing contexts happens
+// outside the pool lock; concurrent acquires wait for a load or reset they can use.
+// -----------------------------------------------------------------------------
+class ContextPool {
+public:
+  explicit ContextPool(const ContextPoolOptions &options = ContextPoolOptions());
+
+  /**
+   * Frees every context, leases must have been released.
+   */
+  ~ContextPool();
+
+  /**
+   * Shared instance, contexts created from JS are leased from it.
+   */
+  static ContextPool &shared();
+
+  /**
+   * Lease an idle context loaded with config_str, loading one on a miss. Idle
+   * contexts are evicted least recently released first to make room.
+   * Throws std::runtime_error if the load fails or max_contexts are leased.
+   * @param share Join a context another holder leased with share
+   */
+  Context *acquire(const char *config_str, bool share = false);
+
+  /**
+   * Return a lease taken by acquire. With the last lease the context is reset
+   * and goes idle, or is freed if it cannot be reset, see Context::resetLease.
+   */
+  void release(Context *context);
+
+  /**
+   * Evicts idle contexts beyond the new max_contexts.
+   */
+  void setOptions(const ContextPoolOptions &options);
+
+  /**
+   * Free every idle context, e.g. under memory pressure.
+   * @return Number of freed contexts
+   */
+  size_t trim();
+
+  ContextPoolStats stats() const;
+
+  /**
+   * Config JSON with whitespace and key order normalized, equal for configs
+   * that load the same context.
+   */
+  static std::string normalizeConfig(const char *config_str);
+
+private:
+  struct Impl;
+  Impl *impl_;
+};
+
+}  // namespace qnnllm
@@ -0,0 +1,133 @@
+#include "embedding.h"
+#include "metrics.h"
+#include <cmath>
+
+namespace qnnllm {
+
+// One GenieEmbedding_generate call, the callback appends to result
+struct EmbeddingCall {
+  EmbeddingResult *result;
+  size_t           received = 0;  // Floats the call produced
+};
+
+EmbeddingContext::EmbeddingContext(const char *config_str) {
+  Genie_Status_t status;
+  GenieLog_create((GenieLogConfig_Handle_t)NULL, logStdoutCallback, QNN_LOG_LEVEL, &logHandle);
+  status = GenieProfile_create(NULL, &profileHandle);
+  if (status != GENIE_STATUS_SUCCESS) {
+    throw std::runtime_error(genie_status_to_string(status));
+  }
+  status = GenieEmbeddingConfig_createFromJson(config_str, &configHandle);
+  if (status != GENIE_STATUS_SUCCESS) {
+    GenieProfile_free(profileHandle);
+    throw std::runtime_error(genie_status_to_string(status));
+  }
+  status = GenieEmbeddingConfig_bindProfiler(configHandle, profileHandle);
+  if (status == GENIE_STATUS_SUCCESS && logHandle != NULL) {
+    status = GenieEmbeddingConfig_bindLogger(configHandle, logHandle);
+  }
+  if (status != GENIE_STATUS_SUCCESS) {
+    GenieEmbeddingConfig_free(configHandle);
+    GenieProfile_free(profileHandle);
+    throw std::runtime_error(genie_status_to_string(status));
+  }
+  status = GenieEmbedding_create(configHandle, &handle);
+  if (status != GENIE_STATUS_SUCCESS) {
+    GenieEmbeddingConfig_free(configHandle);
+    GenieProfile_free(profileHandle);
+    throw std::runtime_error(genie_status_to_string(status));
+  }
+}
+
+EmbeddingContext::~EmbeddingContext() {
+  scheduler.shutdown();
+  if (handle != NULL) {
+    if (GenieEmbedding_free(handle) != GENIE_STATUS_SUCCESS) {
+      LOGE("Failed to free GenieEmbedding handle");
+    }
+  }
+  if (configHandle != NULL) {
+    if (GenieEmbeddingConfig_free(configHandle) != GENIE_STATUS_SUCCESS) {
+      LOGE("Failed to free GenieEmbeddingConfig handle");
+    }
+  }
+  if (profileHandle != NULL) {
+    if (GenieProfile_free(profileHandle) != GENIE_STATUS_SUCCESS) {
+      LOGE("Failed to free GenieProfile handle");
+    }
+  }
+  if (logHandle != NULL) {
+    if (GenieLog_free(logHandle) != GENIE_STATUS_SUCCESS) {
+      LOGE("Failed to free GenieLog handle");
+    }
+  }
+}
+
+EmbeddingResult EmbeddingContext::embed(const std::vector<std::string> &inputs, bool normalize,
+                                        Priority priority) {
+  EmbeddingResult result;
+  if (inputs.empty()) return result;
+  scheduler.run(priority, [&] {
+    const uint64_t start = QueryTimer::now();
+    result.dimensions = embed_dimensions;
+    result.data.reserve((size_t)result.dimensions * inputs.size());
+    for (auto &input : inputs) {
+      EmbeddingCall call{&result};
+      const size_t offset = result.data.size();
+      Genie_Status_t status = GenieEmbedding_generate(handle, input.c_str(), on_embedding, &call);
+      if (status != GENIE_STATUS_SUCCESS) {
+        throw std::runtime_error(genie_status_to_string(status));
+      }
+      if (result.dimensions == 0) {
+        // The first vector tells the size of the rest
+        result.dimensions = (uint32_t)call.received;
+        embed_dimensions = result.dimensions;
+        result.data.reserve((size_t)result.dimensions * inputs.size());
+      }
+      if (call.received != result.dimensions) {
+        throw std::runtime_error("Embedding has " + std::to_string(call.received) + " dimensions, expected " +
+                                 std::to_string(result.dimensions));
+      }
+      if (normalize) {
+        EmbeddingContext::normalize(result.data.data() + offset, result.dimensions);
+      }
+      ++result.count;
+    }
+    result.elapsed_ms = (QueryTimer::now() - start) / 1e6;
+  });
+  return result;
+}
+
+uint32_t EmbeddingContext::dimensions() const {
+  return embed_dimensions;
+}
+
+size_t EmbeddingContext::cancelPending() {
+  return scheduler.cancelPending();
+}
+
+SchedulerStats EmbeddingContext::queueStats() const {
+  return scheduler.stats();
+}
+
+void EmbeddingContext::normalize(float *vector, size_t length) {
+  double sum = 0;
+  for (size_t i = 0; i < length; ++i) sum += (double)vector[i] * vector[i];
+  // A zero vector has no direction, leave it as is
+  if (sum <= 0) return;
+  const float scale = (float)(1.0 / std::sqrt(sum));
+  for (size_t i = 0; i < length; ++i) vector[i] *= scale;
+}
+
+void EmbeddingContext::on_embedding(const uint32_t *dimensions, const uint32_t rank, const float *buffer,
+                                    const void *userData) {
+  auto call = (EmbeddingCall *)userData;
+  if (call == nullptr || buffer == nullptr) return;
+  size_t length = rank > 0 ? 1 : 0;
+  for (uint32_t i = 0; i < rank; ++i) length *= dimensions[i];
+  // Appending a vector of the wrong size is caught once Genie returns
+  call->result->data.insert(call->result->data.end(), buffer, buffer + length);
+  call->received += length;
+}
+
+}  // namespace qnnllm
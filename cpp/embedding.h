@@ -0,0 +1,58 @@
+#pragma once
+
+#include "GenieEmbedding.h"
+#include "context.h"
+#include "scheduler.h"
+#include <string>
+#include <vector>
+
+namespace qnnllm {
+
+struct EmbeddingResult {
+  uint32_t           count = 0;       // Vectors, one per input
+  uint32_t           dimensions = 0;  // Floats per vector
+  std::vector<float> data;            // count x dimensions, row-major
+  double             elapsed_ms = 0;  // Genie time for the whole batch, queueing excluded
+};
+
+// -----------------------------------------------------------------------------
+// Wraps a GenieEmbedding model. Genie embeds one string per call, a batch runs
+// all of them in a single job on the worker, writing each vector straight into
+// one contiguous buffer. Throws std::runtime_error on Genie errors.
+// -----------------------------------------------------------------------------
+class EmbeddingContext {
+public:
+  EmbeddingContext(const char *config_str);
+  ~EmbeddingContext();
+
+  /**
+   * @param normalize Scale every vector to unit L2 norm, dot products are then cosine similarities
+   */
+  EmbeddingResult embed(const std::vector<std::string> &inputs, bool normalize,
+                        Priority priority = Priority::Normal);
+
+  /**
+   * Floats per vector, 0 until the first input is embedded.
+   */
+  uint32_t dimensions() const;
+
+  size_t cancelPending();
+
+  SchedulerStats queueStats() const;
+
+  static void normalize(float *vector, size_t length);
+
+protected:
+  static void on_embedding(const uint32_t *dimensions, const uint32_t rank, const float *buffer,
+                           const void *userData);
+
+private:
+  GenieEmbedding_Handle_t handle = NULL;
+  GenieEmbeddingConfig_Handle_t configHandle = NULL;
+  GenieProfile_Handle_t profileHandle = NULL;
+  GenieLog_Handle_t logHandle = NULL;
+  std::atomic<uint32_t> embed_dimensions{0};
+  Scheduler scheduler{QNN_QUEUE_CAPACITY};
+};
+
+}  // namespace qnnllm
@@ -0,0 +1,414 @@
+#include "executor.h"
+#include "log.h"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace qnnllm {
+
+static constexpr size_t MAX_WORKERS = 64;
+static constexpr size_t PRIORITY_LEVELS = 3;
+static constexpr int    MAX_CPUS = 64;
+static constexpr uint64_t UNKNOWN_AFFINITY = ~0ull;
+
+//------------------------------------------------------------------------------
+// Core layout: the slowest cores take Efficiency tasks, the rest Performance
+//------------------------------------------------------------------------------
+
+static bool readValue(const char *format, int cpu, uint64_t &value) {
+  char path[96];
+  snprintf(path, sizeof(path), format, cpu);
+  FILE *file = fopen(path, "r");
+  if (!file) return false;
+  unsigned long long parsed = 0;
+  bool ok = fscanf(file, "%llu", &parsed) == 1;
+  fclose(file);
+  value = parsed;
+  return ok;
+}
+
+static void detectCores(uint64_t &efficiency, uint64_t &performance) {
+  efficiency = performance = 0;
+#ifdef __linux__
+  uint64_t values[MAX_CPUS];
+  int count = 0;
+  for (; count < MAX_CPUS; ++count) {
+    uint64_t value = 0;
+    // cpu_capacity is what the scheduler uses on big.LITTLE, max frequency is a fallback
+    if (!readValue("/sys/devices/system/cpu/cpu%d/cpu_capacity", count, value) &&
+        !readValue("/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", count, value)) {
+      break;
+    }
+    values[count] = value;
+  }
+  if (count == 0) return;
+  uint64_t lowest = *std::min_element(values, values + count);
+  for (int cpu = 0; cpu < count; ++cpu) {
+    (values[cpu] == lowest ? efficiency : performance) |= 1ull << cpu;
+  }
+  if (performance == 0) efficiency = 0;  // Homogeneous cores, nothing to steer
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Executor implementation (PImpl idiom)
+//------------------------------------------------------------------------------
+
+namespace {
+
+struct QueuedTask {
+  Executor::Task task;
+  TaskHints      hints;
+};
+
+struct Worker {
+  std::mutex             mutex;
+  std::deque<QueuedTask> queues[PRIORITY_LEVELS];
+  uint64_t               affinity = 0;  // Mask applied to the thread, 0 for all cores
+  std::atomic<bool>      active{true};  // Cleared when the thread retires, the slot is reused by spawn()
+  std::thread            thread;
+};
+
+thread_local Worker *t_worker = nullptr;
+thread_local const void *t_owner = nullptr;
+thread_local int t_blocking = 0;  // Nesting of blocking tasks and scopes on this worker
+
+}  // namespace
+
+struct Executor::Impl {
+  size_t                   parallelism;
+  std::unique_ptr<Worker>  workers[MAX_WORKERS];
+  std::atomic<size_t>      workerCount{0};  // Slots in use, retired ones included
+  std::atomic<size_t>      live{0};         // Workers not retired
+  std::mutex               spawnMutex;
+  std::atomic<size_t>      blocked{0};
+  std::atomic<size_t>      next{0};
+  std::atomic<size_t>      depth[PRIORITY_LEVELS];
+  std::atomic<size_t>      maxDepth{0};
+  std::atomic<uint64_t>    submitted{0};
+  std::atomic<uint64_t>    executed{0};
+  std::atomic<uint64_t>    steals{0};
+  std::mutex               sleepMutex;
+  std::condition_variable  cvWork;
+  uint64_t                 epoch = 0;
+  bool                     stop = false;
+  uint64_t                 efficiencyCores = 0;
+  uint64_t                 performanceCores = 0;
+
+  void spawn();
+  bool retire(Worker *self);
+  void enterBlocking();
+  void leaveBlocking();
+  void loop(Worker *self);
+  bool pop(Worker *self, bool allowBlocking, QueuedTask &out);
+  void run(Worker *self, QueuedTask &item);
+  void applyAffinity(Worker *self, CoreHint cores);
+};
+
+void Executor::Impl::spawn() {
+  std::lock_guard<std::mutex> lock(spawnMutex);
+  {
+    // The destructor has taken or is taking the thread list
+    std::lock_guard<std::mutex> sleepLock(sleepMutex);
+    if (stop) return;
+  }
+  // Reuse the slot of a retired worker before adding one
+  size_t count = workerCount.load(std::memory_order_relaxed);
+  size_t index = 0;
+  while (index < count && workers[index]->active.load(std::memory_order_relaxed)) ++index;
+  if (index >= MAX_WORKERS) return;
+  if (index == count) workers[index].reset(new Worker());
+  Worker *worker = workers[index].get();
+  // A retired thread needs no lock on its way out, this returns promptly
+  if (worker->thread.joinable()) worker->thread.join();
+  // Threads inherit the affinity of the worker that spawns them
+  worker->affinity = UNKNOWN_AFFINITY;
+  worker->active.store(true, std::memory_order_release);
+  worker->thread = std::thread([this, worker] { loop(worker); });
+  ++live;
+  if (index == count) workerCount.store(count + 1, std::memory_order_release);
+}
+
+// Leave once more workers are running than blocked ones need covering for, so a
+// burst of blocking work does not keep its spares for the life of the process
+bool Executor::Impl::retire(Worker *self) {
+  if (live.load(std::memory_order_relaxed) <= parallelism + blocked.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(spawnMutex);
+  if (live.load() <= parallelism + blocked.load()) return false;
+  // Checked under the deque lock, submit() does not queue on inactive workers
+  std::lock_guard<std::mutex> queueLock(self->mutex);
+  for (auto &queue : self->queues) {
+    if (!queue.empty()) return false;
+  }
+  self->active.store(false, std::memory_order_release);
+  --live;
+  return true;
+}
+
+void Executor::Impl::enterBlocking() {
+  if (t_blocking++ > 0) return;
+  // Keep parallelism workers available for everything else
+  size_t inside = ++blocked;
+  if (live.load(std::memory_order_acquire) < parallelism + inside) spawn();
+}
+
+void Executor::Impl::leaveBlocking() {
+  if (--t_blocking == 0) --blocked;
+}
+
+void Executor::Impl::loop(Worker *self) {
+  t_worker = self;
+  t_owner = this;
+  while (true) {
+    uint64_t seen;
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      if (stop) return;
+      seen = epoch;
+    }
+    if (retire(self)) return;
+    QueuedTask item;
+    if (pop(self, true, item)) {
+      run(self, item);
+      continue;
+    }
+    // Sleep until something was submitted after the scan started
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    cvWork.wait(lock, [&] { return stop || epoch != seen; });
+  }
+}
+
+bool Executor::Impl::pop(Worker *self, bool allowBlocking, QueuedTask &out) {
+  size_t count = workerCount.load(std::memory_order_acquire);
+  size_t start = next.load(std::memory_order_relaxed);
+  for (size_t p = 0; p < PRIORITY_LEVELS; ++p) {
+    if (depth[p].load(std::memory_order_relaxed) == 0) continue;
+    if (self) {
+      std::lock_guard<std::mutex> lock(self->mutex);
+      auto &queue = self->queues[p];
+      if (!queue.empty() && (allowBlocking || !queue.back().hints.blocking)) {
+        out = std::move(queue.back());
+        queue.pop_back();
+        --depth[p];
+        return true;
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      Worker *victim = workers[(start + i) % count].get();
+      if (victim == self) continue;
+      std::lock_guard<std::mutex> lock(victim->mutex);
+      auto &queue = victim->queues[p];
+      if (!queue.empty() && (allowBlocking || !queue.front().hints.blocking)) {
+        out = std::move(queue.front());
+        queue.pop_front();
+        --depth[p];
+        ++steals;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void Executor::Impl::applyAffinity(Worker *self, CoreHint cores) {
+#ifdef __linux__
+  uint64_t mask = cores == CoreHint::Efficiency  ? efficiencyCores
+                : cores == CoreHint::Performance ? performanceCores
+                                                 : 0;
+  if (mask == self->affinity) return;
+  uint64_t all = efficiencyCores | performanceCores;
+  if (all == 0) {
+    self->affinity = 0;  // Nothing to steer, no worker changed its mask
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu = 0; cpu < MAX_CPUS; ++cpu) {
+    if ((mask ? mask : all) & (1ull << cpu)) CPU_SET(cpu, &set);
+  }
+  if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+    self->affinity = mask;
+  }
+#else
+  (void)self;
+  (void)cores;
+#endif
+}
+
+void Executor::Impl::run(Worker *self, QueuedTask &item) {
+  applyAffinity(self, item.hints.cores);
+  if (item.hints.blocking) enterBlocking();
+  try {
+    item.task();
+  } catch (const std::exception &e) {
+    LOGE("Executor task failed: %s", e.what());
+  } catch (...) {
+    LOGE("Executor task failed");
+  }
+  if (item.hints.blocking) leaveBlocking();
+  ++executed;
+}
+
+Executor::Executor(size_t parallelism)
+    : impl_(new Impl()) {
+  impl_->parallelism = std::max<size_t>(parallelism, 1);
+  for (auto &depth : impl_->depth) depth = 0;
+  detectCores(impl_->efficiencyCores, impl_->performanceCores);
+  for (size_t i = 0; i < impl_->parallelism; ++i) {
+    impl_->spawn();
+  }
+}
+
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> lock(impl_->sleepMutex);
+    impl_->stop = true;
+  }
+  impl_->cvWork.notify_all();
+  // Joined without spawnMutex, a worker starting a blocking task takes it to spawn
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(impl_->spawnMutex);
+    size_t count = impl_->workerCount.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i) {
+      if (impl_->workers[i]->thread.joinable()) threads.push_back(std::move(impl_->workers[i]->thread));
+    }
+  }
+  for (auto &thread : threads) thread.join();
+  delete impl_;
+}
+
+Executor &Executor::shared() {
+  // Never destroyed, workers may still be attached to the JVM at exit
+  static Executor *instance = new Executor(std::max(std::thread::hardware_concurrency(), 2u));
+  return *instance;
+}
+
+void Executor::submit(Task task, const TaskHints &hints) {
+  auto &I = *impl_;
+  size_t p = std::min<size_t>(static_cast<size_t>(hints.priority), PRIORITY_LEVELS - 1);
+  Worker *target = t_owner == impl_ ? t_worker : nullptr;
+  const size_t count = I.workerCount.load(std::memory_order_acquire);
+  while (true) {
+    if (!target) target = I.workers[I.next.fetch_add(1, std::memory_order_relaxed) % count].get();
+    std::lock_guard<std::mutex> lock(target->mutex);
+    // Retired workers keep their slot, and their deques stay open to thieves, but take no new tasks
+    if (target->active.load(std::memory_order_relaxed)) {
+      target->queues[p].push_back({std::move(task), hints});
+      break;
+    }
+    target = nullptr;
+  }
+  size_t depth = 0;
+  for (auto &level : I.depth) depth += level.load(std::memory_order_relaxed);
+  ++I.depth[p];
+  ++depth;
+  size_t seen = I.maxDepth.load(std::memory_order_relaxed);
+  while (depth > seen && !I.maxDepth.compare_exchange_weak(seen, depth)) {}
+  ++I.submitted;
+  {
+    std::lock_guard<std::mutex> lock(I.sleepMutex);
+    ++I.epoch;
+  }
+  I.cvWork.notify_one();
+}
+
+bool Executor::runPending() {
+  if (t_owner != impl_) return false;
+  QueuedTask item;
+  if (!impl_->pop(t_worker, false, item)) return false;
+  impl_->run(t_worker, item);
+  return true;
+}
+
+bool Executor::onWorkerThread() {
+  return t_worker != nullptr;
+}
+
+ExecutorStats Executor::stats() const {
+  auto &I = *impl_;
+  ExecutorStats stats{};
+  stats.workers = I.live.load(std::memory_order_acquire);
+  stats.parallelism = I.parallelism;
+  stats.blocked = I.blocked.load();
+  for (size_t p = 0; p < PRIORITY_LEVELS; ++p) stats.depth[p] = I.depth[p].load();
+  stats.max_depth = I.maxDepth.load();
+  stats.submitted = I.submitted.load();
+  stats.executed = I.executed.load();
+  stats.steals = I.steals.load();
+  stats.efficiency_cores = I.efficiencyCores;
+  stats.performance_cores = I.performanceCores;
+  return stats;
+}
+
+BlockingScope::BlockingScope()
+    : executor_(t_worker ? static_cast<Executor::Impl *>(const_cast<void *>(t_owner)) : nullptr) {
+  if (executor_) executor_->enterBlocking();
+}
+
+BlockingScope::~BlockingScope() {
+  if (executor_) executor_->leaveBlocking();
+}
+
+//------------------------------------------------------------------------------
+// TaskGroup implementation
+//------------------------------------------------------------------------------
+
+TaskGroup::TaskGroup(Executor &executor, const TaskHints &hints)
+    : executor_(executor), hints_(hints) {}
+
+TaskGroup::~TaskGroup() {
+  wait();
+}
+
+void TaskGroup::submit(Executor::Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++pending_;
+  }
+  executor_.submit([this, task = std::move(task)]() {
+    try {
+      task();
+    } catch (...) {
+      // Counted as done either way, the caller is responsible for reporting errors
+    }
+    // The group may be destroyed as soon as the mutex is released
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) cvDone_.notify_all();
+  }, hints_);
+}
+
+void TaskGroup::wait() {
+  while (!waitFor(std::chrono::milliseconds(1000))) {}
+}
+
+bool TaskGroup::waitFor(std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  const bool helper = Executor::onWorkerThread();
+  while (true) {
+    {
+      // Checked under the mutex, so the last task has released it before the group can go away
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_ == 0) return true;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) return false;
+    // A worker waiting here would otherwise hold a thread the tasks may need
+    if (helper && executor_.runPending()) continue;
+    auto until = helper ? std::min(deadline, now + std::chrono::milliseconds(1)) : deadline;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (cvDone_.wait_until(lock, until, [&] { return pending_ == 0; })) return true;
+  }
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+namespace qnnllm {
+
+// -----------------------------------------------------------------------------
+// Which cores a task should run on. Efficiency keeps bulk work (unpacking,
+// snapshot writes) off the performance cores that inference runs on. Hints are
+// ignored where the core layout cannot be read or all cores are alike.
+// -----------------------------------------------------------------------------
+enum class CoreHint : int {
+  Any = 0,
+  Efficiency = 1,
+  Performance = 2,
+};
+
+struct TaskHints {
+  Priority priority = Priority::Normal;
+  CoreHint cores = CoreHint::Any;
+  bool     blocking = false;  // Waits on other threads or I/O throughout, a spare worker covers for it
+};
+
+struct ExecutorStats {
+  size_t   workers;           // Worker threads, including spares covering for blocked workers
+  size_t   parallelism;       // Target number of workers running non-blocking tasks
+  size_t   blocked;           // Workers currently inside a blocking task
+  size_t   depth[3];          // Queued tasks per priority
+  size_t   max_depth;         // High-water mark of all queued tasks
+  uint64_t submitted;
+  uint64_t executed;
+  uint64_t steals;            // Tasks taken from another worker's deque
+  uint64_t efficiency_cores;  // Bit mask of the cores used for CoreHint::Efficiency
+  uint64_t performance_cores;
+};
+
+// -----------------------------------------------------------------------------
+// Process-wide work-stealing executor. Every worker owns one deque per priority:
+// it pushes and pops its own tasks LIFO and steals from the others FIFO, always
+// draining higher priorities first. Tasks submitted from outside the pool go to
+// the workers round robin.
+// -----------------------------------------------------------------------------
+class Executor {
+public:
+  typedef std::function<void()> Task;
+
+  explicit Executor(size_t parallelism);
+  ~Executor();
+
+  /**
+   * Shared instance, sized to the number of cores.
+   */
+  static Executor &shared();
+
+  void submit(Task task, const TaskHints &hints = TaskHints());
+
+  /**
+   * Run one queued task on the calling worker thread, so a worker waiting on
+   * other tasks helps instead of idling.
+   * @return false if the caller is not a worker or nothing was queued
+   */
+  bool runPending();
+
+  ExecutorStats stats() const;
+
+  /**
+   * Whether the calling thread is a worker of any executor.
+   */
+  static bool onWorkerThread();
+
+private:
+  friend class BlockingScope;
+  struct Impl;
+  Impl *impl_;
+};
+
+// -----------------------------------------------------------------------------
+// Marks the calling worker as blocked for the rest of the scope, e.g. while it
+// waits for a context scheduler or loads a model. A spare worker covers for it
+// and retires once the wait is over. Does nothing off worker threads.
+// -----------------------------------------------------------------------------
+class BlockingScope {
+public:
+  BlockingScope();
+  ~BlockingScope();
+
+  BlockingScope(const BlockingScope &) = delete;
+  BlockingScope &operator=(const BlockingScope &) = delete;
+
+private:
+  Executor::Impl *executor_;
+};
+
+// -----------------------------------------------------------------------------
+// Tasks submitted together with the same hints, and waited on together.
+// Waiting on a worker thread runs queued tasks meanwhile.
+// -----------------------------------------------------------------------------
+class TaskGroup {
+public:
+  TaskGroup(Executor &executor, const TaskHints &hints);
+  ~TaskGroup();
+
+  void submit(Executor::Task task);
+
+  void wait();
+
+  /**
+   * @return false if tasks are still running after timeout
+   */
+  bool waitFor(std::chrono::milliseconds timeout);
+
+private:
+  Executor               &executor_;
+  TaskHints               hints_;
+  size_t                  pending_ = 0;  // Guarded by mutex_, the last task may end just before the group
+  std::mutex              mutex_;
+  std::condition_variable cvDone_;
+};
+
+}  // namespace qnnllm
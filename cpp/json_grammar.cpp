@@ -0,0 +1,330 @@
+#include "json_grammar.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace qnnllm {
+
+// What the recognizer expects next
+enum Mode : uint8_t {
+  VALUE,        // Any value, or a closing bracket right after '[' when sub_ is 1
+  OBJECT_KEY,   // A key, or '}' right after '{' when sub_ is 1
+  COLON,
+  AFTER_VALUE,  // ',' or a closing bracket, or the end of the document
+  STRING,
+  ESCAPE,
+  UNICODE,      // sub_ hex digits of \uXXXX read so far
+  NUMBER,
+  LITERAL,
+  DONE,
+};
+
+// Number progress kept in sub_
+enum NumberPart : uint8_t {
+  SIGN,           // After '-', a digit must follow
+  ZERO,           // Integer part "0", no more digits
+  INTEGER,
+  POINT,          // After '.', a digit must follow
+  FRACTION,
+  EXPONENT,       // After 'e', a sign or digit must follow
+  EXPONENT_SIGN,  // A digit must follow
+  EXPONENT_DIGITS,
+};
+
+static const char *const LITERALS[] = {"true", "false", "null"};
+
+static bool isDigit(uint8_t byte) {
+  return byte >= '0' && byte <= '9';
+}
+
+static bool isHex(uint8_t byte) {
+  return isDigit(byte) || (byte >= 'a' && byte <= 'f') || (byte >= 'A' && byte <= 'F');
+}
+
+//------------------------------------------------------------------------------
+// JsonState
+//------------------------------------------------------------------------------
+
+JsonState::JsonState(const JsonGrammarOptions &options)
+    : mode_(VALUE), max_ws_(options.max_whitespace), root_(options.root) {}
+
+bool JsonState::whitespace(uint8_t byte) {
+  if (byte != ' ' && byte != '\n' && byte != '\t' && byte != '\r') return false;
+  return ++ws_ <= max_ws_;
+}
+
+bool JsonState::push(bool object) {
+  if (depth_ >= MAX_DEPTH) return false;
+  stack_ = (stack_ << 1) | (object ? 1 : 0);
+  ++depth_;
+  mode_ = object ? OBJECT_KEY : VALUE;
+  sub_ = 1;
+  return true;
+}
+
+bool JsonState::pop(bool object) {
+  if (depth_ == 0 || (bool)(stack_ & 1) != object) return false;
+  stack_ >>= 1;
+  --depth_;
+  mode_ = depth_ == 0 ? DONE : AFTER_VALUE;
+  return true;
+}
+
+bool JsonState::value(uint8_t byte) {
+  // Only the root value is restricted in type
+  if (depth_ == 0 && root_ != JsonGrammarOptions::Any) {
+    if (byte != (root_ == JsonGrammarOptions::Object ? '{' : '[')) return false;
+  }
+  if (byte == '{' || byte == '[') return push(byte == '{');
+  if (byte == '"') {
+    mode_ = STRING;
+    key_ = false;
+    return true;
+  }
+  if (byte == '-' || isDigit(byte)) {
+    mode_ = NUMBER;
+    sub_ = byte == '-' ? SIGN : byte == '0' ? ZERO : INTEGER;
+    return true;
+  }
+  for (uint8_t i = 0; i < 3; ++i) {
+    if (byte == LITERALS[i][0]) {
+      mode_ = LITERAL;
+      sub_ = (uint8_t)(i << 4 | 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool JsonState::afterValue(uint8_t byte) {
+  if (depth_ == 0) return false;
+  const bool object = stack_ & 1;
+  if (byte == ',') {
+    mode_ = object ? OBJECT_KEY : VALUE;
+    sub_ = 0;
+    return true;
+  }
+  if (byte == (object ? '}' : ']')) return pop(object);
+  return false;
+}
+
+bool JsonState::advance(uint8_t byte) {
+  // Only the end of sequence follows a complete document
+  if (mode_ == DONE) return false;
+  if (mode_ != STRING && mode_ != ESCAPE && mode_ != UNICODE && mode_ != NUMBER && mode_ != LITERAL) {
+    if (whitespace(byte)) return true;
+    if (ws_ > max_ws_) return false;
+  }
+  ws_ = 0;
+  switch (mode_) {
+    case VALUE:
+      if (sub_ == 1 && byte == ']') return pop(false);
+      sub_ = 0;
+      return value(byte);
+    case OBJECT_KEY:
+      if (sub_ == 1 && byte == '}') return pop(true);
+      if (byte != '"') return false;
+      mode_ = STRING;
+      key_ = true;
+      return true;
+    case COLON:
+      if (byte != ':') return false;
+      mode_ = VALUE;
+      sub_ = 0;
+      return true;
+    case AFTER_VALUE:
+      return afterValue(byte);
+    case STRING:
+      if (byte == '"') {
+        mode_ = key_ ? COLON : depth_ == 0 ? DONE : AFTER_VALUE;
+        return true;
+      }
+      if (byte == '\\') {
+        mode_ = ESCAPE;
+        return true;
+      }
+      return byte >= 0x20;
+    case ESCAPE:
+      if (byte == 'u') {
+        mode_ = UNICODE;
+        sub_ = 0;
+        return true;
+      }
+      mode_ = STRING;
+      return std::strchr("\"\\/bfnrt", byte) != nullptr && byte != 0;
+    case UNICODE:
+      if (!isHex(byte)) return false;
+      if (++sub_ == 4) mode_ = STRING;
+      return true;
+    case NUMBER:
+      switch (sub_) {
+        case SIGN:
+          if (!isDigit(byte)) return false;
+          sub_ = byte == '0' ? ZERO : INTEGER;
+          return true;
+        case INTEGER:
+          if (isDigit(byte)) return true;
+          // fall through
+        case ZERO:
+          if (byte == '.') {
+            sub_ = POINT;
+            return true;
+          }
+          // fall through
+        case FRACTION:
+          if (sub_ == FRACTION && isDigit(byte)) return true;
+          if (byte == 'e' || byte == 'E') {
+            sub_ = EXPONENT;
+            return true;
+          }
+          break;
+        case POINT:
+          if (!isDigit(byte)) return false;
+          sub_ = FRACTION;
+          return true;
+        case EXPONENT:
+          if (byte == '+' || byte == '-') {
+            sub_ = EXPONENT_SIGN;
+            return true;
+          }
+          // fall through
+        case EXPONENT_SIGN:
+          if (!isDigit(byte)) return false;
+          sub_ = EXPONENT_DIGITS;
+          return true;
+        case EXPONENT_DIGITS:
+          if (isDigit(byte)) return true;
+          break;
+      }
+      // The number ended, the byte belongs to what follows it. Nothing follows a top-level one.
+      if (depth_ == 0) return false;
+      mode_ = AFTER_VALUE;
+      if (whitespace(byte)) return true;
+      return afterValue(byte);
+    case LITERAL: {
+      const char *literal = LITERALS[sub_ >> 4];
+      const uint8_t pos = sub_ & 0xf;
+      if (byte != (uint8_t)literal[pos]) return false;
+      if (literal[pos + 1] == '\0') {
+        mode_ = depth_ == 0 ? DONE : AFTER_VALUE;
+      } else {
+        ++sub_;
+      }
+      return true;
+    }
+    case DONE:
+      return false;
+  }
+  return false;
+}
+
+bool JsonState::advance(const std::string &bytes) {
+  for (char byte : bytes) {
+    if (!advance((uint8_t)byte)) return false;
+  }
+  return true;
+}
+
+bool JsonState::complete() const {
+  if (mode_ == DONE) return true;
+  // A top-level number ends with the document
+  return depth_ == 0 && mode_ == NUMBER &&
+         (sub_ == ZERO || sub_ == INTEGER || sub_ == FRACTION || sub_ == EXPONENT_DIGITS);
+}
+
+bool JsonState::operator==(const JsonState &other) const {
+  return stack_ == other.stack_ && depth_ == other.depth_ && mode_ == other.mode_ && sub_ == other.sub_ &&
+         ws_ == other.ws_ && max_ws_ == other.max_ws_ && root_ == other.root_ && key_ == other.key_;
+}
+
+size_t JsonState::hash() const {
+  uint64_t hash = stack_ * 0x9e3779b97f4a7c15ULL;
+  hash ^= (uint64_t)depth_ << 48 | (uint64_t)mode_ << 40 | (uint64_t)sub_ << 32 | (uint64_t)ws_ << 24 |
+          (uint64_t)max_ws_ << 16 | (uint64_t)root_ << 8 | (uint64_t)key_;
+  return (size_t)(hash ^ (hash >> 29));
+}
+
+//------------------------------------------------------------------------------
+// JsonTokenMask
+//------------------------------------------------------------------------------
+
+JsonTokenMask::JsonTokenMask(const std::vector<std::string> &vocab, int32_t eos_token)
+    : vocab_(vocab), eos_(eos_token) {
+  order_.resize(vocab_.size());
+  std::iota(order_.begin(), order_.end(), 0);
+  std::sort(order_.begin(), order_.end(), [&](uint32_t a, uint32_t b) { return vocab_[a] < vocab_[b]; });
+  prefix_.resize(order_.size());
+  size_t longest = 0;
+  for (size_t i = 0; i < order_.size(); ++i) {
+    const std::string &text = vocab_[order_[i]];
+    longest = std::max(longest, text.size());
+    if (i == 0) continue;
+    const std::string &previous = vocab_[order_[i - 1]];
+    const size_t limit = std::min(text.size(), previous.size());
+    size_t common = std::mismatch(text.begin(), text.begin() + limit, previous.begin()).first - text.begin();
+    prefix_[i] = (uint16_t)std::min<size_t>(common, UINT16_MAX);
+  }
+  states_.resize(longest + 1);
+}
+
+size_t JsonTokenMask::vocabSize() const {
+  return vocab_.size();
+}
+
+size_t JsonTokenMask::words() const {
+  return (vocab_.size() + 63) / 64;
+}
+
+const std::string &JsonTokenMask::text(int32_t token) const {
+  return vocab_[token];
+}
+
+void JsonTokenMask::compute(const JsonState &state, uint64_t *mask) {
+  std::fill(mask, mask + words(), 0);
+  states_[0] = state;
+  // Bytes of the previous token that were walked successfully
+  size_t valid = 0;
+  for (size_t i = 0; i < order_.size(); ++i) {
+    const uint32_t token = order_[i];
+    const std::string &text = vocab_[token];
+    // Special tokens decode to nothing, they never continue the document
+    if (text.empty()) continue;
+    const size_t common = i > 0 ? prefix_[i] : 0;
+    // Extends the prefix the previous token was rejected on
+    if (common > valid) continue;
+    size_t depth = common;
+    for (; depth < text.size(); ++depth) {
+      states_[depth + 1] = states_[depth];
+      if (!states_[depth + 1].advance((uint8_t)text[depth])) break;
+    }
+    valid = depth;
+    if (depth == text.size()) mask[token >> 6] |= 1ULL << (token & 63);
+  }
+  if (eos_ >= 0 && (size_t)eos_ < vocab_.size()) {
+    const uint64_t bit = 1ULL << (eos_ & 63);
+    mask[eos_ >> 6] = state.complete() ? mask[eos_ >> 6] | bit : mask[eos_ >> 6] & ~bit;
+  }
+}
+
+const uint64_t *JsonTokenMask::allowed(const JsonState &state, bool *cached) {
+  auto it = index_.find(state);
+  if (it != index_.end()) {
+    cache_.splice(cache_.begin(), cache_, it->second);
+    if (cached) *cached = true;
+    return cache_.front().second.data();
+  }
+  if (cached) *cached = false;
+  if (cache_.size() >= CACHE_SIZE) {
+    // Reuse the least recently used mask
+    cache_.splice(cache_.begin(), cache_, std::prev(cache_.end()));
+    index_.erase(cache_.front().first);
+    cache_.front().first = state;
+  } else {
+    cache_.emplace_front(state, std::vector<uint64_t>(words()));
+  }
+  compute(state, cache_.front().second.data());
+  index_[state] = cache_.begin();
+  return cache_.front().second.data();
+}
+
+}  // namespace qnnllm
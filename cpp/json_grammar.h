@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace qnnllm {
+
+struct JsonGrammarOptions {
+  enum Root : uint8_t {
+    Any = 0,
+    Object = 1,
+    Array = 2,
+  };
+
+  Root    root = Object;       // Type of the top-level value
+  uint8_t max_whitespace = 8;  // Consecutive whitespace bytes, bounds runaway indentation
+};
+
+// -----------------------------------------------------------------------------
+// Byte-level JSON recognizer. It accepts every prefix of a valid document and
+// nothing else. A state is a small value, copied freely while exploring token
+// texts. Nesting is limited to MAX_DEPTH levels.
+// -----------------------------------------------------------------------------
+class JsonState {
+public:
+  static constexpr uint16_t MAX_DEPTH = 64;
+
+  explicit JsonState(const JsonGrammarOptions &options = JsonGrammarOptions());
+
+  /**
+   * @return false if byte cannot continue the document, the state is then undefined
+   */
+  bool advance(uint8_t byte);
+
+  bool advance(const std::string &bytes);
+
+  /**
+   * Whether the document may end here.
+   */
+  bool complete() const;
+
+  bool operator==(const JsonState &other) const;
+
+  size_t hash() const;
+
+private:
+  bool value(uint8_t byte);
+
+  bool afterValue(uint8_t byte);
+
+  bool whitespace(uint8_t byte);
+
+  bool push(bool object);
+
+  bool pop(bool object);
+
+  uint64_t stack_ = 0;   // Bit per level, set for objects
+  uint16_t depth_ = 0;
+  uint8_t  mode_;
+  uint8_t  sub_ = 0;     // Progress inside a number, literal or escape
+  uint8_t  ws_ = 0;      // Consecutive whitespace bytes so far
+  uint8_t  max_ws_;
+  uint8_t  root_;
+  bool     key_ = false;  // The string being read is an object key
+};
+
+// -----------------------------------------------------------------------------
+// Which tokens may follow a JsonState. Token texts are sorted so that tokens
+// sharing a prefix are walked once up to their common prefix, like a trie, and
+// every token extending a rejected prefix is skipped. Masks of recent states
+// are cached, the state inside a string or between values recurs constantly.
+// -----------------------------------------------------------------------------
+class JsonTokenMask {
+public:
+  /**
+   * @param vocab Text of every token ID
+   * @param eos_token Allowed once the document is complete, and only then
+   */
+  JsonTokenMask(const std::vector<std::string> &vocab, int32_t eos_token);
+
+  /**
+   * @return Bit i is set if token i may follow state, valid until the next call
+   */
+  const uint64_t *allowed(const JsonState &state, bool *cached = nullptr);
+
+  size_t vocabSize() const;
+
+  /**
+   * 64-bit words per mask.
+   */
+  size_t words() const;
+
+  const std::string &text(int32_t token) const;
+
+private:
+  static constexpr size_t CACHE_SIZE = 32;
+
+  struct StateHash {
+    size_t operator()(const JsonState &state) const { return state.hash(); }
+  };
+
+  typedef std::list<std::pair<JsonState, std::vector<uint64_t>>> CacheList;
+
+  void compute(const JsonState &state, uint64_t *mask);
+
+  std::vector<std::string> vocab_;
+  int32_t                  eos_;
+  std::vector<uint32_t>    order_;   // Token IDs sorted by text
+  std::vector<uint16_t>    prefix_;  // Common prefix length of order_[i] with order_[i - 1]
+  std::vector<JsonState>   states_;  // State after each byte of the token being walked
+  CacheList                cache_;   // Most recently used first
+  std::unordered_map<JsonState, CacheList::iterator, StateHash> index_;
+};
+
+}  // namespace qnnllm
@@ -0,0 +1,688 @@
+#include "log.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#endif
+
+namespace qnnllm {
+namespace log {
+
+// -----------------------------------------------------------------------------
+// Record layout inside a thread's ring (8-byte aligned):
+//
+//   u32 size         Record bytes including the header, RING_WRAP marks skip-to-start
+//   u32 text_length  Format or formatted message, without its NUL
+//   u64 time_us
+//   u8  level, u8 deferred, u8[6] padding
+//   char text[text_length + 1], padded to 8 bytes
+//   deferred only: the arguments in order, * widths and precisions included.
+//     Scalars take 8 bytes, strings a u32 length and their NUL-terminated
+//     bytes padded to 8.
+// -----------------------------------------------------------------------------
+static constexpr uint32_t RING_WRAP = 0xFFFFFFFFu;
+static constexpr size_t   RING_CAPACITY = 64 * 1024;
+static constexpr size_t   MAX_SPECS = 16;
+static constexpr size_t   MAX_STRING = 1024;   // Bytes of a %s argument kept
+static constexpr size_t   MAX_MESSAGE = 1024;  // Bytes of a message formatted by the caller
+static constexpr auto     DRAIN_INTERVAL = std::chrono::milliseconds(100);
+
+struct RecordHeader {
+  uint32_t size;
+  uint32_t text_length;
+  uint64_t time_us;
+  uint8_t  level;
+  uint8_t  deferred;
+  uint8_t  padding[6];
+};
+static_assert(sizeof(RecordHeader) == 24, "RecordHeader must stay packed to 8 bytes");
+
+static size_t align8(size_t size) {
+  return (size + 7) & ~(size_t)7;
+}
+
+// -----------------------------------------------------------------------------
+// printf conversions
+// -----------------------------------------------------------------------------
+
+enum ArgKind : uint8_t { ARG_INT, ARG_UINT, ARG_DOUBLE, ARG_CHAR, ARG_POINTER, ARG_STRING };
+enum ArgLength : uint8_t { LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_Z, LEN_J, LEN_T };
+
+struct Spec {
+  ArgKind   kind;
+  ArgLength length;
+  bool      star_width;
+  bool      star_precision;
+  int       precision;  // -1 if none or given by an argument
+  size_t    prefix;     // Characters of flags, width and precision after the %
+};
+
+// Parse the conversion after a '%', returning the character after it, or null
+// if the arguments cannot be captured
+static const char *parseSpec(const char *p, Spec *spec) {
+  const char *start = p;
+  while (*p != '\0' && std::strchr("-+ #0'", *p) != nullptr) ++p;
+  spec->star_width = *p == '*';
+  if (spec->star_width) {
+    ++p;
+  } else {
+    while (*p >= '0' && *p <= '9') ++p;
+  }
+  spec->precision = -1;
+  spec->star_precision = false;
+  if (*p == '.') {
+    ++p;
+    spec->star_precision = *p == '*';
+    if (spec->star_precision) {
+      ++p;
+    } else {
+      spec->precision = 0;
+      while (*p >= '0' && *p <= '9') spec->precision = spec->precision * 10 + (*p++ - '0');
+    }
+  }
+  spec->prefix = p - start;
+  spec->length = LEN_NONE;
+  switch (*p) {
+    case 'h':
+      spec->length = p[1] == 'h' ? LEN_HH : LEN_H;
+      p += p[1] == 'h' ? 2 : 1;
+      break;
+    case 'l':
+      spec->length = p[1] == 'l' ? LEN_LL : LEN_L;
+      p += p[1] == 'l' ? 2 : 1;
+      break;
+    case 'z': spec->length = LEN_Z; ++p; break;
+    case 'j': spec->length = LEN_J; ++p; break;
+    case 't': spec->length = LEN_T; ++p; break;
+  }
+  switch (*p) {
+    case 'd':
+    case 'i':
+      spec->kind = ARG_INT;
+      break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      spec->kind = ARG_UINT;
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      spec->kind = ARG_DOUBLE;
+      break;
+    case 'c':
+      if (spec->length != LEN_NONE) return nullptr;
+      spec->kind = ARG_CHAR;
+      break;
+    case 'p':
+      spec->kind = ARG_POINTER;
+      break;
+    case 's':
+      if (spec->length != LEN_NONE) return nullptr;
+      spec->kind = ARG_STRING;
+      break;
+    default:
+      // %n, long double and extensions
+      return nullptr;
+  }
+  return p + 1;
+}
+
+// One captured argument, strings still point at the caller's memory
+struct Arg {
+  uint64_t    bits;
+  const char *text;
+  uint32_t    length;
+  bool        string;
+};
+
+static uint64_t readInt(ArgLength length, va_list &args) {
+  switch (length) {
+    case LEN_HH: return (uint64_t)(int64_t)(signed char)va_arg(args, int);
+    case LEN_H: return (uint64_t)(int64_t)(short)va_arg(args, int);
+    case LEN_L: return (uint64_t)(int64_t)va_arg(args, long);
+    case LEN_LL: return (uint64_t)(int64_t)va_arg(args, long long);
+    case LEN_Z: return (uint64_t)(int64_t)va_arg(args, ssize_t);
+    case LEN_J: return (uint64_t)(int64_t)va_arg(args, intmax_t);
+    case LEN_T: return (uint64_t)(int64_t)va_arg(args, ptrdiff_t);
+    default: return (uint64_t)(int64_t)va_arg(args, int);
+  }
+}
+
+static uint64_t readUnsigned(ArgLength length, va_list &args) {
+  switch (length) {
+    case LEN_HH: return (unsigned char)va_arg(args, unsigned int);
+    case LEN_H: return (unsigned short)va_arg(args, unsigned int);
+    case LEN_L: return va_arg(args, unsigned long);
+    case LEN_LL: return va_arg(args, unsigned long long);
+    case LEN_Z: return va_arg(args, size_t);
+    case LEN_J: return va_arg(args, uintmax_t);
+    case LEN_T: return (uint64_t)va_arg(args, ptrdiff_t);
+    default: return va_arg(args, unsigned int);
+  }
+}
+
+static void appendFormat(std::string &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void appendFormat(std::string &out, const char *fmt, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, fmt);
+  va_list retry;
+  va_copy(retry, args);
+  const int length = vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+  if (length >= (int)sizeof(buffer)) {
+    const size_t offset = out.size();
+    out.resize(offset + length + 1);
+    vsnprintf(&out[offset], length + 1, fmt, retry);
+    out.resize(offset + length);
+  } else if (length > 0) {
+    out.append(buffer, length);
+  }
+  va_end(retry);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+// Format one conversion with its * arguments, spec is rebuilt by formatDeferred
+template <typename T>
+static void appendSpec(std::string &out, const char *spec, const int *stars, int count, T value) {
+  switch (count) {
+    case 0: appendFormat(out, spec, value); break;
+    case 1: appendFormat(out, spec, stars[0], value); break;
+    default: appendFormat(out, spec, stars[0], stars[1], value); break;
+  }
+}
+#pragma GCC diagnostic pop
+
+// Reader over the argument bytes of a record
+class ArgReader {
+public:
+  ArgReader(const uint8_t *data, const uint8_t *end) : data_(data), end_(end) {}
+
+  uint64_t scalar() {
+    uint64_t bits = 0;
+    if (data_ + sizeof(bits) <= end_) std::memcpy(&bits, data_, sizeof(bits));
+    data_ += sizeof(bits);
+    return bits;
+  }
+
+  const char *string() {
+    uint32_t length = 0;
+    if (data_ + sizeof(length) > end_) return "";
+    std::memcpy(&length, data_, sizeof(length));
+    const char *text = reinterpret_cast<const char *>(data_ + sizeof(length));
+    data_ += align8(sizeof(length) + length + 1);
+    return data_ <= end_ ? text : "";
+  }
+
+private:
+  const uint8_t *data_;
+  const uint8_t *end_;
+};
+
+static std::string formatDeferred(const char *fmt, const uint8_t *args, const uint8_t *end) {
+  std::string out;
+  ArgReader reader(args, end);
+  for (const char *p = fmt; *p != '\0';) {
+    if (*p != '%') {
+      const char *next = std::strchr(p, '%');
+      const size_t length = next != nullptr ? (size_t)(next - p) : std::strlen(p);
+      out.append(p, length);
+      p += length;
+      continue;
+    }
+    if (p[1] == '%') {
+      out += '%';
+      p += 2;
+      continue;
+    }
+    Spec spec;
+    const char *next = parseSpec(p + 1, &spec);
+    if (next == nullptr || spec.prefix > 32) {
+      out.append(p);
+      break;
+    }
+    // Integers are widened to 64 bits when captured
+    char sub[48];
+    size_t n = 0;
+    sub[n++] = '%';
+    std::memcpy(sub + n, p + 1, spec.prefix);
+    n += spec.prefix;
+    if (spec.kind == ARG_INT || spec.kind == ARG_UINT) {
+      sub[n++] = 'l';
+      sub[n++] = 'l';
+    }
+    sub[n++] = next[-1];
+    sub[n] = '\0';
+    int stars[2];
+    int count = 0;
+    if (spec.star_width) stars[count++] = (int)reader.scalar();
+    if (spec.star_precision) stars[count++] = (int)reader.scalar();
+    switch (spec.kind) {
+      case ARG_INT: appendSpec(out, sub, stars, count, (long long)reader.scalar()); break;
+      case ARG_UINT: appendSpec(out, sub, stars, count, (unsigned long long)reader.scalar()); break;
+      case ARG_DOUBLE: {
+        const uint64_t bits = reader.scalar();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        appendSpec(out, sub, stars, count, value);
+        break;
+      }
+      case ARG_CHAR: appendSpec(out, sub, stars, count, (int)reader.scalar()); break;
+      case ARG_POINTER: appendSpec(out, sub, stars, count, (void *)(uintptr_t)reader.scalar()); break;
+      case ARG_STRING: appendSpec(out, sub, stars, count, reader.string()); break;
+    }
+    p = next;
+  }
+  return out;
+}
+
+// -----------------------------------------------------------------------------
+// Per-thread rings
+// -----------------------------------------------------------------------------
+
+// Single-producer/single-consumer byte ring, positions grow monotonically
+struct LogRing {
+  alignas(8) uint8_t    data[RING_CAPACITY];
+  uint32_t              thread = 0;
+  std::atomic<uint64_t> write_pos{0};
+  std::atomic<uint64_t> read_pos{0};
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<bool>     retired{false};  // Its thread exited
+
+  // Producer: space for a record of size bytes, or null if the ring is full
+  uint8_t *reserve(size_t size, uint64_t *end) {
+    const uint64_t pos = write_pos.load(std::memory_order_relaxed);
+    const size_t offset = pos % RING_CAPACITY;
+    const size_t remaining = RING_CAPACITY - offset;
+    const size_t skip = remaining < size ? remaining : 0;
+    if (pos + skip + size - read_pos.load(std::memory_order_acquire) > RING_CAPACITY) {
+      dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    if (skip > 0) std::memcpy(data + offset, &RING_WRAP, sizeof(RING_WRAP));
+    *end = pos + skip + size;
+    return data + (pos + skip) % RING_CAPACITY;
+  }
+
+  // Producer: publish the reserved record
+  void commit(uint64_t end) {
+    written.store(written.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    write_pos.store(end, std::memory_order_release);
+  }
+
+  size_t used() const {
+    return write_pos.load(std::memory_order_relaxed) - read_pos.load(std::memory_order_relaxed);
+  }
+};
+
+class Logger {
+public:
+  static Logger &shared() {
+    // Never destroyed: threads may log while statics are torn down
+    static Logger *instance = new Logger();
+    return *instance;
+  }
+
+  void add(const std::shared_ptr<LogRing> &ring) {
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    rings_.push_back(ring);
+  }
+
+  // Producer: the drainer is woken early for errors and filling rings
+  void written(const LogRing &ring, int level) {
+    if (stopped_.load(std::memory_order_acquire)) {
+      drain();
+    } else if (level == GENIE_LOG_LEVEL_ERROR || ring.used() > RING_CAPACITY / 2) {
+      if (!wake_.exchange(true, std::memory_order_acq_rel)) cv_.notify_one();
+    }
+  }
+
+  // Format and emit everything written so far, on the calling thread
+  void drain() {
+    std::lock_guard<std::mutex> drainLock(drainMutex_);
+    std::vector<std::shared_ptr<LogRing>> rings;
+    {
+      std::lock_guard<std::mutex> lock(ringsMutex_);
+      rings = rings_;
+    }
+    std::vector<LogRecord> pending;
+    for (auto &ring : rings) read(*ring, pending);
+    // Rings are drained one after the other, interleave their records again
+    std::stable_sort(pending.begin(), pending.end(),
+                     [](const LogRecord &a, const LogRecord &b) { return a.time_us < b.time_us; });
+    for (auto &record : pending) emit(record);
+    {
+      std::lock_guard<std::mutex> lock(historyMutex_);
+      for (auto &record : pending) {
+        history_.push_back(std::move(record));
+        if (history_.size() > QNN_LOG_HISTORY) history_.pop_front();
+      }
+      emitted_ += pending.size();
+    }
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [&](const std::shared_ptr<LogRing> &ring) {
+      if (!ring->retired.load(std::memory_order_acquire) || ring->used() > 0) return false;
+      retiredWritten_ += ring->written.load(std::memory_order_relaxed);
+      retiredDropped_ += ring->dropped.load(std::memory_order_relaxed);
+      return true;
+    }), rings_.end());
+  }
+
+  std::vector<LogRecord> history(size_t limit) {
+    drain();
+    std::lock_guard<std::mutex> lock(historyMutex_);
+    const size_t count = limit > 0 ? std::min(limit, history_.size()) : history_.size();
+    return std::vector<LogRecord>(history_.end() - count, history_.end());
+  }
+
+  LogStats stats() {
+    LogStats stats{};
+    {
+      std::lock_guard<std::mutex> lock(ringsMutex_);
+      stats.written = retiredWritten_;
+      stats.dropped = retiredDropped_;
+      for (auto &ring : rings_) {
+        stats.written += ring->written.load(std::memory_order_relaxed);
+        stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+      }
+      stats.threads = rings_.size();
+    }
+    std::lock_guard<std::mutex> lock(historyMutex_);
+    stats.emitted = emitted_;
+    stats.history = history_.size();
+    return stats;
+  }
+
+private:
+  Logger() {
+    drainer_ = std::thread([this] { run(); });
+    std::atexit([] { shared().stop(); });
+  }
+
+  void run() {
+    while (!stopped_.load(std::memory_order_acquire)) {
+      {
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        cv_.wait_for(lock, DRAIN_INTERVAL, [this] {
+          return wake_.load(std::memory_order_acquire) || stopped_.load(std::memory_order_acquire);
+        });
+        wake_.store(false, std::memory_order_relaxed);
+      }
+      drain();
+    }
+  }
+
+  // At exit: emit what is left, later records are emitted by their callers
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(wakeMutex_);
+      stopped_.store(true, std::memory_order_release);
+    }
+    cv_.notify_one();
+    if (drainer_.joinable()) drainer_.join();
+    drain();
+  }
+
+  static void read(LogRing &ring, std::vector<LogRecord> &pending) {
+    uint64_t pos = ring.read_pos.load(std::memory_order_relaxed);
+    const uint64_t end = ring.write_pos.load(std::memory_order_acquire);
+    while (pos < end) {
+      const size_t offset = pos % RING_CAPACITY;
+      RecordHeader header;
+      std::memcpy(&header.size, ring.data + offset, sizeof(header.size));
+      if (header.size == RING_WRAP) {
+        pos += RING_CAPACITY - offset;
+        continue;
+      }
+      std::memcpy(&header, ring.data + offset, sizeof(header));
+      const uint8_t *record = ring.data + offset;
+      const char *text = reinterpret_cast<const char *>(record + sizeof(header));
+      LogRecord item;
+      item.time_us = header.time_us;
+      item.level = header.level;
+      item.thread = ring.thread;
+      if (header.deferred) {
+        const uint8_t *args = record + sizeof(header) + align8(header.text_length + 1);
+        item.message = formatDeferred(text, args, record + header.size);
+      } else {
+        item.message.assign(text, header.text_length);
+      }
+      pending.push_back(std::move(item));
+      pos += header.size;
+    }
+    ring.read_pos.store(pos, std::memory_order_release);
+  }
+
+  static void emit(const LogRecord &record) {
+#ifdef __ANDROID__
+    int priority = ANDROID_LOG_DEBUG;
+    switch (record.level) {
+      case GENIE_LOG_LEVEL_ERROR: priority = ANDROID_LOG_ERROR; break;
+      case GENIE_LOG_LEVEL_WARN: priority = ANDROID_LOG_WARN; break;
+      case GENIE_LOG_LEVEL_INFO: priority = ANDROID_LOG_INFO; break;
+    }
+    __android_log_write(priority, LOG_TAG, record.message.c_str());
+#else
+    fprintf(stderr, LOG_TAG ": %s\n", record.message.c_str());
+#endif
+  }
+
+  std::thread                           drainer_;
+  std::mutex                            wakeMutex_;
+  std::condition_variable               cv_;
+  std::atomic<bool>                     wake_{false};
+  std::atomic<bool>                     stopped_{false};
+  std::mutex                            drainMutex_;  // One drain at a time, the rings have one consumer
+  std::mutex                            ringsMutex_;  // Guards rings_ and the retired totals
+  std::vector<std::shared_ptr<LogRing>> rings_;
+  uint64_t                              retiredWritten_ = 0;
+  uint64_t                              retiredDropped_ = 0;
+  std::mutex                            historyMutex_;  // Guards history_ and emitted_
+  std::deque<LogRecord>                 history_;
+  uint64_t                              emitted_ = 0;
+};
+
+// The calling thread's ring, retired for the drainer to release when the thread exits
+struct ThreadRing {
+  std::shared_ptr<LogRing> ring;
+
+  ~ThreadRing() {
+    if (ring) ring->retired.store(true, std::memory_order_release);
+  }
+
+  LogRing &get() {
+    if (!ring) {
+      ring = std::make_shared<LogRing>();
+      ring->thread = (uint32_t)syscall(SYS_gettid);
+      Logger::shared().add(ring);
+    }
+    return *ring;
+  }
+};
+
+static thread_local ThreadRing t_ring;
+
+static uint64_t nowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Write a record with its text formatted by the caller
+static void writeFormatted(LogRing &ring, int level, uint64_t time_us, const char *fmt, va_list args) {
+  char message[MAX_MESSAGE];
+  const int length = vsnprintf(message, sizeof(message), fmt, args);
+  const size_t textLength = length < 0 ? 0 : std::min<size_t>(length, sizeof(message) - 1);
+  uint64_t end;
+  uint8_t *record = ring.reserve(sizeof(RecordHeader) + align8(textLength + 1), &end);
+  if (record == nullptr) return;
+  RecordHeader header{};
+  header.size = (uint32_t)(sizeof(RecordHeader) + align8(textLength + 1));
+  header.text_length = (uint32_t)textLength;
+  header.time_us = time_us;
+  header.level = (uint8_t)level;
+  std::memcpy(record, &header, sizeof(header));
+  std::memcpy(record + sizeof(header), message, textLength);
+  record[sizeof(header) + textLength] = '\0';
+  ring.commit(end);
+}
+
+void vwrite(int level, const char *fmt, va_list args) {
+  if (level > QNN_LOG_LEVEL || fmt == nullptr) return;
+  const uint64_t time_us = nowUs();
+  LogRing &ring = t_ring.get();
+
+  // Capture the arguments as the conversions in fmt read them
+  Spec specs[MAX_SPECS];
+  size_t specCount = 0;
+  bool deferred = true;
+  const char *p = fmt;
+  for (; *p != '\0'; ++p) {
+    if (*p != '%') continue;
+    if (p[1] == '%') {
+      ++p;
+      continue;
+    }
+    const char *next = specCount < MAX_SPECS ? parseSpec(p + 1, &specs[specCount]) : nullptr;
+    if (next == nullptr) {
+      deferred = false;
+      break;
+    }
+    ++specCount;
+    p = next - 1;
+  }
+  if (!deferred) {
+    writeFormatted(ring, level, time_us, fmt, args);
+    Logger::shared().written(ring, level);
+    return;
+  }
+  const size_t fmtLength = p - fmt;
+
+  Arg values[MAX_SPECS * 3];
+  size_t valueCount = 0;
+  size_t argBytes = 0;
+  va_list copy;
+  va_copy(copy, args);
+  for (size_t i = 0; i < specCount; ++i) {
+    const Spec &spec = specs[i];
+    int precision = spec.precision;
+    if (spec.star_width) values[valueCount++] = Arg{(uint64_t)(int64_t)va_arg(copy, int), nullptr, 0, false};
+    if (spec.star_precision) {
+      precision = va_arg(copy, int);
+      values[valueCount++] = Arg{(uint64_t)(int64_t)precision, nullptr, 0, false};
+    }
+    Arg &value = values[valueCount++];
+    value = Arg{0, nullptr, 0, false};
+    switch (spec.kind) {
+      case ARG_INT: value.bits = readInt(spec.length, copy); break;
+      case ARG_UINT: value.bits = readUnsigned(spec.length, copy); break;
+      case ARG_DOUBLE: {
+        const double number = va_arg(copy, double);
+        std::memcpy(&value.bits, &number, sizeof(number));
+        break;
+      }
+      case ARG_CHAR: value.bits = (uint64_t)va_arg(copy, int); break;
+      case ARG_POINTER: value.bits = (uint64_t)(uintptr_t)va_arg(copy, void *); break;
+      case ARG_STRING: {
+        const char *text = va_arg(copy, const char *);
+        if (text == nullptr) text = "(null)";
+        const size_t limit = precision >= 0 ? std::min<size_t>(precision, MAX_STRING) : MAX_STRING;
+        value.string = true;
+        value.text = text;
+        value.length = (uint32_t)strnlen(text, limit);
+        break;
+      }
+    }
+  }
+  va_end(copy);
+  for (size_t i = 0; i < valueCount; ++i) {
+    argBytes += values[i].string ? align8(sizeof(uint32_t) + values[i].length + 1) : sizeof(uint64_t);
+  }
+
+  const size_t textBytes = align8(fmtLength + 1);
+  const size_t size = sizeof(RecordHeader) + textBytes + argBytes;
+  if (size > RING_CAPACITY / 4) {
+    writeFormatted(ring, level, time_us, fmt, args);
+    Logger::shared().written(ring, level);
+    return;
+  }
+  uint64_t end;
+  uint8_t *record = ring.reserve(size, &end);
+  if (record == nullptr) return;
+  RecordHeader header{};
+  header.size = (uint32_t)size;
+  header.text_length = (uint32_t)fmtLength;
+  header.time_us = time_us;
+  header.level = (uint8_t)level;
+  header.deferred = 1;
+  std::memcpy(record, &header, sizeof(header));
+  uint8_t *out = record + sizeof(header);
+  std::memcpy(out, fmt, fmtLength + 1);
+  out += textBytes;
+  for (size_t i = 0; i < valueCount; ++i) {
+    const Arg &value = values[i];
+    if (!value.string) {
+      std::memcpy(out, &value.bits, sizeof(value.bits));
+      out += sizeof(value.bits);
+      continue;
+    }
+    std::memcpy(out, &value.length, sizeof(value.length));
+    std::memcpy(out + sizeof(value.length), value.text, value.length);
+    out[sizeof(value.length) + value.length] = '\0';
+    out += align8(sizeof(value.length) + value.length + 1);
+  }
+  ring.commit(end);
+  Logger::shared().written(ring, level);
+}
+
+void write(int level, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vwrite(level, fmt, args);
+  va_end(args);
+}
+
+void flush() {
+  Logger::shared().drain();
+}
+
+std::vector<LogRecord> history(size_t limit) {
+  return Logger::shared().history(limit);
+}
+
+LogStats stats() {
+  return Logger::shared().stats();
+}
+
+const char *levelName(int level) {
+  switch (level) {
+    case GENIE_LOG_LEVEL_ERROR: return "error";
+    case GENIE_LOG_LEVEL_WARN: return "warn";
+    case GENIE_LOG_LEVEL_INFO: return "info";
+    default: return "verbose";
+  }
+}
+
+}  // namespace log
+}  // namespace qnnllm
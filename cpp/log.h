@@ -1,19 +1,80 @@
-#ifdef __ANDROID__
-#include <android/log.h>
+#pragma once
+
+#include "GenieLog.h"
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Most verbose GenieLog_Level_t kept, more verbose LOG* calls compile to nothing
+#ifndef QNN_LOG_LEVEL
+#define QNN_LOG_LEVEL GENIE_LOG_LEVEL_INFO
+#endif
+
+// Formatted records kept in memory for log::history()
+#ifndef QNN_LOG_HISTORY
+#define QNN_LOG_HISTORY 1024
 #endif
 
 #define LOG_TAG "QnnLlm"
 
-#ifdef __ANDROID__
-#define LOGI(fmt, ...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, fmt, ##__VA_ARGS__)
-#define LOGE(fmt, ...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, fmt, ##__VA_ARGS__)
-#define LOGW(fmt, ...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, fmt, ##__VA_ARGS__)
-#define LOGD(fmt, ...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, fmt, ##__VA_ARGS__)
+#define QNN_LOG(level, fmt, ...)                                  \
+  do {                                                            \
+    if ((level) <= QNN_LOG_LEVEL) {                               \
+      ::qnnllm::log::write((level), fmt, ##__VA_ARGS__);          \
+    }                                                             \
+  } while (0)
 
-#else
-#define LOGI(fmt, ...) printf(fmt, ##__VA_ARGS__)
-#define LOGE(fmt, ...) printf(fmt, ##__VA_ARGS__)
-#define LOGW(fmt, ...) printf(fmt, ##__VA_ARGS__)
-#define LOGD(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#define LOGE(fmt, ...) QNN_LOG(GENIE_LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) QNN_LOG(GENIE_LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOGI(fmt, ...) QNN_LOG(GENIE_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...) QNN_LOG(GENIE_LOG_LEVEL_VERBOSE, fmt, ##__VA_ARGS__)
 
-#endif
+namespace qnnllm {
+namespace log {
+
+struct LogRecord {
+  uint64_t    time_us;  // Wall clock, us since epoch
+  int         level;    // GenieLog_Level_t
+  uint32_t    thread;   // Kernel thread ID of the caller
+  std::string message;
+};
+
+struct LogStats {
+  uint64_t written;  // Records taken by the rings
+  uint64_t dropped;  // Records lost to a full ring
+  uint64_t emitted;  // Records formatted and sent to logcat or stderr
+  size_t   threads;  // Threads with a ring
+  size_t   history;  // Records in the history
+};
+
+// -----------------------------------------------------------------------------
+// Logging without formatting or I/O on the calling thread. A call copies the
+// format and its arguments into a lock-free ring owned by the thread and
+// returns; a drainer thread formats the records of every ring in time order,
+// sends them to logcat (stderr on the host) and keeps the latest ones in
+// memory. A record that does not fit its ring is dropped and counted. Formats
+// with %n or long double arguments are formatted by the caller instead.
+// -----------------------------------------------------------------------------
+
+void write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void vwrite(int level, const char *fmt, va_list args);
+
+/**
+ * Format and emit every record written so far, on the calling thread.
+ */
+void flush();
+
+/**
+ * The latest records, oldest first, after a flush.
+ * @param limit Most records returned, 0 for the whole history
+ */
+std::vector<LogRecord> history(size_t limit = 0);
+
+LogStats stats();
+
+const char *levelName(int level);
+
+}  // namespace log
+}  // namespace qnnllm
@@ -0,0 +1,112 @@
+#include "lora.h"
+#include "log.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace qnnllm {
+
+// Ask the kernel to read the file ahead, or to drop its cached pages
+static void adviseFile(const std::string &path, bool willNeed) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOGW("Failed to open LoRA adapter %s", path.c_str());
+    return;
+  }
+  posix_fadvise(fd, 0, 0, willNeed ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+LoraAdapters::LoraAdapters(const char *config_str) {
+  stats_.capacity = capacity_;
+  auto config = nlohmann::json::parse(config_str, nullptr, false);
+  if (config.is_discarded() || !config.contains("dialog")) return;
+  const auto &engine = config["dialog"].value("engine", nlohmann::json());
+  std::vector<nlohmann::json> engines;
+  if (engine.is_array()) {
+    engines.assign(engine.begin(), engine.end());
+  } else if (engine.is_object()) {
+    engines.push_back(engine);
+  }
+  for (auto &item : engines) {
+    auto lora = item.value(nlohmann::json::json_pointer("/model/binary/lora"), nlohmann::json());
+    if (!lora.is_object() || !lora.contains("adapters")) continue;
+    for (auto &adapter : lora["adapters"]) {
+      auto &files = files_[adapter.value("name", "")];
+      for (auto &section : adapter.value("bin-sections", nlohmann::json::array())) {
+        if (section.is_string()) files.push_back(section.get<std::string>());
+      }
+    }
+  }
+  files_.erase("");
+}
+
+bool LoraAdapters::contains(const std::string &adapter) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return files_.count(adapter) > 0;
+}
+
+bool LoraAdapters::touch(const std::string &adapter) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = std::find(resident_.begin(), resident_.end(), adapter);
+  const bool resident = it != resident_.end();
+  if (resident) {
+    resident_.splice(resident_.begin(), resident_, it);
+  } else {
+    resident_.push_front(adapter);
+  }
+  // Readahead is asynchronous, it overlaps with Genie opening the files
+  auto files = files_.find(adapter);
+  if (files != files_.end()) {
+    for (auto &path : files->second) adviseFile(path, true);
+  }
+  while (resident_.size() > capacity_) {
+    release(resident_.back());
+    resident_.pop_back();
+  }
+  return resident;
+}
+
+void LoraAdapters::setCapacity(size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  capacity_ = std::max<size_t>(1, capacity);
+  stats_.capacity = capacity_;
+  while (resident_.size() > capacity_) {
+    release(resident_.back());
+    resident_.pop_back();
+  }
+}
+
+void LoraAdapters::release(const std::string &adapter) {
+  auto files = files_.find(adapter);
+  if (files == files_.end()) return;
+  for (auto &path : files->second) adviseFile(path, false);
+}
+
+void LoraAdapters::recordSwap(const std::string &engine, const std::string &adapter, double swap_ms,
+                              bool resident) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.engine = engine;
+  stats_.adapter = adapter;
+  ++stats_.swaps;
+  if (resident) ++stats_.resident_hits;
+  stats_.last_swap_ms = swap_ms;
+  stats_.max_swap_ms = std::max(stats_.max_swap_ms, swap_ms);
+  total_swap_ms_ += swap_ms;
+  stats_.avg_swap_ms = total_swap_ms_ / stats_.swaps;
+}
+
+void LoraAdapters::recordSkip() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.skipped;
+}
+
+LoraStats LoraAdapters::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  LoraStats stats = stats_;
+  stats.resident.assign(resident_.begin(), resident_.end());
+  return stats;
+}
+
+}  // namespace qnnllm
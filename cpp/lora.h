@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace qnnllm {
+
+struct LoraStats {
+  std::string              engine;         // Engine of the applied adapter
+  std::string              adapter;        // Applied adapter, empty for the base model
+  uint64_t                 swaps;          // Adapters applied
+  uint64_t                 skipped;        // Requests for the adapter already applied
+  uint64_t                 resident_hits;  // Swaps to an adapter kept resident
+  double                   last_swap_ms;   // Apply plus KV cache reset
+  double                   avg_swap_ms;
+  double                   max_swap_ms;
+  size_t                   capacity;       // Adapters kept resident
+  std::vector<std::string> resident;       // Most recently used first
+};
+
+// -----------------------------------------------------------------------------
+// LoRA adapters declared in a dialog config, and the most recently used ones
+// kept in the page cache. Genie reads the adapter bin-sections from disk on
+// every apply, so switching back to a resident adapter skips the flash reads.
+// Residency is a hint to the kernel (posix_fadvise), not pinned memory.
+// -----------------------------------------------------------------------------
+class LoraAdapters {
+public:
+  static constexpr size_t DEFAULT_CAPACITY = 3;
+
+  /**
+   * Collects model.binary.lora.adapters of every engine in config_str.
+   */
+  explicit LoraAdapters(const char *config_str);
+
+  bool contains(const std::string &adapter) const;
+
+  /**
+   * Mark adapter as most recently used and read its files ahead, releasing
+   * those of the least recently used adapters beyond the capacity.
+   * @return Whether the adapter was already resident
+   */
+  bool touch(const std::string &adapter);
+
+  void setCapacity(size_t capacity);
+
+  /**
+   * Account for an apply that took swap_ms.
+   */
+  void recordSwap(const std::string &engine, const std::string &adapter, double swap_ms, bool resident);
+
+  void recordSkip();
+
+  LoraStats stats() const;
+
+private:
+  void release(const std::string &adapter);
+
+  mutable std::mutex                              mutex_;
+  std::map<std::string, std::vector<std::string>> files_;  // Adapter name to bin-sections
+  std::list<std::string>                          resident_;
+  size_t                                          capacity_ = DEFAULT_CAPACITY;
+  LoraStats                                       stats_{};
+  double                                          total_swap_ms_ = 0;
+};
+
+}  // namespace qnnllm
@@ -0,0 +1,286 @@
+#include "metrics.h"
+#include "trace.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace qnnllm {
+
+template <typename T>
+static double sortedPercentile(const std::vector<T> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+  return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+static double percentileOf(std::vector<double> values, double p) {
+  std::sort(values.begin(), values.end());
+  return sortedPercentile(values, p);
+}
+
+// Genie reports {"value": ..., "unit": ...}, times are normalized to ms
+static double profileValue(const nlohmann::json &event, const char *key) {
+  auto it = event.find(key);
+  if (it == event.end()) return 0;
+  if (it->is_number()) return it->get<double>();
+  if (!it->is_object()) return 0;
+  double value = it->value("value", 0.0);
+  std::string unit = it->value("unit", "");
+  if (unit == "us") return value / 1000.0;
+  if (unit == "s") return value * 1000.0;
+  return value;
+}
+
+GenieProfileStats parseGenieProfile(const std::string &profile) {
+  GenieProfileStats stats;
+  auto json = nlohmann::json::parse(profile, nullptr, false);
+  if (json.is_discarded() || !json.contains("components")) return stats;
+  for (auto &component : json["components"]) {
+    if (!component.contains("events")) continue;
+    auto &events = component["events"];
+    for (auto it = events.rbegin(); it != events.rend(); ++it) {
+      if (it->value("type", "") != "GenieDialog_query") continue;
+      stats.valid = true;
+      stats.prompt_tokens = (uint32_t)profileValue(*it, "num-prompt-tokens");
+      stats.generated_tokens = (uint32_t)profileValue(*it, "num-generated-tokens");
+      stats.prompt_rate = profileValue(*it, "prompt-processing-rate");
+      stats.ttft_ms = profileValue(*it, "time-to-first-token");
+      stats.token_rate = profileValue(*it, "token-generation-rate");
+      return stats;
+    }
+  }
+  return stats;
+}
+
+void traceGenieProfile(const std::string &profile, uint64_t begin_ns, uint64_t end_ns) {
+  auto json = nlohmann::json::parse(profile, nullptr, false);
+  if (json.is_discarded() || !json.contains("components")) return;
+  const nlohmann::json *event = nullptr;
+  for (auto &component : json["components"]) {
+    if (!component.contains("events")) continue;
+    for (auto &item : component["events"]) {
+      if (item.value("type", "") == "GenieDialog_query") event = &item;
+    }
+  }
+  if (event == nullptr) return;
+  const uint64_t genieStart = (uint64_t)(profileValue(*event, "start") * 1000);
+  const uint64_t genieStop = (uint64_t)(profileValue(*event, "stop") * 1000);
+  uint64_t start = genieStart, stop = genieStop;
+  if (genieStart < begin_ns || genieStop > end_ns || genieStop < genieStart) {
+    stop = end_ns;
+    start = end_ns - std::min<uint64_t>(end_ns - begin_ns, (uint64_t)(profileValue(*event, "duration") * 1000));
+  }
+  nlohmann::json args = nlohmann::json::object();
+  for (auto it = event->begin(); it != event->end(); ++it) {
+    if (it->is_object() && it->contains("value")) args[it.key()] = (*it)["value"];
+  }
+  const std::string argsJson = args.dump();
+  trace::recordExternal("GenieDialog_query", "Genie", start, stop, argsJson);
+  const uint64_t prefillEnd = std::min(stop, start + (uint64_t)(profileValue(*event, "time-to-first-token") * 1e6));
+  const uint64_t decodeEnd =
+    std::min(stop, prefillEnd + (uint64_t)(profileValue(*event, "token-generation-time") * 1e6));
+  trace::recordExternal("prefill", "Genie", start, prefillEnd);
+  trace::recordExternal("decode", "Genie", prefillEnd, decodeEnd);
+}
+
+const char *stopReasonName(StopReason reason) {
+  switch (reason) {
+    case StopReason::Complete: return "complete";
+    case StopReason::Aborted: return "aborted";
+    case StopReason::MaxTokens: return "max_tokens";
+    case StopReason::Deadline: return "deadline";
+    case StopReason::MaxTtft: return "max_ttft";
+  }
+  return "complete";
+}
+
+//------------------------------------------------------------------------------
+// QueryTimer
+//------------------------------------------------------------------------------
+
+uint64_t QueryTimer::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void QueryTimer::begin(uint64_t call_ns) {
+  call_ns_ = call_ns;
+  start_ns_ = dispatch_ns_ = now();
+  first_ns_ = last_ns_ = 0;
+  tokens_ = first_tokens_ = steps_ = 0;
+  aborted_ = false;
+  gaps_.clear();
+}
+
+void QueryTimer::dispatched() {
+  dispatch_ns_ = now();
+}
+
+void QueryTimer::fragment(uint32_t tokens) {
+  if (tokens == 0) return;
+  uint64_t time = now();
+  if (tokens_ == 0) {
+    first_ns_ = time;
+    first_tokens_ = tokens;
+  } else {
+    gaps_.push_back((float)((time - last_ns_) / 1e6));
+    ++steps_;
+  }
+  last_ns_ = time;
+  tokens_ += tokens;
+}
+
+void QueryTimer::abort() {
+  aborted_ = true;
+}
+
+uint32_t QueryTimer::tokens() const {
+  return tokens_;
+}
+
+QueryMetrics QueryTimer::finish() {
+  const uint64_t end = now();
+  QueryMetrics metrics;
+  metrics.queue_ms = (start_ns_ - call_ns_) / 1e6;
+  metrics.total_ms = (end - call_ns_) / 1e6;
+  metrics.tokens = tokens_;
+  metrics.aborted = aborted_;
+  if (tokens_ > 0) {
+    metrics.ttft_ms = (first_ns_ - call_ns_) / 1e6;
+    metrics.prefill_ms = first_ns_ > dispatch_ns_ ? (first_ns_ - dispatch_ns_) / 1e6 : 0;
+    metrics.decode_ms = (last_ns_ - first_ns_) / 1e6;
+    if (metrics.decode_ms > 0) {
+      metrics.tokens_per_s = (tokens_ - first_tokens_) * 1000.0 / metrics.decode_ms;
+    }
+  }
+  metrics.decode_steps = steps_;
+  if (steps_ > 0) {
+    metrics.tokens_per_step = (double)(tokens_ - first_tokens_) / steps_;
+    metrics.accepted_tokens = tokens_ - first_tokens_ - steps_;
+  }
+  if (!gaps_.empty()) {
+    std::vector<float> sorted(gaps_);
+    std::sort(sorted.begin(), sorted.end());
+    metrics.itl_p50_ms = sortedPercentile(sorted, 50);
+    metrics.itl_p90_ms = sortedPercentile(sorted, 90);
+    metrics.itl_p99_ms = sortedPercentile(sorted, 99);
+    metrics.itl_max_ms = sorted.back();
+  }
+  return metrics;
+}
+
+const std::vector<float> &QueryTimer::gaps() const {
+  return gaps_;
+}
+
+//------------------------------------------------------------------------------
+// LatencyHistogram
+//------------------------------------------------------------------------------
+
+double LatencyHistogram::upperBound(size_t bucket) {
+  return bucket + 1 >= BUCKETS ? INFINITY : 0.125 * (double)(1u << bucket);
+}
+
+void LatencyHistogram::add(double ms) {
+  // Smallest i with ms <= 0.125 * 2^i
+  size_t bucket = 0;
+  if (ms > 0.125) {
+    int exponent;
+    double mantissa = std::frexp(ms / 0.125, &exponent);
+    bucket = std::min<size_t>(BUCKETS - 1, mantissa == 0.5 ? exponent - 1 : exponent);
+  }
+  ++counts_[bucket];
+  ++total_;
+}
+
+double LatencyHistogram::percentile(double p) const {
+  if (total_ == 0) return 0;
+  uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p / 100.0 * total_));
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+    seen += counts_[bucket];
+    // The unbounded bucket reports the largest finite bound
+    if (seen >= rank) return upperBound(std::min(bucket, BUCKETS - 2));
+  }
+  return upperBound(BUCKETS - 2);
+}
+
+uint64_t LatencyHistogram::count() const {
+  return total_;
+}
+
+uint64_t LatencyHistogram::bucket(size_t index) const {
+  return index < BUCKETS ? counts_[index] : 0;
+}
+
+//------------------------------------------------------------------------------
+// MetricsAggregator
+//------------------------------------------------------------------------------
+
+void MetricsAggregator::add(const QueryMetrics &metrics, const std::vector<float> &gaps) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++queries_;
+  tokens_ += metrics.tokens;
+  if (metrics.aborted) ++aborted_;
+  if (metrics.tokens > 0) {
+    window_.push_back({metrics.ttft_ms, metrics.prefill_ms, metrics.tokens_per_s, metrics.tokens_per_step,
+                       metrics.acceptance_rate});
+    if (window_.size() > WINDOW) window_.pop_front();
+  }
+  for (float gap : gaps) itl_.add(gap);
+}
+
+MetricsStats MetricsAggregator::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  MetricsStats stats{};
+  stats.queries = queries_;
+  stats.tokens = tokens_;
+  stats.aborted = aborted_;
+  stats.window = window_.size();
+  std::vector<double> ttft, prefill, rate;
+  double perStep = 0, acceptance = 0;
+  size_t decoded = 0;
+  for (auto &sample : window_) {
+    ttft.push_back(sample.ttft_ms);
+    prefill.push_back(sample.prefill_ms);
+    // Single-token responses have no decode rate
+    if (sample.tokens_per_s > 0) rate.push_back(sample.tokens_per_s);
+    if (sample.tokens_per_step > 0) {
+      perStep += sample.tokens_per_step;
+      acceptance += sample.acceptance_rate;
+      ++decoded;
+    }
+  }
+  if (decoded > 0) {
+    stats.tokens_per_step_mean = perStep / decoded;
+    stats.acceptance_rate_mean = acceptance / decoded;
+  }
+  stats.ttft_p50_ms = percentileOf(ttft, 50);
+  stats.ttft_p90_ms = percentileOf(ttft, 90);
+  stats.ttft_p99_ms = percentileOf(ttft, 99);
+  stats.prefill_p50_ms = percentileOf(prefill, 50);
+  if (!rate.empty()) {
+    double sum = 0;
+    for (double value : rate) sum += value;
+    stats.tokens_per_s_mean = sum / rate.size();
+    stats.tokens_per_s_p50 = percentileOf(rate, 50);
+    stats.tokens_per_s_min = *std::min_element(rate.begin(), rate.end());
+  }
+  stats.itl_p50_ms = itl_.percentile(50);
+  stats.itl_p90_ms = itl_.percentile(90);
+  stats.itl_p99_ms = itl_.percentile(99);
+  for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS; ++bucket) {
+    stats.itl_histogram.push_back({LatencyHistogram::upperBound(bucket), itl_.bucket(bucket)});
+  }
+  return stats;
+}
+
+void MetricsAggregator::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  window_.clear();
+  itl_ = LatencyHistogram();
+  queries_ = tokens_ = aborted_ = 0;
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace qnnllm {
+
+// Genie's own view of the last query, parsed from GenieProfile_getJsonData
+struct GenieProfileStats {
+  bool     valid = false;        // A query event was found in the profile
+  uint32_t prompt_tokens = 0;    // Tokens prefilled, the rewound prefix excluded
+  uint32_t generated_tokens = 0;
+  double   prompt_rate = 0;      // Prefill tokens/s
+  double   ttft_ms = 0;
+  double   token_rate = 0;       // Decode tokens/s
+};
+
+// Why a query stopped generating
+enum class StopReason : int {
+  Complete = 0,   // End of sequence or a stop word
+  Aborted = 1,    // Context::abort()
+  MaxTokens = 2,  // QueryOptions limits
+  Deadline = 3,
+  MaxTtft = 4,
+};
+
+const char *stopReasonName(StopReason reason);
+
+// -----------------------------------------------------------------------------
+// Latency of one query as seen by the caller, timestamped on every Genie
+// response fragment with the monotonic clock. A text fragment counts as one
+// token; with the token API every fragment is one decode step, which in a
+// speculative dialog (ssd-q1, lade, spd) carries the accepted draft tokens too.
+// -----------------------------------------------------------------------------
+struct QueryMetrics {
+  double            queue_ms = 0;      // Waiting in the context scheduler
+  double            ttft_ms = 0;       // From the query call to the first token
+  double            prefill_ms = 0;    // From handing the prompt to Genie to the first token
+  double            decode_ms = 0;     // From the first to the last token
+  double            total_ms = 0;      // From the query call to completion
+  uint32_t          tokens = 0;
+  double            tokens_per_s = 0;  // Decode rate, the first token excluded
+  uint32_t          prompt_tokens = 0; // Tokens of the input, 0 without a tokenizer
+  uint32_t          reused_tokens = 0; // Leading input tokens the KV cache already held
+  uint32_t          decode_steps = 0;  // Fragments after the first one
+  double            tokens_per_step = 0;
+  uint32_t          accepted_tokens = 0; // Draft tokens accepted on top of one per step
+  double            acceptance_rate = 0; // accepted_tokens / (decode_steps * draft length)
+  double            itl_p50_ms = 0;    // Inter-token latency percentiles
+  double            itl_p90_ms = 0;
+  double            itl_p99_ms = 0;
+  double            itl_max_ms = 0;
+  bool              aborted = false;
+  StopReason        stop_reason = StopReason::Complete;
+  GenieProfileStats genie;
+  std::string       profile;           // Raw Genie profile JSON
+};
+
+GenieProfileStats parseGenieProfile(const std::string &profile);
+
+/**
+ * Record the last GenieDialog_query event of a profile as trace spans, split
+ * into prefill and decode. Genie's timestamps are used if they fall between
+ * begin_ns and end_ns (QueryTimer clock), otherwise the event ends at end_ns.
+ */
+void traceGenieProfile(const std::string &profile, uint64_t begin_ns, uint64_t end_ns);
+
+// -----------------------------------------------------------------------------
+// Collects the timestamps of one query. Not thread-safe, driven from the
+// thread running the query.
+// -----------------------------------------------------------------------------
+class QueryTimer {
+public:
+  static uint64_t now();
+
+  void begin(uint64_t call_ns);
+
+  /**
+   * The prompt is being handed to Genie, called again when a query is retried.
+   */
+  void dispatched();
+
+  /**
+   * @param tokens Tokens the fragment carries, fragments without any are ignored
+   */
+  void fragment(uint32_t tokens);
+
+  void abort();
+
+  /**
+   * Tokens received so far.
+   */
+  uint32_t tokens() const;
+
+  QueryMetrics finish();
+
+  /**
+   * Inter-token gaps in ms of the query, valid until the next begin().
+   */
+  const std::vector<float> &gaps() const;
+
+private:
+  uint64_t           call_ns_ = 0;
+  uint64_t           start_ns_ = 0;
+  uint64_t           dispatch_ns_ = 0;
+  uint64_t           first_ns_ = 0;
+  uint64_t           last_ns_ = 0;
+  uint32_t           tokens_ = 0;
+  uint32_t           first_tokens_ = 0;  // Carried by the first fragment
+  uint32_t           steps_ = 0;
+  bool               aborted_ = false;
+  std::vector<float> gaps_;
+};
+
+// -----------------------------------------------------------------------------
+// Log-spaced latency histogram, bucket i counts values up to 0.125 ms * 2^i.
+// -----------------------------------------------------------------------------
+class LatencyHistogram {
+public:
+  static constexpr size_t BUCKETS = 20;  // Up to ~65 s, the last bucket is unbounded
+
+  static double upperBound(size_t bucket);
+
+  void add(double ms);
+
+  /**
+   * Upper bound of the bucket holding the p-th percentile, p in [0, 100].
+   */
+  double percentile(double p) const;
+
+  uint64_t count() const;
+  uint64_t bucket(size_t index) const;
+
+private:
+  uint64_t counts_[BUCKETS] = {};
+  uint64_t total_ = 0;
+};
+
+struct MetricsStats {
+  uint64_t queries;           // Since creation or the last reset
+  uint64_t tokens;
+  uint64_t aborted;
+  size_t   window;            // Recent queries the percentiles below cover
+  double   ttft_p50_ms;
+  double   ttft_p90_ms;
+  double   ttft_p99_ms;
+  double   prefill_p50_ms;
+  double   tokens_per_s_mean;
+  double   tokens_per_s_p50;
+  double   tokens_per_s_min;
+  double   tokens_per_step_mean;
+  double   acceptance_rate_mean;  // 0 for basic dialogs
+  double   itl_p50_ms;        // From the histogram, bucket resolution
+  double   itl_p90_ms;
+  double   itl_p99_ms;
+  std::vector<std::pair<double, uint64_t>> itl_histogram;  // {upper bound ms, count}
+};
+
+// -----------------------------------------------------------------------------
+// Rolling aggregates across queries: percentiles over the last WINDOW queries,
+// inter-token latencies over all of them.
+// -----------------------------------------------------------------------------
+class MetricsAggregator {
+public:
+  static constexpr size_t WINDOW = 128;
+
+  void add(const QueryMetrics &metrics, const std::vector<float> &gaps);
+
+  MetricsStats stats() const;
+
+  void reset();
+
+private:
+  struct Sample {
+    double ttft_ms;
+    double prefill_ms;
+    double tokens_per_s;
+    double tokens_per_step;
+    double acceptance_rate;
+  };
+
+  mutable std::mutex mutex_;
+  std::deque<Sample> window_;
+  LatencyHistogram   itl_;
+  uint64_t           queries_ = 0;
+  uint64_t           tokens_ = 0;
+  uint64_t           aborted_ = 0;
+};
+
+}  // namespace qnnllm
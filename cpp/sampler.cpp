@@ -0,0 +1,195 @@
+#include "sampler.h"
+#include "log.h"
+#include "metrics.h"
+#include "sampler_kernels.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+
+namespace qnnllm {
+
+// Tokens whose probability is below exp(-CUTOFF) of the most likely one are
+// never sampled, so their logits are never exponentiated
+static constexpr float CUTOFF = 16.0f;
+
+//------------------------------------------------------------------------------
+// ConstrainedSampler implementation (PImpl idiom)
+//------------------------------------------------------------------------------
+
+struct ConstrainedSampler::Impl {
+  JsonTokenMask         masks;
+  JsonGrammarOptions    grammar;
+  SamplingParams        params;
+  int32_t               eos;
+  JsonState             state;
+  std::mt19937_64       rng;
+  std::vector<uint32_t> candidates;
+  std::vector<float>    weights;
+  mutable std::mutex    mutex;  // Guards the counters below
+  SamplerStats          totals{};
+  double                maskUs = 0;
+  double                sampleUs = 0;
+  double                candidateCount = 0;
+
+  Impl(const std::vector<std::string> &vocab, int32_t eos_token, const JsonGrammarOptions &grammar,
+       const SamplingParams &params)
+      : masks(vocab, eos_token), grammar(grammar), params(params), eos(eos_token), state(grammar),
+        rng(params.seed != 0 ? params.seed : std::random_device()()) {
+    candidates.resize(vocab.size());
+    weights.reserve(vocab.size());
+  }
+
+  // Index into candidates[0, count) drawn with softmax(logit / temp), after top-k and top-p
+  size_t draw(const float *logits, float max, size_t count) {
+    auto byLogit = [&](uint32_t a, uint32_t b) { return logits[a] > logits[b]; };
+    if (params.top_k > 0 && count > params.top_k) {
+      std::nth_element(candidates.begin(), candidates.begin() + params.top_k, candidates.begin() + count,
+                       byLogit);
+      count = params.top_k;
+    }
+    std::sort(candidates.begin(), candidates.begin() + count, byLogit);
+    weights.resize(count);
+    float sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      weights[i] = std::exp((logits[candidates[i]] - max) / params.temp);
+      sum += weights[i];
+    }
+    if (params.top_p > 0 && params.top_p < 1) {
+      float kept = 0;
+      size_t i = 0;
+      while (i < count && kept < params.top_p * sum) kept += weights[i++];
+      count = std::max<size_t>(i, 1);
+      sum = kept > 0 ? kept : weights[0];
+    }
+    float target = std::uniform_real_distribution<float>(0, sum)(rng);
+    for (size_t i = 0; i < count; ++i) {
+      target -= weights[i];
+      if (target < 0) return i;
+    }
+    return count - 1;
+  }
+};
+
+ConstrainedSampler::ConstrainedSampler(const std::vector<std::string> &vocab, int32_t eos_token,
+                                       const JsonGrammarOptions &grammar, const SamplingParams &params)
+    : impl_(new Impl(vocab, eos_token, grammar, params)) {
+  impl_->totals.kernel = kernels::name();
+}
+
+ConstrainedSampler::~ConstrainedSampler() {
+  delete impl_;
+}
+
+void ConstrainedSampler::parseConfig(const std::string &config_str, JsonGrammarOptions *grammar,
+                                     SamplingParams *params) {
+  auto config = nlohmann::json::parse(config_str, nullptr, false);
+  if (config.is_discarded() || !config.is_object()) {
+    throw std::runtime_error("Invalid grammar config");
+  }
+  const std::string type = config.value("type", "json");
+  if (type != "json") {
+    throw std::runtime_error("Unsupported grammar type: " + type);
+  }
+  const std::string root = config.value("root", "object");
+  if (root == "object") {
+    grammar->root = JsonGrammarOptions::Object;
+  } else if (root == "array") {
+    grammar->root = JsonGrammarOptions::Array;
+  } else if (root == "any") {
+    grammar->root = JsonGrammarOptions::Any;
+  } else {
+    throw std::runtime_error("Unsupported grammar root: " + root);
+  }
+  grammar->max_whitespace = (uint8_t)std::min(config.value("max-whitespace", 8u), 255u);
+  params->temp = config.value("temp", params->temp);
+  params->top_k = config.value("top-k", params->top_k);
+  params->top_p = config.value("top-p", params->top_p);
+  params->seed = config.value("seed", params->seed);
+  params->greedy = config.value("greedy", params->greedy) || params->temp <= 0;
+}
+
+void ConstrainedSampler::reset() {
+  impl_->state = JsonState(impl_->grammar);
+}
+
+int32_t ConstrainedSampler::sample(const float *logits) {
+  auto &I = *impl_;
+  const size_t n = I.masks.vocabSize();
+  const uint64_t start = QueryTimer::now();
+  bool cached = false;
+  const uint64_t *allowed = I.masks.allowed(I.state, &cached);
+  const uint64_t masked = QueryTimer::now();
+
+  int32_t token = I.eos;
+  size_t count = 0;
+  const float max = kernels::maskedMax(logits, allowed, n);
+  if (max != -INFINITY) {
+    if (I.params.greedy) {
+      count = kernels::maskedCollect(logits, allowed, n, max, I.candidates.data());
+      token = (int32_t)I.candidates[0];
+    } else {
+      count = kernels::maskedCollect(logits, allowed, n, max - I.params.temp * CUTOFF, I.candidates.data());
+      token = (int32_t)I.candidates[I.draw(logits, max, count)];
+    }
+  }
+  if (token != I.eos && !I.state.advance(I.masks.text(token))) {
+    // The mask only allows tokens the state accepts
+    LOGE("Sampled token %d does not fit the grammar", token);
+    token = I.eos;
+  }
+  const uint64_t end = QueryTimer::now();
+
+  std::lock_guard<std::mutex> lock(I.mutex);
+  ++I.totals.steps;
+  if (cached) ++I.totals.mask_cache_hits;
+  if (max == -INFINITY) ++I.totals.dead_ends;
+  I.maskUs += (masked - start) / 1e3;
+  I.sampleUs += (end - masked) / 1e3;
+  I.totals.max_step_us = std::max(I.totals.max_step_us, (end - start) / 1e3);
+  I.candidateCount += count;
+  return token;
+}
+
+void ConstrainedSampler::callback(uint32_t logitsSize, const void *logits, uint32_t numTokens, int32_t *tokens,
+                                  const void *userData) {
+  auto self = (ConstrainedSampler *)userData;
+  if (self == nullptr || logits == nullptr || tokens == nullptr) return;
+  const size_t n = self->vocabSize();
+  // Genie versions differ in whether logitsSize counts floats or bytes
+  size_t floats = logitsSize;
+  if (floats != n * numTokens && floats % (n * sizeof(float)) == 0) floats /= sizeof(float);
+  const size_t rows = floats / n;
+  for (uint32_t i = 0; i < numTokens; ++i) {
+    if (rows == 0) {
+      LOGE("Logits of %u values do not cover the vocabulary of %zu", logitsSize, n);
+      tokens[i] = self->impl_->eos;
+      continue;
+    }
+    tokens[i] = self->sample((const float *)logits + std::min<size_t>(i, rows - 1) * n);
+  }
+}
+
+bool ConstrainedSampler::complete() const {
+  return impl_->state.complete();
+}
+
+size_t ConstrainedSampler::vocabSize() const {
+  return impl_->masks.vocabSize();
+}
+
+SamplerStats ConstrainedSampler::stats() const {
+  auto &I = *impl_;
+  std::lock_guard<std::mutex> lock(I.mutex);
+  SamplerStats stats = I.totals;
+  if (stats.steps > 0) {
+    stats.avg_mask_us = I.maskUs / stats.steps;
+    stats.avg_sample_us = I.sampleUs / stats.steps;
+    stats.avg_candidates = I.candidateCount / stats.steps;
+  }
+  return stats;
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "json_grammar.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace qnnllm {
+
+struct SamplingParams {
+  float    temp = 0.8f;
+  uint32_t top_k = 40;      // 0 keeps every allowed token
+  float    top_p = 0.95f;
+  uint64_t seed = 0;        // 0 seeds from the system
+  bool     greedy = false;  // Always pick the most likely allowed token
+};
+
+struct SamplerStats {
+  uint64_t    steps = 0;             // Tokens sampled
+  uint64_t    mask_cache_hits = 0;   // Steps whose token mask was cached
+  uint64_t    dead_ends = 0;         // Steps where no token fit the grammar, EOS was forced
+  double      avg_mask_us = 0;       // Computing or looking up the token mask
+  double      avg_sample_us = 0;     // Masking the logits and picking a token
+  double      max_step_us = 0;
+  double      avg_candidates = 0;    // Allowed tokens within the temperature cutoff
+  std::string kernel;                // sampler_kernels.h name()
+};
+
+// -----------------------------------------------------------------------------
+// Sampler for Genie's custom sampler hook that only picks tokens keeping the
+// response a valid prefix of a JSON document, ending it with EOS once it is
+// complete. Logits are float32, one row of vocabulary size per token.
+// Not thread-safe except for stats().
+// -----------------------------------------------------------------------------
+class ConstrainedSampler {
+public:
+  /**
+   * @param vocab Text of every token ID, empty for special tokens
+   */
+  ConstrainedSampler(const std::vector<std::string> &vocab, int32_t eos_token,
+                     const JsonGrammarOptions &grammar, const SamplingParams &params);
+  ~ConstrainedSampler();
+
+  /**
+   * Parse a grammar config: {"type": "json", "root": "object" | "array" | "any",
+   * "max-whitespace", "temp", "top-k", "top-p", "seed", "greedy"}.
+   * Throws std::runtime_error if it is invalid.
+   */
+  static void parseConfig(const std::string &config_str, JsonGrammarOptions *grammar, SamplingParams *params);
+
+  /**
+   * Start a new document.
+   */
+  void reset();
+
+  /**
+   * Pick the next token from one row of logits and advance the grammar with it.
+   */
+  int32_t sample(const float *logits);
+
+  /**
+   * Genie sampler callback, userData is the ConstrainedSampler. Samples
+   * numTokens tokens, row i of the logits for token i, the last row for the
+   * rest. logitsSize may count floats or bytes.
+   */
+  static void callback(uint32_t logitsSize, const void *logits, uint32_t numTokens, int32_t *tokens,
+                       const void *userData);
+
+  /**
+   * Whether the response so far is a complete document.
+   */
+  bool complete() const;
+
+  size_t vocabSize() const;
+
+  SamplerStats stats() const;
+
+private:
+  struct Impl;
+  Impl *impl_;
+};
+
+}  // namespace qnnllm
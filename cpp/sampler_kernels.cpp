@@ -0,0 +1,175 @@
+#include "sampler_kernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if QNN_SAMPLER_NEON
+#include <arm_neon.h>
+#elif QNN_SAMPLER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace qnnllm {
+namespace kernels {
+
+// Logits are processed in blocks of 64, one mask word each. Blocks with no
+// allowed token are skipped without touching their logits, which is most of
+// the vocabulary outside of strings.
+static constexpr size_t BLOCK = 64;
+
+static inline unsigned countTrailingZeros(uint64_t word) {
+  return (unsigned)__builtin_ctzll(word);
+}
+
+//------------------------------------------------------------------------------
+// Scalar reference
+//------------------------------------------------------------------------------
+
+namespace scalar {
+
+float maskedMax(const float *logits, const uint64_t *allowed, size_t n) {
+  float best = -INFINITY;
+  for (size_t i = 0; i < n; ++i) {
+    if ((allowed[i / BLOCK] >> (i % BLOCK)) & 1) best = std::max(best, logits[i]);
+  }
+  return best;
+}
+
+size_t maskedCollect(const float *logits, const uint64_t *allowed, size_t n, float threshold, uint32_t *ids) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (((allowed[i / BLOCK] >> (i % BLOCK)) & 1) && logits[i] >= threshold) ids[count++] = (uint32_t)i;
+  }
+  return count;
+}
+
+}  // namespace scalar
+
+//------------------------------------------------------------------------------
+// Vectorized, 4 lanes per step
+//------------------------------------------------------------------------------
+
+#if QNN_SAMPLER_NEON || QNN_SAMPLER_SSE
+
+#if QNN_SAMPLER_NEON
+
+typedef float32x4_t Vec;
+
+static inline Vec load(const float *p) { return vld1q_f32(p); }
+static inline Vec splat(float value) { return vdupq_n_f32(value); }
+static inline Vec max(Vec a, Vec b) { return vmaxq_f32(a, b); }
+static inline float reduceMax(Vec v) { return vmaxvq_f32(v); }
+
+// Lanes whose bit is set in the low 4 bits of bits, others -INFINITY
+static inline Vec select(uint32_t bits, Vec v) {
+  static const uint32_t lanes[4] = {1, 2, 4, 8};
+  const uint32x4_t mask = vtstq_u32(vdupq_n_u32(bits), vld1q_u32(lanes));
+  return vbslq_f32(mask, v, vdupq_n_f32(-INFINITY));
+}
+
+// Bit per lane with v >= threshold
+static inline uint32_t atLeast(Vec v, Vec threshold) {
+  static const uint32_t lanes[4] = {1, 2, 4, 8};
+  return vaddvq_u32(vandq_u32(vcgeq_f32(v, threshold), vld1q_u32(lanes)));
+}
+
+#else
+
+typedef __m128 Vec;
+
+static inline Vec load(const float *p) { return _mm_loadu_ps(p); }
+static inline Vec splat(float value) { return _mm_set1_ps(value); }
+static inline Vec max(Vec a, Vec b) { return _mm_max_ps(a, b); }
+
+static inline float reduceMax(Vec v) {
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtss_f32(v);
+}
+
+static inline Vec select(uint32_t bits, Vec v) {
+  const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+  const __m128 mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)bits), lanes), lanes));
+  return _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, _mm_set1_ps(-INFINITY)));
+}
+
+static inline uint32_t atLeast(Vec v, Vec threshold) {
+  return (uint32_t)_mm_movemask_ps(_mm_cmpge_ps(v, threshold));
+}
+
+#endif
+
+float maskedMax(const float *logits, const uint64_t *allowed, size_t n) {
+  const size_t blocks = n / BLOCK;
+  Vec best = splat(-INFINITY);
+  for (size_t b = 0; b < blocks; ++b) {
+    uint64_t word = allowed[b];
+    if (word == 0) continue;
+    const float *p = logits + b * BLOCK;
+    if (word == ~0ULL) {
+      Vec m0 = load(p), m1 = load(p + 4), m2 = load(p + 8), m3 = load(p + 12);
+      for (size_t i = 16; i < BLOCK; i += 16) {
+        m0 = max(m0, load(p + i));
+        m1 = max(m1, load(p + i + 4));
+        m2 = max(m2, load(p + i + 8));
+        m3 = max(m3, load(p + i + 12));
+      }
+      best = max(best, max(max(m0, m1), max(m2, m3)));
+      continue;
+    }
+    for (size_t i = 0; word != 0; i += 4, word >>= 4) {
+      if ((word & 0xf) != 0) best = max(best, select((uint32_t)(word & 0xf), load(p + i)));
+    }
+  }
+  float result = reduceMax(best);
+  const size_t tail = blocks * BLOCK;
+  return std::max(result, scalar::maskedMax(logits + tail, allowed + blocks, n - tail));
+}
+
+size_t maskedCollect(const float *logits, const uint64_t *allowed, size_t n, float threshold, uint32_t *ids) {
+  const size_t blocks = n / BLOCK;
+  const Vec limit = splat(threshold);
+  size_t count = 0;
+  for (size_t b = 0; b < blocks; ++b) {
+    const uint64_t word = allowed[b];
+    if (word == 0) continue;
+    const float *p = logits + b * BLOCK;
+    uint64_t above = 0;
+    for (size_t i = 0; i < BLOCK; i += 4) {
+      if ((word >> i) & 0xf) above |= (uint64_t)atLeast(load(p + i), limit) << i;
+    }
+    above &= word;
+    while (above != 0) {
+      ids[count++] = (uint32_t)(b * BLOCK + countTrailingZeros(above));
+      above &= above - 1;
+    }
+  }
+  const size_t tail = blocks * BLOCK;
+  size_t rest = scalar::maskedCollect(logits + tail, allowed + blocks, n - tail, threshold, ids + count);
+  for (size_t i = count; i < count + rest; ++i) ids[i] += (uint32_t)tail;
+  return count + rest;
+}
+
+#else
+
+float maskedMax(const float *logits, const uint64_t *allowed, size_t n) {
+  return scalar::maskedMax(logits, allowed, n);
+}
+
+size_t maskedCollect(const float *logits, const uint64_t *allowed, size_t n, float threshold, uint32_t *ids) {
+  return scalar::maskedCollect(logits, allowed, n, threshold, ids);
+}
+
+#endif
+
+const char *name() {
+#if QNN_SAMPLER_NEON
+  return "neon";
+#elif QNN_SAMPLER_SSE
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+}  // namespace kernels
+}  // namespace qnnllm
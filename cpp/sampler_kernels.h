@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Define QNN_SAMPLER_SCALAR to build the scalar reference kernels only
+#if !defined(QNN_SAMPLER_SCALAR) && defined(__aarch64__) && defined(__ARM_NEON)
+#define QNN_SAMPLER_NEON 1
+#elif !defined(QNN_SAMPLER_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define QNN_SAMPLER_SSE 1
+#endif
+
+namespace qnnllm {
+namespace kernels {
+
+// Logits are float32, one per token. allowed is a bitset with bit i set if
+// token i may be sampled, its bits beyond n are ignored.
+
+/**
+ * @return The largest allowed logit, -INFINITY if no token is allowed
+ */
+float maskedMax(const float *logits, const uint64_t *allowed, size_t n);
+
+/**
+ * Write the IDs of the allowed tokens whose logit is at least threshold to
+ * ids, in ascending order. ids must have room for every allowed token.
+ * @return Number of IDs written
+ */
+size_t maskedCollect(const float *logits, const uint64_t *allowed, size_t n, float threshold, uint32_t *ids);
+
+/**
+ * Name of the vector extension the kernels above use.
+ */
+const char *name();
+
+// Plain C++ versions, the reference the vectorized kernels must match
+namespace scalar {
+
+float maskedMax(const float *logits, const uint64_t *allowed, size_t n);
+
+size_t maskedCollect(const float *logits, const uint64_t *allowed, size_t n, float threshold, uint32_t *ids);
+
+}  // namespace scalar
+
+}  // namespace kernels
+}  // namespace qnnllm
@@ -0,0 +1,184 @@
+#include "scheduler.h"
+#include "executor.h"
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace qnnllm {
+
+typedef std::chrono::steady_clock Clock;
+
+//------------------------------------------------------------------------------
+// Scheduler implementation (PImpl idiom)
+//------------------------------------------------------------------------------
+
+struct Task {
+  Priority                  priority;
+  uint64_t                  seq;
+  Clock::time_point         enqueued;
+  Scheduler::Job            job;
+  std::shared_ptr<std::promise<void>> done;
+};
+
+struct TaskOrder {
+  bool operator()(const Task &a, const Task &b) const {
+    if (a.priority != b.priority) return a.priority > b.priority;
+    return a.seq > b.seq;
+  }
+};
+
+struct Scheduler::Impl {
+  std::thread                                        worker;
+  std::priority_queue<Task, std::vector<Task>, TaskOrder> tasks;
+  mutable std::mutex                                 mutex;
+  std::condition_variable                            cvTask;
+  std::condition_variable                            cvSpace;
+  std::condition_variable                            cvLeft;
+  size_t                                             capacity;
+  size_t                                             submitters = 0;  // Callers in run() waiting for space
+  bool                                               stop = false;
+  bool                                               busy = false;
+  uint64_t                                           seq = 0;
+  size_t                                             maxDepth = 0;
+  uint64_t                                           submitted = 0;
+  uint64_t                                           completed = 0;
+  uint64_t                                           cancelled = 0;
+  double                                             totalWaitMs = 0;
+  double                                             maxWaitMs = 0;
+  uint64_t                                           started = 0;
+};
+
+Scheduler::Scheduler(size_t capacity)
+    : impl_(new Impl()) {
+  impl_->capacity = capacity > 0 ? capacity : 1;
+  impl_->worker = std::thread([this] {
+    auto &I = *impl_;
+    while (true) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(I.mutex);
+        I.cvTask.wait(lock, [&] { return I.stop || !I.tasks.empty(); });
+        if (I.tasks.empty()) return;
+        task = std::move(const_cast<Task &>(I.tasks.top()));
+        I.tasks.pop();
+        double waitMs = std::chrono::duration<double, std::milli>(
+          Clock::now() - task.enqueued).count();
+        I.totalWaitMs += waitMs;
+        if (waitMs > I.maxWaitMs) I.maxWaitMs = waitMs;
+        ++I.started;
+        I.busy = true;
+      }
+      I.cvSpace.notify_one();
+      try {
+        task.job();
+        task.done->set_value();
+      } catch (...) {
+        task.done->set_exception(std::current_exception());
+      }
+      {
+        std::lock_guard<std::mutex> lock(I.mutex);
+        I.busy = false;
+        ++I.completed;
+      }
+    }
+  });
+}
+
+void Scheduler::run(Priority priority, Job job) {
+  // The caller waits for the whole job, hand its executor worker's share to a spare
+  BlockingScope blocking;
+  auto done = std::make_shared<std::promise<void>>();
+  auto future = done->get_future();
+  {
+    // Counted while waiting, the destructor keeps impl_ until every caller has let go
+    std::unique_lock<std::mutex> lock(impl_->mutex);
+    ++impl_->submitters;
+    impl_->cvSpace.wait(lock, [&] {
+      return impl_->stop || impl_->tasks.size() < impl_->capacity;
+    });
+    --impl_->submitters;
+    if (impl_->stop) {
+      if (impl_->submitters == 0) impl_->cvLeft.notify_all();
+      throw std::runtime_error("Context is released");
+    }
+    impl_->tasks.push({priority, impl_->seq++, Clock::now(), std::move(job), done});
+    ++impl_->submitted;
+    if (impl_->tasks.size() > impl_->maxDepth) {
+      impl_->maxDepth = impl_->tasks.size();
+    }
+    // Under the lock, impl_ may be gone once it is released
+    impl_->cvTask.notify_one();
+  }
+  future.get();
+}
+
+size_t Scheduler::cancelPending() {
+  std::vector<Task> dropped;
+  {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    while (!impl_->tasks.empty()) {
+      dropped.push_back(std::move(const_cast<Task &>(impl_->tasks.top())));
+      impl_->tasks.pop();
+    }
+    impl_->cancelled += dropped.size();
+  }
+  impl_->cvSpace.notify_all();
+  for (auto &task : dropped) {
+    task.done->set_exception(std::make_exception_ptr(std::runtime_error("Request cancelled")));
+  }
+  return dropped.size();
+}
+
+void Scheduler::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    if (impl_->stop) return;
+    impl_->stop = true;
+  }
+  cancelPending();
+  impl_->cvTask.notify_all();
+  if (impl_->worker.joinable()) {
+    impl_->worker.join();
+  }
+}
+
+bool Scheduler::running() const {
+  std::lock_guard<std::mutex> lock(impl_->mutex);
+  return impl_->busy;
+}
+
+SchedulerStats Scheduler::stats() const {
+  std::lock_guard<std::mutex> lock(impl_->mutex);
+  const auto &I = *impl_;
+  return {
+    I.tasks.size(),
+    I.maxDepth,
+    I.capacity,
+    I.busy,
+    I.submitted,
+    I.completed,
+    I.cancelled,
+    I.started > 0 ? I.totalWaitMs / I.started : 0,
+    I.maxWaitMs,
+  };
+}
+
+Scheduler::~Scheduler() {
+  shutdown();
+  {
+    // Callers blocked on a full queue wake to the stop flag and throw
+    std::unique_lock<std::mutex> lock(impl_->mutex);
+    impl_->cvSpace.notify_all();
+    impl_->cvLeft.wait(lock, [&] { return impl_->submitters == 0; });
+  }
+  delete impl_;
+}
+
+}  // namespace qnnllm
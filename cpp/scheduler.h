@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace qnnllm {
+
+// -----------------------------------------------------------------------------
+// Job priority, lower value runs first. Jobs of equal priority run in FIFO order.
+// -----------------------------------------------------------------------------
+enum class Priority : int {
+  High = 0,
+  Normal = 1,
+  Low = 2,
+};
+
+struct SchedulerStats {
+  size_t   depth;        // Jobs currently waiting in the queue
+  size_t   max_depth;    // High-water mark of the queue
+  size_t   capacity;     // Queue bound, submitters block while full
+  bool     running;      // Whether the worker is executing a job
+  uint64_t submitted;    // Jobs accepted into the queue
+  uint64_t completed;    // Jobs run to completion (successfully or not)
+  uint64_t cancelled;    // Jobs removed from the queue before running
+  double   avg_wait_ms;  // Mean time from submit to start of execution
+  double   max_wait_ms;  // Worst observed time from submit to start of execution
+};
+
+// -----------------------------------------------------------------------------
+// Single worker, bounded priority queue. Callers block in run() until their job
+// finished so that all work on a Context is serialized in a predictable order.
+// -----------------------------------------------------------------------------
+class Scheduler {
+public:
+  typedef std::function<void()> Job;
+
+  explicit Scheduler(size_t capacity);
+
+  /**
+   * Shuts down, then waits for callers blocked on a full queue to leave run().
+   */
+  ~Scheduler();
+
+  /**
+   * Queue a job and block until it has run on the worker thread.
+   * Blocks while the queue is full. Rethrows exceptions raised by the job and
+   * throws std::runtime_error if the job is cancelled before it starts.
+   */
+  void run(Priority priority, Job job);
+
+  /**
+   * Cancel every job still waiting in the queue. The running job is not affected.
+   * @return Number of cancelled jobs
+   */
+  size_t cancelPending();
+
+  /**
+   * Cancel pending jobs, wait for the running job and stop the worker.
+   * Further run() calls throw.
+   */
+  void shutdown();
+
+  bool running() const;
+
+  SchedulerStats stats() const;
+
+private:
+  struct Impl;
+  Impl *impl_;
+};
+
+}  // namespace qnnllm
@@ -0,0 +1,197 @@
+#include "session_cache.h"
+#include "log.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <set>
+#include <signal.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace qnnllm {
+
+static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+static constexpr uint64_t FNV_PRIME  = 0x100000001b3ULL;
+static constexpr const char *SNAPSHOT_SUFFIX = ".session";
+
+// Subdirectory of a cache: <fingerprint>-<pid>-<instance>.sessions
+static constexpr const char *CACHE_DIR_FORMAT = "%016" PRIx64 "-%d-%u.sessions";
+
+static std::atomic<unsigned> s_instances{0};
+
+static uint64_t fnv(uint64_t hash, const std::string &text, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ (uint8_t)text[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint64_t diskUsage(const fs::path &path) {
+  std::error_code ec;
+  if (fs::is_regular_file(path, ec)) return fs::file_size(path, ec);
+  uint64_t total = 0;
+  for (auto it = fs::recursive_directory_iterator(path, ec);
+       !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (it->is_regular_file(ec)) total += it->file_size(ec);
+  }
+  return total;
+}
+
+// Whether name is a cache subdirectory of a process that is gone
+static bool isOrphaned(const std::string &name) {
+  uint64_t fingerprint;
+  int pid;
+  unsigned instance;
+  char check[64];
+  if (sscanf(name.c_str(), "%" SCNx64 "-%d-%u", &fingerprint, &pid, &instance) != 3) return false;
+  snprintf(check, sizeof(check), CACHE_DIR_FORMAT, fingerprint, pid, instance);
+  if (name != check) return false;
+  return pid != getpid() && kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+SessionCache::SessionCache(const std::string &dir, uint64_t fingerprint, uint64_t budget,
+                           size_t max_entries)
+    : budget_(budget), max_entries_(max_entries), seed_(FNV_OFFSET) {
+  // Snapshots left by a previous process are not indexed, drop them
+  std::error_code ec;
+  for (auto &item : fs::directory_iterator(dir, ec)) {
+    if (item.is_directory(ec) && isOrphaned(item.path().filename().string())) {
+      fs::remove_all(item.path(), ec);
+    }
+  }
+  char name[64];
+  snprintf(name, sizeof(name), CACHE_DIR_FORMAT, fingerprint, (int)getpid(), s_instances.fetch_add(1));
+  dir_ = (fs::path(dir) / name).string();
+  fs::create_directories(dir_);
+}
+
+SessionCache::~SessionCache() {
+  clear();
+  std::error_code ec;
+  fs::remove_all(dir_, ec);
+}
+
+const SessionCache::Entry *SessionCache::lookup(const std::string &text) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::set<size_t> lengths;
+  for (auto &item : entries_) {
+    if (item.second.length < text.length()) lengths.insert(item.second.length);
+  }
+  Entry *best = nullptr;
+  uint64_t hash = seed_;
+  size_t pos = 0;
+  for (size_t length : lengths) {
+    for (; pos < length; ++pos) {
+      hash = (hash ^ (uint8_t)text[pos]) * FNV_PRIME;
+    }
+    auto it = entries_.find(hash);
+    if (it != entries_.end() && it->second.length == length && it->second.scope == scope_ &&
+        text.compare(0, length, it->second.prefix) == 0) {
+      best = &it->second;
+    }
+  }
+  if (best == nullptr) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  best->last_used = ++tick_;
+  return best;
+}
+
+bool SessionCache::contains(const std::string &prefix) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(hashPrefix(prefix, prefix.length()));
+  if (it == entries_.end() || it->second.scope != scope_ || it->second.prefix != prefix) return false;
+  it->second.last_used = ++tick_;
+  return true;
+}
+
+std::string SessionCache::pathFor(const std::string &prefix) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016" PRIx64 "%s", hashPrefix(prefix, prefix.length()), SNAPSHOT_SUFFIX);
+  return (fs::path(dir_) / name).string();
+}
+
+void SessionCache::insert(const std::string &prefix) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t key = hashPrefix(prefix, prefix.length());
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    bytes_ -= it->second.bytes;
+    entries_.erase(it);
+  }
+  std::string path = pathFor(prefix);
+  uint64_t bytes = diskUsage(path);
+  entries_[key] = {key, prefix.length(), prefix, scope_, path, bytes, ++tick_};
+  bytes_ += bytes;
+  ++saves_;
+  evict();
+}
+
+void SessionCache::remove(const Entry *entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(entry->key);
+  if (it == entries_.end()) return;
+  std::error_code ec;
+  fs::remove_all(it->second.path, ec);
+  bytes_ -= it->second.bytes;
+  entries_.erase(it);
+}
+
+void SessionCache::setScope(const std::string &scope) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  scope_ = scope;
+  seed_ = fnv(FNV_OFFSET, scope, scope.length());
+  // 0xff never occurs in UTF-8, it keeps scope "a" + "bc" apart from "ab" + "c"
+  if (!scope.empty()) seed_ = (seed_ ^ 0xff) * FNV_PRIME;
+}
+
+uint64_t SessionCache::hashPrefix(const std::string &text, size_t length) const {
+  return fnv(seed_, text, length);
+}
+
+void SessionCache::evict() {
+  while (!entries_.empty() && (bytes_ > budget_ || entries_.size() > max_entries_)) {
+    auto victim = std::min_element(entries_.begin(), entries_.end(), [](auto &a, auto &b) {
+      return a.second.last_used < b.second.last_used;
+    });
+    LOGI("Evict session snapshot %s (%" PRIu64 " bytes)", victim->second.path.c_str(), victim->second.bytes);
+    ++evictions_;
+    evicted_bytes_ += victim->second.bytes;
+    std::error_code ec;
+    fs::remove_all(victim->second.path, ec);
+    bytes_ -= victim->second.bytes;
+    entries_.erase(victim);
+  }
+}
+
+void SessionCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::error_code ec;
+  for (auto &item : entries_) {
+    fs::remove_all(item.second.path, ec);
+  }
+  entries_.clear();
+  bytes_ = 0;
+}
+
+SessionCacheStats SessionCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {
+    entries_.size(),
+    bytes_,
+    budget_,
+    hits_,
+    misses_,
+    saves_,
+    evictions_,
+    evicted_bytes_,
+  };
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace qnnllm {
+
+struct SessionCacheStats {
+  size_t   entries;        // Snapshots currently on disk
+  uint64_t bytes;          // Disk usage of the cached snapshots
+  uint64_t budget;         // Byte budget, least recently used snapshots are evicted above it
+  uint64_t hits;           // Lookups that found a cached prefix
+  uint64_t misses;         // Lookups without any cached prefix
+  uint64_t saves;          // Snapshots written
+  uint64_t evictions;      // Snapshots removed to stay within budget
+  uint64_t evicted_bytes;  // Bytes freed by evictions
+};
+
+// -----------------------------------------------------------------------------
+// LRU cache of dialog snapshots keyed by the conversation prefix they hold.
+// Snapshots are directories written by GenieDialog_save, the cache only tracks
+// their location, size and recency. Every cache keeps its snapshots in a
+// subdirectory of its own, named after the model, process and instance, so
+// caches sharing a directory never touch each other's files. Mutated on the
+// context worker thread only, stats() may be read from any thread.
+// -----------------------------------------------------------------------------
+class SessionCache {
+public:
+  struct Entry {
+    uint64_t    key;       // Hash of the conversation prefix
+    size_t      length;    // Length in bytes of the conversation prefix
+    std::string prefix;    // The prefix itself, a matching hash alone may collide
+    std::string scope;
+    std::string path;      // Snapshot directory
+    uint64_t    bytes;     // Disk usage of the snapshot
+    uint64_t    last_used; // Recency tick for LRU eviction
+  };
+
+  /**
+   * Removes the subdirectories caches of exited processes left in dir.
+   * @param fingerprint Identity of the model, see SnapshotStore::modelFingerprint
+   */
+  SessionCache(const std::string &dir, uint64_t fingerprint, uint64_t budget, size_t max_entries);
+
+  /**
+   * Removes the snapshots and the subdirectory of this cache.
+   */
+  ~SessionCache();
+
+  /**
+   * Find the longest cached prefix strictly shorter than text.
+   * Counts a hit or miss.
+   * @return The entry, or nullptr when no cached prefix matches
+   */
+  const Entry *lookup(const std::string &text);
+
+  bool contains(const std::string &prefix);
+
+  /**
+   * Snapshot directory to save the given prefix into.
+   */
+  std::string pathFor(const std::string &prefix) const;
+
+  /**
+   * Register a snapshot saved at pathFor(prefix) and evict down to budget.
+   */
+  void insert(const std::string &prefix);
+
+  void remove(const Entry *entry);
+
+  /**
+   * Only match snapshots saved within scope, e.g. the LoRA adapter that was
+   * applied when the KV cache was computed. Defaults to the empty scope.
+   */
+  void setScope(const std::string &scope);
+
+  void clear();
+
+  SessionCacheStats stats() const;
+
+private:
+  void evict();
+
+  uint64_t hashPrefix(const std::string &text, size_t length) const;
+
+  mutable std::mutex mutex_;
+  std::string dir_;   // Subdirectory of this cache
+  std::string scope_;
+  uint64_t budget_;
+  size_t max_entries_;
+  uint64_t seed_;     // Hash of the scope, every key starts from it
+  uint64_t tick_ = 0;
+  uint64_t bytes_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t saves_ = 0;
+  uint64_t evictions_ = 0;
+  uint64_t evicted_bytes_ = 0;
+  std::unordered_map<uint64_t, Entry> entries_;
+};
+
+}  // namespace qnnllm
@@ -0,0 +1,555 @@
+#include "snapshot.h"
+#include "GenieCommon.h"
+#include "executor.h"
+#include "log.h"
+#include "unpack.h"
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+#include <zstd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace qnnllm {
+
+typedef std::chrono::steady_clock Clock;
+
+static constexpr uint8_t  SNAPSHOT_ZSTD = 0;
+static constexpr uint8_t  SNAPSHOT_STORED = 1;
+static constexpr size_t   IO_CHUNK = 4 << 20;
+static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+static constexpr uint64_t FNV_PRIME  = 0x100000001b3ULL;
+
+static double elapsedMs(Clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+static void hashBytes(uint64_t &hash, const void *data, size_t size) {
+  for (size_t i = 0; i < size; ++i) hash = (hash ^ ((const uint8_t *)data)[i]) * FNV_PRIME;
+}
+
+static uint32_t genieVersion() {
+  return Genie_getApiMajorVersion() << 20 | Genie_getApiMinorVersion() << 10 | Genie_getApiPatchVersion();
+}
+
+//------------------------------------------------------------------------------
+// Header encoding
+//------------------------------------------------------------------------------
+
+struct SnapshotEntry {
+  std::string name;  // Path relative to the dialog state directory
+  uint64_t    offset = 0;
+  uint64_t    comp_length = 0;
+  uint64_t    raw_length = 0;
+  uint32_t    crc32 = 0;
+  uint8_t     method = SNAPSHOT_ZSTD;
+};
+
+struct SnapshotHeader {
+  uint64_t                   fingerprint = 0;
+  uint32_t                   genie_version = 0;
+  uint64_t                   created_us = 0;
+  std::vector<SnapshotEntry> entries;
+};
+
+template <typename T>
+static void putLE(std::string &out, T value) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  out.append(bytes, sizeof(T));
+}
+
+static std::string encodeHeader(const SnapshotHeader &header) {
+  std::string out(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  putLE<uint16_t>(out, SNAPSHOT_VERSION);
+  putLE<uint16_t>(out, 0);
+  putLE<uint64_t>(out, header.fingerprint);
+  putLE<uint32_t>(out, header.genie_version);
+  putLE<uint32_t>(out, (uint32_t)header.entries.size());
+  putLE<uint64_t>(out, header.created_us);
+  for (auto &entry : header.entries) {
+    putLE<uint16_t>(out, (uint16_t)entry.name.size());
+    out += entry.name;
+    putLE<uint64_t>(out, entry.offset);
+    putLE<uint64_t>(out, entry.comp_length);
+    putLE<uint64_t>(out, entry.raw_length);
+    putLE<uint32_t>(out, entry.crc32);
+    putLE<uint8_t>(out, entry.method);
+  }
+  putLE<uint32_t>(out, (uint32_t)crc32(0, (const Bytef *)out.data(), (uInt)out.size()));
+  return out;
+}
+
+// Bounds-checked reads over the mapped snapshot
+class HeaderReader {
+public:
+  HeaderReader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+  template <typename T>
+  T read() {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  std::string readString(size_t length) {
+    const uint8_t *bytes = take(length);
+    return std::string((const char *)bytes, length);
+  }
+
+  size_t position() const { return pos_; }
+
+private:
+  const uint8_t *take(size_t length) {
+    if (length > size_ - pos_) throw std::runtime_error("Session snapshot is truncated");
+    const uint8_t *bytes = data_ + pos_;
+    pos_ += length;
+    return bytes;
+  }
+
+  const uint8_t *data_;
+  size_t         size_;
+  size_t         pos_ = 0;
+};
+
+static SnapshotHeader decodeHeader(const uint8_t *data, size_t size) {
+  HeaderReader reader(data, size);
+  if (reader.readString(sizeof(SNAPSHOT_MAGIC)) != std::string(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))) {
+    throw std::runtime_error("Not a session snapshot");
+  }
+  if (reader.read<uint16_t>() != SNAPSHOT_VERSION) {
+    throw std::runtime_error("Unsupported session snapshot version");
+  }
+  reader.read<uint16_t>();
+  SnapshotHeader header;
+  header.fingerprint = reader.read<uint64_t>();
+  header.genie_version = reader.read<uint32_t>();
+  const uint32_t count = reader.read<uint32_t>();
+  header.created_us = reader.read<uint64_t>();
+  for (uint32_t i = 0; i < count; ++i) {
+    SnapshotEntry entry;
+    entry.name = reader.readString(reader.read<uint16_t>());
+    entry.offset = reader.read<uint64_t>();
+    entry.comp_length = reader.read<uint64_t>();
+    entry.raw_length = reader.read<uint64_t>();
+    entry.crc32 = reader.read<uint32_t>();
+    entry.method = reader.read<uint8_t>();
+    if (entry.offset > size || entry.comp_length > size - entry.offset) {
+      throw std::runtime_error("Session snapshot is truncated");
+    }
+    header.entries.push_back(std::move(entry));
+  }
+  const size_t covered = reader.position();
+  if (reader.read<uint32_t>() != (uint32_t)crc32(0, data, (uInt)covered)) {
+    throw std::runtime_error("Session snapshot header is corrupt");
+  }
+  return header;
+}
+
+// Entry names come from the file, they must stay inside the staging directory
+static bool isSafeName(const std::string &name) {
+  fs::path path(name);
+  if (name.empty() || path.has_root_path()) return false;
+  for (auto &part : path) {
+    if (part == ".." || part == "." || part.empty()) return false;
+  }
+  return true;
+}
+
+// Process id and store number, keeps the temporary names of stores sharing a directory apart
+static std::string storeTag() {
+  static std::atomic<uint32_t> stores{0};
+#ifdef _WIN32
+  const int pid = _getpid();
+#else
+  const int pid = (int)getpid();
+#endif
+  return std::to_string(pid) + "-" + std::to_string(stores.fetch_add(1));
+}
+
+// Removes a staging directory however the save or restore ends
+struct StagingDir {
+  fs::path path;
+
+  explicit StagingDir(fs::path dir) : path(std::move(dir)) {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+    fs::create_directories(path);
+  }
+
+  ~StagingDir() {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+  }
+};
+
+// Removes a snapshot being written unless it was renamed into place
+struct PartFile {
+  fs::path path;
+  bool     committed = false;
+
+  ~PartFile() {
+    if (committed) return;
+    std::error_code ec;
+    fs::remove(path, ec);
+  }
+};
+
+// fsync a written file, or a directory after a rename in it
+static void syncPath(const fs::path &path, bool directory) {
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY | (directory ? O_DIRECTORY : 0));
+  if (fd < 0) {
+    if (directory) return;
+    throw std::runtime_error("Failed to open " + path.string());
+  }
+  const bool synced = fsync(fd) == 0;
+  ::close(fd);
+  if (!synced && !directory) throw std::runtime_error("Failed to sync " + path.string());
+#else
+  (void)path;
+  (void)directory;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Entry compression
+//------------------------------------------------------------------------------
+
+// Append one file to out, filling in the lengths and CRC of entry
+static void writeEntry(std::ofstream &out, const fs::path &file, int level, SnapshotEntry &entry,
+                       std::vector<char> &buffer) {
+  entry.raw_length = fs::file_size(file);
+  entry.method = level > 0 ? SNAPSHOT_ZSTD : SNAPSHOT_STORED;
+  const uint64_t start = (uint64_t)out.tellp();
+  entry.offset = start;
+  uint32_t crc = 0;
+  if (entry.raw_length == 0) {
+    entry.method = SNAPSHOT_STORED;
+    entry.crc32 = 0;
+    return;
+  }
+  MemoryMap map(file.string());
+  for (size_t pos = 0; pos < map.size(); pos += IO_CHUNK) {
+    crc = crc32(crc, map.data() + pos, (uInt)std::min(IO_CHUNK, map.size() - pos));
+  }
+  entry.crc32 = crc;
+  if (entry.method == SNAPSHOT_STORED) {
+    out.write((const char *)map.data(), (std::streamsize)map.size());
+  } else {
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setPledgedSrcSize(cctx, map.size());
+    ZSTD_inBuffer in{map.data(), map.size(), 0};
+    size_t remaining;
+    do {
+      ZSTD_outBuffer chunk{buffer.data(), buffer.size(), 0};
+      remaining = ZSTD_compressStream2(cctx, &chunk, &in, ZSTD_e_end);
+      if (ZSTD_isError(remaining)) {
+        ZSTD_freeCCtx(cctx);
+        throw std::runtime_error(std::string("Failed to compress session: ") + ZSTD_getErrorName(remaining));
+      }
+      out.write(buffer.data(), (std::streamsize)chunk.pos);
+    } while (remaining != 0);
+    ZSTD_freeCCtx(cctx);
+  }
+  if (!out) throw std::runtime_error("Failed to write session snapshot");
+  entry.comp_length = (uint64_t)out.tellp() - start;
+}
+
+// Extract one entry of the mapped snapshot to file, checking its CRC
+static void readEntry(const uint8_t *base, const SnapshotEntry &entry, const fs::path &file,
+                      std::vector<char> &buffer) {
+  std::ofstream out(file, std::ios::binary | std::ios::trunc);
+  if (!out) throw std::runtime_error("Failed to create " + file.string());
+  const uint8_t *data = base + entry.offset;
+  uint32_t crc = 0;
+  uint64_t written = 0;
+  if (entry.method == SNAPSHOT_STORED) {
+    if (entry.comp_length != entry.raw_length) throw std::runtime_error("Session snapshot is corrupt");
+    for (uint64_t pos = 0; pos < entry.raw_length; pos += IO_CHUNK) {
+      const size_t length = (size_t)std::min<uint64_t>(IO_CHUNK, entry.raw_length - pos);
+      crc = crc32(crc, data + pos, (uInt)length);
+      out.write((const char *)data + pos, (std::streamsize)length);
+    }
+    written = entry.raw_length;
+  } else if (entry.method == SNAPSHOT_ZSTD) {
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    ZSTD_inBuffer in{data, (size_t)entry.comp_length, 0};
+    size_t ret = 1;
+    while (in.pos < in.size && ret != 0) {
+      ZSTD_outBuffer chunk{buffer.data(), buffer.size(), 0};
+      ret = ZSTD_decompressStream(dctx, &chunk, &in);
+      if (ZSTD_isError(ret)) {
+        ZSTD_freeDCtx(dctx);
+        throw std::runtime_error("Session snapshot is corrupt");
+      }
+      crc = crc32(crc, (const Bytef *)buffer.data(), (uInt)chunk.pos);
+      out.write(buffer.data(), (std::streamsize)chunk.pos);
+      written += chunk.pos;
+    }
+    ZSTD_freeDCtx(dctx);
+  } else {
+    throw std::runtime_error("Unsupported session snapshot encoding");
+  }
+  if (written != entry.raw_length || crc != entry.crc32) {
+    throw std::runtime_error("Session snapshot is corrupt");
+  }
+  out.close();
+  if (!out) throw std::runtime_error("Failed to write " + file.string());
+}
+
+//------------------------------------------------------------------------------
+// SnapshotStore implementation (PImpl idiom)
+//------------------------------------------------------------------------------
+
+struct SnapshotStore::Impl {
+  uint64_t                        fingerprint;
+  std::string                     tag = storeTag();
+  mutable std::mutex              mutex;
+  std::condition_variable         cvWritten;
+  std::map<std::string, size_t>   pending;    // Background writes per directory
+  std::map<std::string, uint64_t> committed;  // Sequence of the newest snapshot per directory
+  uint64_t                        sequence = 0;
+  SnapshotStats                   stats{};
+
+  // Compress staging into dir, unless a later save committed first
+  void write(const std::string &dir, const fs::path &staging, uint64_t seq, int level, double handoffMs,
+             Clock::time_point start) {
+    std::vector<fs::path> files;
+    for (auto &item : fs::recursive_directory_iterator(staging)) {
+      if (item.is_regular_file()) files.push_back(item.path());
+    }
+    std::sort(files.begin(), files.end());
+    SnapshotHeader header;
+    header.fingerprint = fingerprint;
+    header.genie_version = genieVersion();
+    header.created_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+    uint64_t rawBytes = 0;
+    for (auto &file : files) {
+      SnapshotEntry entry;
+      entry.name = fs::relative(file, staging).generic_string();
+      header.entries.push_back(std::move(entry));
+    }
+    // Entries follow a header of known size, it is rewritten once their lengths are known
+    const std::string placeholder = encodeHeader(header);
+    // Written to a part file, synced and renamed into place like unpacked files
+    PartFile part{fs::path(dir) / (std::string(SNAPSHOT_FILE) + ".part-" + tag + "-" + std::to_string(seq))};
+    {
+      std::ofstream out(part.path, std::ios::binary | std::ios::trunc);
+      if (!out) throw std::runtime_error("Failed to create session snapshot in " + dir);
+      out.write(placeholder.data(), (std::streamsize)placeholder.size());
+      std::vector<char> buffer(ZSTD_CStreamOutSize());
+      for (size_t i = 0; i < files.size(); ++i) {
+        writeEntry(out, files[i], level, header.entries[i], buffer);
+        rawBytes += header.entries[i].raw_length;
+      }
+      const std::string encoded = encodeHeader(header);
+      out.seekp(0);
+      out.write(encoded.data(), (std::streamsize)encoded.size());
+      out.close();
+      if (!out) throw std::runtime_error("Failed to write session snapshot in " + dir);
+    }
+    syncPath(part.path, false);
+    const uint64_t bytes = fs::file_size(part.path);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (seq < committed[dir]) return;
+      fs::rename(part.path, fs::path(dir) / SNAPSHOT_FILE);
+      part.committed = true;
+      committed[dir] = seq;
+    }
+    syncPath(dir, true);
+    std::lock_guard<std::mutex> lock(mutex);
+    ++stats.saves;
+    stats.last_raw_bytes = rawBytes;
+    stats.last_bytes = bytes;
+    stats.last_handoff_ms = handoffMs;
+    stats.last_write_ms = elapsedMs(start) - handoffMs;
+  }
+
+  void finish(const std::string &dir) {
+    // Notified under the lock, flush() may destroy the store as soon as it sees nothing pending
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pending[dir] == 0) pending.erase(dir);
+    --stats.pending;
+    cvWritten.notify_all();
+  }
+};
+
+SnapshotStore::SnapshotStore(uint64_t fingerprint)
+    : impl_(new Impl()) {
+  impl_->fingerprint = fingerprint;
+}
+
+SnapshotStore::~SnapshotStore() {
+  flush();
+  delete impl_;
+}
+
+uint64_t SnapshotStore::modelFingerprint(const char *config_str) {
+  uint64_t hash = FNV_OFFSET;
+  auto config = nlohmann::json::parse(config_str, nullptr, false);
+  if (config.is_discarded() || !config.contains("dialog")) {
+    hashBytes(hash, config_str, strlen(config_str));
+    return hash;
+  }
+  // Sampling does not shape the dialog state
+  nlohmann::json dialog = config["dialog"];
+  dialog.erase("sampler");
+  const std::string canonical = dialog.dump();
+  hashBytes(hash, canonical.data(), canonical.size());
+  // Every model file the config names, by size and write time
+  std::vector<const nlohmann::json *> values = {&dialog};
+  while (!values.empty()) {
+    const nlohmann::json &value = *values.back();
+    values.pop_back();
+    if (value.is_structured()) {
+      for (auto &item : value) values.push_back(&item);
+    } else if (value.is_string()) {
+      std::error_code ec;
+      const fs::path path(value.get<std::string>());
+      if (!fs::is_regular_file(path, ec)) continue;
+      const uint64_t size = fs::file_size(path, ec);
+      const int64_t mtime = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+      hashBytes(hash, &size, sizeof(size));
+      hashBytes(hash, &mtime, sizeof(mtime));
+    }
+  }
+  return hash;
+}
+
+void SnapshotStore::save(const std::string &dir, const DialogIO &dump, const SnapshotOptions &options) {
+  auto &I = *impl_;
+  const auto start = Clock::now();
+  fs::create_directories(dir);
+  uint64_t seq;
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    seq = ++I.sequence;
+  }
+  auto staging = std::make_shared<StagingDir>(fs::path(dir) / (".staging-" + I.tag + "-" + std::to_string(seq)));
+  dump(staging->path.string());
+  const double handoffMs = elapsedMs(start);
+  const int level = std::max(0, std::min(options.level, ZSTD_maxCLevel()));
+  if (!options.background) {
+    I.write(dir, staging->path, seq, level, handoffMs, start);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    ++I.pending[dir];
+    ++I.stats.pending;
+  }
+  TaskHints hints;
+  hints.priority = Priority::Low;
+  hints.cores = CoreHint::Efficiency;
+  hints.blocking = true;
+  Executor::shared().submit([&I, dir, staging, seq, level, handoffMs, start]() mutable {
+    try {
+      I.write(dir, staging->path, seq, level, handoffMs, start);
+    } catch (const std::exception &e) {
+      LOGE("Failed to write session snapshot: %s", e.what());
+      std::lock_guard<std::mutex> lock(I.mutex);
+      ++I.stats.failures;
+      I.stats.last_error = e.what();
+    }
+    // Removed before the write counts as done, a flush() leaves no staging behind
+    staging.reset();
+    I.finish(dir);
+  }, hints);
+}
+
+void SnapshotStore::restore(const std::string &dir, const DialogIO &load) {
+  auto &I = *impl_;
+  {
+    std::unique_lock<std::mutex> lock(I.mutex);
+    I.cvWritten.wait(lock, [&] { return I.pending.count(dir) == 0; });
+  }
+  const auto start = Clock::now();
+  const fs::path file = fs::path(dir) / SNAPSHOT_FILE;
+  if (!fs::exists(file)) {
+    load(dir);
+    std::lock_guard<std::mutex> lock(I.mutex);
+    ++I.stats.restores;
+    I.stats.last_restore_ms = elapsedMs(start);
+    return;
+  }
+  MemoryMap map(file.string());
+  SnapshotHeader header;
+  try {
+    header = decodeHeader(map.data(), map.size());
+    if (header.fingerprint != I.fingerprint) {
+      throw std::runtime_error("Session snapshot was saved with another model");
+    }
+    if (header.genie_version != genieVersion()) {
+      throw std::runtime_error("Session snapshot was saved with another Genie version");
+    }
+    for (auto &entry : header.entries) {
+      if (!isSafeName(entry.name)) throw std::runtime_error("Session snapshot is corrupt");
+    }
+  } catch (const std::runtime_error &) {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    ++I.stats.rejected;
+    throw;
+  }
+#ifndef _WIN32
+  // Pages are read once, in order, as the entries are decompressed
+  madvise(const_cast<uint8_t *>(map.data()), map.size(), MADV_SEQUENTIAL);
+#endif
+  uint64_t seq;
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    seq = ++I.sequence;
+  }
+  StagingDir staging(fs::path(dir) / (".staging-" + I.tag + "-restore-" + std::to_string(seq)));
+  std::vector<char> buffer(ZSTD_DStreamOutSize());
+  try {
+    for (auto &entry : header.entries) {
+      const fs::path path = staging.path / entry.name;
+      fs::create_directories(path.parent_path());
+      readEntry(map.data(), entry, path, buffer);
+    }
+  } catch (const std::runtime_error &) {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    ++I.stats.rejected;
+    throw;
+  }
+  load(staging.path.string());
+  std::lock_guard<std::mutex> lock(I.mutex);
+  ++I.stats.restores;
+  I.stats.last_restore_ms = elapsedMs(start);
+}
+
+void SnapshotStore::flush() {
+  auto &I = *impl_;
+  std::unique_lock<std::mutex> lock(I.mutex);
+  I.cvWritten.wait(lock, [&] { return I.pending.empty(); });
+}
+
+SnapshotStats SnapshotStore::stats() const {
+  auto &I = *impl_;
+  std::lock_guard<std::mutex> lock(I.mutex);
+  return I.stats;
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace qnnllm {
+
+// -----------------------------------------------------------------------------
+// Snapshot file format, SNAPSHOT_FILE inside the session directory:
+//
+//   char[8] magic "QNNSNAP\0", u16 version, u16 reserved, u64 model fingerprint,
+//   u32 Genie API version, u32 entry count, u64 creation time (us since epoch)
+//   { u16 name_len, name, u64 offset, u64 comp_length, u64 raw_length,
+//     u32 crc32 of the raw file, u8 method } x entry count
+//   u32 crc32 of everything above
+//
+// followed by the entries, each one file GenieDialog_save wrote, compressed as
+// one zstd stream or stored. Integers are little-endian.
+// -----------------------------------------------------------------------------
+static constexpr char     SNAPSHOT_MAGIC[8] = {'Q', 'N', 'N', 'S', 'N', 'A', 'P', '\0'};
+static constexpr uint16_t SNAPSHOT_VERSION = 1;
+static constexpr const char *SNAPSHOT_FILE = "session.qnns";
+
+struct SnapshotOptions {
+  int  level = 3;          // zstd level, 0 stores the files as they are
+  bool background = true;  // Compress and write after the dialog state is handed off
+};
+
+struct SnapshotStats {
+  uint64_t    saves;             // Snapshots committed
+  uint64_t    restores;
+  uint64_t    rejected;          // Restores refused: other model, Genie version or corrupt
+  uint64_t    failures;          // Background writes that failed
+  size_t      pending;           // Background writes in progress
+  uint64_t    last_raw_bytes;    // Dialog state of the last save
+  uint64_t    last_bytes;        // Its snapshot file
+  double      last_handoff_ms;   // The dialog was blocked dumping its state
+  double      last_write_ms;     // Compressing and writing, off the dialog
+  double      last_restore_ms;
+  std::string last_error;        // Of the last failed background write
+};
+
+// -----------------------------------------------------------------------------
+// Saves and restores dialog state as compressed snapshot files. A save dumps
+// the raw state into a staging directory, the only step the dialog is blocked
+// for, and hands it to the shared executor to compress on the efficiency
+// cores. A restore maps the snapshot, checks from the header alone that it was
+// saved with the same model and Genie version, then decompresses every entry
+// into a staging directory in one sequential pass and loads the dialog from it.
+// Staging and part files are named after the process and store, so stores
+// sharing a directory never remove each other's.
+// -----------------------------------------------------------------------------
+class SnapshotStore {
+public:
+  // Writes or reads the dialog state to or from a directory, throws on failure
+  typedef std::function<void(const std::string &dir)> DialogIO;
+
+  /**
+   * @param fingerprint Identity of the model, see modelFingerprint
+   */
+  explicit SnapshotStore(uint64_t fingerprint);
+
+  /**
+   * Waits for the background writes.
+   */
+  ~SnapshotStore();
+
+  /**
+   * Hash of the config and of the size and write time of every file it names,
+   * so replacing the model bundle invalidates the snapshots saved with it.
+   */
+  static uint64_t modelFingerprint(const char *config_str);
+
+  /**
+   * Snapshot the dialog into dir. Without options.background the snapshot is
+   * written when this returns. A write fails in the background by counting a
+   * failure and leaving the previous snapshot in place.
+   */
+  void save(const std::string &dir, const DialogIO &dump, const SnapshotOptions &options = SnapshotOptions());
+
+  /**
+   * Restore the dialog from dir, waiting for a write to it in progress.
+   * Directories written by GenieDialog_save directly are restored as they are.
+   * Throws std::runtime_error if the snapshot belongs to another model.
+   */
+  void restore(const std::string &dir, const DialogIO &load);
+
+  /**
+   * Wait for every background write to finish.
+   */
+  void flush();
+
+  SnapshotStats stats() const;
+
+private:
+  struct Impl;
+  Impl *impl_;
+};
+
+}  // namespace qnnllm
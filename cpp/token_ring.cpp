@@ -0,0 +1,125 @@
+#include "token_ring.h"
+#include "GenieDialog.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace qnnllm {
+
+static constexpr size_t MIN_RING_CAPACITY = 256;
+
+static inline uint32_t align4(uint32_t value) { return (value + 3) & ~3u; }
+
+static inline void storeLE(uint8_t *ptr, uint32_t value) { std::memcpy(ptr, &value, sizeof(value)); }
+
+TokenRing::TokenRing(size_t capacity, uint32_t max_stall_ms) : max_stall_ms_(max_stall_ms) {
+  capacity_ = capacity < MIN_RING_CAPACITY ? MIN_RING_CAPACITY : (capacity + 3) & ~size_t(3);
+  data_ = static_cast<uint8_t *>(std::calloc(capacity_, 1));
+}
+
+TokenRing::~TokenRing() {
+  std::free(data_);
+}
+
+uint8_t *TokenRing::data() const { return data_; }
+size_t   TokenRing::capacity() const { return capacity_; }
+
+void TokenRing::setDoorbell(Doorbell doorbell) {
+  doorbell_ = std::move(doorbell);
+}
+
+bool TokenRing::write(const char *text, size_t length, int32_t code, uint32_t fragments,
+                      uint32_t batch_us) {
+  const size_t maxPayload = capacity_ / 2 - RING_HEADER_SIZE;
+  // Split oversized payloads on UTF-8 boundaries, only the last part carries the code
+  while (length > maxPayload) {
+    size_t part = maxPayload;
+    while (part > 0 && (static_cast<uint8_t>(text[part]) & 0xC0) == 0x80) --part;
+    if (part == 0) part = maxPayload;
+    if (!writeRecord(text, (uint32_t)part, GENIE_DIALOG_SENTENCE_CONTINUE, 0, batch_us)) {
+      return false;
+    }
+    text += part;
+    length -= part;
+  }
+  return writeRecord(text, (uint32_t)length, code, fragments, batch_us);
+}
+
+bool TokenRing::writeRecord(const char *text, uint32_t length, int32_t code, uint32_t fragments,
+                            uint32_t batch_us) {
+  const uint64_t pos = write_pos_.load(std::memory_order_relaxed);
+  const size_t offset = pos % capacity_;
+  const size_t remaining = capacity_ - offset;
+  const size_t need = RING_HEADER_SIZE + align4(length);
+  const size_t skip = remaining < need ? remaining : 0;
+
+  auto fits = [&] { return capacity_ - (pos - read_pos_.load(std::memory_order_acquire)) >= skip + need; };
+  if (!fits()) {
+    // Only CONTINUE records may be lost, the others end or restart the response
+    const bool droppable = code == GENIE_DIALOG_SENTENCE_CONTINUE;
+    // Behind since the last drop, the consumer is stuck, do not stall decoding again
+    bool ready = false;
+    if (!droppable || read_pos_.load(std::memory_order_acquire) != lagging_read_) {
+      const auto start = std::chrono::steady_clock::now();
+      const auto deadline = start + std::chrono::milliseconds(max_stall_ms_);
+      while (!(ready = fits())) {
+        if (closed_.load(std::memory_order_acquire)) return false;
+        if (droppable && max_stall_ms_ > 0 && std::chrono::steady_clock::now() >= deadline) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+      const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+      ++stats_.stalls;
+      stats_.stall_us += us;
+      if (us > stats_.max_stall_us) stats_.max_stall_us = us;
+    }
+    if (!ready) {
+      lagging_read_ = read_pos_.load(std::memory_order_acquire);
+      ++pending_drops_;
+      ++stats_.dropped;
+      stats_.dropped_bytes += length;
+      return true;
+    }
+  }
+
+  if (skip >= RING_HEADER_SIZE) {
+    storeLE(data_ + offset, RING_WRAP);
+  }
+  uint8_t *record = data_ + (pos + skip) % capacity_;
+  storeLE(record, length);
+  storeLE(record + 4, (uint32_t)code);
+  storeLE(record + 8, fragments);
+  storeLE(record + 12, batch_us);
+  storeLE(record + 16, pending_drops_);
+  pending_drops_ = 0;
+  if (length > 0) {
+    std::memcpy(record + RING_HEADER_SIZE, text, length);
+  }
+  write_pos_.store(pos + skip + need, std::memory_order_seq_cst);
+
+  if (armed_.exchange(false, std::memory_order_seq_cst) && doorbell_) {
+    doorbell_();
+  }
+  return true;
+}
+
+uint64_t TokenRing::writePosition() const {
+  return write_pos_.load(std::memory_order_acquire);
+}
+
+uint64_t TokenRing::consume(uint64_t pos) {
+  read_pos_.store(pos, std::memory_order_release);
+  armed_.store(true, std::memory_order_seq_cst);
+  return write_pos_.load(std::memory_order_seq_cst);
+}
+
+void TokenRing::close() {
+  closed_.store(true, std::memory_order_release);
+}
+
+TokenRingStats TokenRing::stats() const {
+  return stats_;
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace qnnllm {
+
+// -----------------------------------------------------------------------------
+// Record layout inside the ring (little-endian, 4-byte aligned):
+//
+//   u32 length     Payload length in bytes, RING_WRAP marks skip-to-start
+//   i32 code       GenieDialog_SentenceCode_t
+//   u32 fragments  Genie fragments merged into the record
+//   u32 batch_us   Time from the first merged fragment to publication
+//   u32 dropped    Records dropped right before this one
+//   u8  payload[length], padded to 4 bytes
+//
+// A header never straddles the end of the buffer: if fewer than RING_HEADER_SIZE
+// bytes remain the reader skips to offset 0.
+// -----------------------------------------------------------------------------
+static constexpr uint32_t RING_HEADER_SIZE = 20;
+static constexpr uint32_t RING_WRAP = 0xFFFFFFFFu;
+
+// Longest a CONTINUE write waits for the consumer before its record is dropped
+static constexpr uint32_t RING_MAX_STALL_MS = 1000;
+
+struct TokenRingStats {
+  uint64_t stalls;         // Writes that waited for the consumer to free space
+  uint64_t stall_us;       // Time the producer spent waiting
+  uint64_t max_stall_us;
+  uint64_t dropped;        // Records dropped because the consumer fell behind
+  uint64_t dropped_bytes;  // Payload bytes of the dropped records
+};
+
+// -----------------------------------------------------------------------------
+// Lock-free single-producer/single-consumer ring of UTF-8 response fragments.
+// Positions grow monotonically, offsets are position % capacity. The doorbell
+// fires on the producer thread only when the consumer has drained and re-armed
+// it, so a busy consumer costs the producer no extra calls.
+//
+// A full ring stalls the producer, which is Genie's decode thread, for at most
+// max_stall_ms. A CONTINUE record that still does not fit is dropped, and so is
+// every later one that does not fit before the consumer frees some space. Other
+// codes end or restart a response and wait until they fit. The next record
+// written counts the drops in its header, so the consumer sees every gap.
+// -----------------------------------------------------------------------------
+class TokenRing {
+public:
+  typedef std::function<void()> Doorbell;
+
+  /**
+   * @param max_stall_ms Longest wait for space per write, 0 waits until it is closed
+   */
+  explicit TokenRing(size_t capacity, uint32_t max_stall_ms = RING_MAX_STALL_MS);
+  ~TokenRing();
+
+  uint8_t *data() const;
+  size_t   capacity() const;
+
+  void setDoorbell(Doorbell doorbell);
+
+  /**
+   * Producer: append a record, splitting payloads larger than half the ring.
+   * Blocks while the ring is full, up to max_stall_ms for CONTINUE records,
+   * which are then dropped. Returns false once the ring is closed.
+   */
+  bool write(const char *text, size_t length, int32_t code, uint32_t fragments, uint32_t batch_us);
+
+  /**
+   * Consumer: position up to which records are published.
+   */
+  uint64_t writePosition() const;
+
+  /**
+   * Consumer: release everything before pos and re-arm the doorbell. Must be
+   * called after every doorbell, even when no new record is visible: the
+   * records may have been drained before the producer disarmed it.
+   * @return The current write position, drain again if it is past pos
+   */
+  uint64_t consume(uint64_t pos);
+
+  /**
+   * Wake a blocked producer and reject further writes.
+   */
+  void close();
+
+  /**
+   * Producer counters, read once the producer is done.
+   */
+  TokenRingStats stats() const;
+
+private:
+  bool writeRecord(const char *text, uint32_t length, int32_t code, uint32_t fragments, uint32_t batch_us);
+
+  uint8_t              *data_;
+  size_t                capacity_;
+  Doorbell              doorbell_;
+  std::atomic<uint64_t> write_pos_{0};
+  std::atomic<uint64_t> read_pos_{0};
+  std::atomic<bool>     armed_{true};
+  std::atomic<bool>     closed_{false};
+  uint32_t              max_stall_ms_;
+  uint64_t              lagging_read_ = UINT64_MAX;  // Read position at the last drop
+  uint32_t              pending_drops_ = 0;          // Drops not yet reported in a header
+  TokenRingStats        stats_{};
+};
+
+}  // namespace qnnllm
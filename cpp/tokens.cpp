@@ -0,0 +1,175 @@
+#include "tokens.h"
+#include "context.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace qnnllm {
+
+static void allocTokens(size_t size, const char **data) { *data = (char *)malloc(size); }
+
+// Length of text without a trailing incomplete UTF-8 sequence or replacement character
+static size_t completeLength(const std::string &text) {
+  const size_t end = text.size();
+  if (end >= 3 && text.compare(end - 3, 3, "\xEF\xBF\xBD") == 0) return end - 3;
+  size_t lead = end;
+  while (lead > 0 && end - lead < 4 && ((uint8_t)text[lead - 1] & 0xC0) == 0x80) --lead;
+  if (lead == 0) return end;
+  const uint8_t byte = (uint8_t)text[lead - 1];
+  const size_t length = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+  return end - (lead - 1) < length ? lead - 1 : end;
+}
+
+//------------------------------------------------------------------------------
+// Tokenizer
+//------------------------------------------------------------------------------
+
+Tokenizer::Tokenizer(GenieTokenizer_Handle_t handle) : handle_(handle) {}
+
+std::vector<int32_t> Tokenizer::encode(const std::string &text) const {
+  const int32_t *ids = nullptr;
+  uint32_t count = 0;
+  Genie_Status_t status = GenieTokenizer_encode(handle_, text.c_str(), allocTokens, &ids, &count);
+  if (status != GENIE_STATUS_SUCCESS) {
+    free((void *)ids);
+    throw std::runtime_error(genie_status_to_string(status));
+  }
+  std::vector<int32_t> tokens(ids, ids + count);
+  free((void *)ids);
+  return tokens;
+}
+
+std::string Tokenizer::decode(const std::vector<int32_t> &tokens) const {
+  const char *text = nullptr;
+  Genie_Status_t status =
+    GenieTokenizer_decode(handle_, tokens.data(), (uint32_t)tokens.size(), allocTokens, &text);
+  if (status != GENIE_STATUS_SUCCESS) {
+    free((void *)text);
+    throw std::runtime_error(genie_status_to_string(status));
+  }
+  std::string result(text ? text : "");
+  free((void *)text);
+  return result;
+}
+
+//------------------------------------------------------------------------------
+// TokenDecoder
+//------------------------------------------------------------------------------
+
+TokenDecoder::TokenDecoder(const Tokenizer &tokenizer) : tokenizer_(tokenizer) {}
+
+void TokenDecoder::reset() {
+  window_.clear();
+  emitted_ = 0;
+  held_ = 0;
+}
+
+std::string TokenDecoder::push(const uint32_t *tokens, uint32_t count) {
+  if (count == 0) return std::string();
+  window_.insert(window_.end(), tokens, tokens + count);
+  held_ += count;
+  const std::string text = tokenizer_.decode(window_);
+  // Give up waiting for a sequence to complete after a few tokens
+  const size_t end = held_ > MAX_HELD_TOKENS ? text.size() : completeLength(text);
+  std::string out;
+  if (end > emitted_) out.assign(text, emitted_, end - emitted_);
+  if (end < text.size()) {
+    emitted_ = std::max(emitted_, end);
+    return out;
+  }
+  held_ = 0;
+  if (window_.size() > CONTEXT_TOKENS) {
+    window_.erase(window_.begin(), window_.end() - CONTEXT_TOKENS);
+    emitted_ = tokenizer_.decode(window_).size();
+  } else {
+    emitted_ = end;
+  }
+  return out;
+}
+
+std::string TokenDecoder::flush() {
+  std::string out;
+  if (held_ > 0) {
+    const std::string text = tokenizer_.decode(window_);
+    if (text.size() > emitted_) out = text.substr(emitted_);
+  }
+  reset();
+  return out;
+}
+
+//------------------------------------------------------------------------------
+// TokenHistory
+//------------------------------------------------------------------------------
+
+TokenPlan TokenHistory::plan(const std::string &input, const std::string &text,
+                             const Tokenizer &tokenizer) const {
+  TokenPlan plan;
+  if (!tracked_) {
+    plan.tokens = tokenizer.encode(input);
+    return plan;
+  }
+  // Reuse the tokens up to the last split point inside the common text prefix
+  const size_t common = std::mismatch(input.begin(), input.begin() + std::min(input.size(), text.size()),
+                                      text.begin()).first - input.begin();
+  Split from{0, 0};
+  while (plan.splits < splits_.size() && splits_[plan.splits].bytes <= common) {
+    from = splits_[plan.splits++];
+  }
+  plan.tokens.assign(tokens_.begin(), tokens_.begin() + from.tokens);
+  std::vector<int32_t> rest = tokenizer.encode(input.substr(from.bytes));
+  plan.tokens.insert(plan.tokens.end(), rest.begin(), rest.end());
+  // Tokenizing the rest may reproduce more of the history
+  const size_t limit = std::min(plan.tokens.size(), tokens_.size());
+  plan.reused = std::mismatch(plan.tokens.begin() + from.tokens, plan.tokens.begin() + limit,
+                              tokens_.begin() + from.tokens).first - plan.tokens.begin();
+  return plan;
+}
+
+void TokenHistory::begin(const TokenPlan &plan, size_t text_length) {
+  tokens_ = plan.tokens;
+  splits_.resize(std::min(splits_.size(), plan.splits));
+  tracked_ = true;
+  split(text_length);
+}
+
+void TokenHistory::truncate(const TokenPlan &plan, size_t count) {
+  tokens_.assign(plan.tokens.begin(), plan.tokens.begin() + std::min(count, plan.tokens.size()));
+  splits_.resize(std::min(splits_.size(), plan.splits));
+  while (!splits_.empty() && splits_.back().tokens > tokens_.size()) splits_.pop_back();
+  tracked_ = true;
+}
+
+void TokenHistory::append(const uint32_t *tokens, uint32_t count) {
+  tokens_.insert(tokens_.end(), tokens, tokens + count);
+}
+
+void TokenHistory::split(size_t text_length) {
+  if (!splits_.empty() && splits_.back().tokens == tokens_.size()) {
+    splits_.back().bytes = text_length;
+    return;
+  }
+  splits_.push_back({tokens_.size(), text_length});
+}
+
+void TokenHistory::assign(std::vector<int32_t> tokens, size_t text_length) {
+  tokens_ = std::move(tokens);
+  splits_.clear();
+  tracked_ = true;
+  split(text_length);
+}
+
+void TokenHistory::untrack() {
+  tokens_.clear();
+  splits_.clear();
+  tracked_ = false;
+}
+
+bool TokenHistory::tracked() const {
+  return tracked_;
+}
+
+size_t TokenHistory::size() const {
+  return tokens_.size();
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "GenieDialog.h"
+#include "GenieTokenizer.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace qnnllm {
+
+// -----------------------------------------------------------------------------
+// Thin wrapper over the dialog's GenieTokenizer. Throws std::runtime_error on
+// Genie errors.
+// -----------------------------------------------------------------------------
+class Tokenizer {
+public:
+  explicit Tokenizer(GenieTokenizer_Handle_t handle);
+
+  std::vector<int32_t> encode(const std::string &text) const;
+
+  std::string decode(const std::vector<int32_t> &tokens) const;
+
+private:
+  GenieTokenizer_Handle_t handle_;
+};
+
+// -----------------------------------------------------------------------------
+// Turns streamed token IDs back into text. A few already delivered tokens are
+// kept as context so decoders that drop the leading space of a lone token still
+// produce the right text, and incomplete UTF-8 sequences are held back until
+// the tokens completing them arrive.
+// -----------------------------------------------------------------------------
+class TokenDecoder {
+public:
+  explicit TokenDecoder(const Tokenizer &tokenizer);
+
+  void reset();
+
+  /**
+   * @return Text completed by tokens, possibly empty
+   */
+  std::string push(const uint32_t *tokens, uint32_t count);
+
+  /**
+   * Deliver whatever is held back, even if it is not valid UTF-8.
+   */
+  std::string flush();
+
+private:
+  static constexpr size_t CONTEXT_TOKENS = 4;
+  static constexpr size_t MAX_HELD_TOKENS = 8;
+
+  const Tokenizer     &tokenizer_;
+  std::vector<int32_t> window_;
+  size_t               emitted_ = 0;  // Bytes of decode(window_) delivered
+  size_t               held_ = 0;     // Tokens whose text is not delivered yet
+};
+
+// The parts of a prompt the KV cache already holds
+struct TokenPlan {
+  std::vector<int32_t> tokens;      // Token IDs of the whole prompt
+  size_t               reused = 0;  // Leading tokens already in the KV cache
+  size_t               splits = 0;  // History split points still valid for the prompt
+};
+
+// -----------------------------------------------------------------------------
+// Token IDs committed to the KV cache, in order, along with the text offsets
+// at which they can be split: the end of every prompt and every response. A
+// prompt that diverges from the history is tokenized from the last split point
+// before the divergence, so the tokens before it are reused exactly as Genie
+// produced them instead of being re-tokenized.
+// -----------------------------------------------------------------------------
+class TokenHistory {
+public:
+  /**
+   * @param text What the history decodes to
+   */
+  TokenPlan plan(const std::string &input, const std::string &text, const Tokenizer &tokenizer) const;
+
+  /**
+   * The KV cache is about to hold the tokens of plan, decoding to text_length bytes.
+   */
+  void begin(const TokenPlan &plan, size_t text_length);
+
+  /**
+   * The KV cache is about to hold the first count tokens of plan, which may
+   * end inside the prompt, so no split point is added.
+   */
+  void truncate(const TokenPlan &plan, size_t count);
+
+  void append(const uint32_t *tokens, uint32_t count);
+
+  /**
+   * Mark the current end of the history as a split point.
+   */
+  void split(size_t text_length);
+
+  /**
+   * The KV cache holds tokens, e.g. after restoring a snapshot.
+   */
+  void assign(std::vector<int32_t> tokens, size_t text_length);
+
+  /**
+   * The KV cache content is unknown, the next prompt is matched by Genie alone.
+   */
+  void untrack();
+
+  bool tracked() const;
+
+  size_t size() const;
+
+private:
+  struct Split {
+    size_t tokens;
+    size_t bytes;
+  };
+
+  std::vector<int32_t> tokens_;
+  std::vector<Split>   splits_;
+  bool                 tracked_ = true;
+};
+
+}  // namespace qnnllm
@@ -0,0 +1,201 @@
+#include "trace.h"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace qnnllm {
+namespace trace {
+
+std::atomic<bool> g_enabled{false};
+
+struct Event {
+  const char *name;
+  const char *arg_key;
+  uint64_t    start_ns;
+  uint64_t    end_ns;
+  uint64_t    arg_value;
+};
+
+// Spans of one thread, appended by that thread only
+struct ThreadBuffer {
+  uint32_t                 thread = 0;
+  std::string              name;
+  std::unique_ptr<Event[]> events{new Event[QNN_TRACE_EVENTS]};
+  std::atomic<size_t>      count{0};
+  std::atomic<uint64_t>    session{0};  // Trace the events belong to, reset lazily by the owner
+  std::atomic<uint64_t>    dropped{0};
+  std::atomic<bool>        exited{false};
+};
+
+// Thread IDs of external tracks, above any kernel thread ID
+static constexpr int64_t EXTERNAL_TID = 1000000000;
+
+struct ExternalEvent {
+  std::string name;
+  std::string track;
+  std::string args;
+  uint64_t    start_ns;
+  uint64_t    end_ns;
+};
+
+struct Tracer {
+  std::mutex                                 mutex;  // Guards buffers and external
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  std::vector<ExternalEvent>                 external;
+  std::atomic<uint64_t>                      session{0};
+};
+
+static Tracer &tracer() {
+  // Never destroyed: threads may end spans while statics are torn down
+  static Tracer *instance = new Tracer();
+  return *instance;
+}
+
+// The calling thread's buffer, released at the next start() once the thread exited
+struct ThreadSlot {
+  std::shared_ptr<ThreadBuffer> buffer;
+
+  ~ThreadSlot() {
+    if (buffer) buffer->exited.store(true, std::memory_order_release);
+  }
+
+  ThreadBuffer &get() {
+    if (!buffer) {
+      buffer = std::make_shared<ThreadBuffer>();
+      buffer->thread = (uint32_t)syscall(SYS_gettid);
+      char name[17] = {};
+      prctl(PR_GET_NAME, name, 0, 0, 0);
+      buffer->name = name;
+      Tracer &T = tracer();
+      std::lock_guard<std::mutex> lock(T.mutex);
+      T.buffers.push_back(buffer);
+    }
+    return *buffer;
+  }
+};
+
+static thread_local ThreadSlot t_slot;
+
+void record(const char *name, uint64_t start_ns, uint64_t end_ns, const char *arg_key, uint64_t arg_value) {
+  if (!enabled()) return;
+  const uint64_t session = tracer().session.load(std::memory_order_acquire);
+  ThreadBuffer &buffer = t_slot.get();
+  if (buffer.session.load(std::memory_order_relaxed) != session) {
+    buffer.count.store(0, std::memory_order_relaxed);
+    buffer.dropped.store(0, std::memory_order_relaxed);
+    buffer.session.store(session, std::memory_order_release);
+  }
+  const size_t count = buffer.count.load(std::memory_order_relaxed);
+  if (count >= QNN_TRACE_EVENTS) {
+    buffer.dropped.store(buffer.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return;
+  }
+  buffer.events[count] = Event{name, arg_key, start_ns, end_ns, arg_value};
+  buffer.count.store(count + 1, std::memory_order_release);
+}
+
+void recordExternal(const std::string &name, const std::string &track, uint64_t start_ns, uint64_t end_ns,
+                    const std::string &args_json) {
+  if (!enabled()) return;
+  Tracer &T = tracer();
+  std::lock_guard<std::mutex> lock(T.mutex);
+  T.external.push_back({name, track, args_json, start_ns, end_ns});
+}
+
+void start() {
+  Tracer &T = tracer();
+  std::lock_guard<std::mutex> lock(T.mutex);
+  T.buffers.erase(std::remove_if(T.buffers.begin(), T.buffers.end(), [](const std::shared_ptr<ThreadBuffer> &buffer) {
+    return buffer->exited.load(std::memory_order_acquire);
+  }), T.buffers.end());
+  T.external.clear();
+  T.session.fetch_add(1, std::memory_order_acq_rel);
+  g_enabled.store(true, std::memory_order_release);
+}
+
+void stop() {
+  g_enabled.store(false, std::memory_order_release);
+}
+
+std::string exportJson() {
+  Tracer &T = tracer();
+  std::lock_guard<std::mutex> lock(T.mutex);
+  const uint64_t session = T.session.load(std::memory_order_acquire);
+  const int pid = (int)getpid();
+  nlohmann::json events = nlohmann::json::array();
+  uint64_t dropped = 0;
+  events.push_back({{"ph", "M"}, {"pid", pid}, {"name", "process_name"}, {"args", {{"name", "qnn-llm"}}}});
+  for (auto &buffer : T.buffers) {
+    if (buffer->session.load(std::memory_order_acquire) != session) continue;
+    const size_t count = buffer->count.load(std::memory_order_acquire);
+    dropped += buffer->dropped.load(std::memory_order_relaxed);
+    events.push_back({{"ph", "M"}, {"pid", pid}, {"tid", buffer->thread}, {"name", "thread_name"},
+                      {"args", {{"name", buffer->name}}}});
+    for (size_t i = 0; i < count; ++i) {
+      const Event &event = buffer->events[i];
+      nlohmann::json span = {
+        {"name", event.name},
+        {"cat", "qnnllm"},
+        {"ph", "X"},
+        {"ts", event.start_ns / 1e3},
+        {"dur", (event.end_ns - event.start_ns) / 1e3},
+        {"pid", pid},
+        {"tid", buffer->thread},
+      };
+      if (event.arg_key != nullptr) span["args"] = {{event.arg_key, event.arg_value}};
+      events.push_back(std::move(span));
+    }
+  }
+  std::vector<std::string> tracks;
+  for (auto &event : T.external) {
+    auto it = std::find(tracks.begin(), tracks.end(), event.track);
+    const size_t track = it - tracks.begin();
+    if (it == tracks.end()) {
+      tracks.push_back(event.track);
+      events.push_back({{"ph", "M"}, {"pid", pid}, {"tid", EXTERNAL_TID + (int64_t)track}, {"name", "thread_name"},
+                        {"args", {{"name", event.track}}}});
+    }
+    nlohmann::json span = {
+      {"name", event.name},
+      {"cat", event.track},
+      {"ph", "X"},
+      {"ts", event.start_ns / 1e3},
+      {"dur", (event.end_ns - event.start_ns) / 1e3},
+      {"pid", pid},
+      {"tid", EXTERNAL_TID + (int64_t)track},
+    };
+    auto args = nlohmann::json::parse(event.args, nullptr, false);
+    if (!args.is_discarded() && args.is_object()) span["args"] = std::move(args);
+    events.push_back(std::move(span));
+  }
+  nlohmann::json trace = {
+    {"traceEvents", std::move(events)},
+    {"displayTimeUnit", "ms"},
+    {"otherData", {{"dropped", dropped}}},
+  };
+  return trace.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+}
+
+TraceStats stats() {
+  Tracer &T = tracer();
+  std::lock_guard<std::mutex> lock(T.mutex);
+  const uint64_t session = T.session.load(std::memory_order_acquire);
+  TraceStats stats{};
+  stats.enabled = enabled();
+  for (auto &buffer : T.buffers) {
+    if (buffer->session.load(std::memory_order_acquire) != session) continue;
+    stats.events += buffer->count.load(std::memory_order_relaxed);
+    stats.dropped += buffer->dropped.load(std::memory_order_relaxed);
+    ++stats.threads;
+  }
+  stats.events += T.external.size();
+  return stats;
+}
+
+}  // namespace trace
+}  // namespace qnnllm
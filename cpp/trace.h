@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 0 compiles every span out
+#ifndef QNN_TRACE
+#define QNN_TRACE 1
+#endif
+
+// Spans kept per thread and trace, later ones are dropped
+#ifndef QNN_TRACE_EVENTS
+#define QNN_TRACE_EVENTS 16384
+#endif
+
+namespace qnnllm {
+namespace trace {
+
+struct TraceStats {
+  bool     enabled;
+  uint64_t events;   // Spans recorded since start()
+  uint64_t dropped;  // Spans lost to a full thread buffer
+  size_t   threads;  // Threads that recorded a span
+};
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled() {
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+// Same clock as QueryTimer::now()
+inline uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Record a span of the calling thread. name and arg_key must be string
+ * literals, they are kept as pointers.
+ */
+void record(const char *name, uint64_t start_ns, uint64_t end_ns, const char *arg_key, uint64_t arg_value);
+
+/**
+ * Record a span on a track of its own, e.g. for events reported by Genie.
+ * @param args_json JSON object shown with the span, may be empty
+ */
+void recordExternal(const std::string &name, const std::string &track, uint64_t start_ns, uint64_t end_ns,
+                    const std::string &args_json = std::string());
+
+/**
+ * Discard the spans recorded so far and start recording.
+ */
+void start();
+
+/**
+ * Stop recording, the spans are kept for exportJson.
+ */
+void stop();
+
+/**
+ * The recorded spans as Chrome trace event JSON, loadable by Perfetto and
+ * chrome://tracing.
+ */
+std::string exportJson();
+
+TraceStats stats();
+
+// -----------------------------------------------------------------------------
+// Span from construction to destruction. While tracing is stopped it costs a
+// relaxed atomic load.
+// -----------------------------------------------------------------------------
+class Span {
+public:
+  explicit Span(const char *name) : name_(name), start_(enabled() ? now() : 0) {}
+
+  ~Span() {
+    if (start_ != 0) record(name_, start_, now(), key_, value_);
+  }
+
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  /**
+   * Attach a value shown with the span, key must be a string literal.
+   */
+  void arg(const char *key, uint64_t value) {
+    key_ = key;
+    value_ = value;
+  }
+
+private:
+  const char *name_;
+  uint64_t    start_;
+  const char *key_ = nullptr;
+  uint64_t    value_ = 0;
+};
+
+// Stands in for Span when tracing is compiled out
+class NullSpan {
+public:
+  void arg(const char *, uint64_t) {}
+};
+
+}  // namespace trace
+}  // namespace qnnllm
+
+#define QNN_TRACE_CONCAT_(a, b) a##b
+#define QNN_TRACE_CONCAT(a, b) QNN_TRACE_CONCAT_(a, b)
+
+#if QNN_TRACE
+#define QNN_TRACE_SPAN(var, name) ::qnnllm::trace::Span var(name)
+#else
+#define QNN_TRACE_SPAN(var, name) [[maybe_unused]] ::qnnllm::trace::NullSpan var
+#endif
+
+// Trace the rest of the enclosing scope
+#define QNN_TRACE_SCOPE(name) QNN_TRACE_SPAN(QNN_TRACE_CONCAT(qnn_trace_span_, __LINE__), name)
@@ -1,16 +1,22 @@
 #include "unpack.h"
+#include "trace.h"
 #include <filesystem>
 #include <fstream>
 #include <vector>
 #include <cstring>
+#include <cerrno>
 #include <stdexcept>
 #include <algorithm>
 #include <zstd.h>
 #include <zlib.h>
-#include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <exception>
 #include <condition_variable>
-#include <queue>
+#include <chrono>
+#include <map>
+#include <nlohmann/json.hpp>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -19,10 +25,23 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
 #endif
 
 namespace fs = std::filesystem;
 static constexpr size_t IO_BUFFER_SIZE = 1 << 20;  // 1 MiB
+static constexpr uint64_t STORED_CHUNK_SIZE = 64ull << 20;  // 64 MiB per copy task
+static constexpr uint64_t GLOBAL_CRC_CHUNK_SIZE = 64ull << 20;  // 64 MiB per CRC task
+static constexpr const char *MANIFEST_NAME = ".unpack-manifest.json";
+static constexpr int MANIFEST_VERSION = 1;
+static constexpr uint64_t CHECKPOINT_INTERVAL = 64ull << 20;  // Sync and checkpoint every 64 MiB of output
 
 //------------------------------------------------------------------------------
 // MemoryMap implementation
@@ -64,181 +83,1239 @@ MemoryMap::~MemoryMap() {
 
 const uint8_t* MemoryMap::data() const { return data_; }
 size_t         MemoryMap::size() const { return size_; }
+#ifndef _WIN32
+int            MemoryMap::fd() const { return fd_; }
+#endif
 
 //------------------------------------------------------------------------------
-// ThreadPool implementation (PImpl idiom)
+// Utility: read little-endian integers from memory
 //------------------------------------------------------------------------------
 
-struct ThreadPool::Impl {
-    std::vector<std::thread>          workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex                        mutex;
-    std::condition_variable           cvTask;
-    std::condition_variable           cvDone;
-    bool                              stop = false;
-    size_t                            busy = 0;
-};
+template<typename T>
+static T readLE(const uint8_t *ptr) {
+    T val;
+    std::memcpy(&val, ptr, sizeof(T));
+    return val;
+}
 
-ThreadPool::ThreadPool(size_t threadCount)
-    : impl_(new Impl()) {
-    for (size_t i = 0; i < threadCount; ++i) {
-        impl_->workers.emplace_back([this] {
-            auto &I = *impl_;
-            while (true) {
-                std::function<void()> job;
-                {
-                    std::unique_lock<std::mutex> lock(I.mutex);
-                    I.cvTask.wait(lock, [&] { return I.stop || !I.tasks.empty(); });
-                    if (I.stop && I.tasks.empty()) return;
-                    job = std::move(I.tasks.front());
-                    I.tasks.pop();
-                    ++I.busy;
-                }
-                job();
-                {
-                    std::unique_lock<std::mutex> lock(I.mutex);
-                    --I.busy;
-                    if (I.tasks.empty() && I.busy == 0) {
-                        I.cvDone.notify_one();
-                    }
-                }
-            }
-        });
+//------------------------------------------------------------------------------
+// CRC32 over a byte range, and the ranges the bundle CRC is assembled from
+//------------------------------------------------------------------------------
+
+static uint32_t crc32Range(uint32_t crc, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        size_t chunk = std::min<size_t>(IO_BUFFER_SIZE, size);
+        crc = crc32(crc, data, static_cast<uInt>(chunk));
+        data += chunk;
+        size -= chunk;
     }
+    return crc;
 }
 
-void ThreadPool::enqueue(std::function<void()> job) {
-    {
-        std::lock_guard<std::mutex> lock(impl_->mutex);
-        impl_->tasks.push(std::move(job));
+// A byte range of the bundle whose CRC is computed by exactly one task
+struct CrcSpan {
+    uint64_t offset;
+    uint64_t length;
+    uint32_t crc;
+};
+
+static uint32_t appendCrc(uint32_t crc, const CrcSpan &span) {
+    return crc32_combine(crc, span.crc, static_cast<z_off_t>(span.length));
+}
+
+//------------------------------------------------------------------------------
+// Progress counters, bumped by workers and read by the calling thread
+//------------------------------------------------------------------------------
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct SectionCounters {
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> crcNs{0};
+    std::atomic<uint64_t> startNs{0};   // First frame started
+    std::atomic<uint64_t> endNs{0};     // Committed
+    bool                  skipped = false;
+
+    void start() {
+        uint64_t expected = 0;
+        startNs.compare_exchange_strong(expected, nowNs(), std::memory_order_relaxed);
     }
-    impl_->cvTask.notify_one();
+};
+
+static uint32_t timedCrc(uint32_t crc, const uint8_t *data, size_t size, std::atomic<uint64_t> &ns) {
+    uint64_t start = nowNs();
+    crc = crc32Range(crc, data, size);
+    ns.fetch_add(nowNs() - start, std::memory_order_relaxed);
+    return crc;
 }
 
-void ThreadPool::wait() {
-    std::unique_lock<std::mutex> lock(impl_->mutex);
-    impl_->cvDone.wait(lock, [&] { return impl_->tasks.empty() && impl_->busy == 0; });
+class ProgressTracker {
+public:
+    ProgressTracker(const std::vector<Entry> &entries)
+        : entries_(entries), sections_(new SectionCounters[entries.size()]), startNs_(nowNs()) {}
+
+    SectionCounters &section(size_t index) { return sections_[index]; }
+    std::atomic<uint64_t> &crcNs() { return crcNs_; }
+
+    UnpackProgress snapshot(bool finished) const {
+        uint64_t now = nowNs();
+        UnpackProgress progress{};
+        progress.finished = finished;
+        progress.elapsed_ms = (now - startNs_) / 1e6;
+        uint64_t crcNs = crcNs_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            const SectionCounters &c = sections_[i];
+            SectionProgress section{};
+            section.name      = entries_[i].name;
+            section.skipped   = c.skipped;
+            section.total_in  = entries_[i].comp_length;
+            section.total_out = entries_[i].raw_length;
+            section.bytes_in  = c.bytesIn.load(std::memory_order_relaxed);
+            section.bytes_out = c.bytesOut.load(std::memory_order_relaxed);
+            section.crc_ms    = c.crcNs.load(std::memory_order_relaxed) / 1e6;
+            uint64_t start = c.startNs.load(std::memory_order_relaxed);
+            uint64_t end   = c.endNs.load(std::memory_order_relaxed);
+            section.done       = c.skipped || end > 0;
+            section.elapsed_ms = start == 0 ? 0 : ((end > 0 ? end : now) - start) / 1e6;
+            if (!c.skipped) {
+                progress.total_in += section.total_in;
+                progress.total_out += section.total_out;
+            }
+            progress.bytes_in += section.bytes_in;
+            progress.bytes_out += section.bytes_out;
+            crcNs += c.crcNs.load(std::memory_order_relaxed);
+            progress.sections.push_back(section);
+        }
+        progress.crc_ms = crcNs / 1e6;
+        double seconds = progress.elapsed_ms / 1e3;
+        if (seconds > 0) {
+            progress.in_mb_per_s  = progress.bytes_in / 1e6 / seconds;
+            progress.out_mb_per_s = progress.bytes_out / 1e6 / seconds;
+        }
+        return progress;
+    }
+
+private:
+    const std::vector<Entry>          &entries_;
+    std::unique_ptr<SectionCounters[]> sections_;
+    std::atomic<uint64_t>              crcNs_{0};  // Standalone CRC tasks
+    uint64_t                           startNs_;
+};
+
+//------------------------------------------------------------------------------
+// Positioned writer shared by the frames of a section
+//------------------------------------------------------------------------------
+
+class OutputFile {
+public:
+    // truncate = false keeps the contents of an existing file, to resume it
+    OutputFile(const fs::path &path, uint64_t size, bool truncate = true);
+    ~OutputFile();
+
+    // Reserve size bytes of contiguous space and extend the file to it
+    void allocate(uint64_t size);
+    void write(const void *data, size_t size, uint64_t offset);
+    void sync();
+    void close();
+    const fs::path &path() const { return path_; }
+#ifndef _WIN32
+    int  fd() const { return fd_; }
+#endif
+
+private:
+    fs::path path_;
+#ifdef _WIN32
+    void *handle_;
+#else
+    int   fd_;
+#endif
+};
+
+OutputFile::OutputFile(const fs::path &path, uint64_t size, bool truncate) : path_(path) {
+#ifdef _WIN32
+    handle_ = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr,
+                          truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle_ == INVALID_HANDLE_VALUE) throw std::runtime_error("Cannot create output file");
+#else
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (fd_ < 0) throw std::runtime_error("Cannot create output file");
+#endif
+    if (size > 0) allocate(size);
 }
 
-ThreadPool::~ThreadPool() {
-    {
-        std::lock_guard<std::mutex> lock(impl_->mutex);
-        impl_->stop = true;
+void OutputFile::allocate(uint64_t size) {
+#ifdef _WIN32
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx((HANDLE)handle_, end, nullptr, FILE_BEGIN) ||
+        !SetEndOfFile((HANDLE)handle_)) {
+        throw std::runtime_error("Cannot resize output file");
     }
-    impl_->cvTask.notify_all();
-    for (auto &worker : impl_->workers) {
-        worker.join();
+#else
+#ifdef __linux__
+    // Real blocks up front keep the file unfragmented; not every filesystem supports it
+    if (fallocate(fd_, 0, 0, static_cast<off_t>(size)) == 0) return;
+#endif
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+        throw std::runtime_error("Cannot resize output file");
+    }
+#endif
+}
+
+void OutputFile::write(const void *data, size_t size, uint64_t offset) {
+    const char *ptr = static_cast<const char*>(data);
+    while (size > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov{};
+        ov.Offset = static_cast<DWORD>(offset);
+        ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+        if (!WriteFile((HANDLE)handle_, ptr, chunk, &written, &ov)) {
+            throw std::runtime_error("Write failed");
+        }
+#else
+        ssize_t written = pwrite(fd_, ptr, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Write failed");
+        }
+#endif
+        ptr += written;
+        size -= written;
+        offset += written;
     }
-    delete impl_;
+}
+
+void OutputFile::sync() {
+#ifdef _WIN32
+    if (!FlushFileBuffers((HANDLE)handle_)) throw std::runtime_error("Sync failed");
+#else
+    if (fsync(fd_) != 0) throw std::runtime_error("Sync failed");
+#endif
+}
+
+static void syncDirectory(const fs::path &dir) {
+#ifndef _WIN32
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return;
+    fsync(fd);
+    ::close(fd);
+#else
+    (void)dir;
+#endif
+}
+
+void OutputFile::close() {
+#ifdef _WIN32
+    if (handle_ != INVALID_HANDLE_VALUE) CloseHandle((HANDLE)handle_);
+    handle_ = INVALID_HANDLE_VALUE;
+#else
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+#endif
+}
+
+OutputFile::~OutputFile() {
+    close();
 }
 
 //------------------------------------------------------------------------------
-// Utility: read little-endian integers from memory
+// Minimal io_uring write queue through raw syscalls, one per worker thread
 //------------------------------------------------------------------------------
 
-template<typename T>
-static T readLE(const uint8_t *ptr) {
-    T val;
-    std::memcpy(&val, ptr, sizeof(T));
-    return val;
-}
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IORING_OFF_SQ_RING)
+#define UNPACK_HAVE_URING 1
+
+class Uring {
+public:
+    // nullptr if the kernel (or a sandbox) refuses io_uring
+    static Uring *forThread() {
+        thread_local std::unique_ptr<Uring> ring;
+        thread_local bool failed = false;
+        if (!ring && !failed) {
+            ring.reset(new Uring());
+            if (ring->fd_ < 0) {
+                ring.reset();
+                failed = true;
+            }
+        }
+        return ring.get();
+    }
+
+    ~Uring() {
+        if (sqes_) munmap(sqes_, sqesSize_);
+        if (cqPtr_ && cqPtr_ != sqPtr_) munmap(cqPtr_, cqSize_);
+        if (sqPtr_) munmap(sqPtr_, sqSize_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    void write(int fd, const void *data, uint32_t length, uint64_t offset, uint64_t tag) {
+        unsigned tail = *sqTail_;
+        unsigned index = tail & *sqMask_;
+        io_uring_sqe &sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode    = IORING_OP_WRITE;
+        sqe.fd        = fd;
+        sqe.addr      = reinterpret_cast<uint64_t>(data);
+        sqe.len       = length;
+        sqe.off       = offset;
+        sqe.user_data = tag;
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        while (syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN) throw std::runtime_error("io_uring submit failed");
+        }
+    }
+
+    // Block for the next completion, returns its tag and result
+    uint64_t wait(int32_t &result) {
+        while (true) {
+            unsigned head = *cqHead_;
+            if (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe &cqe = cqes_[head & *cqMask_];
+                uint64_t tag = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+                return tag;
+            }
+            if (syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                errno != EINTR) {
+                throw std::runtime_error("io_uring wait failed");
+            }
+        }
+    }
+
+private:
+    static constexpr unsigned DEPTH = 4;
+
+    Uring() {
+        io_uring_params params{};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, DEPTH, &params));
+        if (fd_ < 0) return;
+        sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+        sqPtr_ = mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sqPtr_ == MAP_FAILED) { sqPtr_ = nullptr; fail(); return; }
+        cqPtr_ = single ? sqPtr_
+                        : mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cqPtr_ == MAP_FAILED) { cqPtr_ = nullptr; fail(); return; }
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) { fail(); return; }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        uint8_t *sq = static_cast<uint8_t*>(sqPtr_);
+        uint8_t *cq = static_cast<uint8_t*>(cqPtr_);
+        sqTail_  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead_  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    void fail() {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    int           fd_ = -1;
+    void         *sqPtr_ = nullptr;
+    void         *cqPtr_ = nullptr;
+    size_t        sqSize_ = 0;
+    size_t        cqSize_ = 0;
+    size_t        sqesSize_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    io_uring_cqe *cqes_ = nullptr;
+    unsigned     *sqTail_ = nullptr;
+    unsigned     *sqMask_ = nullptr;
+    unsigned     *sqArray_ = nullptr;
+    unsigned     *cqHead_ = nullptr;
+    unsigned     *cqTail_ = nullptr;
+    unsigned     *cqMask_ = nullptr;
+};
+#endif
 
 //------------------------------------------------------------------------------
-// Compute global CRC32 over data[0..size-5] (exclude last 4-byte footer)
+// Block writer of one frame: fills buffer_size blocks aligned to the file offset
+// and writes each with a single positioned write
 //------------------------------------------------------------------------------
 
-static uint32_t computeGlobalCrc(const uint8_t *data, size_t size) {
-    size_t validLen = (size > sizeof(uint32_t)) ? size - sizeof(uint32_t) : 0;
-    uint32_t crc = crc32(0, nullptr, 0);
-    size_t offset = 0;
-    while (offset < validLen) {
-        size_t chunk = std::min<size_t>(IO_BUFFER_SIZE, validLen - offset);
-        crc = crc32(crc, data + offset, static_cast<uInt>(chunk));
-        offset += chunk;
+class BlockWriter {
+public:
+    BlockWriter(OutputFile &out, WriterBackend backend, size_t blockSize, uint64_t offset)
+        : out_(out), backend_(backend), blockSize_(std::max<size_t>(blockSize, 4096)),
+          start_(offset), offset_(offset) {
+        buffers_[0].reset(new uint8_t[blockSize_]);
+#ifdef UNPACK_HAVE_URING
+        if (backend_ == WriterBackend::Uring) {
+            ring_ = Uring::forThread();
+            if (ring_) buffers_[1].reset(new uint8_t[blockSize_]);
+        }
+#endif
+        if (backend_ == WriterBackend::Stream) {
+            stream_.reset(new std::ofstream(out_.path(), std::ios::in | std::ios::out | std::ios::binary));
+            if (!*stream_) throw std::runtime_error("Cannot open output stream");
+            stream_->seekp(static_cast<std::streamoff>(offset));
+        }
+        // The first block ends on a block boundary, so every later write starts on one
+        capacity_ = blockSize_ - static_cast<size_t>(offset % blockSize_);
+    }
+
+    ~BlockWriter() {
+        // Buffers must outlive the writes the kernel still reads from
+        try {
+            drain();
+        } catch (...) {
+        }
     }
-    return crc;
-}
 
+    uint8_t *data() { return buffers_[current_].get(); }
+    size_t   capacity() const { return capacity_; }
+    size_t   filled() const { return filled_; }
+    void     setFilled(size_t filled) { filled_ = filled; }
+    bool     full() const { return filled_ == capacity_; }
+    uint64_t written() const { return offset_ + filled_ - start_; }
+
+    // Write the filled part of the current block and start the next one
+    void flush() {
+        if (filled_ == 0) return;
+        const uint8_t *block = buffers_[current_].get();
+        if (stream_) {
+            stream_->write(reinterpret_cast<const char*>(block), static_cast<std::streamsize>(filled_));
+            if (!*stream_) throw std::runtime_error("Write failed");
+#ifdef UNPACK_HAVE_URING
+        } else if (ring_) {
+            ring_->write(out_.fd(), block, static_cast<uint32_t>(filled_), offset_, current_);
+            pending_[current_] = {offset_, filled_, true};
+            current_ ^= 1;
+            if (pending_[current_].inflight) complete(current_);
+#endif
+        } else {
+            out_.write(block, filled_, offset_);
+        }
+        offset_ += filled_;
+        filled_ = 0;
+        capacity_ = blockSize_;
+    }
+
+    // Wait for submitted writes, rethrowing their failures
+    void finish() {
+        flush();
+        drain();
+        if (stream_) {
+            stream_->close();
+            if (stream_->fail()) throw std::runtime_error("Write failed");
+        }
+    }
+
+private:
+    struct Pending {
+        uint64_t offset;
+        size_t   length;
+        bool     inflight;
+    };
+
+    void drain() {
+#ifdef UNPACK_HAVE_URING
+        for (int i = 0; i < 2; ++i) {
+            if (pending_[i].inflight) complete(i);
+        }
+#endif
+    }
+
+#ifdef UNPACK_HAVE_URING
+    // Reap completions until buffer index is free again
+    void complete(int index) {
+        while (pending_[index].inflight) {
+            int32_t result = 0;
+            uint64_t tag = ring_->wait(result);
+            Pending &done = pending_[tag & 1];
+            done.inflight = false;
+            size_t written = result > 0 ? static_cast<size_t>(result) : 0;
+            if (result < 0 && result != -EINVAL && result != -EOPNOTSUPP) {
+                throw std::runtime_error("Write failed");
+            }
+            // Short write, or a kernel without IORING_OP_WRITE: finish it synchronously
+            if (written < done.length) {
+                out_.write(buffers_[tag & 1].get() + written, done.length - written, done.offset + written);
+            }
+        }
+    }
+
+    Uring  *ring_ = nullptr;
+    Pending pending_[2] = {};
+#endif
+
+    OutputFile                    &out_;
+    WriterBackend                  backend_;
+    size_t                         blockSize_;
+    uint64_t                       start_;
+    uint64_t                       offset_;
+    std::unique_ptr<uint8_t[]>     buffers_[2];
+    int                            current_ = 0;
+    size_t                         filled_ = 0;
+    size_t                         capacity_;
+    std::unique_ptr<std::ofstream> stream_;
+};
+
+//------------------------------------------------------------------------------
+// Decompress one zstd frame (or a whole single-stream section) into out at rawOffset
 //------------------------------------------------------------------------------
-static void decompressSection(const uint8_t *base,
-                              size_t offset,
-                              size_t compSize,
-                              const fs::path &outputPath) {
-    const uint8_t *srcPtr = base + offset;
+
+// Returns the number of bytes written; crc accumulates the input, rawCrc the output
+static uint64_t decompressFrame(const uint8_t *srcPtr,
+                                size_t compSize,
+                                BlockWriter &writer,
+                                uint64_t rawSize,
+                                uint32_t *crc,
+                                uint32_t &rawCrc,
+                                SectionCounters &counters) {
     ZSTD_DStream *dctx = ZSTD_createDStream();
     if (!dctx) throw std::runtime_error("Failed to create Zstd decompressor");
     if (ZSTD_isError(ZSTD_initDStream(dctx))) {
+        ZSTD_freeDStream(dctx);
         throw std::runtime_error("Failed to initialize Zstd decompressor");
     }
 
-    std::ofstream outFile(outputPath, std::ios::binary);
-    ZSTD_inBuffer inBuf{srcPtr, compSize, 0};
-    std::vector<char> outBuf(IO_BUFFER_SIZE);
-    ZSTD_outBuffer outZ{outBuf.data(), outBuf.size(), 0};
+    ZSTD_inBuffer inBuf{srcPtr, 0, 0};
+    bool flushed = false;
+    auto writeBlock = [&]() {
+        rawCrc = timedCrc(rawCrc, writer.data(), writer.filled(), counters.crcNs);
+        writer.flush();
+    };
 
-    while (inBuf.pos < inBuf.size) {
-        size_t ret = ZSTD_decompressStream(dctx, &outZ, &inBuf);
-        if (ZSTD_isError(ret)) {
-            ZSTD_freeDStream(dctx);
-            throw std::runtime_error("Zstd decompression error");
+    try {
+        // Keep going while input remains or the decoder filled the whole output buffer
+        while (inBuf.size < compSize || inBuf.pos < inBuf.size || !flushed) {
+            // Feed the input a slice at a time, so the CRC reads bytes the decoder is about to use
+            if (inBuf.pos == inBuf.size && inBuf.size < compSize) {
+                size_t next = std::min<size_t>(compSize, inBuf.size + IO_BUFFER_SIZE);
+                if (crc) *crc = timedCrc(*crc, srcPtr + inBuf.size, next - inBuf.size, counters.crcNs);
+                inBuf.size = next;
+            }
+            // Keep filling the current block, it is written once full
+            ZSTD_outBuffer outZ{writer.data(), writer.capacity(), writer.filled()};
+            size_t consumed = inBuf.pos;
+            size_t produced = outZ.pos;
+            size_t ret = ZSTD_decompressStream(dctx, &outZ, &inBuf);
+            if (ZSTD_isError(ret)) {
+                throw std::runtime_error("Zstd decompression error");
+            }
+            writer.setFilled(outZ.pos);
+            counters.bytesIn.fetch_add(inBuf.pos - consumed, std::memory_order_relaxed);
+            counters.bytesOut.fetch_add(outZ.pos - produced, std::memory_order_relaxed);
+            flushed = outZ.pos < outZ.size;
+            if (writer.full()) writeBlock();
         }
-        outFile.write(outBuf.data(), outZ.pos);
-        outZ.pos = 0;
+        writeBlock();
+        writer.finish();
+    } catch (...) {
+        ZSTD_freeDStream(dctx);
+        throw;
     }
-
     ZSTD_freeDStream(dctx);
+
+    uint64_t written = writer.written();
+    if (rawSize > 0 && written != rawSize) {
+        throw std::runtime_error("Decompressed size mismatch");
+    }
+    return written;
+}
+
+//------------------------------------------------------------------------------
+// Stored sections: share extents with the bundle, or copy them in the kernel
+//------------------------------------------------------------------------------
+
+// Share the block-aligned head of a stored section with the bundle.
+// Returns the number of bytes cloned, 0 if the filesystem cannot reflink.
+static uint64_t reflinkRange(const MemoryMap &mm, uint64_t offset, uint64_t length, OutputFile &out) {
+#if defined(__linux__) && defined(FICLONERANGE)
+    uint64_t aligned = length - length % STORED_ALIGNMENT;
+    if (offset % STORED_ALIGNMENT != 0 || aligned == 0) return 0;
+    struct file_clone_range range{};
+    range.src_fd      = mm.fd();
+    range.src_offset  = offset;
+    range.src_length  = aligned;
+    range.dest_offset = 0;
+    return ioctl(out.fd(), FICLONERANGE, &range) == 0 ? aligned : 0;
+#else
+    (void)mm; (void)offset; (void)length; (void)out;
+    return 0;
+#endif
+}
+
+static void copyRange(const MemoryMap &mm, uint64_t offset, uint64_t length,
+                      OutputFile &out, uint64_t rawOffset) {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    loff_t src = static_cast<loff_t>(offset);
+    loff_t dst = static_cast<loff_t>(rawOffset);
+    while (length > 0) {
+        ssize_t copied = syscall(SYS_copy_file_range, mm.fd(), &src, out.fd(), &dst,
+                                 static_cast<size_t>(std::min<uint64_t>(length, 1ull << 30)), 0u);
+        if (copied < 0 && errno == EINTR) continue;
+        if (copied <= 0) break;  // Unsupported here, fall back to a user-space copy
+        length -= copied;
+    }
+    offset = static_cast<uint64_t>(src);
+    rawOffset = static_cast<uint64_t>(dst);
+#endif
+    if (length > 0) {
+        out.write(mm.data() + offset, static_cast<size_t>(length), rawOffset);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Manifest of a finished unpack, lets a warm start skip the bundle payload
+//------------------------------------------------------------------------------
+
+struct FileRecord {
+    uint64_t size;
+    int64_t  mtime;   // Output file write time, detects replacement by other tools
+    uint32_t crc32;   // CRC32 of the extracted contents
+};
+
+struct Manifest {
+    uint64_t bundleSize = 0;
+    int64_t  bundleMtime = 0;
+    uint32_t bundleCrc = 0;   // CRC32 of the header, TOC and footer
+    std::map<std::string, FileRecord> files;
+};
+
+static int64_t mtimeOf(const fs::path &path) {
+#ifdef _WIN32
+    return static_cast<int64_t>(fs::last_write_time(path).time_since_epoch().count());
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+// Section names are paths relative to outDir, e.g. "draft/model.bin" for the
+// draft model of a speculative dialog, and must stay inside it
+static bool isSafeSectionName(const std::string &name) {
+    if (name.empty() || name == MANIFEST_NAME) return false;
+    fs::path path(name);
+    if (path.has_root_path()) return false;
+    for (auto &part : path) {
+        if (part == ".." || part == "." || part.empty()) return false;
+    }
+    return true;
+}
+
+static bool loadManifest(const fs::path &path, Manifest &manifest) {
+    std::ifstream file(path);
+    if (!file) return false;
+    nlohmann::json json = nlohmann::json::parse(file, nullptr, false);
+    if (json.is_discarded() || json.value("version", 0) != MANIFEST_VERSION) return false;
+    try {
+        auto &bundle = json.at("bundle");
+        manifest.bundleSize  = bundle.at("size").get<uint64_t>();
+        manifest.bundleMtime = bundle.at("mtime").get<int64_t>();
+        manifest.bundleCrc   = bundle.at("crc32").get<uint32_t>();
+        for (auto &item : json.at("files").items()) {
+            manifest.files[item.key()] = {
+                item.value().at("size").get<uint64_t>(),
+                item.value().at("mtime").get<int64_t>(),
+                item.value().at("crc32").get<uint32_t>(),
+            };
+        }
+    } catch (const nlohmann::json::exception &) {
+        return false;
+    }
+    return true;
+}
+
+static void saveManifest(const fs::path &path, const Manifest &manifest) {
+    nlohmann::json json;
+    json["version"] = MANIFEST_VERSION;
+    json["bundle"] = {
+        {"size", manifest.bundleSize},
+        {"mtime", manifest.bundleMtime},
+        {"crc32", manifest.bundleCrc},
+    };
+    json["files"] = nlohmann::json::object();
+    for (auto &item : manifest.files) {
+        json["files"][item.first] = {
+            {"size", item.second.size},
+            {"mtime", item.second.mtime},
+            {"crc32", item.second.crc32},
+        };
+    }
+    fs::path tmpPath = path.string() + ".part";
+    std::string text = json.dump(2);
+    {
+        OutputFile file(tmpPath, 0);
+        file.write(text.data(), text.size(), 0);
+        file.sync();
+    }
+    fs::rename(tmpPath, path);
+}
+
+static uint32_t fileCrc(const fs::path &path) {
+    QNN_TRACE_SCOPE("fileCrc");
+    if (fs::file_size(path) == 0) return 0;
+    MemoryMap mm(path.string());
+    return crc32Range(0, mm.data(), mm.size());
+}
+
+//------------------------------------------------------------------------------
+// Frame checkpoints of a multi-frame section, so an interrupted unpack resumes
+// where it stopped instead of restarting the section
+//
+//   Header:  char magic[8], u64 bundle_size, u32 bundle_crc, u32 section_crc,
+//            u64 frame_count
+//   Slot:    u32 comp_crc, u32 raw_crc, u64 raw_length, u32 flags, u32 slot_crc
+//            (one per frame, slot_crc covers the preceding 20 bytes)
+//
+// Slots are written only after the part file has been synced, so a valid slot
+// always describes frame data that is already on disk.
+//------------------------------------------------------------------------------
+
+static constexpr char     CHECKPOINT_MAGIC[8] = {'Q','C','K','P','T','0','1','\0'};
+static constexpr size_t   CHECKPOINT_HEADER_SIZE = 32;
+static constexpr size_t   CHECKPOINT_SLOT_SIZE = 24;
+static constexpr uint32_t SLOT_DONE = 1;
+static constexpr uint32_t SLOT_COMP_CRC = 2;  // comp_crc was computed
+
+struct FrameSlot {
+    uint32_t compCrc;
+    uint32_t rawCrc;
+    uint64_t rawLength;
+    uint32_t flags;
+};
+
+static std::string checkpointHeader(uint64_t bundleSize, uint32_t bundleCrc,
+                                    uint32_t sectionCrc, uint64_t frameCount) {
+    std::string header(CHECKPOINT_HEADER_SIZE, '\0');
+    char *p = &header[0];
+    std::memcpy(p, CHECKPOINT_MAGIC, 8);
+    std::memcpy(p + 8, &bundleSize, 8);
+    std::memcpy(p + 16, &bundleCrc, 4);
+    std::memcpy(p + 20, &sectionCrc, 4);
+    std::memcpy(p + 24, &frameCount, 8);
+    return header;
+}
+
+static void encodeSlot(uint8_t *slot, const FrameSlot &frame) {
+    std::memcpy(slot, &frame.compCrc, 4);
+    std::memcpy(slot + 4, &frame.rawCrc, 4);
+    std::memcpy(slot + 8, &frame.rawLength, 8);
+    std::memcpy(slot + 16, &frame.flags, 4);
+    uint32_t crc = crc32Range(0, slot, 20);
+    std::memcpy(slot + 20, &crc, 4);
+}
+
+// Slots that are missing, torn or not done come back with flags == 0
+static bool loadCheckpoint(const fs::path &path, const std::string &header,
+                           size_t frameCount, std::vector<FrameSlot> &slots) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < CHECKPOINT_HEADER_SIZE || data.compare(0, CHECKPOINT_HEADER_SIZE, header) != 0) {
+        return false;
+    }
+    slots.assign(frameCount, FrameSlot{0, 0, 0, 0});
+    for (size_t i = 0; i < frameCount; ++i) {
+        size_t offset = CHECKPOINT_HEADER_SIZE + i * CHECKPOINT_SLOT_SIZE;
+        if (offset + CHECKPOINT_SLOT_SIZE > data.size()) break;
+        const uint8_t *slot = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+        if (readLE<uint32_t>(slot + 20) != crc32Range(0, slot, 20)) continue;
+        slots[i] = {readLE<uint32_t>(slot), readLE<uint32_t>(slot + 4),
+                    readLE<uint64_t>(slot + 8), readLE<uint32_t>(slot + 16)};
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Output file of a section, committed once its last frame is written
+//------------------------------------------------------------------------------
+
+struct SectionJob {
+    const Entry                *entry;
+    fs::path                    partPath;
+    fs::path                    outPath;
+    fs::path                    checkpointPath;
+    std::unique_ptr<OutputFile> out;
+    std::unique_ptr<OutputFile> checkpoint;      // Null for single-frame sections
+    std::vector<Frame>          frames;
+    std::vector<size_t>         todo;            // Frames not restored from the checkpoint
+    bool                        cloned = false;  // Reflinked already, frames only need their CRC
+    bool                        verify = false;  // Check the combined frame CRCs against entry->crc32
+    size_t                      firstSpan = 0;   // CRC spans of the frames, in order
+    size_t                      spanCount = 0;
+    std::vector<uint32_t>       rawCrcs;         // CRC and size of each frame's output
+    std::vector<uint64_t>       rawLengths;
+    FileRecord                  record{};        // Filled in on commit
+    SectionCounters            *counters = nullptr;
+    WriterBackend               writer = WriterBackend::Pwrite;
+    size_t                      bufferSize = 0;
+    std::atomic<size_t>         pending{0};
+    bool                        compCrcs = false; // Frame input CRCs are computed this run
+    std::mutex                  checkpointMutex;
+    std::vector<size_t>         unsynced;        // Finished frames not checkpointed yet
+    uint64_t                    unsyncedBytes = 0;
+};
+
+static void decompressSection(const MemoryMap &mm,
+                              SectionJob &job,
+                              size_t index,
+                              const Frame &frame,
+                              uint32_t *crc) {
+    QNN_TRACE_SPAN(span, "decompressSection");
+    span.arg("bytes", frame.raw_length);
+    const Entry &e = *job.entry;
+    const uint8_t *src = mm.data() + e.offset + frame.comp_offset;
+    SectionCounters &counters = *job.counters;
+    counters.start();
+    if (e.method == METHOD_STORED) {
+        if (!job.cloned) {
+            copyRange(mm, e.offset + frame.comp_offset, frame.comp_length, *job.out, frame.raw_offset);
+            counters.bytesIn.fetch_add(frame.comp_length, std::memory_order_relaxed);
+            counters.bytesOut.fetch_add(frame.comp_length, std::memory_order_relaxed);
+        }
+        // Same bytes on both sides, read them once
+        uint32_t rawCrc = timedCrc(0, src, frame.comp_length, counters.crcNs);
+        if (crc) *crc = rawCrc;
+        job.rawCrcs[index]    = rawCrc;
+        job.rawLengths[index] = frame.comp_length;
+    } else {
+        BlockWriter writer(*job.out, job.writer, job.bufferSize, frame.raw_offset);
+        job.rawLengths[index] = decompressFrame(src, frame.comp_length, writer, frame.raw_length,
+                                                crc, job.rawCrcs[index], counters);
+    }
+}
+
+// Group frames so the part file is synced once per CHECKPOINT_INTERVAL of output
+static void checkpointFrame(SectionJob &job, size_t index, const std::vector<CrcSpan> &spans) {
+    if (!job.checkpoint) return;
+    std::vector<size_t> ready;
+    {
+        std::lock_guard<std::mutex> lock(job.checkpointMutex);
+        job.unsynced.push_back(index);
+        job.unsyncedBytes += job.rawLengths[index];
+        if (job.unsyncedBytes < CHECKPOINT_INTERVAL) return;
+        ready.swap(job.unsynced);
+        job.unsyncedBytes = 0;
+    }
+    job.out->sync();
+    for (size_t i : ready) {
+        uint8_t slot[CHECKPOINT_SLOT_SIZE];
+        encodeSlot(slot, {spans[job.firstSpan + i].crc, job.rawCrcs[i], job.rawLengths[i],
+                          SLOT_DONE | (job.compCrcs ? SLOT_COMP_CRC : 0)});
+        job.checkpoint->write(slot, sizeof(slot), CHECKPOINT_HEADER_SIZE + i * CHECKPOINT_SLOT_SIZE);
+    }
+}
+
+static void commitSection(SectionJob &job, const std::vector<CrcSpan> &spans) {
+    QNN_TRACE_SCOPE("commitSection");
+    job.out->sync();
+    job.out->close();
+    if (job.verify) {
+        uint32_t crc = 0;
+        for (size_t i = 0; i < job.spanCount; ++i) {
+            crc = appendCrc(crc, spans[job.firstSpan + i]);
+        }
+        if (crc != job.entry->crc32) {
+            std::error_code ec;
+            fs::remove(job.partPath, ec);
+            fs::remove(job.checkpointPath, ec);
+            throw std::runtime_error("CRC mismatch for " + job.entry->name);
+        }
+    }
+    fs::rename(job.partPath, job.outPath);
+    if (job.checkpoint) {
+        job.checkpoint->close();
+        std::error_code ec;
+        fs::remove(job.checkpointPath, ec);
+    }
+    uint32_t rawCrc = 0;
+    uint64_t size = 0;
+    for (size_t i = 0; i < job.spanCount; ++i) {
+        rawCrc = crc32_combine(rawCrc, job.rawCrcs[i], static_cast<z_off_t>(job.rawLengths[i]));
+        size += job.rawLengths[i];
+    }
+    job.record = {size, mtimeOf(job.outPath), rawCrc};
+    job.counters->endNs.store(nowNs(), std::memory_order_relaxed);
 }
 
 //------------------------------------------------------------------------------
 // unpackModel implementation
 //------------------------------------------------------------------------------
 
-void unpackModel(const std::string &bundlePath,
-                 const std::string &outDir) {
+UnpackProgress unpackModel(const std::string &bundlePath,
+                           const std::string &outDir,
+                           const UnpackOptions &options) {
+    QNN_TRACE_SCOPE("unpackModel");
     MemoryMap mm(bundlePath);
     const uint8_t *base = mm.data();
     size_t totalSize   = mm.size();
 
-    // Validate global CRC32
-    uint32_t storedCrc = readLE<uint32_t>(base + totalSize - sizeof(uint32_t));
-    if (storedCrc != computeGlobalCrc(base, totalSize)) {
-        throw std::runtime_error("Global CRC mismatch");
-    }
-
     // Parse header manually
     const uint8_t *p = base;
+    if (totalSize < 37 + sizeof(uint32_t) ||
+        std::memcmp(p, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) != 0) {
+        throw std::runtime_error("Invalid bundle magic");
+    }
     p += 7; // magic
-    p += 2; // version
+    uint16_t version = readLE<uint16_t>(p); p += 2;
+    if (version == 0 || version > CONTAINER_VERSION) {
+        throw std::runtime_error("Unsupported bundle version");
+    }
     p += 4; // reserved
     uint64_t configOffset = readLE<uint64_t>(p); p += 8;
     uint64_t configLength = readLE<uint64_t>(p); p += 8;
     uint64_t tocOffset    = readLE<uint64_t>(p); p += 8;
 
+    // The global CRC is checked after extraction, so bound every read of the TOC
+    const uint64_t dataEnd = totalSize - sizeof(uint32_t);
+    auto inBundle = [&](uint64_t offset, uint64_t length) {
+        return length <= dataEnd && offset <= dataEnd - length;
+    };
+    if (!inBundle(configOffset, configLength) || tocOffset > dataEnd) {
+        throw std::runtime_error("Invalid bundle header");
+    }
+
     // Collect entries (config.json + TOC entries)
     std::vector<Entry> entries;
-    entries.push_back({"config.json", configOffset, configLength, 0, 0});
+    entries.push_back({"config.json", configOffset, configLength, 0, 0, METHOD_ZSTD, {}});
 
     size_t ptr = tocOffset;
-    while (ptr + sizeof(uint16_t) < totalSize - sizeof(uint32_t)) {
+    auto need = [&](uint64_t length) {
+        if (!inBundle(ptr, length)) throw std::runtime_error("Truncated bundle TOC");
+    };
+    while (ptr + sizeof(uint16_t) < dataEnd) {
+        need(2);
         uint16_t nameLen = readLE<uint16_t>(base + ptr); ptr += 2;
+        need(nameLen + 28);
         std::string name(reinterpret_cast<const char*>(base + ptr), nameLen);
         ptr += nameLen;
+        if (!isSafeSectionName(name)) {
+            throw std::runtime_error("Invalid section name: " + name);
+        }
         uint64_t offset = readLE<uint64_t>(base + ptr); ptr += 8;
         uint64_t clen   = readLE<uint64_t>(base + ptr); ptr += 8;
         uint64_t rlen   = readLE<uint64_t>(base + ptr); ptr += 8;
         uint32_t crc    = readLE<uint32_t>(base + ptr); ptr += 4;
-        entries.push_back({name, offset, clen, rlen, crc});
+        if (!inBundle(offset, clen)) {
+            throw std::runtime_error("Section out of bounds: " + name);
+        }
+        Entry e{name, offset, clen, rlen, crc, METHOD_ZSTD, {}};
+        if (version >= 2) {
+            need(5);
+            e.method = base[ptr]; ptr += 1;
+            uint32_t frameCount = readLE<uint32_t>(base + ptr); ptr += 4;
+            need(uint64_t(frameCount) * 16);
+            uint64_t compOffset = 0, rawOffset = 0;
+            for (uint32_t i = 0; i < frameCount; ++i) {
+                uint64_t fclen = readLE<uint64_t>(base + ptr); ptr += 8;
+                uint64_t frlen = readLE<uint64_t>(base + ptr); ptr += 8;
+                e.frames.push_back({compOffset, fclen, rawOffset, frlen});
+                compOffset += fclen;
+                rawOffset  += frlen;
+            }
+            if (frameCount > 0 && (compOffset != clen || rawOffset != rlen)) {
+                throw std::runtime_error("Invalid frame index for " + name);
+            }
+        }
+        if (e.method == METHOD_STORED) {
+            if (clen != rlen) {
+                throw std::runtime_error("Invalid stored section " + name);
+            }
+            // Copy in chunks so large stored sections spread across the workers
+            e.frames.clear();
+            for (uint64_t pos = 0; pos < rlen; pos += STORED_CHUNK_SIZE) {
+                uint64_t len = std::min<uint64_t>(STORED_CHUNK_SIZE, rlen - pos);
+                e.frames.push_back({pos, len, pos, len});
+            }
+        } else if (e.method != METHOD_ZSTD) {
+            throw std::runtime_error("Unsupported section method for " + name);
+        }
+        entries.push_back(e);
     }
 
+    const bool verifyGlobal   = options.verify == VerifyMode::Full;
+    const bool verifySections = options.verify != VerifyMode::None;
+    const qnnllm::TaskHints hints{options.priority, options.cores, false};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    auto guard = [&](const std::function<void()> &task) {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    // Workers only bump counters, the calling thread turns them into reports
+    ProgressTracker tracker(entries);
+    auto waitGroup = [&](qnnllm::TaskGroup &group) {
+        if (!options.on_progress) {
+            group.wait();
+            return;
+        }
+        auto interval = std::chrono::milliseconds(std::max<uint32_t>(options.progress_interval_ms, 1));
+        while (!group.waitFor(interval)) {
+            guard([&]() { options.on_progress(tracker.snapshot(false)); });
+        }
+    };
+    auto finish = [&]() {
+        UnpackProgress summary = tracker.snapshot(true);
+        if (options.on_progress) options.on_progress(summary);
+        return summary;
+    };
+
+    // Files recorded by the manifest of the same bundle are trusted while their
+    // size and write time are unchanged, or, on deep verification, their CRC
+    Manifest manifest;
+    manifest.bundleSize  = totalSize;
+    manifest.bundleMtime = mtimeOf(bundlePath);
+    manifest.bundleCrc   = crc32Range(crc32Range(0, base, 37), base + tocOffset, totalSize - tocOffset);
+    const fs::path manifestPath = fs::path(outDir) / MANIFEST_NAME;
+    Manifest previous;
+    if (loadManifest(manifestPath, previous) &&
+        previous.bundleSize == manifest.bundleSize &&
+        previous.bundleMtime == manifest.bundleMtime &&
+        previous.bundleCrc == manifest.bundleCrc) {
+        for (auto &e : entries) {
+            auto it = previous.files.find(e.name);
+            if (it == previous.files.end()) continue;
+            fs::path outPath = fs::path(outDir) / e.name;
+            std::error_code ec;
+            if (fs::file_size(outPath, ec) == it->second.size && !ec &&
+                mtimeOf(outPath) == it->second.mtime) {
+                manifest.files[e.name] = it->second;
+            }
+        }
+    }
+    if (options.deep_verify && !manifest.files.empty()) {
+        std::mutex resultMutex;
+        std::vector<std::string> corrupt;
+        qnnllm::TaskGroup group(qnnllm::Executor::shared(), hints);
+        for (auto &item : manifest.files) {
+            group.submit([&, name = item.first, expected = item.second.crc32]() {
+                bool valid = false;
+                uint64_t start = nowNs();
+                try {
+                    valid = fileCrc(fs::path(outDir) / name) == expected;
+                } catch (const std::exception &) {
+                }
+                tracker.crcNs().fetch_add(nowNs() - start, std::memory_order_relaxed);
+                if (!valid) {
+                    std::lock_guard<std::mutex> lock(resultMutex);
+                    corrupt.push_back(name);
+                }
+            });
+        }
+        waitGroup(group);
+        for (auto &name : corrupt) manifest.files.erase(name);
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        tracker.section(i).skipped = manifest.files.count(entries[i].name) > 0;
+    }
+    if (manifest.files.size() == entries.size()) {
+        return finish();  // Warm start, the payload is never touched
+    }
+
+    // Narrow the manifest to the trusted files before replacing any other, then
+    // record each section as it is committed, so a killed unpack keeps them
     fs::create_directories(outDir);
-    ThreadPool pool(std::thread::hardware_concurrency());
-    for (auto &e : entries) {
-        // Skip if file exists and size matches expected raw length
+    saveManifest(manifestPath, manifest);
+    std::mutex manifestMutex;
+    auto recordFile = [&](const std::string &name, const FileRecord &record) {
+        std::lock_guard<std::mutex> lock(manifestMutex);
+        manifest.files[name] = record;
+        syncDirectory((fs::path(outDir) / name).parent_path());
+        saveManifest(manifestPath, manifest);
+    };
+
+    // Plan every task before starting any, so spans never reallocate under a worker
+    const bool computeCrc = verifyGlobal || verifySections;
+    const bool preallocate = options.writer != WriterBackend::Stream;
+    std::vector<CrcSpan> spans;
+    std::vector<std::shared_ptr<SectionJob>> jobs;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry &e = entries[i];
         fs::path outPath = fs::path(outDir) / e.name;
-        if (fs::exists(outPath) && fs::file_size(outPath) == e.raw_length) {
+        if (manifest.files.count(e.name)) {
             continue; // skip already extracted section
         }
-        pool.enqueue([=](){ decompressSection(base, e.offset, e.comp_length, fs::path(outDir)/e.name); });
+        if (fs::create_directories(outPath.parent_path())) {
+            syncDirectory(outDir);
+        }
+        std::vector<Frame> frames = e.frames;
+        if (frames.empty()) {
+            frames.push_back({0, e.comp_length, 0, 0});
+        }
+        auto job = std::make_shared<SectionJob>();
+        job->entry          = &e;
+        job->counters       = &tracker.section(i);
+        job->outPath        = outPath;
+        job->partPath       = outPath.string() + ".part";
+        job->checkpointPath = outPath.string() + ".ckpt";
+        job->verify         = verifySections && i > 0;  // config.json has no CRC of its own
+        job->compCrcs       = computeCrc;
+        job->writer         = options.writer;
+        job->bufferSize     = options.buffer_size;
+
+        // Pick up the frames an interrupted run already wrote
+        const std::string header = checkpointHeader(manifest.bundleSize, manifest.bundleCrc,
+                                                    e.crc32, frames.size());
+        std::vector<FrameSlot> slots;
+        bool resume = frames.size() > 1 && fs::exists(job->partPath) &&
+                      loadCheckpoint(job->checkpointPath, header, frames.size(), slots);
+
+        if (e.method == METHOD_STORED) {
+            job->out.reset(new OutputFile(job->partPath, 0, !resume));
+            uint64_t cloned = resume ? 0 : reflinkRange(mm, e.offset, e.raw_length, *job->out);
+            if (cloned > 0) {
+                job->counters->start();
+                copyRange(mm, e.offset + cloned, e.raw_length - cloned, *job->out, cloned);
+                job->counters->bytesIn  = e.raw_length;
+                job->counters->bytesOut = e.raw_length;
+                if (!job->verify) {
+                    job->out->sync();
+                    job->out->close();
+                    fs::rename(job->partPath, job->outPath);
+                    // The TOC CRC covers exactly the stored bytes
+                    recordFile(e.name, {e.raw_length, mtimeOf(job->outPath), e.crc32});
+                    job->counters->endNs = nowNs();
+                    continue;
+                }
+                job->cloned = true;
+            } else if (preallocate) {
+                job->out->allocate(e.raw_length);
+            }
+        } else {
+            uint64_t size = preallocate && !e.frames.empty() ? e.raw_length : 0;
+            job->out.reset(new OutputFile(job->partPath, size, !resume));
+        }
+        if (frames.size() > 1 && !job->cloned) {
+            job->checkpoint.reset(new OutputFile(job->checkpointPath, 0, !resume));
+            if (!resume) {
+                job->checkpoint->write(header.data(), header.size(), 0);
+            }
+        }
+
+        job->firstSpan = spans.size();
+        job->spanCount = frames.size();
+        job->rawCrcs.assign(frames.size(), 0);
+        job->rawLengths.assign(frames.size(), 0);
+        for (size_t f = 0; f < frames.size(); ++f) {
+            spans.push_back({e.offset + frames[f].comp_offset, frames[f].comp_length, 0});
+            const FrameSlot *slot = resume ? &slots[f] : nullptr;
+            if (slot && (slot->flags & SLOT_DONE) && (!computeCrc || (slot->flags & SLOT_COMP_CRC))) {
+                spans.back().crc     = slot->compCrc;
+                job->rawCrcs[f]      = slot->rawCrc;
+                job->rawLengths[f]   = slot->rawLength;
+                job->counters->bytesIn  += frames[f].comp_length;
+                job->counters->bytesOut += slot->rawLength;
+            } else {
+                job->todo.push_back(f);
+            }
+        }
+        job->frames  = std::move(frames);
+        job->pending = job->todo.size();
+        jobs.push_back(job);
+    }
+
+    // The bundle CRC reuses the frame CRCs and only reads the bytes between them
+    // (header, TOC, padding, skipped sections) in separate chunk tasks
+    const size_t sectionSpans = spans.size();
+    std::vector<size_t> order;
+    if (verifyGlobal) {
+        std::vector<size_t> sorted(sectionSpans);
+        for (size_t i = 0; i < sectionSpans; ++i) sorted[i] = i;
+        std::sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) {
+            return spans[a].offset != spans[b].offset ? spans[a].offset < spans[b].offset
+                                                      : spans[a].length < spans[b].length;
+        });
+        for (size_t i = 1; i < sorted.size(); ++i) {
+            const CrcSpan &prev = spans[sorted[i - 1]];
+            if (prev.offset + prev.length > spans[sorted[i]].offset) {
+                sorted.clear();  // Overlapping sections, checksum the bundle in plain chunks
+                break;
+            }
+        }
+        uint64_t pos = 0;
+        auto addGap = [&](uint64_t end) {
+            for (; pos < end; pos += GLOBAL_CRC_CHUNK_SIZE) {
+                order.push_back(spans.size());
+                spans.push_back({pos, std::min<uint64_t>(GLOBAL_CRC_CHUNK_SIZE, end - pos), 0});
+            }
+            pos = end;
+        };
+        for (size_t index : sorted) {
+            uint64_t offset = spans[index].offset;
+            uint64_t end    = offset + spans[index].length;
+            addGap(offset);
+            order.push_back(index);
+            pos = end;
+        }
+        addGap(dataEnd);
+    }
+
+    // Declared after the spans and jobs it references, so it is drained before they go away
+    qnnllm::TaskGroup group(qnnllm::Executor::shared(), hints);
+    for (auto &job : jobs) {
+        if (job->todo.empty()) {
+            // Every frame was restored from the checkpoint
+            guard([&]() {
+                commitSection(*job, spans);
+                recordFile(job->entry->name, job->record);
+            });
+            continue;
+        }
+        for (size_t f : job->todo) {
+            CrcSpan *span = &spans[job->firstSpan + f];
+            group.submit([&, job, f, span]() {
+                guard([&]() {
+                    decompressSection(mm, *job, f, job->frames[f], computeCrc ? &span->crc : nullptr);
+                    checkpointFrame(*job, f, spans);
+                    if (--job->pending == 0) {
+                        commitSection(*job, spans);
+                        recordFile(job->entry->name, job->record);
+                    }
+                });
+            });
+        }
+    }
+    for (size_t i = sectionSpans; i < spans.size(); ++i) {
+        CrcSpan *span = &spans[i];
+        group.submit([&, span]() {
+            guard([&]() {
+                QNN_TRACE_SPAN(trace, "gapCrc");
+                trace.arg("bytes", span->length);
+                span->crc = timedCrc(0, base + span->offset, span->length, tracker.crcNs());
+            });
+        });
+    }
+    waitGroup(group);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    if (verifyGlobal) {
+        uint32_t crc = 0;
+        for (size_t index : order) {
+            crc = appendCrc(crc, spans[index]);
+        }
+        if (crc != readLE<uint32_t>(base + dataEnd)) {
+            // Header or TOC damage, do not leave anything from this run behind
+            std::error_code ec;
+            for (auto &job : jobs) fs::remove(job->outPath, ec);
+            fs::remove(manifestPath, ec);
+            throw std::runtime_error("Global CRC mismatch");
+        }
     }
-    pool.wait();
+    return finish();
 }
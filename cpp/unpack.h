@@ -4,13 +4,55 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <chrono>
+#include "executor.h"
 
 // -----------------------------------------------------------------------------
 // Container format constants
 // -----------------------------------------------------------------------------
 
 static constexpr char CONTAINER_MAGIC[7] = {'Q','G','E','N','I','E','1'};
-static constexpr uint16_t CONTAINER_VERSION = 1;
+static constexpr uint16_t CONTAINER_VERSION = 2;
+
+// Section encodings (version 2+)
+static constexpr uint8_t METHOD_ZSTD   = 0;
+static constexpr uint8_t METHOD_STORED = 1;   // Raw bytes, comp_length == raw_length
+
+// Stored sections start on this boundary so they can be reflinked or mapped
+static constexpr uint64_t STORED_ALIGNMENT = 4096;
+
+// -----------------------------------------------------------------------------
+// TOC entry layout
+//
+// Version 1:
+//   u16 name_len, name, u64 offset, u64 comp_length, u64 raw_length, u32 crc32
+//
+// Version 2 appends:
+//   u8  method       Section encoding (METHOD_*)
+//   u32 frame_count  Number of independently decompressible frames, 0 if the
+//                    section is a single stream
+//   { u64 comp_length, u64 raw_length } x frame_count
+//
+// Frames are stored back to back, so their offsets are the running sums of the
+// lengths. Splitting large sections into frames lets them be decompressed in
+// parallel; the concatenated frames still form one valid zstd stream.
+//
+// METHOD_STORED sections hold the file as-is at a STORED_ALIGNMENT-aligned offset
+// and have no frames. They are extracted without decompression, by reflink where
+// the filesystem supports it, otherwise by in-kernel copy_file_range. Only a
+// reflink avoids a second copy on disk, and ext4 and F2FS, which Android uses,
+// cannot reflink.
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// Independently decompressible part of a section
+// -----------------------------------------------------------------------------
+struct Frame {
+    uint64_t comp_offset;    // Offset of the compressed frame, relative to the section
+    uint64_t comp_length;    // Length in bytes of the compressed frame
+    uint64_t raw_offset;     // Offset of the frame's output in the extracted file
+    uint64_t raw_length;     // Size of the frame after decompression
+};
 
 // -----------------------------------------------------------------------------
 // Metadata for each section inside the bundle
@@ -21,6 +63,8 @@ struct Entry {
     uint64_t    comp_length; // Length in bytes of the compressed data
     uint64_t    raw_length;  // Expected size after decompression
     uint32_t    crc32;       // CRC32 checksum of the compressed data
+    uint8_t     method = METHOD_ZSTD;
+    std::vector<Frame> frames; // Empty if the section is a single stream
 };
 
 // -----------------------------------------------------------------------------
@@ -33,6 +77,9 @@ public:
 
     const uint8_t *data() const;
     size_t         size() const;
+#ifndef _WIN32
+    int            fd() const;
+#endif
 
 private:
     const uint8_t *data_;
@@ -46,19 +93,63 @@ private:
 };
 
 // -----------------------------------------------------------------------------
-// Simple thread pool for executing tasks in parallel
+// Integrity checks performed while unpacking
 // -----------------------------------------------------------------------------
-class ThreadPool {
-public:
-    explicit ThreadPool(size_t threads);
-    ~ThreadPool();
+enum class VerifyMode {
+    Full,      // Bundle CRC footer and per-section CRCs
+    Sections,  // Per-section CRCs only, the header and TOC are not covered
+    None,
+};
 
-    void enqueue(std::function<void()> job);
-    void wait();
+// -----------------------------------------------------------------------------
+// Progress of an unpack, reported periodically and returned as its summary
+// -----------------------------------------------------------------------------
+struct SectionProgress {
+    std::string name;
+    uint64_t    bytes_in;     // Bundle bytes consumed
+    uint64_t    bytes_out;    // Bytes written to the extracted file
+    uint64_t    total_in;
+    uint64_t    total_out;    // 0 if not known up front (config.json)
+    double      elapsed_ms;   // From its first frame starting to commit, or to now
+    double      crc_ms;       // Worker time spent computing its CRCs
+    bool        skipped;      // Trusted from the manifest, not extracted
+    bool        done;
+};
 
-private:
-    struct Impl;
-    Impl *impl_;
+struct UnpackProgress {
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t total_in;        // Sections being extracted only
+    uint64_t total_out;
+    double   elapsed_ms;
+    double   crc_ms;          // Worker time spent on CRCs, fused and standalone
+    double   in_mb_per_s;
+    double   out_mb_per_s;
+    bool     finished;
+    std::vector<SectionProgress> sections;
+};
+
+typedef std::function<void(const UnpackProgress &progress)> ProgressSink;
+
+// -----------------------------------------------------------------------------
+// How decompressed sections reach the disk
+// -----------------------------------------------------------------------------
+enum class WriterBackend {
+    Pwrite,  // Preallocated file, one positioned write per buffer_size block
+    Uring,   // Same blocks submitted through io_uring while the next one is
+             // decompressed, falls back to Pwrite where io_uring is unavailable
+    Stream,  // std::ofstream without preallocation, the old path, for comparison
+};
+
+struct UnpackOptions {
+    VerifyMode   verify = VerifyMode::Full;
+    bool         deep_verify = false;        // Re-check the CRC of files the manifest already vouches for
+    ProgressSink on_progress;                // Called on the calling thread, workers never wait for it
+    uint32_t     progress_interval_ms = 250;
+    WriterBackend writer = WriterBackend::Pwrite;
+    size_t       buffer_size = 4 << 20;      // Decompression output block, also the write size
+    qnnllm::Priority priority = qnnllm::Priority::Low;   // Queue position on the shared executor
+    qnnllm::CoreHint cores = qnnllm::CoreHint::Any;      // Efficiency keeps unpacking off the inference cores
 };
 
 // -----------------------------------------------------------------------------
@@ -69,10 +160,25 @@ private:
  * unpackModel
  *
  * Extracts all sections from a bundled file into the specified output directory.
- * Performs CRC validation and uses a thread pool to decompress sections in parallel.
+ * Uses the shared executor to decompress sections, and the frames of framed sections,
+ * in parallel. Section CRCs are computed in the same pass that decompresses the
+ * section and checked before the file is moved into place; the bundle CRC is
+ * combined from those and chunked CRCs of the remaining bytes.
+ *
+ * A manifest in outDir records the bundle identity (size, write time, CRC of the
+ * header and TOC) and the size, write time and CRC of every extracted file. When
+ * the bundle matches it, files whose size and write time are unchanged are not
+ * extracted again, so a warm start never reads the bundle payload.
+ *
+ * Files are written to "<name>.part", synced and renamed into place, and the
+ * manifest is updated as each one is committed. Multi-frame sections checkpoint
+ * finished frames to "<name>.ckpt", so an interrupted unpack resumes them.
  *
  * @param bundlePath Path to the input bundle file
  * @param outDir     Directory where extracted files will be written
+ * @param options    Integrity checks and progress reporting
+ * @return Summary of the run, also passed to the progress sink as the last report
  */
-void unpackModel(const std::string &bundlePath,
-                 const std::string &outDir);
+UnpackProgress unpackModel(const std::string &bundlePath,
+                           const std::string &outDir,
+                           const UnpackOptions &options = UnpackOptions());
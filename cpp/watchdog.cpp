@@ -0,0 +1,97 @@
+#include "watchdog.h"
+#include "metrics.h"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace qnnllm {
+
+//------------------------------------------------------------------------------
+// Watchdog implementation (PImpl idiom)
+//------------------------------------------------------------------------------
+
+struct Alarm {
+  uint64_t           deadline_ns;
+  Watchdog::Callback callback;
+};
+
+struct Watchdog::Impl {
+  std::thread                 worker;
+  std::map<uint64_t, Alarm>   alarms;  // By ID
+  std::mutex                  mutex;
+  std::condition_variable     cvAlarm;
+  std::condition_variable     cvFired;
+  uint64_t                    nextId = 1;
+  uint64_t                    firing = 0;  // ID of the running callback
+  bool                        stop = false;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop) {
+      auto next = alarms.end();
+      for (auto it = alarms.begin(); it != alarms.end(); ++it) {
+        if (next == alarms.end() || it->second.deadline_ns < next->second.deadline_ns) next = it;
+      }
+      if (next == alarms.end()) {
+        cvAlarm.wait(lock);
+        continue;
+      }
+      const uint64_t now = QueryTimer::now();
+      if (next->second.deadline_ns > now) {
+        cvAlarm.wait_for(lock, std::chrono::nanoseconds(next->second.deadline_ns - now));
+        continue;
+      }
+      Callback callback = std::move(next->second.callback);
+      firing = next->first;
+      alarms.erase(next);
+      lock.unlock();
+      callback();
+      lock.lock();
+      firing = 0;
+      cvFired.notify_all();
+    }
+  }
+};
+
+Watchdog::Watchdog()
+    : impl_(new Impl()) {
+  impl_->worker = std::thread([this] { impl_->run(); });
+}
+
+Watchdog::~Watchdog() {
+  {
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    impl_->stop = true;
+  }
+  impl_->cvAlarm.notify_one();
+  impl_->worker.join();
+  delete impl_;
+}
+
+Watchdog &Watchdog::shared() {
+  static Watchdog *instance = new Watchdog();
+  return *instance;
+}
+
+uint64_t Watchdog::arm(uint64_t deadline_ns, Callback callback) {
+  auto &I = *impl_;
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(I.mutex);
+    id = I.nextId++;
+    I.alarms[id] = {deadline_ns, std::move(callback)};
+  }
+  I.cvAlarm.notify_one();
+  return id;
+}
+
+void Watchdog::disarm(uint64_t id) {
+  auto &I = *impl_;
+  std::unique_lock<std::mutex> lock(I.mutex);
+  I.alarms.erase(id);
+  I.cvFired.wait(lock, [&] { return I.firing != id; });
+}
+
+}  // namespace qnnllm
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace qnnllm {
+
+// -----------------------------------------------------------------------------
+// One timer thread firing callbacks at QueryTimer::now() deadlines, e.g. to
+// abort a generation that ran out of time. Callbacks run on the timer thread
+// and must be short.
+// -----------------------------------------------------------------------------
+class Watchdog {
+public:
+  typedef std::function<void()> Callback;
+
+  Watchdog();
+  ~Watchdog();
+
+  /**
+   * Shared instance, never destroyed.
+   */
+  static Watchdog &shared();
+
+  /**
+   * Run callback once deadline_ns has passed.
+   * @return Alarm ID for disarm
+   */
+  uint64_t arm(uint64_t deadline_ns, Callback callback);
+
+  /**
+   * Cancel an alarm. If its callback is running, wait for it to return, so
+   * whatever the callback captured may be released afterwards.
+   */
+  void disarm(uint64_t id);
+
+private:
+  struct Impl;
+  Impl *impl_;
+};
+
+}  // namespace qnnllm
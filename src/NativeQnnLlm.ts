@@ -2,16 +2,103 @@ import type { TurboModule } from 'react-native';
 import { TurboModuleRegistry } from 'react-native';
 
 export interface Spec extends TurboModule {
-  createContext(config: string): Promise<number>;
-  unpack(bundlePath: string, unpackDir: string): Promise<string>;
+  createContext(config: string, share: boolean): Promise<number>;
+  unpack(
+    bundlePath: string,
+    unpackDir: string,
+    verify: number,
+    deepVerify: boolean,
+    writer: number,
+    bufferSize: number,
+    unpackId: number,
+    progressIntervalMs: number
+  ): Promise<string>;
   freeContext(context: number): Promise<void>;
-  process(context: number, input: string): Promise<void>;
-  query(context: number, input: string): Promise<string>;
+  process(
+    context: number,
+    requestId: number,
+    input: string,
+    priority: number,
+    chunkTokens: number,
+    reportProgress: boolean
+  ): Promise<string>;
+  query(
+    context: number,
+    requestId: number,
+    input: string,
+    priority: number,
+    maxNewTokens: number,
+    deadlineMs: number,
+    maxTtftMs: number
+  ): Promise<string>;
   setStopWords(context: number, stopWords: string): Promise<void>;
   applySamplerConfig(context: number, config: string): Promise<void>;
-  saveSession(context: number, filename: string): Promise<void>;
-  restoreSession(context: number, filename: string): Promise<void>;
+  saveSession(
+    context: number,
+    filename: string,
+    priority: number,
+    level: number,
+    background: boolean
+  ): Promise<void>;
+  restoreSession(
+    context: number,
+    filename: string,
+    priority: number
+  ): Promise<void>;
   abort(context: number): Promise<void>;
+  cancelPending(context: number): Promise<number>;
+  getQueueStats(context: number): Promise<string>;
+  getMetricsStats(context: number): Promise<string>;
+  resetMetrics(context: number): Promise<void>;
+  setSessionCache(
+    context: number,
+    dir: string,
+    budget: number,
+    maxEntries: number
+  ): Promise<void>;
+  getSessionCacheStats(context: number): Promise<string>;
+  setResponseCoalescing(
+    context: number,
+    intervalMs: number,
+    maxFragments: number
+  ): Promise<void>;
+  applyLora(
+    context: number,
+    adapter: string,
+    engine: string,
+    priority: number
+  ): Promise<void>;
+  setLoraStrength(
+    context: number,
+    tensor: string,
+    alpha: number,
+    engine: string,
+    priority: number
+  ): Promise<void>;
+  setLoraResidency(context: number, maxAdapters: number): Promise<void>;
+  getLoraStats(context: number): Promise<string>;
+  setGrammar(context: number, grammar: string, priority: number): Promise<void>;
+  getSamplerStats(context: number): Promise<string>;
+  getSnapshotStats(context: number): Promise<string>;
+  setContextPoolOptions(maxContexts: number, idleMs: number): Promise<void>;
+  trimContextPool(): Promise<number>;
+  getContextPoolStats(): Promise<string>;
+  getExecutorStats(): Promise<string>;
+  getLogHistory(limit: number): Promise<string>;
+  getLogStats(): Promise<string>;
+  startTrace(): Promise<void>;
+  stopTrace(): Promise<void>;
+  getTrace(): Promise<string>;
+  getTraceStats(): Promise<string>;
+  createEmbeddingContext(config: string): Promise<number>;
+  freeEmbeddingContext(context: number): Promise<void>;
+  embed(
+    context: number,
+    inputs: string[],
+    normalize: boolean,
+    priority: number
+  ): Promise<string>;
+  cancelPendingEmbeddings(context: number): Promise<number>;
 }
 
 export default TurboModuleRegistry.getEnforcing<Spec>('QnnLlm');
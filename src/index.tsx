@@ -35,16 +35,467 @@ export enum SentenceCode {
   Abort = 4,
 }
 
-interface ResponseEvent {
+/**
+ * Request priority in the per-context queue.
+ * Requests of the same priority run in submission order.
+ */
+export enum Priority {
+  High = 0,
+  Normal = 1,
+  Low = 2,
+}
+
+/**
+ * Integrity checks performed when unpacking a bundle.
+ * `Sections` skips the bundle CRC, which only adds coverage of the header and TOC.
+ */
+export enum VerifyMode {
+  Full = 0,
+  Sections = 1,
+  None = 2,
+}
+
+/**
+ * How unpacked files are written.
+ * `Stream` is the unbuffered, non-preallocated path, kept for comparison.
+ */
+export enum WriterBackend {
+  Pwrite = 0,
+  Uring = 1,
+  Stream = 2,
+}
+
+export interface QueueStats {
+  depth: number;
+  max_depth: number;
+  capacity: number;
+  running: boolean;
+  submitted: number;
+  completed: number;
+  cancelled: number;
+  avg_wait_ms: number;
+  max_wait_ms: number;
+}
+
+/** Genie's own view of a query, from its profile. */
+export interface GenieProfileStats {
+  /** Whether the profile held a query event. */
+  valid: boolean;
+  /** Tokens prefilled, the rewound prefix excluded. */
+  prompt_tokens: number;
+  generated_tokens: number;
+  /** Prefill tokens/s. */
+  prompt_rate: number;
+  ttft_ms: number;
+  /** Decode tokens/s. */
+  token_rate: number;
+}
+
+/** Latency of a query as seen by the caller, measured natively. */
+export type StopReason =
+  | 'complete'
+  | 'aborted'
+  | 'max_tokens'
+  | 'deadline'
+  | 'max_ttft';
+
+/**
+ * Limits of a query, enforced natively: the dialog is aborted as soon as one
+ * is hit, without a round trip through JS.
+ */
+export interface QueryOptions {
+  /** Tokens to generate at most, a speculative step may overshoot by its accepted drafts. */
+  max_new_tokens?: number;
+  /** From the call to the end of generation, queue wait included. */
+  deadline_ms?: number;
+  /** From the call to the first token. */
+  max_ttft_ms?: number;
+}
+
+export interface QueryResult {
+  /** Time spent waiting in the context queue. */
+  queue_ms: number;
+  /** From the query call to the first token. */
+  ttft_ms: number;
+  /** From handing the prompt to Genie to the first token. */
+  prefill_ms: number;
+  /** From the first to the last token. */
+  decode_ms: number;
+  total_ms: number;
+  tokens: number;
+  /** Decode rate, the first token excluded. */
+  tokens_per_s: number;
+  /** Tokens of the input, 0 when the model exposes no tokenizer. */
+  prompt_tokens: number;
+  /** Leading input tokens the KV cache already held, only the rest was prefilled. */
+  reused_tokens: number;
+  /** Decode steps after the first token, a speculative dialog emits several tokens per step. */
+  decode_steps: number;
+  tokens_per_step: number;
+  /** Draft tokens accepted on top of the one token each step decodes. */
+  accepted_tokens: number;
+  /** accepted_tokens / (decode_steps * draft length), 0 for basic dialogs. */
+  acceptance_rate: number;
+  itl_p50_ms: number;
+  itl_p90_ms: number;
+  itl_p99_ms: number;
+  itl_max_ms: number;
+  aborted: boolean;
+  /** Why generation stopped, `aborted` for `abort()`, otherwise the limit hit. */
+  stop_reason: StopReason;
+  genie: GenieProfileStats;
+  /** Raw Genie profile. */
+  profile: object | null;
+  stream: StreamStats;
+}
+
+/**
+ * Backpressure of the native response stream. Decoding waits up to a second
+ * for the JS side to take responses, then drops them rather than stalling.
+ * The final response is never dropped.
+ */
+export interface StreamStats {
+  /** Times decoding waited for the JS side. */
+  stalls: number;
+  stall_ms: number;
+  max_stall_ms: number;
+  /** Response fragments dropped because the JS side fell behind. */
+  dropped: number;
+  dropped_bytes: number;
+  /** The streamed text is incomplete, some responses were dropped. */
+  truncated: boolean;
+}
+
+export interface MetricsStats {
+  queries: number;
+  tokens: number;
+  aborted: number;
+  /** Number of recent queries the TTFT, prefill and tokens/s figures cover. */
+  window: number;
+  ttft_p50_ms: number;
+  ttft_p90_ms: number;
+  ttft_p99_ms: number;
+  prefill_p50_ms: number;
+  tokens_per_s_mean: number;
+  tokens_per_s_p50: number;
+  tokens_per_s_min: number;
+  tokens_per_step_mean: number;
+  acceptance_rate_mean: number;
+  /** Inter-token latency over all queries, at histogram bucket resolution. */
+  itl_p50_ms: number;
+  itl_p90_ms: number;
+  itl_p99_ms: number;
+  /** [upper bound in ms, count] per bucket, the last bound is null (unbounded). */
+  itl_histogram: [number | null, number][];
+}
+
+export interface ExecutorStats {
+  /** Worker threads, including spares covering for blocked calls until they return. */
+  workers: number;
+  parallelism: number;
+  blocked: number;
+  /** Queued tasks per priority, indexed by `Priority`. */
+  depth: [number, number, number];
+  max_depth: number;
+  submitted: number;
+  executed: number;
+  /** Tasks taken from another worker's queue. */
+  steals: number;
+  /** Bit masks of the cores used for efficiency and performance hints. */
+  efficiency_cores: number;
+  performance_cores: number;
+}
+
+export interface LogRecord {
+  /** Milliseconds since the epoch. */
+  time: number;
+  level: 'error' | 'warn' | 'info' | 'verbose';
+  /** Native thread ID. */
+  thread: number;
+  message: string;
+}
+
+export interface LogStats {
+  written: number;
+  /** Messages lost because their thread logged faster than they were written out. */
+  dropped: number;
+  emitted: number;
+  /** Threads that logged and are still running or not yet drained. */
+  threads: number;
+  /** Messages kept for `get_log_history`. */
+  history: number;
+}
+
+export interface TraceStats {
+  enabled: boolean;
+  /** Spans recorded since `start_trace`. */
+  events: number;
+  /** Spans lost because their thread filled its buffer. */
+  dropped: number;
+  threads: number;
+}
+
+export interface ContextPoolOptions {
+  max_contexts: number;
+  idle_ms: number;
+}
+
+export interface ContextPoolStats {
+  /** Contexts loaded or loading. */
+  loaded: number;
+  /** Contexts held by at least one `Context`. */
+  leased: number;
+  max_contexts: number;
+  idle_ms: number;
+  /** Creates served by a loaded context. */
+  hits: number;
+  misses: number;
+  /** Released contexts freed to make room, or by `trim_context_pool`. */
+  evictions: number;
+  /** Released contexts freed after `idle_ms`. */
+  expirations: number;
+  load_failures: number;
+  last_load_ms: number;
+  avg_load_ms: number;
+  max_load_ms: number;
+  /** Least recently released first, `key` is a hash of the normalized config. */
+  entries: {
+    key: string;
+    leases: number;
+    /** Created with `share`, other sharing creates join it. */
+    shared: boolean;
+    loading: boolean;
+    idle_ms: number;
+    load_ms: number;
+    hits: number;
+  }[];
+}
+
+export interface SessionCacheOptions {
+  /** Directory to store dialog snapshots in, each context uses a subdirectory of its own. */
+  dir: string;
+  /** Disk budget in bytes, least recently used snapshots are evicted above it. */
+  max_bytes: number;
+  /** Maximum number of snapshots to keep. */
+  max_entries?: number;
+}
+
+export interface SessionCacheStats {
+  entries: number;
+  bytes: number;
+  budget: number;
+  hits: number;
+  misses: number;
+  saves: number;
+  evictions: number;
+  evicted_bytes: number;
+}
+
+export interface SnapshotOptions {
+  /** zstd level, 0 stores the dialog state uncompressed. Defaults to 3. */
+  level?: number;
+  /**
+   * Resolve once the dialog state is handed off, and compress and write it in
+   * the background. Defaults to true.
+   */
+  background?: boolean;
+}
+
+export interface SnapshotStats {
+  saves: number;
+  restores: number;
+  /** Snapshots refused because they were saved with another model or are corrupt. */
+  rejected: number;
+  /** Background writes that failed, the previous snapshot is kept. */
+  failures: number;
+  pending: number;
+  /** Dialog state and snapshot file size of the last save. */
+  last_raw_bytes: number;
+  last_bytes: number;
+  /** Time the dialog was blocked by the last save. */
+  last_handoff_ms: number;
+  last_write_ms: number;
+  last_restore_ms: number;
+  last_error: string;
+}
+
+export interface LoraStats {
+  /** Engine and adapter currently applied, empty before the first switch. */
+  engine: string;
+  adapter: string;
+  swaps: number;
+  /** Requests for the adapter already applied. */
+  skipped: number;
+  /** Swaps to an adapter whose files were kept in the page cache. */
+  resident_hits: number;
+  /** Apply plus KV cache reset. */
+  last_swap_ms: number;
+  avg_swap_ms: number;
+  max_swap_ms: number;
+  /** Adapters kept resident, most recently used first. */
+  capacity: number;
+  resident: string[];
+}
+
+export interface ResponseBatch {
+  /** Number of Genie fragments merged into this response. */
+  fragments: number;
+  /** Time in ms from the first merged fragment to delivery. */
+  batchMs: number;
+  /** Responses lost right before this one because the JS side fell behind. */
+  dropped: number;
+}
+
+export interface CoalesceOptions {
+  /** Deliver once the oldest pending fragment is this old, also while decoding stalls. 0 disables. */
+  interval_ms?: number;
+  /** Deliver once this many fragments are pending, 0 disables. */
+  max_fragments?: number;
+}
+
+export interface SectionProgress {
+  name: string;
+  /** Bundle bytes consumed. */
+  bytes_in: number;
+  /** Bytes written to the extracted file. */
+  bytes_out: number;
+  total_in: number;
+  /** 0 if not known up front (config.json). */
+  total_out: number;
+  /** From its first frame starting to commit, or to now. */
+  elapsed_ms: number;
+  /** Worker time spent computing its CRCs. */
+  crc_ms: number;
+  /** Trusted from an earlier unpack, not extracted. */
+  skipped: boolean;
+  done: boolean;
+}
+
+export interface UnpackProgress {
+  bytes_in: number;
+  bytes_out: number;
+  /** Sections being extracted only. */
+  total_in: number;
+  total_out: number;
+  elapsed_ms: number;
+  /** Worker time spent on CRCs. */
+  crc_ms: number;
+  in_mb_per_s: number;
+  out_mb_per_s: number;
+  /** Set on the last report, which is also the summary. */
+  finished: boolean;
+  sections: SectionProgress[];
+}
+
+interface UnpackProgressEvent {
+  unpackId: number;
+  progress: string;
+}
+
+let nextUnpackId = 0;
+
+export interface PrefillProgress {
+  total_tokens: number;
+  /** Leading tokens the KV cache already held. */
+  reused_tokens: number;
+  /** Tokens fed so far, the reused ones excluded. */
+  prefilled_tokens: number;
+  chunks: number;
+  /** Decode steps run and thrown away, one when the prompt diverges from the dialog and it is rewound. */
+  discarded_steps: number;
+  elapsed_ms: number;
+  /** Stopped by `abort()`, between chunks or before it started. */
+  cancelled: boolean;
+  finished: boolean;
+}
+
+interface PrefillProgressEvent {
+  contextId: number;
+  requestId: number;
+  progress: string;
+}
+
+interface ResponseEvent extends ResponseBatch {
   response: string;
   sentenceCode: SentenceCode;
   contextId: number;
+  requestId: number;
 }
 
+// Tags the events of a query or process call, several may be queued on one context
+let nextRequestId = 0;
+
 const join = (...paths: string[]) => paths.join('/');
 
 export const getHtpConfigFilePath = () => QnnLlm.HTP_CONFIG_FILE_PATH;
 
+/**
+ * Get the statistics of the native executor that runs all module calls and
+ * background work such as unpacking.
+ */
+export const get_executor_stats = async (): Promise<ExecutorStats> =>
+  JSON.parse(await QnnLlm.getExecutorStats());
+
+/**
+ * Get the latest native and Genie log messages, oldest first, e.g. to attach
+ * to a bug report. Verbose messages are only logged by debug builds.
+ * @param limit - Most messages returned, 0 for all that are kept.
+ */
+export const get_log_history = async (limit = 0): Promise<LogRecord[]> =>
+  JSON.parse(await QnnLlm.getLogHistory(limit));
+
+/**
+ * Get the native logging counters.
+ */
+export const get_log_stats = async (): Promise<LogStats> =>
+  JSON.parse(await QnnLlm.getLogStats());
+
+/**
+ * Discard the recorded trace and start recording spans of the native calls,
+ * e.g. unpacking, loading, prefill and decoding.
+ */
+export const start_trace = (): Promise<void> => QnnLlm.startTrace();
+
+/**
+ * Stop recording spans, the trace is kept for `get_trace`.
+ */
+export const stop_trace = (): Promise<void> => QnnLlm.stopTrace();
+
+/**
+ * Get the recorded spans as Chrome trace event JSON, which Perfetto
+ * (ui.perfetto.dev) and chrome://tracing open.
+ */
+export const get_trace = (): Promise<string> => QnnLlm.getTrace();
+
+/**
+ * Get the counters of the recorded trace.
+ */
+export const get_trace_stats = async (): Promise<TraceStats> =>
+  JSON.parse(await QnnLlm.getTraceStats());
+
+/**
+ * Configure the native context pool.
+ * @param max_contexts - Contexts kept loaded, leased or idle.
+ * @param idle_ms - How long a released context stays loaded, 0 frees it on release.
+ */
+export const set_context_pool_options = ({
+  max_contexts = 4,
+  idle_ms = 30000,
+}: Partial<ContextPoolOptions>): Promise<void> =>
+  QnnLlm.setContextPoolOptions(max_contexts, idle_ms);
+
+/**
+ * Free every released context the pool keeps loaded.
+ * @returns The number of freed contexts.
+ */
+export const trim_context_pool = (): Promise<number> => QnnLlm.trimContextPool();
+
+/**
+ * Get the hit rate and load times of the native context pool.
+ */
+export const get_context_pool_stats = async (): Promise<ContextPoolStats> =>
+  JSON.parse(await QnnLlm.getContextPoolStats());
+
 export interface SamplerConfig {
   'version': number;
   'seed': number;
@@ -54,6 +505,110 @@ export interface SamplerConfig {
   'greedy': boolean;
 }
 
+/**
+ * Grammar the native sampler constrains responses to, see `Context.set_grammar`.
+ * Sampling parameters default to temp 0.8, top-k 40 and top-p 0.95.
+ */
+export interface GrammarConfig {
+  'type': 'json';
+  /** Type of the top-level value, `object` by default. */
+  'root'?: 'object' | 'array' | 'any';
+  /** Consecutive whitespace characters allowed, 8 by default. */
+  'max-whitespace'?: number;
+  'temp'?: number;
+  'top-k'?: number;
+  'top-p'?: number;
+  /** 0 seeds from the system. */
+  'seed'?: number;
+  'greedy'?: boolean;
+}
+
+export interface SamplerStats {
+  /** Tokens sampled under the current grammar. */
+  steps: number;
+  /** Steps whose allowed-token mask was cached. */
+  mask_cache_hits: number;
+  /** Steps where no token fit the grammar and EOS was forced. */
+  dead_ends: number;
+  avg_mask_us: number;
+  avg_sample_us: number;
+  max_step_us: number;
+  /** Allowed tokens considered per step. */
+  avg_candidates: number;
+  /** Vector extension of the masking kernels: `neon`, `sse2` or `scalar`. */
+  kernel: string;
+}
+
+export interface EngineConfig {
+  'version': number;
+  'n-threads': number;
+  /** Which model of a `spd` dialog the engine runs. */
+  'role'?: 'target' | 'draft';
+  'backend': {
+    type: 'QnnHtp' | 'QnnGenAiTransformer';
+    QnnHtp?: {
+      'use-mmap': boolean;
+      [key: string]: any;
+    };
+    QnnGenAiTransformer?: Record<string, any>;
+    extensions?: string;
+  };
+  'model': {
+    version: number;
+    type: 'binary' | 'library';
+    binary?: {
+      'version': number;
+      'ctx-bins': string[];
+      'lora'?: LoraConfig;
+    };
+    library?: {
+      'version': number;
+      'model-bin': string;
+    };
+    [key: string]: any;
+  };
+}
+
+/** LoRA adapters switchable with `Context.apply_lora`, bundled next to the ctx-bins. */
+export interface LoraConfig {
+  'version': number;
+  'alpha-tensor-name'?: string;
+  'adapters': {
+    'version': number;
+    'name': string;
+    'bin-sections': string[];
+  }[];
+}
+
+/** Self-speculative decoding, the model drafts with its own forecast tokens. */
+export interface SsdConfig {
+  'version': number;
+  'ssd-version': number;
+  /** Tokens drafted per step. */
+  'forecast-token-count': number;
+  'branches': number[];
+  'forecast-prefix': number;
+  /** Forecast prefix file, relative to the unpack dir for bundled models. */
+  'forecast-prefix-name': string;
+}
+
+/** Lookahead decoding, drafts from n-grams collected while decoding. */
+export interface LadeConfig {
+  'version': number;
+  'update-mode': 'ALWAYS_FWD_ONE' | 'FWD_MAX_HIT' | 'FWD_LEVEL';
+  'window': number;
+  /** Drafts are ngram - 1 tokens long. */
+  'ngram': number;
+  'gcap': number;
+}
+
+/** Speculative decoding with a draft model, needs a `draft` and a `target` engine. */
+export interface SpdConfig {
+  'version': number;
+  /** Tokens drafted per step. */
+  'draft-len': number;
+}
+
 /**
  * Context config.
  * @see https://docs.qualcomm.com/bundle/publicresource/topics/80-63442-100/json.html
@@ -61,7 +616,10 @@ export interface SamplerConfig {
 export interface ContextConfig {
   dialog: {
     version: number;
-    type: 'basic';
+    type: 'basic' | 'ssd-q1' | 'lade' | 'spd';
+    'ssd-q1'?: SsdConfig;
+    'lade'?: LadeConfig;
+    'spd'?: SpdConfig;
     context: {
       version: number;
       [key: string]: any;
@@ -74,49 +632,107 @@ export interface ContextConfig {
       version: number;
       path: string;
     };
-    engine: {
-      'version': number;
-      'n-threads': number;
-      'backend': {
-        type: 'QnnHtp' | 'QnnGenAiTransformer';
-        QnnHtp?: {
-          'use-mmap': boolean;
-          [key: string]: any;
-        };
-        QnnGenAiTransformer?: Record<string, any>;
-        extensions?: string;
-      };
-      'model': {
-        version: number;
-        type: 'binary' | 'library';
-        binary?: {
-          'version': number;
-          'ctx-bins': string[];
-        };
-        library?: {
-          'version': number;
-          'model-bin': string;
-        };
-        [key: string]: any;
-      };
-    };
+    engine: EngineConfig | EngineConfig[];
   };
 }
 
+export interface LoadOptions {
+  bundle_path: string;
+  unpack_dir: string;
+  n_threads?: number;
+  verify?: VerifyMode;
+  deep_verify?: boolean;
+  writer?: WriterBackend;
+  buffer_size?: number;
+  on_progress?: (progress: UnpackProgress) => void;
+  progress_interval_ms?: number;
+}
+
+const unpackBundle = async <Config,>({
+  bundle_path,
+  unpack_dir,
+  verify = VerifyMode.Full,
+  deep_verify = false,
+  writer = WriterBackend.Pwrite,
+  buffer_size = 0,
+  on_progress,
+  progress_interval_ms = 250,
+}: LoadOptions): Promise<{ config: Config; summary: UnpackProgress }> => {
+  const unpackId = ++nextUnpackId;
+  const listener = on_progress
+    ? eventEmitter!.addListener('unpackProgress', (event) => {
+        const { unpackId: id, progress } = event as UnpackProgressEvent;
+        if (id === unpackId) on_progress(JSON.parse(progress));
+      })
+    : null;
+  try {
+    return JSON.parse(
+      await QnnLlm.unpack(
+        bundle_path,
+        unpack_dir,
+        verify,
+        deep_verify,
+        writer,
+        buffer_size,
+        unpackId,
+        on_progress ? progress_interval_ms : 0
+      )
+    );
+  } finally {
+    listener?.remove();
+  }
+};
+
+// Model paths in a bundled config are relative to the unpack dir
+const resolveEngine = (
+  engine: EngineConfig,
+  unpack_dir: string,
+  n_threads?: number
+) => {
+  if (engine.backend.type === 'QnnHtp') {
+    engine.backend.extensions = getHtpConfigFilePath();
+    engine.backend.QnnHtp!['use-mmap'] = Platform.OS !== 'windows';
+  }
+  if (engine.model.type === 'binary') {
+    engine.model.binary!['ctx-bins'] = engine.model.binary!['ctx-bins'].map(
+      (bin: string) => join(unpack_dir, bin)
+    );
+    for (const adapter of engine.model.binary!.lora?.adapters ?? []) {
+      adapter['bin-sections'] = adapter['bin-sections'].map((bin: string) =>
+        join(unpack_dir, bin)
+      );
+    }
+  } else {
+    const bin = engine.model.library!['model-bin'];
+    engine.model.library!['model-bin'] = join(unpack_dir, bin);
+  }
+  if (n_threads && n_threads > 0) engine['n-threads'] = n_threads;
+};
+
 export class Context {
   private _id: number;
 
+  /** Summary of the unpack, for contexts created by `Context.load`. */
+  unpack_summary?: UnpackProgress;
+
   private constructor(context: number) {
     this._id = context;
   }
 
   /**
-   * Create a context from a config.
+   * Create a context from a config. Contexts are leased from a native pool:
+   * a released context with the same config is reused, reset to its loaded
+   * state, instead of loading the model again.
    * @param config - The config to create the context.
+   * @param share - Share a context created with `share` and the same config,
+   *   conversation and settings included, instead of loading another one.
    * @returns The context.
    */
-  static async create(config: ContextConfig): Promise<Context> {
-    const context = await QnnLlm.createContext(JSON.stringify(config));
+  static async create(
+    config: ContextConfig,
+    { share = false }: { share?: boolean } = {}
+  ): Promise<Context> {
+    const context = await QnnLlm.createContext(JSON.stringify(config), share);
     return new Context(context);
   }
 
@@ -125,68 +741,135 @@ export class Context {
    * @param bundle_path - The path to the bundled model.
    * @param unpack_dir - The path to store the unpacked model.
    * @param n_threads - The number of threads to use.
+   * @param verify - The integrity checks to perform while unpacking.
+   * @param deep_verify - Re-check the CRC of files already unpacked by an earlier load.
+   * @param writer - How unpacked files are written.
+   * @param buffer_size - Decompression output block size in bytes, also the write size.
+   * @param on_progress - Called periodically while unpacking, and once with the summary.
+   * @param progress_interval_ms - Minimum time between progress reports.
    * @returns The context.
    */
   static async load({
-    bundle_path,
     unpack_dir,
     n_threads,
-  }: {
-    bundle_path: string;
-    unpack_dir: string;
-    n_threads?: number;
-  }): Promise<Context> {
-    const config = JSON.parse(await QnnLlm.unpack(bundle_path, unpack_dir));
-    if (config.dialog.engine.backend.type === 'QnnHtp') {
-      config.dialog.engine.backend.extensions = getHtpConfigFilePath();
-      config.dialog.engine.backend.QnnHtp['use-mmap'] =
-        Platform.OS !== 'windows';
-    }
+    ...options
+  }: LoadOptions): Promise<Context> {
+    const { config, summary } = await unpackBundle<ContextConfig>({
+      unpack_dir,
+      ...options,
+    });
+    if (!config.dialog) throw new Error('Bundle does not hold a dialog model');
     config.dialog.tokenizer.path = join(
       unpack_dir,
       config.dialog.tokenizer.path
     );
-    if (config.dialog.engine.model.type === 'binary') {
-      const bins = config.dialog.engine.model.binary['ctx-bins'];
-      config.dialog.engine.model.binary['ctx-bins'] = bins.map((bin: string) =>
-        join(unpack_dir, bin)
+    // spd dialogs carry a target and a draft engine, each with its own model
+    const engines: EngineConfig[] = Array.isArray(config.dialog.engine)
+      ? config.dialog.engine
+      : [config.dialog.engine];
+    for (const engine of engines) resolveEngine(engine, unpack_dir, n_threads);
+    const ssd = config.dialog['ssd-q1'];
+    if (ssd?.['forecast-prefix-name']) {
+      ssd['forecast-prefix-name'] = join(
+        unpack_dir,
+        ssd['forecast-prefix-name']
       );
-    } else {
-      const bin = config.dialog.engine.library['model-bin'];
-      config.dialog.engine.library['model-bin'] = join(unpack_dir, bin);
     }
-    if (n_threads && n_threads > 0)
-      config.dialog.engine['n-threads'] = n_threads;
-    return Context.create(config);
+    const context = await Context.create(config);
+    context.unpack_summary = summary;
+    return context;
   }
 
   /**
-   * Process the prompt.
+   * Prefill the prompt without generating, e.g. the system prompt while the user
+   * is typing. A later query extending it only prefills its own tokens and starts
+   * decoding right away. `abort()` stops between chunks, keeping what was fed,
+   * and skips a prefill still queued.
    * @param input - The prompt to process.
+   * @param priority - The queue priority of the request.
+   * @param chunk_tokens - Tokens fed per step, bounds how long an abort takes. 0 for the default.
+   * @param on_progress - Called after every chunk.
+   * @returns The final progress, null if the context was released.
    */
-  process(input: string): Promise<void> {
-    return QnnLlm.process(this._id, input);
+  async process(
+    input: string,
+    priority: Priority = Priority.Normal,
+    {
+      chunk_tokens = 0,
+      on_progress,
+    }: {
+      chunk_tokens?: number;
+      on_progress?: (progress: PrefillProgress) => void;
+    } = {}
+  ): Promise<PrefillProgress | null> {
+    const requestId = ++nextRequestId;
+    const listener = on_progress
+      ? eventEmitter!.addListener('prefillProgress', (event) => {
+          const { requestId: id, progress } = event as PrefillProgressEvent;
+          if (id === requestId) on_progress(JSON.parse(progress));
+        })
+      : null;
+    try {
+      return JSON.parse(
+        await QnnLlm.process(
+          this._id,
+          requestId,
+          input,
+          priority,
+          chunk_tokens,
+          on_progress != null
+        )
+      );
+    } finally {
+      listener?.remove();
+    }
   }
 
   /**
    * Make a completion request.
    * @param input - The input to query.
    * @param callback - The callback to call when the response is received.
-   * @returns Performance profile.
+   * @param priority - The queue priority of the request.
+   * @param options - Token budget and time limits of the request.
+   * @returns Latency metrics merged with the Genie profile, and the stop reason.
    */
   async query(
     input: string,
-    callback: (response: string, sentenceCode: SentenceCode) => void
-  ): Promise<object> {
+    callback: (
+      response: string,
+      sentenceCode: SentenceCode,
+      batch: ResponseBatch
+    ) => void,
+    priority: Priority = Priority.Normal,
+    { max_new_tokens = 0, deadline_ms = 0, max_ttft_ms = 0 }: QueryOptions = {}
+  ): Promise<QueryResult> {
+    const requestId = ++nextRequestId;
     const listener = eventEmitter!.addListener('response', (event) => {
-      const { response, sentenceCode, contextId } = event as ResponseEvent;
-      if (contextId !== this._id) {
+      const {
+        response,
+        sentenceCode,
+        requestId: id,
+        fragments,
+        batchMs,
+        dropped,
+      } = event as ResponseEvent;
+      if (id !== requestId) {
         return;
       }
-      callback(response, sentenceCode);
+      callback(response, sentenceCode, { fragments, batchMs, dropped });
     });
     try {
-      return JSON.parse(await QnnLlm.query(this._id, input));
+      return JSON.parse(
+        await QnnLlm.query(
+          this._id,
+          requestId,
+          input,
+          priority,
+          max_new_tokens,
+          deadline_ms,
+          max_ttft_ms
+        )
+      );
     } catch (error) {
       throw error;
     } finally {
@@ -206,7 +889,7 @@ export class Context {
   }
 
   /**
-   * Apply the sampler config.
+   * Apply the sampler config, dropping a grammar set with `set_grammar`.
    * @param config - The sampler config to apply.
    */
   apply_sampler_config(config: Partial<SamplerConfig>): Promise<void> {
@@ -214,19 +897,30 @@ export class Context {
   }
 
   /**
-   * Save the session.
-   * @param filename - The filename to save the session to.
+   * Save the session as a compressed snapshot tied to the loaded model.
+   * @param filename - The directory to save the session to.
+   * @param priority - The queue priority of the request.
+   * @param options - Compression, and whether to write in the background.
    */
-  save_session(filename: string): Promise<void> {
-    return QnnLlm.saveSession(this._id, filename);
+  save_session(
+    filename: string,
+    priority: Priority = Priority.Normal,
+    { level = 3, background = true }: SnapshotOptions = {}
+  ): Promise<void> {
+    return QnnLlm.saveSession(this._id, filename, priority, level, background);
   }
 
   /**
-   * Restore the session.
-   * @param filename - The filename to restore the session from.
+   * Restore the session, waiting for a background save to it. Rejects
+   * snapshots saved with another model without loading them.
+   * @param filename - The directory to restore the session from.
+   * @param priority - The queue priority of the request.
    */
-  restore_session(filename: string): Promise<void> {
-    return QnnLlm.restoreSession(this._id, filename);
+  restore_session(
+    filename: string,
+    priority: Priority = Priority.Normal
+  ): Promise<void> {
+    return QnnLlm.restoreSession(this._id, filename, priority);
   }
 
   /**
@@ -237,9 +931,300 @@ export class Context {
   }
 
   /**
-   * Release the context.
+   * Cancel the requests waiting in the queue, the running one is not affected.
+   * Cancelled requests reject with `Request cancelled`.
+   * @returns The number of cancelled requests.
+   */
+  cancel_pending(): Promise<number> {
+    return QnnLlm.cancelPending(this._id);
+  }
+
+  /**
+   * Get the request queue statistics.
+   */
+  async get_queue_stats(): Promise<QueueStats> {
+    return JSON.parse(await QnnLlm.getQueueStats(this._id));
+  }
+
+  /**
+   * Get rolling latency aggregates of the queries run on this context.
+   */
+  async get_metrics_stats(): Promise<MetricsStats> {
+    return JSON.parse(await QnnLlm.getMetricsStats(this._id));
+  }
+
+  /**
+   * Reset the latency aggregates, e.g. after reporting them.
+   */
+  reset_metrics(): Promise<void> {
+    return QnnLlm.resetMetrics(this._id);
+  }
+
+  /**
+   * Enable the session cache, or disable it with `null`.
+   * When a query does not continue the current conversation (e.g. switching
+   * chat threads), the dialog state is snapshotted and the longest cached
+   * prefix of the new input is restored, so only the remainder is prefilled.
+   * @param options - The cache options.
+   */
+  set_session_cache(options: SessionCacheOptions | null): Promise<void> {
+    return QnnLlm.setSessionCache(
+      this._id,
+      options?.dir ?? '',
+      options?.max_bytes ?? 0,
+      options?.max_entries ?? 16
+    );
+  }
+
+  /**
+   * Get the session cache statistics.
+   */
+  async get_session_cache_stats(): Promise<SessionCacheStats> {
+    return JSON.parse(await QnnLlm.getSessionCacheStats(this._id));
+  }
+
+  /**
+   * Switch to a LoRA adapter declared in the config without reloading the model.
+   * The conversation is reset, as the KV cache was computed with the previous
+   * weights; with a session cache it resumes when switching back.
+   * @param adapter - The adapter name.
+   * @param engine - The engine role of the adapter, `primary` for basic dialogs.
+   * @param priority - The queue priority of the request.
+   */
+  apply_lora(
+    adapter: string,
+    {
+      engine = 'primary',
+      priority = Priority.Normal,
+    }: { engine?: string; priority?: Priority } = {}
+  ): Promise<void> {
+    return QnnLlm.applyLora(this._id, adapter, engine, priority);
+  }
+
+  /**
+   * Scale the applied adapter, resets the conversation like `apply_lora`.
+   * @param tensor - The alpha tensor, `alpha-tensor-name` of the LoRA config.
+   * @param alpha - The strength.
+   */
+  set_lora_strength(
+    tensor: string,
+    alpha: number,
+    {
+      engine = 'primary',
+      priority = Priority.Normal,
+    }: { engine?: string; priority?: Priority } = {}
+  ): Promise<void> {
+    return QnnLlm.setLoraStrength(this._id, tensor, alpha, engine, priority);
+  }
+
+  /**
+   * Set how many recently used adapters are kept in the page cache, 3 by default.
+   */
+  set_lora_residency(max_adapters: number): Promise<void> {
+    return QnnLlm.setLoraResidency(this._id, max_adapters);
+  }
+
+  /**
+   * Get the adapter swap statistics.
+   */
+  async get_lora_stats(): Promise<LoraStats> {
+    return JSON.parse(await QnnLlm.getLoraStats(this._id));
+  }
+
+  /**
+   * Constrain responses to a grammar natively: every token is sampled from
+   * the ones that keep the response valid, and the response ends once it is
+   * complete, so it never needs validating and re-querying. Needs `n-vocab`
+   * and `eos-token` in the dialog context config, and a basic dialog.
+   * @param grammar - The grammar, `null` restores the sampler config.
+   * @param priority - The queue priority of the request.
+   */
+  set_grammar(
+    grammar: GrammarConfig | null,
+    { priority = Priority.Normal }: { priority?: Priority } = {}
+  ): Promise<void> {
+    return QnnLlm.setGrammar(
+      this._id,
+      grammar ? JSON.stringify(grammar) : '',
+      priority
+    );
+  }
+
+  /**
+   * Get the session snapshot statistics.
+   */
+  async get_snapshot_stats(): Promise<SnapshotStats> {
+    return JSON.parse(await QnnLlm.getSnapshotStats(this._id));
+  }
+
+  /**
+   * Get the per-token cost of constrained sampling.
+   */
+  async get_sampler_stats(): Promise<SamplerStats> {
+    return JSON.parse(await QnnLlm.getSamplerStats(this._id));
+  }
+
+  /**
+   * Merge response fragments before they are sent to JS, to reduce bridge
+   * traffic at high decode rates. Begin, End and Abort are always delivered
+   * immediately. Defaults to one fragment per response.
+   * @param options - The flush window.
+   */
+  set_response_coalescing(options: CoalesceOptions): Promise<void> {
+    return QnnLlm.setResponseCoalescing(
+      this._id,
+      options.interval_ms ?? 0,
+      options.max_fragments ?? 0
+    );
+  }
+
+  /**
+   * Release the context. The pool resets it and keeps it loaded for `idle_ms`
+   * after its last holder released it, see `set_context_pool_options`.
    */
   release(): Promise<void> {
     return QnnLlm.freeContext(this._id);
   }
 }
+
+/**
+ * Embedding model config.
+ * @see https://docs.qualcomm.com/bundle/publicresource/topics/80-63442-100/json.html
+ */
+export interface EmbeddingConfig {
+  embedding: {
+    version: number;
+    context: {
+      version: number;
+      [key: string]: any;
+    };
+    tokenizer: {
+      version: number;
+      path: string;
+    };
+    'truncate-input'?: boolean;
+    engine: EngineConfig;
+  };
+}
+
+export interface EmbeddingResult {
+  /** `count` vectors of `dimensions` floats, row-major. */
+  data: Float32Array;
+  /** One view into `data` per input, nothing is copied. */
+  vectors: Float32Array[];
+  count: number;
+  dimensions: number;
+  /** Time spent embedding the batch, queueing excluded. */
+  elapsed_ms: number;
+}
+
+const BASE64 =
+  'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/';
+const BASE64_LOOKUP = new Uint8Array(128);
+for (let i = 0; i < BASE64.length; i++) BASE64_LOOKUP[BASE64.charCodeAt(i)] = i;
+
+// Straight into the bytes of a Float32Array, no intermediate string or boxed numbers
+const decodeFloats = (base64: string): Float32Array => {
+  let length = base64.length;
+  while (length > 0 && base64[length - 1] === '=') length--;
+  const bytes = new Uint8Array((length * 3) >> 2);
+  let out = 0;
+  for (let i = 0; i < length; i += 4) {
+    const n =
+      (BASE64_LOOKUP[base64.charCodeAt(i)]! << 18) |
+      (BASE64_LOOKUP[base64.charCodeAt(i + 1)]! << 12) |
+      (BASE64_LOOKUP[base64.charCodeAt(i + 2)]! << 6) |
+      BASE64_LOOKUP[base64.charCodeAt(i + 3)]!;
+    bytes[out++] = n >> 16;
+    if (out < bytes.length) bytes[out++] = (n >> 8) & 255;
+    if (out < bytes.length) bytes[out++] = n & 255;
+  }
+  return new Float32Array(bytes.buffer, 0, bytes.length >> 2);
+};
+
+export class EmbeddingContext {
+  private _id: number;
+
+  /** Summary of the unpack, for contexts created by `EmbeddingContext.load`. */
+  unpack_summary?: UnpackProgress;
+
+  private constructor(context: number) {
+    this._id = context;
+  }
+
+  /**
+   * Create an embedding context from a config.
+   * @param config - The config to create the context.
+   * @returns The context.
+   */
+  static async create(config: EmbeddingConfig): Promise<EmbeddingContext> {
+    const context = await QnnLlm.createEmbeddingContext(JSON.stringify(config));
+    return new EmbeddingContext(context);
+  }
+
+  /**
+   * Load an embedding context from a bundle, takes the same options as `Context.load`.
+   * @returns The context.
+   */
+  static async load({
+    unpack_dir,
+    n_threads,
+    ...options
+  }: LoadOptions): Promise<EmbeddingContext> {
+    const { config, summary } = await unpackBundle<EmbeddingConfig>({
+      unpack_dir,
+      ...options,
+    });
+    if (!config.embedding) {
+      throw new Error('Bundle does not hold an embedding model');
+    }
+    config.embedding.tokenizer.path = join(
+      unpack_dir,
+      config.embedding.tokenizer.path
+    );
+    resolveEngine(config.embedding.engine, unpack_dir, n_threads);
+    const context = await EmbeddingContext.create(config);
+    context.unpack_summary = summary;
+    return context;
+  }
+
+  /**
+   * Embed a batch of strings in one native call.
+   * @param inputs - The strings to embed.
+   * @param normalize - Scale the vectors to unit L2 norm, so dot products are cosine similarities.
+   * @param priority - The queue priority of the request.
+   * @returns The vectors, in input order.
+   */
+  async embed(
+    inputs: string[],
+    {
+      normalize = false,
+      priority = Priority.Normal,
+    }: { normalize?: boolean; priority?: Priority } = {}
+  ): Promise<EmbeddingResult> {
+    const { count, dimensions, elapsed_ms, data } = JSON.parse(
+      await QnnLlm.embed(this._id, inputs, normalize, priority)
+    );
+    const floats = decodeFloats(data);
+    const vectors: Float32Array[] = [];
+    for (let i = 0; i < count; i++) {
+      vectors.push(floats.subarray(i * dimensions, (i + 1) * dimensions));
+    }
+    return { data: floats, vectors, count, dimensions, elapsed_ms };
+  }
+
+  /**
+   * Cancel the batches waiting in the queue, the running one is not affected.
+   * @returns The number of cancelled batches.
+   */
+  cancel_pending(): Promise<number> {
+    return QnnLlm.cancelPendingEmbeddings(this._id);
+  }
+
+  /**
+   * Release the context.
+   */
+  release(): Promise<void> {
+    return QnnLlm.freeEmbeddingContext(this._id);
+  }
+}